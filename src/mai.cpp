@@ -1,22 +1,125 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <array>
 #include <unordered_map>
 #include <unordered_set>
 #include <map>
+#include <optional>
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <shared_mutex>
 #include <random>
 #include <chrono>
 #include <iomanip>
+#include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <climits>
+#include <cmath>
+#include <atomic>
+#include <functional>
+#include <deque>
+#include <ctime>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/inotify.h>
+#include <poll.h>
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#if __has_include(<linux/perf_event.h>)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#define FS_HAVE_PERF_EVENTS 1
+#endif
+#endif
+
+// statx 可取文件的创建时间（btime），glibc 2.28 起提供
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+#define FS_HAVE_STATX 1
+#endif
+
+// io_uring 批量 statx 需要 5.6+ 的内核头文件（IORING_FEAT_RW_CUR_POS 与 IORING_OP_STATX 同版本引入）
+#if defined(__linux__) && defined(IORING_FEAT_RW_CUR_POS) && defined(STATX_BASIC_STATS)
+#define FS_HAVE_IO_URING 1
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+#endif
 
 using namespace std;
 using namespace std::chrono;
 
+// 扩展属性/标签。同一个键可以有多个值（多值标签），单值的扩展属性就是只有一个值的键
+struct FileTag {
+    string key;
+    string value;
+    
+    bool operator<(const FileTag& other) const {
+        return key != other.key ? key < other.key : value < other.value;
+    }
+    
+    bool operator==(const FileTag& other) const {
+        return key == other.key && value == other.value;
+    }
+};
+
+// tagFile 的修改方式
+enum class TagMode : uint8_t {
+    Set = 0,      // 替换该键的全部值（单值扩展属性）
+    Add = 1,      // 追加一个值（多值标签），已有时不变
+    Remove = 2,   // 删除该值；值为空时删除整个键
+};
+
+// 按 mode 修改按 (键, 值) 排序的标签表，返回是否有变化
+inline bool editTags(vector<FileTag>& tags, const string& key, const string& value, TagMode mode) {
+    auto first = lower_bound(tags.begin(), tags.end(), FileTag{key, ""});
+    auto last = first;
+    while (last != tags.end() && last->key == key) ++last;
+    auto found = lower_bound(first, last, FileTag{key, value});
+    bool present = found != last && found->value == value;
+    switch (mode) {
+        case TagMode::Set:
+            if (last - first == 1 && present) return false;
+            tags.insert(tags.erase(first, last), FileTag{key, value});
+            return true;
+        case TagMode::Add:
+            if (present) return false;
+            tags.insert(found, FileTag{key, value});
+            return true;
+        case TagMode::Remove:
+            if (value.empty()) {
+                if (first == last) return false;
+                tags.erase(first, last);
+                return true;
+            }
+            if (!present) return false;
+            tags.erase(found);
+            return true;
+    }
+    return false;
+}
+
 // 文件元数据结构
 struct FileMetadata {
     int fileId;
@@ -26,514 +129,10825 @@ struct FileMetadata {
     string owner;
     string createTime;
     string fullPath;
+    long long modifyTime = 0; // 修改时间（Unix 秒），真实扫描时填充
+    uint32_t mode = 0644;     // 权限位（含 setuid/setgid/sticky，不含文件类型）
+    uint32_t uid = 0;
+    uint32_t gid = 0;
+    vector<FileTag> tags;     // 扩展属性和标签，按 (键, 值) 排序、无重复
     
     FileMetadata() = default;
     FileMetadata(int id, const string& name, const string& ext, 
-                long long size, const string& own, const string& time, const string& path)
+                long long size, const string& own, const string& time, const string& path,
+                long long mtime = 0, uint32_t permissions = 0644, uint32_t ownerId = 0, uint32_t groupId = 0)
         : fileId(id), fileName(name), extension(ext), fileSize(size), 
-          owner(own), createTime(time), fullPath(path) {}
-};
-
-// 目录树节点
-class DirectoryNode {
-public:
-    string name;
-    bool isDirectory;
-    shared_ptr<FileMetadata> fileData;
-    unordered_map<string, shared_ptr<DirectoryNode>> children;
-    weak_ptr<DirectoryNode> parent;
-    
-    DirectoryNode(const string& n, bool isDir = true) 
-        : name(n), isDirectory(isDir) {}
+          owner(own), createTime(time), fullPath(path), modifyTime(mtime),
+          mode(permissions), uid(ownerId), gid(groupId) {}
 };
 
-// 压缩的倒排索引项
-class CompressedInvertedList {
-private:
-    vector<int> sortedFileIds;
+// 访问者身份：uid 和所属的全部组（含主组），组按升序去重
+struct Principal {
+    uint32_t uid = 0;
+    vector<uint32_t> gids;
     
-public:
-    void addFileId(int fileId) {
-        auto it = lower_bound(sortedFileIds.begin(), sortedFileIds.end(), fileId);
-        if (it == sortedFileIds.end() || *it != fileId) {
-            sortedFileIds.insert(it, fileId);
-        }
+    Principal() = default;
+    Principal(uint32_t userId, vector<uint32_t> groups) : uid(userId), gids(move(groups)) {
+        sort(gids.begin(), gids.end());
+        gids.erase(unique(gids.begin(), gids.end()), gids.end());
     }
     
-    void removeFileId(int fileId) {
-        auto it = lower_bound(sortedFileIds.begin(), sortedFileIds.end(), fileId);
-        if (it != sortedFileIds.end() && *it == fileId) {
-            sortedFileIds.erase(it);
-        }
+    bool inGroup(uint32_t gid) const {
+        return binary_search(gids.begin(), gids.end(), gid);
     }
     
-    const vector<int>& getFileIds() const {
-        return sortedFileIds;
+    bool operator<(const Principal& other) const {
+        return uid != other.uid ? uid < other.uid : gids < other.gids;
     }
     
-    size_t size() const {
-        return sortedFileIds.size();
+    bool operator==(const Principal& other) const {
+        return uid == other.uid && gids == other.gids;
     }
+};
+
+// POSIX 读权限：属主只看属主位，属组成员只看组位，其余看其他人位；uid 0 全部可读。
+// 只判断文件自身的权限位，目录节点没有权限信息，不检查路径上各级目录的搜索权限
+inline bool canRead(const Principal& caller, uint32_t mode, uint32_t uid, uint32_t gid) {
+    if (caller.uid == 0) return true;
+    if (caller.uid == uid) return mode & 0400;
+    if (caller.inGroup(gid)) return mode & 0040;
+    return mode & 0004;
+}
+
+inline bool canRead(const Principal& caller, const FileMetadata& file) {
+    return canRead(caller, file.mode, file.uid, file.gid);
+}
+
+// 批量写入记录：扫描器等批量来源先产出记录，再整批写入模拟器
+struct FileRecord {
+    string path;              // 所在目录的绝对路径
+    string fileName;
+    string extension;
+    long long fileSize = 0;
+    string owner;
+    string createTime;
+    long long modifyTime = 0;
+    uint32_t mode = 0644;
+    uint32_t uid = 0;
+    uint32_t gid = 0;
+};
+
+// 目录状态记录：扫描时采集，增量重扫时与磁盘比对
+struct DirectoryRecord {
+    string path;
+    long long modifyTimeNs = 0;
+    size_t childCount = 0;
+};
+
+// 批量变更：一次加锁完成增、改、删，供目录监听和对账重扫使用
+struct MutationBatch {
+    vector<FileRecord> upserts;          // 不存在则新增，已存在则更新（保留 fileId，内容相同则跳过）
+    vector<string> removals;             // 文件完整路径
+    vector<string> directoryRemovals;    // 删除整个子树
+    vector<DirectoryRecord> directoryStates; // 目录 mtime/子项数，目录不存在时创建
     
     bool empty() const {
-        return sortedFileIds.empty();
+        return upserts.empty() && removals.empty() && directoryRemovals.empty() &&
+               directoryStates.empty();
+    }
+};
+
+struct MutationResult {
+    size_t added = 0;
+    size_t updated = 0;
+    size_t removed = 0;
+};
+
+// 从文件名提取扩展名（含点号，统一小写）；隐藏文件和无扩展名返回空串
+inline string extractExtension(const string& fileName) {
+    auto pos = fileName.rfind('.');
+    if (pos == string::npos || pos == 0 || pos + 1 == fileName.size()) return "";
+    string ext = fileName.substr(pos);
+    for (auto& c : ext) c = (char)tolower((unsigned char)c);
+    return ext;
+}
+
+// 一块分配实际占用的堆内存：glibc 上取 malloc 块的真实大小（可用大小加 8 字节头部），
+// 其他平台按请求大小计
+inline size_t allocatedBytes(void* ptr, size_t requested) {
+#ifdef __GLIBC__
+    (void)requested;
+    return malloc_usable_size(ptr) + sizeof(size_t);
+#else
+    (void)ptr;
+    return requested;
+#endif
+}
+
+// 不分配时的估算：按 glibc 的 8 字节头部、16 字节对齐、最小 32 字节计；15 字节以内的短字符串内联不分配
+inline size_t heapBytes(size_t requested) {
+    return requested == 0 ? 0 : max<size_t>(32, (requested + 8 + 15) & ~(size_t)15);
+}
+
+inline size_t stringHeapBytes(const string& text) {
+    return text.capacity() > 15 ? heapBytes(text.capacity() + 1) : 0;
+}
+
+// 一个子系统的内存账户，由 TrackingAllocator 在分配和释放时记账。
+// 记录和树节点可能比所属的模拟器活得久（调用方仍持有查询结果），
+// 因此账户从进程级的池中分配、永不释放，每个实例只占几十字节
+struct MemoryAccount {
+    atomic<int64_t> bytes{0};
+    atomic<int64_t> allocations{0};
+    
+    void add(int64_t delta, int64_t count) {
+        bytes.fetch_add(delta, memory_order_relaxed);
+        allocations.fetch_add(count, memory_order_relaxed);
     }
     
-    // 估计压缩比
-    size_t getMemoryUsage() const {
-        return sortedFileIds.size() * sizeof(int);
+    size_t getBytes() const {
+        return (size_t)max<int64_t>(0, bytes.load(memory_order_relaxed));
+    }
+    
+    static MemoryAccount* create() {
+        static mutex poolMutex;
+        static deque<MemoryAccount> pool;
+        lock_guard<mutex> lock(poolMutex);
+        return &pool.emplace_back();
     }
 };
 
-// 倒排索引系统
-class InvertedIndex {
-private:
-    unordered_map<string, CompressedInvertedList> extensionIndex;
-    map<long long, CompressedInvertedList> sizeIndex;
-    unordered_map<string, CompressedInvertedList> ownerIndex;
-    unordered_map<string, CompressedInvertedList> timeIndex;
+// 对象自身之外、由其成员字符串持有的堆内存。只用于构造后不再修改的对象
+// （映射表的键、不可变的元数据记录、节点名），构造和析构时各算一次，两次结果相同
+template <typename T>
+size_t ownedHeapBytes(const T&) {
+    return 0;
+}
+
+template <typename Value>
+size_t ownedHeapBytes(const pair<const string, Value>& entry) {
+    return stringHeapBytes(entry.first);
+}
+
+inline size_t ownedHeapBytes(const FileMetadata& file) {
+    size_t bytes = stringHeapBytes(file.fileName) + stringHeapBytes(file.extension) + stringHeapBytes(file.owner) +
+                   stringHeapBytes(file.createTime) + stringHeapBytes(file.fullPath);
+    if (file.tags.capacity() > 0) bytes += heapBytes(file.tags.capacity() * sizeof(FileTag));
+    for (const auto& tag : file.tags) bytes += stringHeapBytes(tag.key) + stringHeapBytes(tag.value);
+    return bytes;
+}
+
+inline size_t ownedHeapBytes(const pair<const int, FileMetadata>& entry) {
+    return ownedHeapBytes(entry.second);
+}
+
+class DirectoryNode;
+size_t ownedHeapBytes(const DirectoryNode& node);
+
+// 记账分配器：容器的节点、桶数组、数组以及 allocate_shared 的控制块都按 malloc 块的真实大小
+// 记到构造时给定的账户；construct/destroy 再记上元素自身持有的字符串堆内存。
+// 账户为空时不记账。容器交换、移动时分配器随之传播，账户跟着数据走
+template <typename T>
+class TrackingAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = true_type;
+    using propagate_on_container_move_assignment = true_type;
+    using propagate_on_container_swap = true_type;
     
-    mutable shared_mutex indexMutex;
+    MemoryAccount* account = nullptr;
     
-public:
-    void addFile(const FileMetadata& file) {
-        unique_lock<shared_mutex> lock(indexMutex);
-        
-        extensionIndex[file.extension].addFileId(file.fileId);
-        sizeIndex[file.fileSize].addFileId(file.fileId);
-        ownerIndex[file.owner].addFileId(file.fileId);
-        timeIndex[file.createTime].addFileId(file.fileId);
-    }
+    TrackingAllocator() noexcept = default;
+    explicit TrackingAllocator(MemoryAccount* account) noexcept : account(account) {}
+    template <typename U>
+    TrackingAllocator(const TrackingAllocator<U>& other) noexcept : account(other.account) {}
     
-    void removeFile(const FileMetadata& file) {
-        unique_lock<shared_mutex> lock(indexMutex);
-        
-        extensionIndex[file.extension].removeFileId(file.fileId);
-        if (extensionIndex[file.extension].empty()) {
-            extensionIndex.erase(file.extension);
-        }
-        
-        sizeIndex[file.fileSize].removeFileId(file.fileId);
-        if (sizeIndex[file.fileSize].empty()) {
-            sizeIndex.erase(file.fileSize);
-        }
-        
-        ownerIndex[file.owner].removeFileId(file.fileId);
-        if (ownerIndex[file.owner].empty()) {
-            ownerIndex.erase(file.owner);
-        }
-        
-        timeIndex[file.createTime].removeFileId(file.fileId);
-        if (timeIndex[file.createTime].empty()) {
-            timeIndex.erase(file.createTime);
-        }
+    T* allocate(size_t n) {
+        size_t requested = n * sizeof(T);
+        void* ptr = ::operator new(requested);
+        if (account) account->add((int64_t)allocatedBytes(ptr, requested), 1);
+        return static_cast<T*>(ptr);
     }
     
-    vector<int> queryByExtension(const string& ext) const {
-        shared_lock<shared_mutex> lock(indexMutex);
-        auto it = extensionIndex.find(ext);
-        if (it != extensionIndex.end()) {
-            return it->second.getFileIds();
-        }
-        return {};
+    void deallocate(T* ptr, size_t n) noexcept {
+        if (account) account->add(-(int64_t)allocatedBytes(ptr, n * sizeof(T)), -1);
+        ::operator delete(ptr);
     }
     
-    vector<int> queryBySizeRange(long long minSize, long long maxSize) const {
-        shared_lock<shared_mutex> lock(indexMutex);
-        vector<int> result;
-        auto lower = sizeIndex.lower_bound(minSize);
-        auto upper = sizeIndex.upper_bound(maxSize);
-        
-        for (auto it = lower; it != upper; ++it) {
-            const auto& fileIds = it->second.getFileIds();
-            result.insert(result.end(), fileIds.begin(), fileIds.end());
-        }
-        
-        sort(result.begin(), result.end());
-        result.erase(unique(result.begin(), result.end()), result.end());
-        return result;
+    template <typename U, typename... Args>
+    void construct(U* ptr, Args&&... args) {
+        ::new ((void*)ptr) U(forward<Args>(args)...);
+        if (account) account->add((int64_t)ownedHeapBytes(*ptr), 0);
     }
     
-    vector<int> queryByOwner(const string& owner) const {
-        shared_lock<shared_mutex> lock(indexMutex);
-        auto it = ownerIndex.find(owner);
-        if (it != ownerIndex.end()) {
-            return it->second.getFileIds();
-        }
-        return {};
+    template <typename U>
+    void destroy(U* ptr) {
+        if (account) account->add(-(int64_t)ownedHeapBytes(*ptr), 0);
+        ptr->~U();
     }
     
-    vector<int> queryByTime(const string& time) const {
-        shared_lock<shared_mutex> lock(indexMutex);
-        auto it = timeIndex.find(time);
-        if (it != timeIndex.end()) {
-            return it->second.getFileIds();
-        }
-        return {};
+    template <typename U>
+    bool operator==(const TrackingAllocator<U>& other) const noexcept {
+        return account == other.account;
     }
     
-    size_t getMemoryUsage() const {
-        shared_lock<shared_mutex> lock(indexMutex);
-        size_t total = 0;
-        
-        for (const auto& pair : extensionIndex) {
-            total += pair.second.getMemoryUsage();
-        }
-        for (const auto& pair : sizeIndex) {
-            total += pair.second.getMemoryUsage();
-        }
-        for (const auto& pair : ownerIndex) {
-            total += pair.second.getMemoryUsage();
-        }
-        for (const auto& pair : timeIndex) {
-            total += pair.second.getMemoryUsage();
-        }
-        
-        return total;
+    template <typename U>
+    bool operator!=(const TrackingAllocator<U>& other) const noexcept {
+        return account != other.account;
     }
 };
 
-// 文件系统模拟器
-class FileSystemSimulator {
+template <typename Key, typename Value>
+using TrackedHashMap = unordered_map<Key, Value, hash<Key>, equal_to<Key>, TrackingAllocator<pair<const Key, Value>>>;
+
+template <typename Key, typename Value>
+using TrackedOrderedMap = map<Key, Value, less<Key>, TrackingAllocator<pair<const Key, Value>>>;
+
+// HyperLogLog 基数估计：2^12 个寄存器，各记落到该寄存器的哈希其余位的前导零个数 + 1 的最大值，
+// 标准误差约 1.04 / sqrt(4096) ≈ 1.6%。取值少时是稀疏形式（按寄存器号排序的 号 << 8 | 值），
+// 项数到 kDenseWords 时转成稠密的字节数组，两种形式此时一样大。合并按寄存器取最大值，
+// 等于对两边的并集求草图；删除无法撤销，由持有方重算（见 SubtreeSummary）
+class HyperLogLog {
+public:
+    static constexpr unsigned kPrecision = 12;
+    static constexpr size_t kRegisters = size_t(1) << kPrecision;
+    static constexpr size_t kDenseWords = kRegisters / sizeof(uint32_t);
+    
+    explicit HyperLogLog(MemoryAccount* account = nullptr) : words(Words::allocator_type(account)) {}
+    
+    static uint64_t hashOf(const string& value) { return mix(hash<string>()(value)); }
+    static uint64_t hashOf(uint64_t value) { return mix(value); }
+    
+    // 返回草图是否因此改变
+    bool add(uint64_t hash) {
+        uint64_t rest = hash << kPrecision;
+        return raise((uint32_t)(hash >> (64 - kPrecision)),
+                     (uint8_t)(rest ? __builtin_clzll(rest) + 1 : 64 - kPrecision + 1));
+    }
+    
+    void merge(const HyperLogLog& other) {
+        if (other.dense && !dense) toDense();
+        other.forEachRegister([&](uint32_t index, uint8_t rank) { raise(index, rank); });
+    }
+    
+    // 取值少时（估计值不超过 2.5 倍寄存器数且有空寄存器）改用线性计数
+    double estimate() const {
+        double sum = 0;
+        size_t zeros = kRegisters;
+        forEachRegister([&](uint32_t, uint8_t rank) {
+            sum += ldexp(1.0, -rank);
+            zeros--;
+        });
+        sum += (double)zeros;
+        double m = (double)kRegisters;
+        double raw = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+        if (raw <= 2.5 * m && zeros > 0) return m * log(m / (double)zeros);
+        return raw;
+    }
+    
+    bool empty() const { return words.empty(); }
+    MemoryAccount* account() const { return words.get_allocator().account; }
+    
 private:
-    shared_ptr<DirectoryNode> root;
-    unordered_map<int, shared_ptr<FileMetadata>> fileMetadataMap;
-    InvertedIndex invertedIndex;
-    mutable shared_mutex treeMetadataMutex;
-    int nextFileId;
+    using Words = vector<uint32_t, TrackingAllocator<uint32_t>>;
+    Words words;
+    bool dense = false;
     
-public:
- 
-    FileSystemSimulator() : nextFileId(1) {
-        root = make_shared<DirectoryNode>("/");
+    static uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
     }
     
-    // 添加文件并同时更新目录树和倒排索引
-    bool addFile(const string& path, const string& fileName, const string& extension,
-                long long fileSize, const string& owner, const string& createTime) {
-        unique_lock<shared_mutex> lock(treeMetadataMutex);
-        
-        auto pathNode = getOrCreatePath(path);
-        if (!pathNode) return false;
-        
-        int fileId = nextFileId++;
-        string fullPath = path + (path.back() == '/' ? "" : "/") + fileName;
-        
-        auto fileData = make_shared<FileMetadata>(fileId, fileName, extension, 
-                                                 fileSize, owner, createTime, fullPath);
-        
-        auto fileNode = make_shared<DirectoryNode>(fileName, false);
-        fileNode->fileData = fileData;
-        fileNode->parent = pathNode;
-        
-        pathNode->children[fileName] = fileNode;
-        fileMetadataMap[fileId] = fileData;
-        
-        // 更新倒排索引
-        invertedIndex.addFile(*fileData);
-        
-        return true;
+    uint8_t* registers() { return reinterpret_cast<uint8_t*>(words.data()); }
+    const uint8_t* registers() const { return reinterpret_cast<const uint8_t*>(words.data()); }
+    
+    template <typename Fn>
+    void forEachRegister(Fn&& fn) const {
+        if (dense) {
+            for (uint32_t i = 0; i < kRegisters; ++i) {
+                if (registers()[i]) fn(i, registers()[i]);
+            }
+            return;
+        }
+        for (uint32_t entry : words) fn(entry >> 8, (uint8_t)entry);
     }
     
-    // 删除文件并更新索引
-    bool removeFile(const string& fullPath) {
-        unique_lock<shared_mutex> lock(treeMetadataMutex);
-        
-        auto fileNode = findFileNode(fullPath);
-        if (!fileNode || fileNode->isDirectory) return false;
-        
-        auto fileData = fileNode->fileData;
-        if (fileData) {
-            invertedIndex.removeFile(*fileData);
-            fileMetadataMap.erase(fileData->fileId);
+    bool raise(uint32_t index, uint8_t rank) {
+        if (dense) {
+            if (registers()[index] >= rank) return false;
+            registers()[index] = rank;
+            return true;
         }
-        
-        // 从父节点删除
-        if (auto parent = fileNode->parent.lock()) {
-            parent->children.erase(fileNode->name);
+        auto it = lower_bound(words.begin(), words.end(), index << 8);
+        if (it != words.end() && (*it >> 8) == index) {
+            if ((uint8_t)*it >= rank) return false;
+            *it = index << 8 | rank;
+            return true;
         }
-        
+        words.insert(it, index << 8 | rank);
+        if (words.size() >= kDenseWords) toDense();
         return true;
     }
     
-    // 传统方式查询（遍历目录树）
-    vector<shared_ptr<FileMetadata>> queryByExtensionTraditional(const string& ext) const {
-        shared_lock<shared_mutex> lock(treeMetadataMutex);
-        vector<shared_ptr<FileMetadata>> result;
-        traverseAndFilter(root, [&](const shared_ptr<FileMetadata>& file) {
-            if (file->extension == ext) {
-                result.push_back(file);
-            }
-        });
-        return result;
+    void toDense() {
+        Words sparse(kDenseWords, 0, words.get_allocator());
+        swap(sparse, words);
+        dense = true;
+        for (uint32_t entry : sparse) registers()[entry >> 8] = (uint8_t)entry;
     }
+};
+
+// 子树摘要里估计不同取值个数的属性
+enum class DistinctAttribute { Extension, Owner, Group };
+constexpr size_t kDistinctAttributeCount = 3;
+const char* const kDistinctAttributeNames[kDistinctAttributeCount] = {"extension", "owner", "gid"};
+
+// 目录树节点
+// 子树摘要（类似列存的 zone map）：子树内全部文件扩展名、属主的 Bloom 过滤器，
+// 以及文件大小、创建日期的最小/最大值。摘要只会比子树的实际内容宽，
+// 扫描据此跳过不可能有匹配的子树；插入时增量合并，删除先把摘要标记为松弛，攒够一批后由写操作在写锁下收紧。
+// 另带扩展名、属主、属组的 HyperLogLog 草图，估计子树内的不同取值个数，随摘要一起合并和收紧。
+// 草图在子树文件数达到 kSketchMinFiles 时才分配（祖先先于子孙），更小的子树估计时现场遍历
+struct SubtreeSummary {
+    static constexpr size_t kBloomWords = 4;   // 每个过滤器 256 位，每个值置 2 位
+    // 遍历这么多文件求不同取值个数，与估计一个稠密草图（扫 4096 个寄存器）的开销相当
+    static constexpr size_t kSketchMinFiles = 256;
+    using Bloom = array<uint64_t, kBloomWords>;
+    using Sketches = vector<HyperLogLog, TrackingAllocator<HyperLogLog>>;
+    using DistinctHashes = array<uint64_t, kDistinctAttributeCount>;   // 按 DistinctAttribute 的顺序
     
-    // 使用倒排索引查询
-    vector<shared_ptr<FileMetadata>> queryByExtensionIndexed(const string& ext) const {
-        auto fileIds = invertedIndex.queryByExtension(ext);
-        vector<shared_ptr<FileMetadata>> result;
+    // 文件在摘要中用到的值。沿祖先逐层合并同一个文件时只算一次哈希和日期
+    struct FileKey {
+        Bloom extension;
+        Bloom owner;
+        long long size;
+        int32_t minDate;
+        int32_t maxDate;
+        DistinctHashes hashes;
         
-        shared_lock<shared_mutex> lock(treeMetadataMutex);
-        for (int fileId : fileIds) {
-            auto it = fileMetadataMap.find(fileId);
-            if (it != fileMetadataMap.end()) {
-                result.push_back(it->second);
-            }
+        explicit FileKey(const FileMetadata& file) : size(file.fileSize) {
+            size_t extensionHash = hash<string>()(file.extension);
+            size_t ownerHash = hash<string>()(file.owner);
+            extension = bloomBitsOf(extensionHash);
+            owner = bloomBitsOf(ownerHash);
+            int32_t date = dateKey(file.createTime);
+            minDate = date < 0 ? INT32_MIN : date;
+            maxDate = date < 0 ? INT32_MAX : date;
+            hashes = distinctHashes(extensionHash, ownerHash, file.gid);
         }
-        return result;
+    };
+    
+    static DistinctHashes distinctHashes(const FileMetadata& file) {
+        return distinctHashes(hash<string>()(file.extension), hash<string>()(file.owner), file.gid);
     }
     
-    vector<shared_ptr<FileMetadata>> queryBySizeRangeIndexed(long long minSize, long long maxSize) const {
-        auto fileIds = invertedIndex.queryBySizeRange(minSize, maxSize);
-        vector<shared_ptr<FileMetadata>> result;
-        
-        shared_lock<shared_mutex> lock(treeMetadataMutex);
-        for (int fileId : fileIds) {
-            auto it = fileMetadataMap.find(fileId);
-            if (it != fileMetadataMap.end()) {
-                result.push_back(it->second);
-            }
-        }
-        return result;
+    static DistinctHashes distinctHashes(size_t extensionHash, size_t ownerHash, uint32_t gid) {
+        return {HyperLogLog::hashOf((uint64_t)extensionHash), HyperLogLog::hashOf((uint64_t)ownerHash),
+                HyperLogLog::hashOf(gid)};
     }
     
-    vector<shared_ptr<FileMetadata>> queryByOwnerIndexed(const string& owner) const {
-        auto fileIds = invertedIndex.queryByOwner(owner);
-        vector<shared_ptr<FileMetadata>> result;
-        
-        shared_lock<shared_mutex> lock(treeMetadataMutex);
-        for (int fileId : fileIds) {
-            auto it = fileMetadataMap.find(fileId);
-            if (it != fileMetadataMap.end()) {
-                result.push_back(it->second);
-            }
-        }
-        return result;
+    Bloom extensions{};
+    Bloom owners{};
+    long long minSize = LLONG_MAX;
+    long long maxSize = LLONG_MIN;
+    int32_t minDate = INT32_MAX;   // 创建日期 yyyymmdd；无法解析的日期把范围放到最宽
+    int32_t maxDate = INT32_MIN;
+    size_t files = 0;              // 并入的文件数，只在分配草图前用到（此前每个文件都会并入）
+    Sketches distinct;             // 按 DistinctAttribute 的顺序；未分配时为空
+    
+    // account 为草图记账
+    explicit SubtreeSummary(MemoryAccount* account = nullptr) : distinct(Sketches::allocator_type(account)) {}
+    
+    bool empty() const { return minSize > maxSize; }
+    MemoryAccount* account() const { return distinct.get_allocator().account; }
+    
+    bool hasSketches() const { return !distinct.empty(); }
+    const HyperLogLog& sketch(DistinctAttribute attribute) const { return distinct[(size_t)attribute]; }
+    
+    void allocateSketches() {
+        distinct.reserve(kDistinctAttributeCount);
+        while (distinct.size() < kDistinctAttributeCount) distinct.emplace_back(account());
     }
     
-    // 生成测试数据
-    void generateTestData(int numFiles) {
-        vector<string> extensions = {".jpg", ".png", ".pdf", ".txt", ".doc", ".mp4", ".mp3"};
-        vector<string> owners = {"user1", "user2", "user3", "admin", "guest"};
-        vector<string> paths = {"/home/user1", "/home/user2", "/documents", "/pictures", "/videos"};
-        
-        random_device rd;
-        mt19937 gen(rd());
-        uniform_int_distribution<> extDist(0, extensions.size() - 1);
-        uniform_int_distribution<> ownerDist(0, owners.size() - 1);
-        uniform_int_distribution<> pathDist(0, paths.size() - 1);
-        uniform_int_distribution<long long> sizeDist(1024, 10 * 1024 * 1024); // 1KB to 10MB
-        
-        for (int i = 0; i < numFiles; ++i) {
-            string fileName = "file" + to_string(i);
-            string extension = extensions[extDist(gen)];
-            string owner = owners[ownerDist(gen)];
-            string path = paths[pathDist(gen)];
-            long long fileSize = sizeDist(gen);
-            string createTime = "2024-" + to_string((i % 12) + 1) + "-" + to_string((i % 28) + 1);
-            
-            addFile(path, fileName, extension, fileSize, owner, createTime);
-        }
+    static Bloom bloomBits(const string& value) {
+        return bloomBitsOf(hash<string>()(value));
     }
     
-    size_t getIndexMemoryUsage() const {
-        return invertedIndex.getMemoryUsage();
+    static Bloom bloomBitsOf(size_t valueHash) {
+        uint64_t h = valueHash * 0x9e3779b97f4a7c15ull;
+        Bloom bits{};
+        unsigned first = h >> 56, second = (h >> 48) & 0xff;
+        bits[first >> 6] |= 1ull << (first & 63);
+        bits[second >> 6] |= 1ull << (second & 63);
+        return bits;
     }
     
-    size_t getTotalFiles() const {
-        shared_lock<shared_mutex> lock(treeMetadataMutex);
-        return fileMetadataMap.size();
+    static bool contains(const Bloom& set, const Bloom& bits) {
+        for (size_t i = 0; i < kBloomWords; ++i) {
+            if ((set[i] & bits[i]) != bits[i]) return false;
+        }
+        return true;
     }
     
-private:
-    shared_ptr<DirectoryNode> getOrCreatePath(const string& path) {
-        if (path.empty() || path[0] != '/') return nullptr;
-        
-        auto current = root;
-        if (path == "/") return current;
-        
-        stringstream ss(path.substr(1));
-        string part;
-        
-        while (getline(ss, part, '/')) {
-            if (part.empty()) continue;
-            
-            if (current->children.find(part) == current->children.end()) {
-                auto newNode = make_shared<DirectoryNode>(part, true);
-                newNode->parent = current;
-                current->children[part] = newNode;
+    // "2024-1-5"、"2024-01-05" 都解析为 20240105，失败返回 -1
+    static int32_t dateKey(const string& text) {
+        int32_t parts[3] = {0, 0, 0};
+        size_t part = 0, digits = 0;
+        for (char c : text) {
+            if (c == '-' && digits > 0 && part < 2) {
+                part++;
+                digits = 0;
+            } else if (c >= '0' && c <= '9' && digits < 4) {
+                parts[part] = parts[part] * 10 + (c - '0');
+                digits++;
+            } else {
+                return -1;
             }
-            current = current->children[part];
         }
-        
-        return current;
+        if (part != 2 || digits == 0 || parts[1] > 99 || parts[2] > 99) return -1;
+        return parts[0] * 10000 + parts[1] * 100 + parts[2];
     }
     
-    shared_ptr<DirectoryNode> findFileNode(const string& fullPath) const {
+    // 合并一个文件（不含草图，见 addToSketches）；返回摘要是否因此变宽，没有变宽时祖先的摘要也已覆盖该文件
+    bool add(const FileKey& key) {
+        bool widened = false;
+        auto addBits = [&](Bloom& set, const Bloom& bits) {
+            if (contains(set, bits)) return;
+            for (size_t i = 0; i < kBloomWords; ++i) set[i] |= bits[i];
+            widened = true;
+        };
+        addBits(extensions, key.extension);
+        addBits(owners, key.owner);
+        if (key.size < minSize) minSize = key.size, widened = true;
+        if (key.size > maxSize) maxSize = key.size, widened = true;
+        if (key.minDate < minDate) minDate = key.minDate, widened = true;
+        if (key.maxDate > maxDate) maxDate = key.maxDate, widened = true;
+        files++;
+        return widened;
+    }
+    
+    bool add(const FileMetadata& file) {
+        return add(FileKey(file));
+    }
+    
+    // 返回草图是否有变；没有变时祖先的草图也已覆盖该文件（祖先的寄存器不小于子目录的）
+    bool addToSketches(const DistinctHashes& hashes) {
+        bool changed = false;
+        for (size_t i = 0; i < distinct.size(); ++i) changed |= distinct[i].add(hashes[i]);
+        return changed;
+    }
+    
+    void mergeSketches(const SubtreeSummary& other) {
+        for (size_t i = 0; i < distinct.size() && i < other.distinct.size(); ++i) distinct[i].merge(other.distinct[i]);
+    }
+    
+    // 合并子目录的摘要；草图不在这里合并（子目录可能还没有草图），见 FileSystemSimulator::collectSketchesLocked
+    void merge(const SubtreeSummary& other) {
+        for (size_t i = 0; i < kBloomWords; ++i) {
+            extensions[i] |= other.extensions[i];
+            owners[i] |= other.owners[i];
+        }
+        minSize = min(minSize, other.minSize);
+        maxSize = max(maxSize, other.maxSize);
+        minDate = min(minDate, other.minDate);
+        maxDate = max(maxDate, other.maxDate);
+        files += other.files;
+    }
+};
+
+// 扫描条件在摘要上的形式，每次扫描只算一次哈希
+struct SummaryProbe {
+    optional<SubtreeSummary::Bloom> extension;
+    optional<SubtreeSummary::Bloom> owner;
+    optional<pair<long long, long long>> sizeRange;
+    optional<int32_t> date;
+    
+    bool mayMatch(const SubtreeSummary& summary) const {
+        if (summary.empty()) return false;
+        if (extension && !SubtreeSummary::contains(summary.extensions, *extension)) return false;
+        if (owner && !SubtreeSummary::contains(summary.owners, *owner)) return false;
+        if (sizeRange && (sizeRange->second < summary.minSize || sizeRange->first > summary.maxSize)) return false;
+        if (date && (*date < summary.minDate || *date > summary.maxDate)) return false;
+        return true;
+    }
+};
+
+// 一次摘要剪枝扫描的统计
+struct PruneStats {
+    size_t directoriesVisited = 0;
+    size_t directoriesPruned = 0;   // 摘要表明不可能匹配而跳过的子树
+    size_t filesExamined = 0;
+};
+
+class DirectoryNode {
+public:
+    using ChildMap = TrackedHashMap<string, shared_ptr<DirectoryNode>>;
+    
+    string name;
+    bool isDirectory;
+    shared_ptr<FileMetadata> fileData;
+    ChildMap children;
+    weak_ptr<DirectoryNode> parent;
+    long long modifyTimeNs = 0;   // 目录 mtime（纳秒），增量重扫据此判断是否需要重新列目录
+    size_t childCount = 0;        // 上次列目录时的子项数
+    size_t subdirectoryCount = 0; // 子目录数，收集目录时据此跳过只含文件的目录
+    unique_ptr<SubtreeSummary> summary;   // 只有目录有，见 SubtreeSummary
+    bool summaryLoose = false;            // 有删除或修改后摘要可能偏宽；置位时祖先也都置位
+    
+    // account 为子项表记账（节点自身由创建方的分配器记账）
+    DirectoryNode(const string& n, bool isDir = true, MemoryAccount* account = nullptr)
+        : name(n), isDirectory(isDir), children(ChildMap::allocator_type(account)),
+          summary(isDir ? make_unique<SubtreeSummary>(account) : nullptr) {}
+};
+
+inline size_t ownedHeapBytes(const DirectoryNode& node) {
+    return stringHeapBytes(node.name) + (node.summary ? heapBytes(sizeof(SubtreeSummary)) : 0);
+}
+
+// 列式元数据：批量建索引的输入，按 fileId 升序排列最快。
+// 字符串列只保存指针，所指字符串须在构建期间保持有效
+struct MetadataColumns {
+    vector<int> fileIds;
+    vector<const string*> extensions;
+    vector<long long> sizes;
+    vector<const string*> owners;
+    vector<const string*> createTimes;
+    vector<long long> modifyTimes;
+    vector<uint32_t> modes;
+    vector<uint32_t> uids;
+    vector<uint32_t> gids;
+    vector<const vector<FileTag>*> tags;   // 可以为空（没有标签的数据），此时不构建标签索引
+    
+    size_t size() const {
+        return fileIds.size();
+    }
+    
+    void reserve(size_t n) {
+        fileIds.reserve(n);
+        extensions.reserve(n);
+        sizes.reserve(n);
+        owners.reserve(n);
+        createTimes.reserve(n);
+        modifyTimes.reserve(n);
+        modes.reserve(n);
+        uids.reserve(n);
+        gids.reserve(n);
+        tags.reserve(n);
+    }
+    
+    void append(const FileMetadata& file) {
+        fileIds.push_back(file.fileId);
+        extensions.push_back(&file.extension);
+        sizes.push_back(file.fileSize);
+        owners.push_back(&file.owner);
+        createTimes.push_back(&file.createTime);
+        modifyTimes.push_back(file.modifyTime);
+        modes.push_back(file.mode);
+        uids.push_back(file.uid);
+        gids.push_back(file.gid);
+        tags.push_back(&file.tags);
+    }
+    
+    static MetadataColumns fromFiles(const vector<shared_ptr<FileMetadata>>& files) {
+        MetadataColumns columns;
+        columns.reserve(files.size());
+        for (const auto& file : files) {
+            columns.append(*file);
+        }
+        return columns;
+    }
+};
+
+// 把 [0, n) 均分给 numThreads 个线程执行 body(线程号, begin, end)
+template <typename Body>
+void parallelFor(size_t n, int numThreads, Body&& body) {
+    numThreads = (int)max<size_t>(1, min<size_t>(numThreads, n / 4096 + 1));
+    if (numThreads == 1) {
+        body(0, (size_t)0, n);
+        return;
+    }
+    vector<thread> workers;
+    for (int t = 0; t < numThreads; ++t) {
+        workers.emplace_back([&, t]() {
+            body(t, n * t / numThreads, n * (t + 1) / numThreads);
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// 并行 LSD 基数排序：只按 keyOf(item) 在 [lowBit, highBit) 区间内的位排序，每趟 11 位。
+// 每一趟都是稳定的计数排序，原有的相对顺序（例如升序的 fileId）在键相同时会被保留。
+template <typename T, typename KeyOf>
+void parallelRadixSort(vector<T>& keys, int lowBit, int highBit, int numThreads, KeyOf keyOf) {
+    const int digitBits = 11;
+    const size_t buckets = 1 << digitBits;
+    const size_t n = keys.size();
+    vector<T> buffer(n);
+    int threads = (int)max<size_t>(1, min<size_t>(numThreads, n / 4096 + 1));
+    vector<vector<size_t>> histograms(threads, vector<size_t>(buckets));
+    
+    for (int shift = lowBit; shift < highBit; shift += digitBits) {
+        const uint64_t mask = buckets - 1;
+        parallelFor(n, threads, [&](int t, size_t begin, size_t end) {
+            auto& histogram = histograms[t];
+            fill(histogram.begin(), histogram.end(), 0);
+            for (size_t i = begin; i < end; ++i) {
+                histogram[(keyOf(keys[i]) >> shift) & mask]++;
+            }
+        });
+        
+        // 所有元素落在同一个桶里时这一趟没有意义
+        size_t largest = 0;
+        for (size_t d = 0; d < buckets; ++d) {
+            size_t total = 0;
+            for (int t = 0; t < threads; ++t) total += histograms[t][d];
+            largest = max(largest, total);
+        }
+        if (largest == n) continue;
+        
+        // 桶 d 中线程 t 的起始位置 = 所有更小桶的总数 + 桶 d 中更小线程的数量
+        size_t offset = 0;
+        for (size_t d = 0; d < buckets; ++d) {
+            for (int t = 0; t < threads; ++t) {
+                size_t count = histograms[t][d];
+                histograms[t][d] = offset;
+                offset += count;
+            }
+        }
+        parallelFor(n, threads, [&](int t, size_t begin, size_t end) {
+            auto& positions = histograms[t];
+            for (size_t i = begin; i < end; ++i) {
+                buffer[positions[(keyOf(keys[i]) >> shift) & mask]++] = keys[i];
+            }
+        });
+        keys.swap(buffer);
+    }
+}
+
+inline void parallelRadixSort(vector<uint64_t>& keys, int lowBit, int highBit, int numThreads) {
+    parallelRadixSort(keys, lowBit, highBit, numThreads, [](uint64_t key) { return key; });
+}
+
+// 单个属性索引的内存占用（字节）
+struct IndexMemory {
+    size_t dictionary = 0;        // 键表：哈希/有序表的节点、桶数组和键字符串
+    size_t postings = 0;          // 倒排链数组
+    
+    size_t total() const {
+        return dictionary + postings;
+    }
+};
+
+// 按组件划分的内存占用（字节），由各子系统的 MemoryAccount 读出
+struct MemoryBreakdown {
+    size_t tree = 0;              // 目录树节点、子项表、节点名和子树摘要（含不同取值草图）
+    size_t metadata = 0;          // 元数据记录及 fileId 映射表
+    IndexMemory extension;
+    IndexMemory size;
+    IndexMemory owner;
+    IndexMemory time;
+    IndexMemory group;
+    IndexMemory modifyTime;
+    IndexMemory tags;             // 各个标签键的索引合计
+    IndexMemory readable;         // 各访问者的可读位图
+    IndexMemory sample;           // 基数估计的样本行
+    IndexMemory base;             // 底段的文件位图和墓碑
+    size_t mappedSegment = 0;     // 映射的底段文件大小：在页缓存中按需装入，不计入 total
+    
+    size_t index() const {
+        return extension.total() + size.total() + owner.total() + time.total() + group.total() +
+               modifyTime.total() + tags.total() + readable.total() + sample.total() + base.total();
+    }
+    
+    size_t total() const {
+        return tree + metadata + index();
+    }
+};
+
+class PostingSpillStore;
+
+using PostingVector = vector<int, TrackingAllocator<int>>;
+
+// 压缩的倒排索引项
+class CompressedInvertedList {
+private:
+    PostingVector sortedFileIds;
+    
+    // 内存预算下的驻留状态，由 PostingSpillStore 维护；未设置预算时始终驻留且不被跟踪
+    friend class PostingSpillStore;
+    static constexpr uint32_t kUntracked = UINT32_MAX;
+    mutable atomic<bool> referenced{false};   // CLOCK 引用位，读路径在读锁下设置
+    bool resident = true;
+    uint32_t clockSlot = kUntracked;
+    size_t chargedBytes = 0;                  // 已计入预算的字节数
+    uint64_t spillOffset = 0;
+    uint32_t spillBytes = 0;                  // 0 表示磁盘上没有有效副本
+    uint32_t spilledCount = 0;
+    uint32_t spilledBlocks = 0;
+    
+public:
+    // account 为倒排链数组记账
+    explicit CompressedInvertedList(MemoryAccount* account = nullptr)
+        : sortedFileIds(PostingVector::allocator_type(account)) {}
+    
+    void addFileId(int fileId) {
+        auto it = lower_bound(sortedFileIds.begin(), sortedFileIds.end(), fileId);
+        if (it == sortedFileIds.end() || *it != fileId) {
+            sortedFileIds.insert(it, fileId);
+        }
+    }
+    
+    void removeFileId(int fileId) {
+        auto it = lower_bound(sortedFileIds.begin(), sortedFileIds.end(), fileId);
+        if (it != sortedFileIds.end() && *it == fileId) {
+            sortedFileIds.erase(it);
+        }
+    }
+    
+    // 追加一段已排序的 fileId（批量构建用）；与已有内容交叠时归并去重
+    void appendSorted(const int* fileIds, size_t count) {
+        if (count == 0) return;
+        size_t middle = sortedFileIds.size();
+        bool isTail = sortedFileIds.empty() || sortedFileIds.back() < fileIds[0];
+        sortedFileIds.insert(sortedFileIds.end(), fileIds, fileIds + count);
+        if (!isTail) {
+            inplace_merge(sortedFileIds.begin(), sortedFileIds.begin() + middle, sortedFileIds.end());
+            sortedFileIds.erase(unique(sortedFileIds.begin(), sortedFileIds.end()), sortedFileIds.end());
+        }
+    }
+    
+    const PostingVector& getFileIds() const {
+        return sortedFileIds;
+    }
+    
+    // 追加到 out 末尾
+    void copyTo(vector<int>& out) const {
+        out.insert(out.end(), sortedFileIds.begin(), sortedFileIds.end());
+    }
+    
+    size_t size() const {
+        return resident ? sortedFileIds.size() : spilledCount;
+    }
+    
+    bool empty() const {
+        return size() == 0;
+    }
+    
+    bool isResident() const {
+        return resident;
+    }
+};
+
+// 持久化倒排段的文件格式（只读、不可变，读取时直接 mmap，不反序列化）：
+//   [头部][倒排链…][各字段的词项表][各字段的字符串池]
+// 每条倒排链先是块跳表（每块一项），后是块数据；多块的链从 64 字节边界开始，单块的短链只按 16 字节对齐，避免填充膨胀。
+// 每块最多 128 个 fileId，块首 id 存在跳表里，其余存相邻差值减一，按块内最大位宽紧凑打包成 32 位字。
+// 词项表按键升序排列，查找时直接在映射内存上二分。
+enum class SegmentField : uint32_t { Extension = 0, Size = 1, Owner = 2, CreateTime = 3, Group = 4, ModifyTime = 5 };
+constexpr size_t kSegmentFieldCount = 6;
+constexpr size_t kSegmentBlockSize = 128;
+constexpr uint32_t kSegmentVersion = 3;
+constexpr char kSegmentMagic[8] = {'F', 'S', 'S', 'E', 'G', '0', '0', '1'};
+
+struct SegmentFieldInfo {
+    uint64_t termOffset;
+    uint64_t termCount;
+    uint64_t poolOffset;
+    uint64_t poolSize;
+};
+
+struct SegmentHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t fieldCount;
+    uint64_t fileSize;
+    uint64_t totalPostings;
+    SegmentFieldInfo fields[kSegmentFieldCount];
+};
+
+struct SegmentTerm {
+    uint64_t key;          // 数值字段为键值本身；字符串字段高 32 位为池内偏移，低 32 位为长度
+    uint64_t listOffset;   // 倒排链在文件内的偏移
+    uint32_t count;
+    uint32_t blockCount;
+};
+
+struct SegmentSkipEntry {
+    uint32_t firstId;
+    uint32_t lastId;
+    uint32_t wordOffset;   // 块数据在本链数据区内的偏移（以 32 位字计）
+    uint8_t bitWidth;
+    uint8_t countMinusOne;
+    uint16_t reserved;
+};
+
+static_assert(sizeof(SegmentTerm) == 24, "段文件布局不能依赖编译器填充");
+static_assert(sizeof(SegmentSkipEntry) == 16, "段文件布局不能依赖编译器填充");
+
+// 块编解码：values 为严格递增的 fileId
+inline void encodeSegmentBlock(const int* values, size_t count, SegmentSkipEntry& skip, vector<uint32_t>& words) {
+    uint32_t maxGap = 0;
+    for (size_t i = 1; i < count; ++i) {
+        maxGap = max(maxGap, (uint32_t)(values[i] - values[i - 1] - 1));
+    }
+    uint32_t bitWidth = 0;
+    while (bitWidth < 32 && (maxGap >> bitWidth) != 0) bitWidth++;
+    
+    skip.firstId = (uint32_t)values[0];
+    skip.lastId = (uint32_t)values[count - 1];
+    skip.wordOffset = (uint32_t)words.size();
+    skip.bitWidth = (uint8_t)bitWidth;
+    skip.countMinusOne = (uint8_t)(count - 1);
+    skip.reserved = 0;
+    if (bitWidth == 0) return;   // 连续 id，不需要数据
+    
+    uint64_t accumulator = 0;
+    uint32_t filled = 0;
+    for (size_t i = 1; i < count; ++i) {
+        accumulator |= (uint64_t)(uint32_t)(values[i] - values[i - 1] - 1) << filled;
+        filled += bitWidth;
+        if (filled >= 32) {
+            words.push_back((uint32_t)accumulator);
+            accumulator >>= 32;
+            filled -= 32;
+        }
+    }
+    if (filled > 0) words.push_back((uint32_t)accumulator);
+}
+
+// 解码一块到 out，返回个数；words 指向本链数据区起点
+inline size_t decodeSegmentBlock(const SegmentSkipEntry& skip, const uint32_t* words, int* out) {
+    size_t count = (size_t)skip.countMinusOne + 1;
+    uint32_t bitWidth = skip.bitWidth;
+    int current = (int)skip.firstId;
+    out[0] = current;
+    if (bitWidth == 0) {
+        for (size_t i = 1; i < count; ++i) out[i] = ++current;
+        return count;
+    }
+    
+    const uint32_t* word = words + skip.wordOffset;
+    uint64_t mask = bitWidth == 32 ? 0xFFFFFFFFULL : ((1ULL << bitWidth) - 1);
+    uint64_t accumulator = 0;
+    uint32_t available = 0;
+    for (size_t i = 1; i < count; ++i) {
+        if (available < bitWidth) {
+            accumulator |= (uint64_t)*word++ << available;
+            available += 32;
+        }
+        current += (int)(accumulator & mask) + 1;
+        accumulator >>= bitWidth;
+        available -= bitWidth;
+        out[i] = current;
+    }
+    return count;
+}
+
+// 段文件写入：倒排链顺序写出，词项表和字符串池在内存中累积，最后写在文件尾，再回填头部。
+// 同一字段的词项须按键升序添加（数值字段按有符号值）
+class SegmentWriter {
+public:
+    explicit SegmentWriter(const string& path) : path(path) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw runtime_error("无法写入段文件: " + path + ": " + strerror(errno));
+        }
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, kSegmentMagic, sizeof(kSegmentMagic));
+        header.version = kSegmentVersion;
+        header.fieldCount = kSegmentFieldCount;
+        // 头部单独占一页，倒排链从第二页开始
+        buffer.assign(4096, '\0');
+    }
+    
+    SegmentWriter(const SegmentWriter&) = delete;
+    SegmentWriter& operator=(const SegmentWriter&) = delete;
+    
+    ~SegmentWriter() {
+        if (fd >= 0) close(fd);
+    }
+    
+    void addStringTerm(SegmentField field, const string& key, const vector<int>& fileIds) {
+        auto& pool = pools[(size_t)field];
+        uint64_t packedKey = ((uint64_t)pool.size() << 32) | (uint32_t)key.size();
+        pool.append(key);
+        addTerm(field, packedKey, fileIds);
+    }
+    
+    void addNumericTerm(SegmentField field, long long key, const vector<int>& fileIds) {
+        addTerm(field, (uint64_t)key, fileIds);
+    }
+    
+    // 写出词项表、字符串池和头部并 fsync，返回文件大小
+    uint64_t finish() {
+        for (size_t f = 0; f < kSegmentFieldCount; ++f) {
+            alignTo(64);
+            header.fields[f].termOffset = offset();
+            header.fields[f].termCount = terms[f].size();
+            append(terms[f].data(), terms[f].size() * sizeof(SegmentTerm));
+        }
+        for (size_t f = 0; f < kSegmentFieldCount; ++f) {
+            header.fields[f].poolOffset = offset();
+            header.fields[f].poolSize = pools[f].size();
+            append(pools[f].data(), pools[f].size());
+        }
+        alignTo(64);
+        header.fileSize = offset();
+        flush();
+        
+        if (pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) || fsync(fd) != 0) {
+            throw runtime_error("写段文件失败: " + path + ": " + strerror(errno));
+        }
+        close(fd);
+        fd = -1;
+        return header.fileSize;
+    }
+    
+private:
+    string path;
+    int fd = -1;
+    SegmentHeader header;
+    string buffer;               // 尚未写出的尾部
+    uint64_t flushedBytes = 0;
+    vector<SegmentTerm> terms[kSegmentFieldCount];
+    string pools[kSegmentFieldCount];
+    vector<SegmentSkipEntry> skips;
+    vector<uint32_t> words;
+    
+    uint64_t offset() const { return flushedBytes + buffer.size(); }
+    
+    void append(const void* data, size_t length) {
+        buffer.append(static_cast<const char*>(data), length);
+        if (buffer.size() >= (4 << 20)) flush();
+    }
+    
+    void alignTo(size_t alignment) {
+        size_t padding = (alignment - offset() % alignment) % alignment;
+        buffer.append(padding, '\0');
+    }
+    
+    void flush() {
+        const char* data = buffer.data();
+        size_t remaining = buffer.size();
+        while (remaining > 0) {
+            ssize_t n = write(fd, data, remaining);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw runtime_error("写段文件失败: " + path + ": " + strerror(errno));
+            }
+            data += n;
+            remaining -= n;
+        }
+        flushedBytes += buffer.size();
+        buffer.clear();
+    }
+    
+    void addTerm(SegmentField field, uint64_t key, const vector<int>& fileIds) {
+        if (fileIds.empty()) return;
+        skips.clear();
+        words.clear();
+        for (size_t begin = 0; begin < fileIds.size(); begin += kSegmentBlockSize) {
+            size_t count = min(kSegmentBlockSize, fileIds.size() - begin);
+            skips.emplace_back();
+            encodeSegmentBlock(fileIds.data() + begin, count, skips.back(), words);
+        }
+        
+        alignTo(skips.size() > 1 ? 64 : sizeof(SegmentSkipEntry));
+        terms[(size_t)field].push_back({key, offset(), (uint32_t)fileIds.size(), (uint32_t)skips.size()});
+        append(skips.data(), skips.size() * sizeof(SegmentSkipEntry));
+        append(words.data(), words.size() * sizeof(uint32_t));
+        header.totalPostings += fileIds.size();
+    }
+};
+
+// 只读内存映射文件
+class MappedFile {
+public:
+    // advice 为 madvise 的访问模式：整体顺序读取用 MADV_SEQUENTIAL，随机查找用 MADV_RANDOM
+    explicit MappedFile(const string& path, int advice = MADV_SEQUENTIAL) {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw runtime_error("无法打开文件: " + path + ": " + strerror(errno));
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            throw runtime_error("无法读取文件信息: " + path);
+        }
+        length = (size_t)st.st_size;
+        if (length > 0) {
+            void* ptr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr == MAP_FAILED) {
+                close(fd);
+                throw runtime_error("mmap 失败: " + path + ": " + strerror(errno));
+            }
+            base = static_cast<const char*>(ptr);
+            madvise(ptr, length, advice);
+        }
+    }
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    ~MappedFile() {
+        if (base) munmap(const_cast<char*>(base), length);
+        close(fd);
+    }
+    
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+    
+private:
+    int fd = -1;
+    const char* base = nullptr;
+    size_t length = 0;
+};
+
+// 倒排链视图：直接指向段文件的映射内存，不做拷贝
+struct PostingListView {
+    const SegmentSkipEntry* skips = nullptr;
+    const uint32_t* words = nullptr;
+    uint32_t count = 0;
+    uint32_t blockCount = 0;
+    
+    bool empty() const { return count == 0; }
+};
+
+// 倒排链游标：一次只解码一块到栈上的缓冲区；seek 先在跳表上二分，
+// 跳过的块既不解码也不触碰其数据页
+class PostingCursor {
+public:
+    explicit PostingCursor(const PostingListView& list) : list(list) {
+        loadBlock(0);
+    }
+    
+    bool valid() const { return block < list.blockCount; }
+    int value() const { return buffer[position]; }
+    
+    void next() {
+        if (++position == length) loadBlock(block + 1);
+    }
+    
+    // 前进到第一个 >= target 的位置（不会后退）
+    void seek(int target) {
+        if (!valid() || value() >= target) return;
+        if ((int)list.skips[block].lastId < target) {
+            auto it = partition_point(list.skips + block + 1, list.skips + list.blockCount,
+                                      [&](const SegmentSkipEntry& skip) { return (int)skip.lastId < target; });
+            loadBlock(it - list.skips);
+            if (!valid()) return;
+        }
+        position = lower_bound(buffer + position, buffer + length, target) - buffer;
+    }
+    
+private:
+    PostingListView list;
+    size_t block = 0;
+    size_t position = 0;
+    size_t length = 0;
+    int buffer[kSegmentBlockSize];
+    
+    void loadBlock(size_t b) {
+        block = b;
+        position = 0;
+        length = b < list.blockCount ? decodeSegmentBlock(list.skips[b], list.words, buffer) : 0;
+    }
+};
+
+// 只读映射的倒排段。查询和求交直接在映射内存上解码，不把倒排链读进堆内存；
+// 页面在第一次访问时才由内核装入，页缓存就是缓冲池，因此段可以大于物理内存。
+// 检查点把内置属性的倒排写成段，恢复时映射为 InvertedIndex 的底段（见 InvertedIndex::attachBase）。
+class MappedSegment {
+public:
+    explicit MappedSegment(const string& path) : file(path, MADV_RANDOM) {
+        if (file.size() < sizeof(SegmentHeader)) {
+            throw runtime_error("段文件过小: " + path);
+        }
+        header = reinterpret_cast<const SegmentHeader*>(file.data());
+        if (memcmp(header->magic, kSegmentMagic, sizeof(kSegmentMagic)) != 0 ||
+            header->version != kSegmentVersion || header->fieldCount != kSegmentFieldCount ||
+            header->fileSize != file.size()) {
+            throw runtime_error("段文件格式不正确: " + path);
+        }
+        for (const auto& field : header->fields) {
+            if (field.termOffset + field.termCount * sizeof(SegmentTerm) > file.size() ||
+                field.poolOffset + field.poolSize > file.size()) {
+                throw runtime_error("段文件已损坏: " + path);
+            }
+        }
+    }
+    
+    // 字符串字段（扩展名、所有者、创建时间）的精确查找
+    PostingListView find(SegmentField field, const string& key) const {
+        const auto& info = header->fields[(size_t)field];
+        const SegmentTerm* begin = terms(field);
+        const SegmentTerm* end = begin + info.termCount;
+        auto it = lower_bound(begin, end, key, [&](const SegmentTerm& term, const string& k) {
+            return compareKey(info, term, k) < 0;
+        });
+        if (it == end || compareKey(info, *it, key) != 0) return {};
+        return view(*it);
+    }
+    
+    // 数值字段（大小、属组、修改时间的桶下界）的精确查找
+    PostingListView find(SegmentField field, long long key) const {
+        auto range = numericRange(field, key, key);
+        return range.first == range.second ? PostingListView{} : view(*range.first);
+    }
+    
+    // 数值字段中键在 [low, high] 内的所有倒排链，按键升序
+    vector<PostingListView> findRange(SegmentField field, long long low, long long high) const {
+        vector<PostingListView> lists;
+        auto range = numericRange(field, low, high);
+        for (auto it = range.first; it != range.second; ++it) lists.push_back(view(*it));
+        return lists;
+    }
+    
+    // 大小在 [minSize, maxSize] 内的所有倒排链
+    vector<PostingListView> findSizeRange(long long minSize, long long maxSize) const {
+        return findRange(SegmentField::Size, minSize, maxSize);
+    }
+    
+    // 按键序取 [low, high] 内紧接 after 之后（descending 时为之前）的一项，after 为空时从一端开始；没有时返回空
+    optional<pair<long long, PostingListView>> nextTerm(SegmentField field, long long low, long long high,
+                                                        bool descending, const optional<long long>& after) const {
+        auto range = numericRange(field, low, high);
+        const SegmentTerm* it;
+        if (!descending) {
+            it = after ? partition_point(range.first, range.second,
+                                         [&](const SegmentTerm& term) { return (long long)term.key <= *after; })
+                       : range.first;
+            if (it == range.second) return nullopt;
+        } else {
+            it = after ? partition_point(range.first, range.second,
+                                         [&](const SegmentTerm& term) { return (long long)term.key < *after; })
+                       : range.second;
+            if (it == range.first) return nullopt;
+            --it;
+        }
+        return make_pair((long long)it->key, view(*it));
+    }
+    
+    // 按键升序遍历字段的全部词项，fn(键, 倒排)；Key 为 string 时取字符串键，否则取数值键
+    template <typename Key, typename Fn>
+    void forEachTerm(SegmentField field, Fn&& fn) const {
+        const auto& info = header->fields[(size_t)field];
+        const SegmentTerm* begin = terms(field);
+        for (const SegmentTerm* it = begin; it != begin + info.termCount; ++it) {
+            if constexpr (is_same<Key, string>::value) {
+                fn(string(file.data() + info.poolOffset + (uint32_t)(it->key >> 32), (uint32_t)it->key), view(*it));
+            } else {
+                fn((Key)(long long)it->key, view(*it));
+            }
+        }
+    }
+    
+    vector<int> queryByExtension(const string& ext) const {
+        return decode(find(SegmentField::Extension, ext));
+    }
+    
+    vector<int> queryByOwner(const string& owner) const {
+        return decode(find(SegmentField::Owner, owner));
+    }
+    
+    vector<int> queryByTime(const string& time) const {
+        return decode(find(SegmentField::CreateTime, time));
+    }
+    
+    vector<int> queryBySizeRange(long long minSize, long long maxSize) const {
+        vector<int> result;
+        for (const auto& list : findSizeRange(minSize, maxSize)) {
+            decodeInto(list, result);
+        }
+        sort(result.begin(), result.end());
+        result.erase(unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+    
+    static vector<int> decode(const PostingListView& list) {
+        vector<int> result;
+        decodeInto(list, result);
+        return result;
+    }
+    
+    static void decodeInto(const PostingListView& list, vector<int>& out) {
+        size_t start = out.size();
+        out.resize(start + list.count);
+        int* cursor = out.data() + start;
+        for (uint32_t b = 0; b < list.blockCount; ++b) {
+            cursor += decodeSegmentBlock(list.skips[b], list.words, cursor);
+        }
+    }
+    
+    // 多条倒排链求交：从最短的链出发，其余链用游标 seek（跳表上跳过不可能命中的块）
+    static vector<int> intersect(vector<PostingListView> lists) {
+        vector<int> result;
+        if (lists.empty()) return result;
+        sort(lists.begin(), lists.end(), [](const PostingListView& a, const PostingListView& b) {
+            return a.count < b.count;
+        });
+        if (lists.front().empty()) return result;
+        
+        vector<PostingCursor> cursors(lists.begin(), lists.end());
+        auto& lead = cursors.front();
+        while (lead.valid()) {
+            int candidate = lead.value();
+            bool matched = true;
+            for (size_t i = 1; i < cursors.size(); ++i) {
+                cursors[i].seek(candidate);
+                if (!cursors[i].valid()) return result;
+                if (cursors[i].value() != candidate) {
+                    lead.seek(cursors[i].value());
+                    matched = false;
+                    break;
+                }
+            }
+            if (matched) {
+                result.push_back(candidate);
+                lead.next();
+            }
+        }
+        return result;
+    }
+    
+    size_t termCount(SegmentField field) const {
+        return header->fields[(size_t)field].termCount;
+    }
+    
+    uint64_t totalPostings() const { return header->totalPostings; }
+    size_t size() const { return file.size(); }
+    
+    // 当前在页缓存中的字节数（mincore），用于观察按需装入
+    size_t residentBytes() const {
+        size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+        size_t pages = (file.size() + pageSize - 1) / pageSize;
+#ifdef __linux__
+        vector<unsigned char> residency(pages);
+#else
+        vector<char> residency(pages);
+#endif
+        if (mincore(const_cast<char*>(file.data()), file.size(), residency.data()) != 0) return 0;
+        size_t resident = 0;
+        for (auto page : residency) resident += page & 1;
+        return resident * pageSize;
+    }
+    
+private:
+    MappedFile file;
+    const SegmentHeader* header = nullptr;
+    
+    const SegmentTerm* terms(SegmentField field) const {
+        return reinterpret_cast<const SegmentTerm*>(file.data() + header->fields[(size_t)field].termOffset);
+    }
+    
+    // 数值字段中键在 [low, high] 内的词项区间（键按有符号值升序）
+    pair<const SegmentTerm*, const SegmentTerm*> numericRange(SegmentField field, long long low,
+                                                               long long high) const {
+        const SegmentTerm* begin = terms(field);
+        const SegmentTerm* end = begin + header->fields[(size_t)field].termCount;
+        auto first = partition_point(begin, end, [&](const SegmentTerm& term) { return (long long)term.key < low; });
+        auto last = partition_point(first, end, [&](const SegmentTerm& term) { return (long long)term.key <= high; });
+        return {first, last};
+    }
+    
+    int compareKey(const SegmentFieldInfo& info, const SegmentTerm& term, const string& key) const {
+        uint32_t offset = (uint32_t)(term.key >> 32);
+        uint32_t length = (uint32_t)term.key;
+        const char* text = file.data() + info.poolOffset + offset;
+        int order = memcmp(text, key.data(), min<size_t>(length, key.size()));
+        if (order != 0) return order;
+        return length < key.size() ? -1 : (length > key.size() ? 1 : 0);
+    }
+    
+    PostingListView view(const SegmentTerm& term) const {
+        if (term.listOffset + (uint64_t)term.blockCount * sizeof(SegmentSkipEntry) > file.size()) {
+            throw runtime_error("段文件已损坏: 倒排链越界");
+        }
+        PostingListView list;
+        list.skips = reinterpret_cast<const SegmentSkipEntry*>(file.data() + term.listOffset);
+        list.words = reinterpret_cast<const uint32_t*>(list.skips + term.blockCount);
+        list.count = term.count;
+        list.blockCount = term.blockCount;
+        return list;
+    }
+};
+
+struct SpillStats {
+    size_t budgetBytes = 0;         // 总预算
+    size_t fixedBytes = 0;          // 其中不可换出的部分，超过 budgetBytes 时预算无法满足
+    size_t residentBytes = 0;       // 驻留的倒排链
+    size_t residentLists = 0;
+    size_t spilledLists = 0;
+    uint64_t hits = 0;
+    uint64_t faults = 0;
+    uint64_t scanReads = 0;         // 范围扫描直接从磁盘读取、不装回内存的链数
+    uint64_t evictions = 0;
+    uint64_t spillWrites = 0;       // 实际写盘的次数（磁盘副本仍有效的链换出时不必重写）
+    uint64_t spillFileBytes = 0;
+    uint64_t liveSpillBytes = 0;
+    double meanFaultMicros = 0;
+    double maxFaultMicros = 0;
+    
+    double hitRate() const {
+        uint64_t total = hits + faults;
+        return total ? (double)hits / total : 1.0;
+    }
+};
+
+// 倒排链的溢出存储：超出内存预算时把冷的倒排链换出到溢出文件，访问时再装回。
+// 换出的链用段文件的块格式压缩（跳表 + 位打包差值）追加写入，链被修改后旧副本成为垃圾，
+// 垃圾超过有效数据时由索引触发整体压缩。冷热判断用 CLOCK：读路径只置引用位，
+// 换出时指针扫过驻留链，引用位已置的清零跳过，未置的换出。
+// 装入、换出和压缩都在索引写锁下进行；读锁下只会置引用位、更新计数、直接读取已溢出的链。
+// 这里的预算只是倒排链的额度，由 InvertedIndex 从总预算中扣除不可换出的部分后设置
+class PostingSpillStore {
+public:
+    PostingSpillStore(const string& path, size_t budgetBytes) : path(path), budget(budgetBytes) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            throw runtime_error("无法创建溢出文件: " + path + ": " + strerror(errno));
+        }
+    }
+    
+    PostingSpillStore(const PostingSpillStore&) = delete;
+    PostingSpillStore& operator=(const PostingSpillStore&) = delete;
+    
+    // 溢出文件只是换出内存的暂存，随索引一起删除
+    ~PostingSpillStore() {
+        if (fd >= 0) close(fd);
+        unlink(path.c_str());
+    }
+    
+    size_t getBudget() const { return budget; }
+    void setBudget(size_t bytes) { budget = bytes; }
+    
+    // 驻留链纳入 CLOCK 并计入预算（已跟踪的不重复加入）
+    void track(CompressedInvertedList& list) {
+        if (!list.resident || list.clockSlot != CompressedInvertedList::kUntracked) return;
+        list.clockSlot = (uint32_t)ring.size();
+        ring.push_back(&list);
+        residentLists++;
+        charge(list);
+    }
+    
+    // 修改链之前调用：已溢出的先装回
+    void prepareForUpdate(CompressedInvertedList& list) {
+        if (list.resident) {
+            track(list);
+        } else {
+            fault(list);
+        }
+    }
+    
+    // 修改链之后调用：重新计入占用，磁盘副本作废
+    void updated(CompressedInvertedList& list) {
+        charge(list);
+        discardSpillCopy(list);
+    }
+    
+    // 链即将从索引中删除
+    void release(CompressedInvertedList& list) {
+        discardSpillCopy(list);
+        if (!list.resident) {
+            spilledLists--;
+        } else if (list.clockSlot != CompressedInvertedList::kUntracked) {
+            untrack(list);
+        }
+    }
+    
+    // 读路径命中驻留链
+    void touch(const CompressedInvertedList& list) {
+        list.referenced.store(true, memory_order_relaxed);
+        hits.fetch_add(1, memory_order_relaxed);
+    }
+    
+    // 把已溢出的链装回内存
+    void fault(CompressedInvertedList& list) {
+        auto start = steady_clock::now();
+        auto ids = decodeSpilled(list);
+        list.sortedFileIds.assign(ids.begin(), ids.end());
+        list.resident = true;
+        spilledLists--;
+        track(list);
+        list.referenced.store(true, memory_order_relaxed);
+        recordFault(start);
+    }
+    
+    // 不装入内存，直接读出已溢出链的内容。范围扫描用它避免一次扫描冲掉全部热链；
+    // 写段文件等内部读取不计入统计
+    vector<int> read(const CompressedInvertedList& list, bool countAsScan = true) {
+        if (countAsScan) scanReads.fetch_add(1, memory_order_relaxed);
+        return decodeSpilled(list);
+    }
+    
+    // 超出预算时按 CLOCK 换出，直到回到预算以内
+    void enforce() {
+        while (residentBytes > budget && residentLists > 0) {
+            if (hand >= ring.size()) hand = 0;
+            CompressedInvertedList* list = ring[hand++];
+            if (!list || list->referenced.exchange(false, memory_order_relaxed)) continue;
+            evict(*list);
+        }
+        if (tombstones > 1024 && tombstones * 2 > ring.size()) {
+            compactRing();
+        }
+    }
+    
+    bool needsCompaction() const {
+        return fileBytes > (64u << 20) && fileBytes > 2 * liveBytes;
+    }
+    
+    // 只保留仍处于溢出状态的链，顺序复制到新文件后原子替换；驻留链的旧副本直接丢弃
+    void compact(const vector<CompressedInvertedList*>& lists) {
+        string tempPath = path + ".tmp";
+        int newFd = ::open(tempPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (newFd < 0) {
+            throw runtime_error("无法创建溢出文件: " + tempPath + ": " + strerror(errno));
+        }
+        uint64_t newBytes = 0;
+        vector<char> buffer;
+        for (auto* list : lists) {
+            if (list->spillBytes == 0) continue;
+            if (list->resident) {
+                discardSpillCopy(*list);
+                continue;
+            }
+            buffer.resize(list->spillBytes);
+            readFully(fd, buffer.data(), buffer.size(), list->spillOffset);
+            writeFully(newFd, buffer.data(), buffer.size(), newBytes);
+            list->spillOffset = newBytes;
+            newBytes += buffer.size();
+        }
+        if (rename(tempPath.c_str(), path.c_str()) != 0) {
+            close(newFd);
+            throw runtime_error("替换溢出文件失败: " + path + ": " + strerror(errno));
+        }
+        close(fd);
+        fd = newFd;
+        fileBytes = liveBytes = newBytes;
+    }
+    
+    // 索引被清空时调用：所有链都已不存在
+    void reset() {
+        ring.clear();
+        hand = 0;
+        tombstones = 0;
+        residentBytes = 0;
+        residentLists = 0;
+        spilledLists = 0;
+        fileBytes = liveBytes = 0;
+        if (ftruncate(fd, 0) != 0) {
+            throw runtime_error("清空溢出文件失败: " + path + ": " + strerror(errno));
+        }
+    }
+    
+    SpillStats stats() const {
+        SpillStats result;
+        result.budgetBytes = budget;
+        result.residentBytes = residentBytes;
+        result.residentLists = residentLists;
+        result.spilledLists = spilledLists;
+        result.hits = hits.load(memory_order_relaxed);
+        result.faults = faults.load(memory_order_relaxed);
+        result.scanReads = scanReads.load(memory_order_relaxed);
+        result.evictions = evictions;
+        result.spillWrites = spillWrites;
+        result.spillFileBytes = fileBytes;
+        result.liveSpillBytes = liveBytes;
+        if (result.faults > 0) {
+            result.meanFaultMicros = faultNanos.load(memory_order_relaxed) / 1000.0 / result.faults;
+        }
+        result.maxFaultMicros = maxFaultNanos.load(memory_order_relaxed) / 1000.0;
+        return result;
+    }
+    
+private:
+    string path;
+    int fd = -1;
+    size_t budget;
+    size_t residentBytes = 0;
+    size_t residentLists = 0;
+    size_t spilledLists = 0;
+    vector<CompressedInvertedList*> ring;   // 驻留链；换出或删除后留空位，空位过多时压实
+    size_t hand = 0;
+    size_t tombstones = 0;
+    uint64_t fileBytes = 0;
+    uint64_t liveBytes = 0;
+    uint64_t evictions = 0;
+    uint64_t spillWrites = 0;
+    atomic<uint64_t> hits{0};
+    atomic<uint64_t> faults{0};
+    atomic<uint64_t> scanReads{0};
+    atomic<uint64_t> faultNanos{0};
+    atomic<uint64_t> maxFaultNanos{0};
+    vector<SegmentSkipEntry> skips;
+    vector<uint32_t> words;
+    
+    // 按 malloc 块的真实大小计，与记账分配器的口径一致：短链的块开销远大于其内容
+    void charge(CompressedInvertedList& list) {
+        auto& ids = list.sortedFileIds;
+        size_t bytes = ids.capacity() ? allocatedBytes(ids.data(), ids.capacity() * sizeof(int)) : 0;
+        residentBytes = residentBytes - list.chargedBytes + bytes;
+        list.chargedBytes = bytes;
+    }
+    
+    void untrack(CompressedInvertedList& list) {
+        ring[list.clockSlot] = nullptr;
+        list.clockSlot = CompressedInvertedList::kUntracked;
+        tombstones++;
+        residentLists--;
+        residentBytes -= list.chargedBytes;
+        list.chargedBytes = 0;
+    }
+    
+    void discardSpillCopy(CompressedInvertedList& list) {
+        liveBytes -= list.spillBytes;
+        list.spillBytes = 0;
+    }
+    
+    void evict(CompressedInvertedList& list) {
+        if (list.spillBytes == 0) {
+            writeSpill(list);
+        }
+        untrack(list);
+        list.sortedFileIds.clear();
+        list.sortedFileIds.shrink_to_fit();
+        list.resident = false;
+        spilledLists++;
+        evictions++;
+    }
+    
+    void writeSpill(CompressedInvertedList& list) {
+        const auto& ids = list.sortedFileIds;
+        skips.clear();
+        words.clear();
+        for (size_t begin = 0; begin < ids.size(); begin += kSegmentBlockSize) {
+            skips.emplace_back();
+            encodeSegmentBlock(ids.data() + begin, min(kSegmentBlockSize, ids.size() - begin), skips.back(), words);
+        }
+        size_t skipBytes = skips.size() * sizeof(SegmentSkipEntry);
+        size_t wordBytes = words.size() * sizeof(uint32_t);
+        writeFully(fd, skips.data(), skipBytes, fileBytes);
+        writeFully(fd, words.data(), wordBytes, fileBytes + skipBytes);
+        
+        list.spillOffset = fileBytes;
+        list.spillBytes = (uint32_t)(skipBytes + wordBytes);
+        list.spilledCount = (uint32_t)ids.size();
+        list.spilledBlocks = (uint32_t)skips.size();
+        fileBytes += list.spillBytes;
+        liveBytes += list.spillBytes;
+        spillWrites++;
+    }
+    
+    vector<int> decodeSpilled(const CompressedInvertedList& list) const {
+        vector<int> ids(list.spilledCount);
+        if (list.spilledCount == 0) return ids;
+        vector<uint32_t> buffer((list.spillBytes + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+        readFully(fd, buffer.data(), list.spillBytes, list.spillOffset);
+        auto* blockSkips = reinterpret_cast<const SegmentSkipEntry*>(buffer.data());
+        auto* blockWords = reinterpret_cast<const uint32_t*>(blockSkips + list.spilledBlocks);
+        int* out = ids.data();
+        for (uint32_t b = 0; b < list.spilledBlocks; ++b) {
+            out += decodeSegmentBlock(blockSkips[b], blockWords, out);
+        }
+        return ids;
+    }
+    
+    void recordFault(steady_clock::time_point start) {
+        uint64_t nanos = (uint64_t)duration_cast<nanoseconds>(steady_clock::now() - start).count();
+        faults.fetch_add(1, memory_order_relaxed);
+        faultNanos.fetch_add(nanos, memory_order_relaxed);
+        uint64_t previous = maxFaultNanos.load(memory_order_relaxed);
+        while (nanos > previous && !maxFaultNanos.compare_exchange_weak(previous, nanos, memory_order_relaxed)) {
+        }
+    }
+    
+    void compactRing() {
+        size_t live = 0;
+        for (auto* list : ring) {
+            if (!list) continue;
+            list->clockSlot = (uint32_t)live;
+            ring[live++] = list;
+        }
+        ring.resize(live);
+        hand = 0;
+        tombstones = 0;
+    }
+    
+    void readFully(int file, void* data, size_t length, uint64_t offset) const {
+        char* cursor = static_cast<char*>(data);
+        while (length > 0) {
+            ssize_t n = pread(file, cursor, length, (off_t)offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                throw runtime_error("读取溢出文件失败: " + path + ": " + (n < 0 ? strerror(errno) : "文件过短"));
+            }
+            cursor += n;
+            length -= n;
+            offset += n;
+        }
+    }
+    
+    void writeFully(int file, const void* data, size_t length, uint64_t offset) const {
+        const char* cursor = static_cast<const char*>(data);
+        while (length > 0) {
+            ssize_t n = pwrite(file, cursor, length, (off_t)offset);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                throw runtime_error("写入溢出文件失败: " + path + ": " + strerror(errno));
+            }
+            cursor += n;
+            length -= n;
+            offset += n;
+        }
+    }
+};
+
+// ORDER BY 的排序键。大小和修改时间有有序索引，可以沿索引从一端取前 K 个；创建日期只能取出结果后排序
+enum class OrderKey { Size, ModifyTime, CreateTime };
+const char* const kOrderKeyNames[] = {"size", "modify_time", "create_time"};
+
+struct QueryOrder {
+    OrderKey key = OrderKey::Size;
+    bool descending = true;
+};
+
+// 文件在排序键上的值；创建日期按 SubtreeSummary::dateKey 解析，无法解析的排在最前（升序时）
+inline long long orderValue(const FileMetadata& file, OrderKey key) {
+    switch (key) {
+        case OrderKey::Size: return file.fileSize;
+        case OrderKey::ModifyTime: return file.modifyTime;
+        case OrderKey::CreateTime: return SubtreeSummary::dateKey(file.createTime);
+    }
+    return 0;
+}
+
+// 多条件查询：已设置的条件取交集。扩展名、属主、创建日期和属组按等值匹配，大小按闭区间，
+// 每个标签条件要求文件带有该键值（多值标签中有一个即可）；给定 caller 时只返回其可读的文件
+struct FileQuery {
+    optional<string> extension;
+    optional<string> owner;
+    optional<string> createTime;
+    optional<pair<long long, long long>> sizeRange;
+    optional<pair<long long, long long>> modifyTimeRange;   // Unix 秒，两端都包含
+    optional<uint32_t> gid;
+    vector<FileTag> tags;
+    optional<Principal> caller;
+    optional<QueryOrder> orderBy;   // 结果的顺序，键相同时按 fileId 升序；不给时顺序不定
+    size_t limit = 0;               // 最多返回的行数，0 表示不限
+    
+    // 是否没有任何条件（排序和行数限制不算条件）
+    bool empty() const {
+        return !extension && !owner && !createTime && !sizeRange && !modifyTimeRange && !gid && tags.empty() &&
+               !caller;
+    }
+    
+    // 逐文件比较（扫描路径用），语义与索引查询相同：大小区间两端都包含
+    bool matches(const FileMetadata& file) const {
+        if ((extension && file.extension != *extension) || (owner && file.owner != *owner) ||
+            (createTime && file.createTime != *createTime) ||
+            (sizeRange && (file.fileSize < sizeRange->first || file.fileSize > sizeRange->second)) ||
+            (modifyTimeRange &&
+             (file.modifyTime < modifyTimeRange->first || file.modifyTime > modifyTimeRange->second)) ||
+            (gid && file.gid != *gid) || (caller && !canRead(*caller, file))) {
+            return false;
+        }
+        for (const auto& tag : tags) {
+            if (!binary_search(file.tags.begin(), file.tags.end(), tag)) return false;
+        }
+        return true;
+    }
+    
+    // 并入另一个查询的条件（AND）。同一属性的等值条件不同、或区间交为空时返回 false，表示不会有结果；
+    // 两个调用者不同时只保留原来的，结果只会变宽
+    bool conjoin(const FileQuery& other) {
+        bool satisfiable = true;
+        auto equal = [&](auto& mine, const auto& theirs) {
+            if (!theirs) return;
+            if (mine && *mine != *theirs) satisfiable = false;
+            mine = theirs;
+        };
+        auto range = [&](auto& mine, const auto& theirs) {
+            if (theirs) {
+                mine = mine ? make_pair(max(mine->first, theirs->first), min(mine->second, theirs->second)) : *theirs;
+            }
+            if (mine && mine->first > mine->second) satisfiable = false;
+        };
+        equal(extension, other.extension);
+        equal(owner, other.owner);
+        equal(createTime, other.createTime);
+        equal(gid, other.gid);
+        range(sizeRange, other.sizeRange);
+        range(modifyTimeRange, other.modifyTimeRange);
+        tags.insert(tags.end(), other.tags.begin(), other.tags.end());
+        if (!caller) caller = other.caller;
+        return satisfiable;
+    }
+    
+    // 拆成各含一个条件的查询，顺序同 describe
+    vector<FileQuery> conditions() const {
+        vector<FileQuery> result;
+        auto single = [&](auto set) {
+            result.emplace_back();
+            set(result.back());
+        };
+        if (extension) single([&](FileQuery& query) { query.extension = extension; });
+        if (owner) single([&](FileQuery& query) { query.owner = owner; });
+        if (createTime) single([&](FileQuery& query) { query.createTime = createTime; });
+        if (sizeRange) single([&](FileQuery& query) { query.sizeRange = sizeRange; });
+        if (modifyTimeRange) single([&](FileQuery& query) { query.modifyTimeRange = modifyTimeRange; });
+        if (gid) single([&](FileQuery& query) { query.gid = gid; });
+        for (const auto& tag : tags) single([&](FileQuery& query) { query.tags.push_back(tag); });
+        if (caller) single([&](FileQuery& query) { query.caller = caller; });
+        return result;
+    }
+    
+    // 形如 extension = ".jpg" AND size BETWEEN 0 AND 4096 ORDER BY size DESC LIMIT 10，用于剖析输出和日志
+    string describe() const {
+        vector<string> terms;
+        if (extension) terms.push_back("extension = \"" + *extension + "\"");
+        if (owner) terms.push_back("owner = \"" + *owner + "\"");
+        if (createTime) terms.push_back("create_time = \"" + *createTime + "\"");
+        if (sizeRange) {
+            terms.push_back("size BETWEEN " + to_string(sizeRange->first) + " AND " + to_string(sizeRange->second));
+        }
+        if (modifyTimeRange) {
+            terms.push_back("modify_time BETWEEN " + to_string(modifyTimeRange->first) + " AND " +
+                            to_string(modifyTimeRange->second));
+        }
+        if (gid) terms.push_back("gid = " + to_string(*gid));
+        for (const auto& tag : tags) terms.push_back("tag." + tag.key + " = \"" + tag.value + "\"");
+        if (caller) {
+            string groups;
+            for (uint32_t group : caller->gids) groups += (groups.empty() ? "" : ",") + to_string(group);
+            terms.push_back("readable_by(uid=" + to_string(caller->uid) + ", gids=" + groups + ")");
+        }
+        string text = terms.empty() ? "TRUE" : terms[0];
+        for (size_t i = 1; i < terms.size(); ++i) text += " AND " + terms[i];
+        if (orderBy) {
+            text += string(" ORDER BY ") + kOrderKeyNames[(size_t)orderBy->key] +
+                    (orderBy->descending ? " DESC" : " ASC");
+        }
+        if (limit) text += " LIMIT " + to_string(limit);
+        return text;
+    }
+};
+
+// 基数估计用的谓词表达式：叶子是一个 FileQuery（其中的条件为 AND，没有条件即 TRUE，不看排序和行数限制），
+// 内部节点对子表达式做 AND / OR
+struct PredicateExpr {
+    enum class Kind : uint8_t { Leaf, And, Or };
+    Kind kind = Kind::Leaf;
+    FileQuery leaf;
+    vector<PredicateExpr> children;
+    
+    static PredicateExpr of(FileQuery query) {
+        PredicateExpr expr;
+        expr.leaf = move(query);
+        return expr;
+    }
+    
+    static PredicateExpr allOf(vector<PredicateExpr> children) {
+        PredicateExpr expr;
+        expr.kind = Kind::And;
+        expr.children = move(children);
+        return expr;
+    }
+    
+    static PredicateExpr anyOf(vector<PredicateExpr> children) {
+        PredicateExpr expr;
+        expr.kind = Kind::Or;
+        expr.children = move(children);
+        return expr;
+    }
+    
+    bool matches(const FileMetadata& file) const {
+        switch (kind) {
+            case Kind::Leaf: return leaf.matches(file);
+            case Kind::And:
+                return all_of(children.begin(), children.end(),
+                              [&](const PredicateExpr& c) { return c.matches(file); });
+            case Kind::Or:
+                return any_of(children.begin(), children.end(),
+                              [&](const PredicateExpr& c) { return c.matches(file); });
+        }
+        return false;
+    }
+    
+    // 是否可能有结果：沿 AND 把叶子的条件并入 context，检查同一属性的等值冲突和空区间。
+    // 只看条件本身，不看数据；返回 true 不保证有结果
+    bool satisfiable(FileQuery context = FileQuery()) const {
+        switch (kind) {
+            case Kind::Leaf: return context.conjoin(leaf);
+            case Kind::And:
+                for (const auto& child : children) {
+                    if (child.kind == Kind::Leaf && !context.conjoin(child.leaf)) return false;
+                }
+                return all_of(children.begin(), children.end(), [&](const PredicateExpr& c) {
+                    return c.kind == Kind::Leaf || c.satisfiable(context);
+                });
+            case Kind::Or:
+                return any_of(children.begin(), children.end(), [&](const PredicateExpr& c) {
+                    return c.satisfiable(context);
+                });
+        }
+        return true;
+    }
+    
+    string describe() const {
+        if (kind == Kind::Leaf) {
+            FileQuery conditions = leaf;
+            conditions.orderBy.reset();
+            conditions.limit = 0;
+            return conditions.describe();
+        }
+        if (children.empty()) return kind == Kind::And ? "TRUE" : "FALSE";
+        string text = "(" + children[0].describe();
+        for (size_t i = 1; i < children.size(); ++i) {
+            text += (kind == Kind::And ? " AND " : " OR ") + children[i].describe();
+        }
+        return text + ")";
+    }
+};
+
+// 基数估计的结果，见 InvertedIndex::estimateRows
+struct CardinalityEstimate {
+    double rows = 0;
+    size_t sampleRows = 0;    // 样本行数
+    size_t sampleHits = 0;    // 其中满足表达式的（直接取倒排长度时为 0）
+    bool exact = false;       // 由单条倒排的长度得出，或样本就是全部文件
+};
+
+// 查询执行的阶段，见 QueryProfile
+enum class QueryStage {
+    IndexLockWait, PostingFetch, SetOperations, AccessFilter, TreeLockWait, MetadataGather, ResultBuild, Sort
+};
+constexpr size_t kQueryStageCount = 8;
+const char* const kQueryStageNames[kQueryStageCount] = {
+    "index_lock_wait", "posting_fetch", "set_ops", "access_filter", "tree_lock_wait", "metadata_gather",
+    "result_build", "sort"};
+
+// 单次查询的执行剖析（类似 EXPLAIN ANALYZE）：每个阶段的耗时和进出的 fileId 数。
+// 只在调用方传入时收集，不传时查询路径上没有额外的计时
+struct QueryProfile {
+    struct Stage {
+        uint64_t ns = 0;
+        size_t idsIn = 0;
+        size_t idsOut = 0;
+    };
+    
+    string query;
+    array<Stage, kQueryStageCount> stages{};
+    size_t postingLists = 0;          // 读取的倒排链数
+    size_t spilledLists = 0;          // 其中不在内存、从溢出文件解码的
+    size_t rows = 0;
+    uint64_t totalNs = 0;
+    
+    Stage& operator[](QueryStage stage) {
+        return stages[(size_t)stage];
+    }
+    
+    const Stage& operator[](QueryStage stage) const {
+        return stages[(size_t)stage];
+    }
+    
+    void addTime(QueryStage stage, steady_clock::time_point start) {
+        stages[(size_t)stage].ns += (uint64_t)duration_cast<nanoseconds>(steady_clock::now() - start).count();
+    }
+    
+    // 不属于任何阶段的时间（阶段之间的调度、被抢占等）
+    uint64_t unaccountedNs() const {
+        uint64_t staged = 0;
+        for (const auto& stage : stages) staged += stage.ns;
+        return totalNs > staged ? totalNs - staged : 0;
+    }
+    
+    static bool isLockWait(size_t stage) {
+        return stage == (size_t)QueryStage::IndexLockWait || stage == (size_t)QueryStage::TreeLockWait;
+    }
+    
+    // 多行的可读格式
+    string format() const {
+        ostringstream out;
+        out << "EXPLAIN ANALYZE " << query << "\n" << fixed << setprecision(3)
+            << "  rows=" << rows << " total=" << totalNs / 1e6 << " ms lists=" << postingLists
+            << " spilled=" << spilledLists << "\n";
+        for (size_t i = 0; i < kQueryStageCount; ++i) {
+            out << "  " << left << setw(18) << kQueryStageNames[i] << right << setw(10) << stages[i].ns / 1e6 << " ms";
+            if (!isLockWait(i)) out << "  ids_in=" << stages[i].idsIn << " ids_out=" << stages[i].idsOut;
+            out << "\n";
+        }
+        out << "  " << left << setw(18) << "unaccounted" << right << setw(10) << unaccountedNs() / 1e6 << " ms\n";
+        return out.str();
+    }
+    
+    // 单行 key=value 格式，便于写日志
+    string formatLogLine() const {
+        ostringstream out;
+        out << "query=\"" << escapeQuotes(query) << "\" rows=" << rows << " total_ns=" << totalNs
+            << " lists=" << postingLists << " spilled=" << spilledLists;
+        for (size_t i = 0; i < kQueryStageCount; ++i) {
+            out << ' ' << kQueryStageNames[i] << "_ns=" << stages[i].ns;
+            if (!isLockWait(i)) {
+                out << ' ' << kQueryStageNames[i] << "_in=" << stages[i].idsIn << ' ' << kQueryStageNames[i]
+                    << "_out=" << stages[i].idsOut;
+            }
+        }
+        out << " unaccounted_ns=" << unaccountedNs();
+        return out.str();
+    }
+    
+private:
+    static string escapeQuotes(const string& text) {
+        string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\') escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+};
+
+// 加锁；给定剖析时把等锁时间记到 stage
+template <typename Lock, typename Mutex>
+Lock acquireProfiled(Mutex& mutex, QueryProfile* profile, QueryStage stage) {
+    if (!profile) return Lock(mutex);
+    auto start = steady_clock::now();
+    Lock lock(mutex);
+    profile->addTime(stage, start);
+    return lock;
+}
+
+// 单个属性索引的两个内存账户
+struct IndexAccounts {
+    MemoryAccount* dictionary = MemoryAccount::create();
+    MemoryAccount* postings = MemoryAccount::create();
+    
+    IndexMemory read() const {
+        return {dictionary->getBytes(), postings->getBytes()};
+    }
+};
+
+// 按 fileId 编址的位图倒排（BitmapPolicy 用）：增删 O(1)，占用与最大 fileId 成正比，
+// 只适合取值很少、每个值覆盖大量文件的属性。位图不参与内存预算下的换出
+class PostingBitmap {
+private:
+    vector<uint64_t, TrackingAllocator<uint64_t>> words;
+    size_t count = 0;
+    
+public:
+    explicit PostingBitmap(MemoryAccount* account = nullptr)
+        : words(TrackingAllocator<uint64_t>(account)) {}
+    
+    void addFileId(int fileId) {
+        size_t word = (size_t)fileId >> 6;
+        if (word >= words.size()) words.resize(word + 1);
+        uint64_t bit = 1ULL << (fileId & 63);
+        if (words[word] & bit) return;
+        words[word] |= bit;
+        count++;
+    }
+    
+    void removeFileId(int fileId) {
+        size_t word = (size_t)fileId >> 6;
+        uint64_t bit = 1ULL << (fileId & 63);
+        if (word >= words.size() || !(words[word] & bit)) return;
+        words[word] &= ~bit;
+        count--;
+    }
+    
+    bool contains(int fileId) const {
+        size_t word = (size_t)fileId >> 6;
+        return word < words.size() && (words[word] >> (fileId & 63) & 1);
+    }
+    
+    void appendSorted(const int* fileIds, size_t n) {
+        if (n == 0) return;
+        words.resize(max(words.size(), ((size_t)fileIds[n - 1] >> 6) + 1));
+        for (size_t i = 0; i < n; ++i) addFileId(fileIds[i]);
+    }
+    
+    // 按 fileId 升序追加到 out 末尾
+    void copyTo(vector<int>& out) const {
+        out.reserve(out.size() + count);
+        for (size_t w = 0; w < words.size(); ++w) {
+            for (uint64_t bits = words[w]; bits; bits &= bits - 1) {
+                out.push_back((int)(w << 6 | __builtin_ctzll(bits)));
+            }
+        }
+    }
+    
+    void clear() {
+        words.clear();
+        words.shrink_to_fit();
+        count = 0;
+    }
+    
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool isResident() const { return true; }
+};
+
+// 属性索引的策略：决定键表结构、倒排的形式和可用的查询算法，编译期选定，不经虚调用。
+//   HashEqualityPolicy          哈希键表，只做等值查找
+//   OrderedRangePolicy          有序键表，等值和区间查找
+//   BucketedNumericPolicy<W>    数值键按宽度 W 分桶的有序键表，键表小；结果是候选，两端的桶须由调用方复核
+//   BitmapPolicy                哈希键表 + 位图倒排，适合取值很少的属性
+// slot 把键映射到键表中的位置；exact 表示查找结果是否不需要复核
+struct HashEqualityPolicy {
+    template <typename Key, typename Posting>
+    using Map = TrackedHashMap<Key, Posting>;
+    using Posting = CompressedInvertedList;
+    static constexpr bool kOrdered = false;
+    static constexpr bool kRange = false;
+    static constexpr bool kExactEquality = true;
+    
+    template <typename Key>
+    static const Key& slot(const Key& key) { return key; }
+};
+
+struct OrderedRangePolicy {
+    template <typename Key, typename Posting>
+    using Map = TrackedOrderedMap<Key, Posting>;
+    using Posting = CompressedInvertedList;
+    static constexpr bool kOrdered = true;
+    static constexpr bool kRange = true;
+    static constexpr bool kExactEquality = true;
+    
+    template <typename Key>
+    static const Key& slot(const Key& key) { return key; }
+    
+    template <typename Key>
+    static bool exactRange(const Key&, const Key&) { return true; }
+};
+
+template <long long Width>
+struct BucketedNumericPolicy {
+    static_assert(Width > 0, "桶宽必须为正");
+    template <typename Key, typename Posting>
+    using Map = TrackedOrderedMap<Key, Posting>;
+    using Posting = CompressedInvertedList;
+    static constexpr bool kOrdered = true;
+    static constexpr bool kRange = true;
+    static constexpr bool kExactEquality = Width == 1;
+    
+    // 桶的下界（向负无穷取整）；最靠近下限的不完整桶以键类型的最小值为下界
+    template <typename Key>
+    static Key slot(Key key) {
+        Key offset = (Key)(((key % Width) + Width) % Width);
+        return key < numeric_limits<Key>::min() + offset ? numeric_limits<Key>::min() : key - offset;
+    }
+    
+    // 区间两端恰好落在桶边界上时整桶都在区间内
+    template <typename Key>
+    static bool exactRange(Key low, Key high) {
+        return slot(low) == low && (high == numeric_limits<Key>::max() || slot((Key)(high + 1)) == high + 1);
+    }
+};
+
+struct BitmapPolicy {
+    template <typename Key, typename Posting>
+    using Map = TrackedHashMap<Key, Posting>;
+    using Posting = PostingBitmap;
+    static constexpr bool kOrdered = false;
+    static constexpr bool kRange = false;
+    static constexpr bool kExactEquality = true;
+    
+    template <typename Key>
+    static const Key& slot(const Key& key) { return key; }
+};
+
+// 一个属性的倒排索引：键 -> 倒排（CompressedInvertedList 或 PostingBitmap），存储和算法由 Policy 决定。
+// 不自带锁，由 InvertedIndex 在索引锁下调用；spill 为空表示没有内存预算
+template <typename KeyT, typename Policy>
+class AttributeIndex {
+public:
+    using Key = KeyT;
+    using Posting = typename Policy::Posting;
+    using Map = typename Policy::template Map<Key, Posting>;
+    static constexpr bool kRange = Policy::kRange;
+    static constexpr bool kExactEquality = Policy::kExactEquality;
+    static constexpr bool kSpillable = is_same<Posting, CompressedInvertedList>::value;
+    
+    void add(const Key& key, int fileId, PostingSpillStore* spill) {
+        auto& posting = entries.try_emplace(Policy::slot(key), accounts.postings).first->second;
+        prepare(spill, posting);
+        posting.addFileId(fileId);
+        updated(spill, posting);
+    }
+    
+    void remove(const Key& key, int fileId, PostingSpillStore* spill) {
+        auto it = entries.find(Policy::slot(key));
+        if (it == entries.end()) return;
+        prepare(spill, it->second);
+        it->second.removeFileId(fileId);
+        if (!it->second.empty()) {
+            updated(spill, it->second);
+            return;
+        }
+        if constexpr (kSpillable) {
+            if (spill) spill->release(it->second);
+        }
+        entries.erase(it);
+    }
+    
+    // 等值查找，没有时返回空指针；分桶时返回整个桶
+    const Posting* find(const Key& key) const {
+        auto it = entries.find(Policy::slot(key));
+        return it == entries.end() ? nullptr : &it->second;
+    }
+    
+    // [low, high] 内的倒排依次交给 fn，返回结果是否精确
+    template <typename Fn>
+    bool forEachInRange(const Key& low, const Key& high, Fn&& fn) const {
+        static_assert(kRange, "该策略不支持区间查找");
+        if (high < low) return true;
+        auto upper = entries.upper_bound(Policy::slot(high));
+        for (auto it = entries.lower_bound(Policy::slot(low)); it != upper; ++it) fn(it->second);
+        return Policy::exactRange(low, high);
+    }
+    
+    // 按键序遍历 [low, high] 内的倒排（descending 时从大到小），从 after 的下一项开始，after 为空时从一端开始；
+    // fn(键表中的键, 倒排) 返回 false 时停止。返回是否还有未访问的倒排
+    template <typename Fn>
+    bool walkOrdered(const Key& low, const Key& high, bool descending, const optional<Key>& after, Fn&& fn) const {
+        static_assert(Policy::kOrdered, "该策略的键表无序");
+        if (high < low) return false;
+        auto first = entries.lower_bound(Policy::slot(low));
+        auto last = entries.upper_bound(Policy::slot(high));
+        if (!descending) {
+            for (auto it = after ? entries.upper_bound(*after) : first; it != last; ++it) {
+                if (!fn(it->first, it->second)) return next(it) != last;
+            }
+            return false;
+        }
+        for (auto it = after ? entries.lower_bound(*after) : last; it != first;) {
+            --it;
+            if (!fn(it->first, it->second)) return it != first;
+        }
+        return false;
+    }
+    
+    // [low, high] 的区间查找是否不需要复核
+    static bool exactRange(const Key& low, const Key& high) {
+        static_assert(kRange, "该策略不支持区间查找");
+        return Policy::exactRange(low, high);
+    }
+    
+    // 批量追加 fileIds 与 keyAt(行号) 给出的键，见 InvertedIndex::bulkBuildLocked。
+    // 有序的数值键直接基数排序，其余键先做字典编码
+    template <typename KeyAt>
+    void bulkBuild(const vector<int>& fileIds, KeyAt keyAt, bool idsAscending, int buildThreads,
+                   PostingSpillStore* spill) {
+        if (fileIds.empty()) return;
+        if constexpr (Policy::kOrdered && is_integral<Key>::value) {
+            bulkBuildNumeric(fileIds, keyAt, idsAscending, buildThreads, spill);
+        } else {
+            bulkBuildEncoded(fileIds, keyAt, idsAscending, buildThreads, spill);
+        }
+    }
+    
+    // 按键升序遍历，fn(键表中的键, 倒排)；分桶索引的键是桶下界。写段文件用
+    template <typename Fn>
+    void forEachSorted(Fn&& fn) const {
+        vector<const typename Map::value_type*> sorted;
+        sorted.reserve(entries.size());
+        for (const auto& entry : entries) sorted.push_back(&entry);
+        if constexpr (!Policy::kOrdered) {
+            sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+        }
+        for (const auto* entry : sorted) fn(entry->first, entry->second);
+    }
+    
+    // key 在键表中的位置（分桶索引为桶下界），也是段文件中的键
+    static decltype(auto) slotOf(const Key& key) {
+        return Policy::slot(key);
+    }
+    
+    // 可换出的倒排（位图不参与换出）
+    template <typename Fn>
+    void forEachSpillable(Fn&& fn) {
+        if constexpr (kSpillable) {
+            for (auto& entry : entries) fn(entry.second);
+        }
+    }
+    
+    size_t postingCount() const {
+        size_t total = 0;
+        for (const auto& entry : entries) total += entry.second.size();
+        return total;
+    }
+    
+    void clear() {
+        entries.clear();
+    }
+    
+    IndexMemory memory() const {
+        return accounts.read();
+    }
+    
+private:
+    IndexAccounts accounts;
+    Map entries{typename Map::allocator_type(accounts.dictionary)};
+    
+    static void prepare(PostingSpillStore* spill, Posting& posting) {
+        if constexpr (kSpillable) {
+            if (spill) spill->prepareForUpdate(posting);
+        }
+    }
+    
+    static void updated(PostingSpillStore* spill, Posting& posting) {
+        if constexpr (kSpillable) {
+            if (spill) spill->updated(posting);
+        }
+    }
+    
+    // 字典编码构建：每个线程用局部字典编码自己的区段，合并成按键排序的全局字典，
+    // 把 (编码, fileId) 打包成 64 位并行基数排序，之后每个键对应排序结果中连续的一段，
+    // 直接整段写入倒排（空链按精确大小分配，没有容量冗余）。输入按 fileId 升序时只需排序编码所在的高位
+    template <typename KeyAt>
+    void bulkBuildEncoded(const vector<int>& fileIds, KeyAt keyAt, bool idsAscending, int buildThreads,
+                          PostingSpillStore* spill) {
+        const size_t n = fileIds.size();
+        int threads = (int)max<size_t>(1, min<size_t>(buildThreads, n / 4096 + 1));
+        
+        // 1. 各线程用局部字典编码自己的区段
+        vector<uint32_t> codes(n);
+        vector<unordered_map<Key, uint32_t>> localCodes(threads);
+        vector<vector<const Key*>> localKeys(threads);
+        parallelFor(n, threads, [&](int t, size_t begin, size_t end) {
+            auto& dictionary = localCodes[t];
+            for (size_t i = begin; i < end; ++i) {
+                auto it = dictionary.try_emplace(Policy::slot(keyAt(i)), (uint32_t)dictionary.size()).first;
+                codes[i] = it->second;
+            }
+            localKeys[t].resize(dictionary.size());
+            for (const auto& entry : dictionary) {
+                localKeys[t][entry.second] = &entry.first;
+            }
+        });
+        
+        // 2. 合并成全局字典，全局编码按键排序
+        unordered_map<Key, uint32_t> merged;
+        for (const auto& dictionary : localCodes) {
+            for (const auto& entry : dictionary) {
+                merged.try_emplace(entry.first, 0);
+            }
+        }
+        vector<const Key*> keys;
+        keys.reserve(merged.size());
+        for (const auto& entry : merged) keys.push_back(&entry.first);
+        sort(keys.begin(), keys.end(), [](const Key* a, const Key* b) { return *a < *b; });
+        for (size_t code = 0; code < keys.size(); ++code) {
+            merged.find(*keys[code])->second = (uint32_t)code;
+        }
+        
+        vector<vector<uint32_t>> remap(threads);
+        for (int t = 0; t < threads; ++t) {
+            remap[t].resize(localKeys[t].size());
+            for (size_t local = 0; local < localKeys[t].size(); ++local) {
+                remap[t][local] = merged.find(*localKeys[t][local])->second;
+            }
+        }
+        parallelFor(n, threads, [&](int t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) codes[i] = remap[t][codes[i]];
+        });
+        localCodes.clear();
+        localKeys.clear();
+        
+        // 为每个键建好（或找到）倒排，已溢出的先装回
+        vector<Posting*> postings(keys.size());
+        if constexpr (Policy::kOrdered) {
+            auto hint = entries.end();
+            for (size_t code = 0; code < keys.size(); ++code) {
+                hint = entries.try_emplace(hint, *keys[code], accounts.postings);
+                postings[code] = &hint->second;
+                prepare(spill, *postings[code]);
+                ++hint;
+            }
+        } else {
+            entries.reserve(entries.size() + keys.size());
+            for (size_t code = 0; code < keys.size(); ++code) {
+                postings[code] = &entries.try_emplace(*keys[code], accounts.postings).first->second;
+                prepare(spill, *postings[code]);
+            }
+        }
+        
+        // 3. 打包 (编码, fileId) 并行基数排序
+        vector<uint64_t> pairs(n);
+        parallelFor(n, threads, [&](int, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                pairs[i] = (uint64_t)codes[i] << 32 | (uint32_t)fileIds[i];
+            }
+        });
+        vector<uint32_t>().swap(codes);
+        int codeBits = 1;
+        while (codeBits < 32 && (1ULL << codeBits) < keys.size()) codeBits++;
+        parallelRadixSort(pairs, idsAscending ? 32 : 0, 32 + codeBits, threads);
+        
+        // 4. 找出每个编码的区段，并行整段写入倒排
+        vector<size_t> starts(keys.size() + 1, n);
+        for (size_t i = n; i-- > 0;) {
+            starts[pairs[i] >> 32] = i;
+        }
+        vector<int> sortedIds(n);
+        parallelFor(n, threads, [&](int, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) sortedIds[i] = (int)(uint32_t)pairs[i];
+        });
+        vector<uint64_t>().swap(pairs);
+        parallelFor(keys.size(), threads, [&](int, size_t begin, size_t end) {
+            for (size_t code = begin; code < end; ++code) {
+                postings[code]->appendSorted(sortedIds.data() + starts[code], starts[code + 1] - starts[code]);
+            }
+        });
+        for (auto* posting : postings) updated(spill, *posting);
+    }
+    
+    // 数值键不做字典编码：直接对 (键, fileId) 基数排序，只排实际用到的位，
+    // 排序后相同的键（或桶）连续，按升序追加进有序键表
+    template <typename KeyAt>
+    void bulkBuildNumeric(const vector<int>& fileIds, KeyAt keyAt, bool idsAscending, int buildThreads,
+                          PostingSpillStore* spill) {
+        struct KeyedId {
+            uint64_t key;   // 翻转符号位，使无符号序与有符号序一致
+            int fileId;
+        };
+        const size_t n = fileIds.size();
+        int threads = (int)max<size_t>(1, min<size_t>(buildThreads, n / 4096 + 1));
+        
+        vector<KeyedId> items(n);
+        vector<uint64_t> varyingBits(threads, 0);
+        uint64_t first = (uint64_t)(int64_t)Policy::slot(keyAt(0)) ^ (1ULL << 63);
+        parallelFor(n, threads, [&](int t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                items[i] = {(uint64_t)(int64_t)Policy::slot(keyAt(i)) ^ (1ULL << 63), fileIds[i]};
+                varyingBits[t] |= items[i].key ^ first;
+            }
+        });
+        uint64_t varying = 0;
+        for (auto bits : varyingBits) varying |= bits;
+        int highBit = 0;
+        while (highBit < 64 && (varying >> highBit) != 0) highBit++;
+        
+        if (!idsAscending) {
+            parallelRadixSort(items, 0, 32, threads, [](const KeyedId& item) { return (uint64_t)(uint32_t)item.fileId; });
+        }
+        parallelRadixSort(items, 0, highBit, threads, [](const KeyedId& item) { return item.key; });
+        
+        vector<int> sortedIds(n);
+        vector<pair<size_t, Posting*>> runs;
+        auto hint = entries.end();
+        for (size_t i = 0; i < n; ++i) {
+            sortedIds[i] = items[i].fileId;
+            if (i == 0 || items[i].key != items[i - 1].key) {
+                hint = entries.try_emplace(hint, (Key)(int64_t)(items[i].key ^ (1ULL << 63)), accounts.postings);
+                prepare(spill, hint->second);
+                runs.emplace_back(i, &hint->second);
+                ++hint;
+            }
+        }
+        runs.emplace_back(n, nullptr);
+        parallelFor(runs.size() - 1, threads, [&](int, size_t begin, size_t end) {
+            for (size_t r = begin; r < end; ++r) {
+                runs[r].second->appendSorted(sortedIds.data() + runs[r].first, runs[r + 1].first - runs[r].first);
+            }
+        });
+        for (size_t r = 0; r + 1 < runs.size(); ++r) updated(spill, *runs[r].second);
+    }
+};
+
+// 倒排索引登记的属性。每项声明键类型和策略（Index）、从元数据和列式元数据取键（of / column）、
+// 对应的查询条件（condition：等值条件为 optional<键>，区间条件为 optional<pair<键, 键>>）、
+// 段文件字段和内存统计项。新增属性只需加一项并放进 IndexedAttributes，增删、批量构建、
+// 查询、段文件和内存统计都按声明生成
+struct ExtensionAttribute {
+    using Index = AttributeIndex<string, HashEqualityPolicy>;
+    static constexpr SegmentField kSegmentField = SegmentField::Extension;
+    static constexpr IndexMemory MemoryBreakdown::*kMemory = &MemoryBreakdown::extension;
+    static const string& of(const FileMetadata& file) { return file.extension; }
+    static const string& column(const MetadataColumns& columns, size_t row) { return *columns.extensions[row]; }
+    static const optional<string>& condition(const FileQuery& query) { return query.extension; }
+};
+
+struct OwnerAttribute {
+    using Index = AttributeIndex<string, HashEqualityPolicy>;
+    static constexpr SegmentField kSegmentField = SegmentField::Owner;
+    static constexpr IndexMemory MemoryBreakdown::*kMemory = &MemoryBreakdown::owner;
+    static const string& of(const FileMetadata& file) { return file.owner; }
+    static const string& column(const MetadataColumns& columns, size_t row) { return *columns.owners[row]; }
+    static const optional<string>& condition(const FileQuery& query) { return query.owner; }
+};
+
+struct CreateTimeAttribute {
+    using Index = AttributeIndex<string, HashEqualityPolicy>;
+    static constexpr SegmentField kSegmentField = SegmentField::CreateTime;
+    static constexpr IndexMemory MemoryBreakdown::*kMemory = &MemoryBreakdown::time;
+    static const string& of(const FileMetadata& file) { return file.createTime; }
+    static const string& column(const MetadataColumns& columns, size_t row) { return *columns.createTimes[row]; }
+    static const optional<string>& condition(const FileQuery& query) { return query.createTime; }
+};
+
+// 属组取值很少、每组覆盖大量文件，用位图倒排：增删是位操作，与可读位图求交也不必解码
+struct GroupAttribute {
+    using Index = AttributeIndex<uint32_t, BitmapPolicy>;
+    static constexpr SegmentField kSegmentField = SegmentField::Group;
+    static constexpr IndexMemory MemoryBreakdown::*kMemory = &MemoryBreakdown::group;
+    static uint32_t of(const FileMetadata& file) { return file.gid; }
+    static uint32_t column(const MetadataColumns& columns, size_t row) { return columns.gids[row]; }
+    static const optional<uint32_t>& condition(const FileQuery& query) { return query.gid; }
+};
+
+struct SizeAttribute {
+    using Index = AttributeIndex<long long, OrderedRangePolicy>;
+    static constexpr SegmentField kSegmentField = SegmentField::Size;
+    static constexpr IndexMemory MemoryBreakdown::*kMemory = &MemoryBreakdown::size;
+    static long long of(const FileMetadata& file) { return file.fileSize; }
+    static long long column(const MetadataColumns& columns, size_t row) { return columns.sizes[row]; }
+    static const optional<pair<long long, long long>>& condition(const FileQuery& query) { return query.sizeRange; }
+};
+
+// 修改时间按小时分桶：键表只有时间跨度 / 3600 项，区间两端不在整点上时结果须复核
+struct ModifyTimeAttribute {
+    using Index = AttributeIndex<long long, BucketedNumericPolicy<3600>>;
+    static constexpr SegmentField kSegmentField = SegmentField::ModifyTime;
+    static constexpr IndexMemory MemoryBreakdown::*kMemory = &MemoryBreakdown::modifyTime;
+    static long long of(const FileMetadata& file) { return file.modifyTime; }
+    static long long column(const MetadataColumns& columns, size_t row) { return columns.modifyTimes[row]; }
+    static const optional<pair<long long, long long>>& condition(const FileQuery& query) {
+        return query.modifyTimeRange;
+    }
+};
+
+// 多条件查询按这里的顺序取倒排：区间条件要合并多条链，代价最高，放在最后，
+// 前面的条件已经为空时就不再读取
+using IndexedAttributes = tuple<ExtensionAttribute, OwnerAttribute, CreateTimeAttribute, GroupAttribute,
+                                SizeAttribute, ModifyTimeAttribute>;
+
+// 倒排索引系统：IndexedAttributes 中每个属性一个 AttributeIndex，另外每个建了索引的标签键一个
+// （值 -> 倒排，与内置属性相同的压缩格式），共用一把读写锁和内存预算。
+// 另外为最近查询过的访问者各保存一个可读文件位图（见 installReadableSet），随增删改增量维护。
+// 从检查点恢复时内置属性的倒排来自映射的只读底段（见 attachBase），AttributeIndex 只保存之后的增量
+class InvertedIndex {
+private:
+    using TagIndex = AttributeIndex<string, HashEqualityPolicy>;
+    
+    struct ReadableSet {
+        PostingBitmap files;
+        mutable atomic<uint64_t> lastUse{0};   // 读锁下更新，淘汰时比较
+        
+        explicit ReadableSet(MemoryAccount* account) : files(account) {}
+    };
+    static constexpr size_t kMaxReadableSets = 64;
+
+    template <typename Attribute>
+    struct Slot {
+        using Type = Attribute;
+        typename Attribute::Index index;
+    };
+    template <typename Attributes>
+    struct SlotsOf;
+    template <typename... Attributes>
+    struct SlotsOf<tuple<Attributes...>> {
+        using Type = tuple<Slot<Attributes>...>;
+    };
+    
+    typename SlotsOf<IndexedAttributes>::Type slots;
+    map<string, unique_ptr<TagIndex>> tagIndexes;   // 只增不删，索引对象的地址在加锁之外也保持有效
+    mutable map<Principal, unique_ptr<ReadableSet>> readableSets;   // 缓存，查询路径上也会登记
+    IndexAccounts readableAccounts;
+    mutable atomic<uint64_t> readableClock{0};
+    // 基数估计的样本：fileId 的哈希不超过 sampleThreshold 的文件的属性副本（不含文件名和路径）。
+    // 超过 2 * kSampleTarget 行时阈值减半、丢掉约一半，文件少于此数时样本就是全部文件。
+    // 删除只移出样本不补入，大量删除后样本变小（估计仍无偏，误差变大），rebuild 时恢复
+    static constexpr size_t kSampleTarget = 8192;
+    static constexpr size_t kMinSampleHits = 32;
+    IndexAccounts sampleAccounts;
+    TrackedHashMap<int, FileMetadata> sample{
+        TrackedHashMap<int, FileMetadata>::allocator_type(sampleAccounts.dictionary)};
+    uint64_t sampleThreshold = UINT64_MAX;
+    size_t fileCount = 0;
+    mutable shared_mutex indexMutex;
+    int buildThreads = (int)max(1u, thread::hardware_concurrency());
+    unique_ptr<PostingSpillStore> spill;   // 未设置内存预算时为空，所有倒排链常驻内存
+    static constexpr size_t kMinPostingBytes = 8 << 20;  // 倒排链额度的保底，见 setMemoryBudget
+    size_t memoryBudget = 0;                        // 总预算，见 setMemoryBudget
+    vector<const MemoryAccount*> externalAccounts;  // 计入预算的外部账户
+    // 底段：检查点写出、恢复时映射的段。底段之后新增或改过的文件进 slots 中的增量索引，底段中被删除
+    // 或改过的文件记入墓碑，查询时从底段的倒排中滤掉；同一 fileId 不会同时在底段和增量中有效。
+    // 没有底段时 slots 就是全部。底段只在 rebuild 或下次 attachBase 时替换，增量在此之前一直增长
+    shared_ptr<const MappedSegment> base;
+    IndexAccounts baseAccounts;
+    PostingBitmap baseFiles{baseAccounts.postings};    // 底段中的 fileId
+    PostingBitmap tombstones{baseAccounts.postings};   // baseFiles 中已删除或改过的
+    
+    static_assert(tuple_size<IndexedAttributes>::value == kSegmentFieldCount, "每个内置属性在段文件中占一个字段");
+    
+    // 按 IndexedAttributes 的顺序对每个属性调用 fn(slot)，属性类型为 decltype(slot)::Type
+    template <typename Fn>
+    void forEachAttribute(Fn&& fn) {
+        apply([&](auto&... slot) { (fn(slot), ...); }, slots);
+    }
+    
+    template <typename Fn>
+    void forEachAttribute(Fn&& fn) const {
+        apply([&](const auto&... slot) { (fn(slot), ...); }, slots);
+    }
+    
+    template <typename Attribute>
+    const typename Attribute::Index& indexOf() const {
+        return get<Slot<Attribute>>(slots).index;
+    }
+    
+public:
+    void addFile(const FileMetadata& file) {
+        unique_lock<shared_mutex> lock(indexMutex);
+        addFileLocked(file);
+        enforceBudgetLocked();
+    }
+    
+    // 批量添加：整批只加一次写锁
+    void addFiles(const vector<shared_ptr<FileMetadata>>& files) {
+        unique_lock<shared_mutex> lock(indexMutex);
+        for (const auto& file : files) {
+            addFileLocked(*file);
+        }
+        enforceBudgetLocked();
+    }
+    
+    void removeFile(const FileMetadata& file) {
+        unique_lock<shared_mutex> lock(indexMutex);
+        forEachAttribute([&](auto& slot) {
+            using Attribute = typename decay_t<decltype(slot)>::Type;
+            slot.index.remove(Attribute::of(file), file.fileId, spill.get());
+        });
+        for (const auto& tag : file.tags) {
+            if (auto* index = tagIndexLocked(tag.key)) index->remove(tag.value, file.fileId, spill.get());
+        }
+        for (auto& entry : readableSets) entry.second->files.removeFileId(file.fileId);
+        if (baseFiles.contains(file.fileId)) tombstones.addFileId(file.fileId);
+        if (fileCount > 0) fileCount--;
+        sample.erase(file.fileId);
+        enforceBudgetLocked();
+    }
+    
+    // 同一文件的标签变化：只改建了索引的键中增删的值，内置属性的倒排不动
+    void updateTags(const FileMetadata& old, const FileMetadata& updated) {
+        unique_lock<shared_mutex> lock(indexMutex);
+        if (sample.count(updated.fileId)) sampleLocked(updated);
+        if (tagIndexes.empty()) return;
+        vector<FileTag> changed;
+        set_difference(old.tags.begin(), old.tags.end(), updated.tags.begin(), updated.tags.end(),
+                       back_inserter(changed));
+        for (const auto& tag : changed) {
+            if (auto* index = tagIndexLocked(tag.key)) index->remove(tag.value, old.fileId, spill.get());
+        }
+        changed.clear();
+        set_difference(updated.tags.begin(), updated.tags.end(), old.tags.begin(), old.tags.end(),
+                       back_inserter(changed));
+        for (const auto& tag : changed) {
+            if (auto* index = tagIndexLocked(tag.key)) index->add(tag.value, updated.fileId, spill.get());
+        }
+        enforceBudgetLocked();
+    }
+    
+    // 为标签键 key 建索引，从 columns 的标签列批量构建；已建过时返回 false。
+    // 此后增删改都维护该索引，rebuild 时保留索引定义
+    bool indexTag(const string& key, const MetadataColumns& columns) {
+        unique_lock<shared_mutex> lock(indexMutex);
+        auto inserted = tagIndexes.try_emplace(key);
+        if (!inserted.second) return false;
+        inserted.first->second = make_unique<TagIndex>();
+        bulkBuildTagLocked(key, *inserted.first->second, columns);
+        enforceBudgetLocked();
+        return true;
+    }
+    
+    vector<string> indexedTagKeys() const {
+        shared_lock<shared_mutex> lock(indexMutex);
+        vector<string> keys;
+        for (const auto& entry : tagIndexes) keys.push_back(entry.first);
+        return keys;
+    }
+    
+    bool hasReadableSet(const Principal& caller) const {
+        shared_lock<shared_mutex> lock(indexMutex);
+        return readableSets.count(caller) > 0;
+    }
+    
+    // 登记 caller 的可读位图：forEachFile(fn) 对全部文件调用 fn(const FileMetadata&)，位图在锁外算好。
+    // 调用方须持有树的读锁，保证遍历和登记之间没有写操作；之后随增删改增量维护。
+    // 已有 kMaxReadableSets 个时淘汰最久未用的，返回遍历的文件数
+    template <typename ForEachFile>
+    size_t installReadableSet(const Principal& caller, ForEachFile&& forEachFile) const {
+        auto set = make_unique<ReadableSet>(readableAccounts.postings);
+        size_t files = 0;
+        forEachFile([&](const FileMetadata& file) {
+            files++;
+            if (canRead(caller, file)) set->files.addFileId(file.fileId);
+        });
+        set->lastUse.store(++readableClock, memory_order_relaxed);
+        
+        unique_lock<shared_mutex> lock(indexMutex);
+        if (readableSets.size() >= kMaxReadableSets && !readableSets.count(caller)) {
+            auto oldest = min_element(readableSets.begin(), readableSets.end(), [](const auto& a, const auto& b) {
+                return a.second->lastUse.load(memory_order_relaxed) < b.second->lastUse.load(memory_order_relaxed);
+            });
+            readableSets.erase(oldest);
+        }
+        readableSets[caller] = move(set);
+        return files;
+    }
+    
+    // 批量追加一批新文件，见 bulkBuildLocked
+    void bulkAdd(const vector<shared_ptr<FileMetadata>>& files) {
+        auto columns = MetadataColumns::fromFiles(files);
+        unique_lock<shared_mutex> lock(indexMutex);
+        bulkBuildLocked(columns, true);
+        enforceBudgetLocked();
+    }
+    
+    // 全量重建：丢弃现有索引（含底段），从整套列式元数据一次性构建
+    void rebuild(const MetadataColumns& columns) {
+        unique_lock<shared_mutex> lock(indexMutex);
+        clearLocked();
+        bulkBuildLocked(columns, true);
+        enforceBudgetLocked();
+    }
+    
+    // 丢弃现有索引，以 segment 为底段：内置属性直接在映射的段上查找，不再构建倒排，
+    // 标签索引、可读位图和样本仍从 columns 构建。segment 须是同一组文件写出的（见 writeSegment），
+    // 倒排总数与文件数对不上时返回 false，索引不变
+    bool attachBase(shared_ptr<const MappedSegment> segment, const MetadataColumns& columns) {
+        if (segment->totalPostings() != kSegmentFieldCount * columns.size()) return false;
+        unique_lock<shared_mutex> lock(indexMutex);
+        clearLocked();
+        base = move(segment);
+        for (int fileId : columns.fileIds) baseFiles.addFileId(fileId);
+        bulkBuildLocked(columns, false);
+        enforceBudgetLocked();
+        return true;
+    }
+    
+    void setBuildThreads(int numThreads) {
+        buildThreads = max(1, numThreads);
+    }
+    
+    // 设置内存预算（字节）：覆盖整个索引的堆内存和 external 中的账户（调用方的目录树、元数据等）。
+    // 其中只有倒排链能换出：预算减去其余不可换出的部分（键表、位图、样本、external）就是倒排链的额度，
+    // 超出时最近未访问的链被换出到 spillPath 指定的溢出文件，访问时再装回。
+    // 倒排链至少留 kMinPostingBytes，否则每次写入都要把热链装入再换出；不可换出的部分加上它超过预算时
+    // 抛出异常，原有预算不变。之后不可换出的部分增长到挤占这份保底时，超出的部分由 getSpillStats 报告
+    // （fixedBytes 加保底大于 budgetBytes）。映射的底段在页缓存中，不计入。budgetBytes 为 0 时取消预算并把所有链装回内存
+    void setMemoryBudget(size_t budgetBytes, const string& spillPath, vector<const MemoryAccount*> external = {}) {
+        unique_lock<shared_mutex> lock(indexMutex);
+        if (budgetBytes == 0) {
+            if (!spill) return;
+            forEachListLocked([&](CompressedInvertedList& list) {
+                if (!list.isResident()) spill->fault(list);
+            });
+            spill.reset();
+            memoryBudget = 0;
+            externalAccounts.clear();
+            return;
+        }
+        size_t fixed = fixedBytesLocked(external);
+        if (fixed + kMinPostingBytes > budgetBytes) {
+            throw runtime_error("内存预算 " + to_string(budgetBytes) + " bytes 容不下不可换出的 " + to_string(fixed) +
+                                " bytes（键表、位图、样本、目录树和元数据）和倒排链保底 " +
+                                to_string(kMinPostingBytes) + " bytes");
+        }
+        memoryBudget = budgetBytes;
+        externalAccounts = move(external);
+        if (!spill) {
+            spill = make_unique<PostingSpillStore>(spillPath, budgetBytes - fixed);
+            forEachListLocked([&](CompressedInvertedList& list) { spill->track(list); });
+        }
+        enforceBudgetLocked();
+    }
+    
+    // 当前不可换出部分的字节数（含 setMemoryBudget 登记的外部账户）
+    size_t getFixedMemoryUsage() const {
+        shared_lock<shared_mutex> lock(indexMutex);
+        return fixedBytesLocked(externalAccounts);
+    }
+    
+    SpillStats getSpillStats() const {
+        shared_lock<shared_mutex> lock(indexMutex);
+        if (!spill) return SpillStats{};
+        auto stats = spill->stats();
+        stats.budgetBytes = memoryBudget;
+        stats.fixedBytes = fixedBytesLocked(externalAccounts);
+        return stats;
+    }
+    
+    // 各属性索引的实际占用（记账分配器统计，不需要加锁；标签索引表要在读锁下遍历）
+    void addMemoryBreakdown(MemoryBreakdown& breakdown) const {
+        forEachAttribute([&](const auto& slot) {
+            using Attribute = typename decay_t<decltype(slot)>::Type;
+            breakdown.*Attribute::kMemory = slot.index.memory();
+        });
+        breakdown.readable = readableAccounts.read();
+        breakdown.sample = sampleAccounts.read();
+        breakdown.base = baseAccounts.read();
+        shared_lock<shared_mutex> lock(indexMutex);
+        breakdown.mappedSegment = base ? base->size() : 0;
+        breakdown.tags = IndexMemory{};
+        for (const auto& entry : tagIndexes) {
+            auto memory = entry.second->memory();
+            breakdown.tags.dictionary += memory.dictionary;
+            breakdown.tags.postings += memory.postings;
+        }
+    }
+    
+    vector<int> queryByExtension(const string& ext, QueryProfile* profile = nullptr) const {
+        bool exact = true;
+        return lookup(indexOf<ExtensionAttribute>(), ext, profile, exact, SegmentField::Extension);
+    }
+    
+    // 已溢出的链直接从磁盘解码而不装回内存，一次大范围扫描不会把热链挤出去
+    vector<int> queryBySizeRange(long long minSize, long long maxSize, QueryProfile* profile = nullptr) const {
+        bool exact = true;
+        return lookupRange(indexOf<SizeAttribute>(), minSize, maxSize, profile, exact, SegmentField::Size);
+    }
+    
+    vector<int> queryByOwner(const string& owner, QueryProfile* profile = nullptr) const {
+        bool exact = true;
+        return lookup(indexOf<OwnerAttribute>(), owner, profile, exact, SegmentField::Owner);
+    }
+    
+    vector<int> queryByTime(const string& time, QueryProfile* profile = nullptr) const {
+        bool exact = true;
+        return lookup(indexOf<CreateTimeAttribute>(), time, profile, exact, SegmentField::CreateTime);
+    }
+    
+    // 多条件查询：按 IndexedAttributes 的顺序、再按标签逐个条件取出 fileId（各条件分别加锁，不是同一时刻的快照），
+    // 从最短的链开始求交；某个条件为空时不再读取其余条件。给定 caller 时结果再与其可读位图求交，
+    // 没有其他可走索引的条件时可读位图本身就是结果。条件为空时抛出异常；没有任何条件能走索引时
+    // 返回空（调用方逐个比较全部元数据）。给定 exact 时写入结果是否精确：分桶索引只给出候选，
+    // 未建索引的标签条件和尚未登记的可读位图被跳过，这些情况都须按元数据复核
+    optional<vector<int>> query(const FileQuery& query, QueryProfile* profile = nullptr,
+                                bool* exact = nullptr) const {
+        if (query.empty()) throw runtime_error("查询至少需要一个条件");
+        vector<vector<int>> lists;
+        bool allExact = true;
+        forEachAttribute([&](const auto& slot) {
+            using Attribute = typename decay_t<decltype(slot)>::Type;
+            using Key = typename Attribute::Index::Key;
+            const auto& condition = Attribute::condition(query);
+            if (!condition || (!lists.empty() && lists.back().empty())) return;
+            constexpr SegmentField field = Attribute::kSegmentField;
+            if constexpr (is_same<decay_t<decltype(*condition)>, pair<Key, Key>>::value) {
+                lists.push_back(lookupRange(slot.index, condition->first, condition->second, profile, allExact,
+                                            field));
+            } else {
+                lists.push_back(lookup(slot.index, *condition, profile, allExact, field));
+            }
+        });
+        for (const auto& tag : query.tags) {
+            if (!lists.empty() && lists.back().empty()) break;
+            const TagIndex* index;
+            {
+                shared_lock<shared_mutex> lock(indexMutex);
+                index = tagIndexLocked(tag.key);
+            }
+            if (index) {
+                lists.push_back(lookup(*index, tag.value, profile, allExact));
+            } else {
+                allExact = false;
+            }
+        }
+        
+        if (query.caller) {
+            auto lock = acquireProfiled<shared_lock<shared_mutex>>(indexMutex, profile, QueryStage::IndexLockWait);
+            auto it = readableSets.find(*query.caller);
+            if (it != readableSets.end()) {
+                const auto& readable = *it->second;
+                readable.lastUse.store(++readableClock, memory_order_relaxed);
+                vector<int> result;
+                if (lists.empty()) {
+                    auto start = profile ? steady_clock::now() : steady_clock::time_point();
+                    readable.files.copyTo(result);
+                    recordFetch(profile, start, result.size(), false);
+                } else {
+                    result = lists.size() == 1 ? move(lists[0]) : intersectSorted(move(lists), profile);
+                    filterReadable(readable.files, result, profile);
+                }
+                if (exact) *exact = allExact;
+                return result;
+            }
+            allExact = false;
+        }
+        if (lists.empty()) return nullopt;
+        if (exact) *exact = allExact;
+        if (lists.size() == 1) return move(lists[0]);
+        return intersectSorted(move(lists), profile);
+    }
+    
+    // 谓词表达式结果行数的估计，不执行查询：
+    //   条件自相矛盾（见 PredicateExpr::satisfiable）时为 0；
+    //   只有一个等值条件时直接取倒排长度；
+    //   否则在样本上逐行判断整个表达式，按样本比例放大，条件之间的相关性如实反映；
+    //   样本命中少于 kMinSampleHits 时改按各条件的倒排长度、假设条件相互独立合成，
+    //   再限制在样本命中数的约 95% 区间（泊松近似，h ± 2√h，命中 0 行时上限 3 行）内，且不超过上界
+    CardinalityEstimate estimateRows(const PredicateExpr& expr) const {
+        shared_lock<shared_mutex> lock(indexMutex);
+        CardinalityEstimate result;
+        result.sampleRows = sample.size();
+        if (fileCount == 0 || !expr.satisfiable()) {
+            result.exact = true;
+            return result;
+        }
+        if (expr.kind == PredicateExpr::Kind::Leaf) {
+            auto conditions = expr.leaf.conditions();
+            if (conditions.empty()) {
+                result.rows = (double)fileCount;
+                result.exact = true;
+                return result;
+            }
+            // 区间条件要累加区间内的每条倒排，交给样本
+            const auto& only = conditions[0];
+            if (conditions.size() == 1 && !only.sizeRange && !only.modifyTimeRange) {
+                auto rows = conditionRowsLocked(only);
+                if (rows && rows->second) {
+                    result.rows = (double)rows->first;
+                    result.exact = true;
+                    return result;
+                }
+            }
+        }
+        for (const auto& row : sample) {
+            if (expr.matches(row.second)) result.sampleHits++;
+        }
+        if (sampleThreshold == UINT64_MAX) {
+            result.rows = (double)result.sampleHits;
+            result.exact = true;
+            return result;
+        }
+        double scale = (double)fileCount / (double)max<size_t>(1, sample.size());
+        if (result.sampleHits >= kMinSampleHits) {
+            result.rows = (double)result.sampleHits * scale;
+            return result;
+        }
+        double hits = (double)result.sampleHits;
+        double low = max(0.0, hits - 2 * sqrt(hits)) * scale;
+        double high = (hits + 2 * sqrt(hits) + 3) * scale;
+        result.rows = min(clamp((double)fileCount * selectivityLocked(expr), low, high), upperBoundLocked(expr));
+        return result;
+    }
+    
+    // ORDER BY 的有序遍历状态：排序键、方向、键的区间和已取到的位置（上一条倒排在键表中的键）
+    struct OrderedWalk {
+        OrderKey key = OrderKey::Size;
+        bool descending = true;
+        long long low = numeric_limits<long long>::min();
+        long long high = numeric_limits<long long>::max();
+        optional<long long> after;
+    };
+    
+    static bool hasOrderedIndex(OrderKey key) {
+        return key == OrderKey::Size || key == OrderKey::ModifyTime;
+    }
+    
+    // walk 的区间是否不需要复核（分桶索引的两端不在桶边界上时须复核）
+    static bool exactWalk(const OrderedWalk& walk) {
+        if (walk.key == OrderKey::ModifyTime) return ModifyTimeAttribute::Index::exactRange(walk.low, walk.high);
+        return true;
+    }
+    
+    // 从 walk.after 之后按键序取整条倒排（分桶索引为整个桶）追加到 out，取够 minIds 个后停在倒排边界
+    // 并推进 walk.after；返回后面是否还有倒排。每次调用单独加读锁，已溢出的链直接从磁盘解码
+    bool nextOrdered(OrderedWalk& walk, size_t minIds, vector<int>& out, QueryProfile* profile = nullptr) const {
+        switch (walk.key) {
+            case OrderKey::Size:
+                return nextOrderedIn(indexOf<SizeAttribute>(), SegmentField::Size, walk, minIds, out, profile);
+            case OrderKey::ModifyTime:
+                return nextOrderedIn(indexOf<ModifyTimeAttribute>(), SegmentField::ModifyTime, walk, minIds, out,
+                                     profile);
+            default: throw runtime_error(string("排序键没有有序索引: ") + kOrderKeyNames[(size_t)walk.key]);
+        }
+    }
+    
+    // 把内置属性的索引写成只读段文件（格式见 SegmentWriter，标签索引不写入），返回文件大小。
+    // 有底段时写出的是底段（去掉墓碑）与增量合并后的内容
+    uint64_t writeSegment(const string& path) const {
+        shared_lock<shared_mutex> lock(indexMutex);
+        SegmentWriter writer(path);
+        vector<int> scratch, merged;
+        forEachAttribute([&](const auto& slot) {
+            using Attribute = typename decay_t<decltype(slot)>::Type;
+            using Key = typename Attribute::Index::Key;
+            using SegmentKey = conditional_t<is_same<Key, string>::value, string, long long>;
+            constexpr SegmentField field = Attribute::kSegmentField;
+            // 底段和增量的键都按升序，逐项归并
+            vector<pair<SegmentKey, PostingListView>> stored;
+            if (base) {
+                base->forEachTerm<SegmentKey>(field, [&](SegmentKey key, const PostingListView& list) {
+                    stored.emplace_back(move(key), list);
+                });
+            }
+            size_t next = 0;
+            auto writeStoredBefore = [&](const SegmentKey* key) {
+                for (; next < stored.size() && (!key || stored[next].first < *key); ++next) {
+                    merged.clear();
+                    appendBaseLocked(stored[next].second, merged);
+                    addSegmentTerm(writer, field, stored[next].first, merged);
+                }
+            };
+            slot.index.forEachSorted([&](const auto& key, const auto& posting) {
+                SegmentKey segmentKey(key);
+                writeStoredBefore(&segmentKey);
+                merged = fileIdsForRead(posting, scratch);
+                if (next < stored.size() && stored[next].first == segmentKey) {
+                    size_t middle = merged.size();
+                    appendBaseLocked(stored[next++].second, merged);
+                    inplace_merge(merged.begin(), merged.begin() + middle, merged.end());
+                }
+                addSegmentTerm(writer, field, segmentKey, merged);
+            });
+            writeStoredBefore(nullptr);
+        });
+        return writer.finish();
+    }
+    
+    // 不经过在线索引，直接从列式元数据写段文件（检查点用）：逐个属性临时构建倒排，写出后即释放，
+    // 峰值内存只是一个属性的倒排。返回文件大小
+    static uint64_t writeSegment(const MetadataColumns& columns, const string& path, int buildThreads) {
+        SegmentWriter writer(path);
+        bool idsAscending = is_sorted(columns.fileIds.begin(), columns.fileIds.end());
+        vector<int> scratch;
+        apply([&](auto... attributes) {
+            auto write = [&](auto attribute) {
+                using Attribute = decltype(attribute);
+                typename Attribute::Index index;
+                index.bulkBuild(columns.fileIds,
+                                [&](size_t row) -> decltype(auto) { return Attribute::column(columns, row); },
+                                idsAscending, buildThreads, nullptr);
+                index.forEachSorted([&](const auto& key, const auto& posting) {
+                    scratch.clear();
+                    posting.copyTo(scratch);
+                    addSegmentTerm(writer, Attribute::kSegmentField, key, scratch);
+                });
+            };
+            (write(attributes), ...);
+        }, IndexedAttributes());
+        return writer.finish();
+    }
+    
+    // 索引实际占用的堆内存：各属性的键表和倒排（已溢出的链不计）
+    size_t getMemoryUsage() const {
+        MemoryBreakdown breakdown;
+        addMemoryBreakdown(breakdown);
+        return breakdown.index();
+    }
+    
+    // 全部倒排的 fileId 总数（含已溢出的链和底段中未作废的）
+    size_t getPostingCount() const {
+        shared_lock<shared_mutex> lock(indexMutex);
+        size_t total = base ? base->totalPostings() - kSegmentFieldCount * tombstones.size() : 0;
+        forEachAttribute([&](const auto& slot) { total += slot.index.postingCount(); });
+        for (const auto& entry : tagIndexes) total += entry.second->postingCount();
+        return total;
+    }
+    
+private:
+    // 清空全部内容（含底段），保留标签索引的定义和已登记的可读位图
+    void clearLocked() {
+        if (spill) spill->reset();
+        forEachAttribute([](auto& slot) { slot.index.clear(); });
+        for (auto& entry : tagIndexes) entry.second->clear();
+        for (auto& entry : readableSets) entry.second->files.clear();
+        sample.clear();
+        sampleThreshold = UINT64_MAX;
+        fileCount = 0;
+        base.reset();
+        baseFiles.clear();
+        tombstones.clear();
+    }
+    
+    // 批量构建：每个属性列各自按其策略构建（见 AttributeIndex::bulkBuild）；
+    // attributes 为 false 时内置属性已在底段中，只构建标签索引、样本和可读位图
+    void bulkBuildLocked(const MetadataColumns& columns, bool attributes) {
+        if (columns.size() == 0) return;
+        bool idsAscending = is_sorted(columns.fileIds.begin(), columns.fileIds.end());
+        if (attributes) {
+            forEachAttribute([&](auto& slot) {
+                using Attribute = typename decay_t<decltype(slot)>::Type;
+                slot.index.bulkBuild(columns.fileIds,
+                                     [&](size_t row) -> decltype(auto) { return Attribute::column(columns, row); },
+                                     idsAscending, buildThreads, spill.get());
+            });
+        }
+        for (auto& entry : tagIndexes) bulkBuildTagLocked(entry.first, *entry.second, columns);
+        fileCount += columns.size();
+        bool hasTags = columns.tags.size() == columns.size();
+        for (size_t row = 0; row < columns.size(); ++row) {
+            if (HyperLogLog::hashOf((uint64_t)columns.fileIds[row]) > sampleThreshold) continue;
+            FileMetadata file(columns.fileIds[row], "", *columns.extensions[row], columns.sizes[row],
+                              *columns.owners[row], *columns.createTimes[row], "", columns.modifyTimes[row],
+                              columns.modes[row], columns.uids[row], columns.gids[row]);
+            if (hasTags) file.tags = *columns.tags[row];
+            sampleLocked(file);
+        }
+        for (auto& entry : readableSets) {
+            for (size_t row = 0; row < columns.size(); ++row) {
+                if (canRead(entry.first, columns.modes[row], columns.uids[row], columns.gids[row])) {
+                    entry.second->files.addFileId(columns.fileIds[row]);
+                }
+            }
+        }
+    }
+    
+    // 从标签列取出键为 key 的 (fileId, 值)，按字典编码路径构建；多值标签的同一文件在各个值下各出现一次
+    void bulkBuildTagLocked(const string& key, TagIndex& index, const MetadataColumns& columns) {
+        if (columns.tags.size() != columns.size()) return;
+        vector<int> fileIds;
+        vector<const string*> values;
+        for (size_t row = 0; row < columns.size(); ++row) {
+            const auto& tags = *columns.tags[row];
+            if (tags.empty()) continue;
+            for (auto it = lower_bound(tags.begin(), tags.end(), FileTag{key, ""}); it != tags.end() && it->key == key;
+                 ++it) {
+                fileIds.push_back(columns.fileIds[row]);
+                values.push_back(&it->value);
+            }
+        }
+        index.bulkBuild(fileIds, [&](size_t i) -> const string& { return *values[i]; },
+                        is_sorted(fileIds.begin(), fileIds.end()), buildThreads, spill.get());
+    }
+    
+    TagIndex* tagIndexLocked(const string& key) const {
+        if (tagIndexes.empty()) return nullptr;
+        auto it = tagIndexes.find(key);
+        return it == tagIndexes.end() ? nullptr : it->second.get();
+    }
+    
+    void addFileLocked(const FileMetadata& file) {
+        forEachAttribute([&](auto& slot) {
+            using Attribute = typename decay_t<decltype(slot)>::Type;
+            slot.index.add(Attribute::of(file), file.fileId, spill.get());
+        });
+        for (const auto& tag : file.tags) {
+            if (auto* index = tagIndexLocked(tag.key)) index->add(tag.value, file.fileId, spill.get());
+        }
+        for (auto& entry : readableSets) {
+            if (canRead(entry.first, file)) entry.second->files.addFileId(file.fileId);
+        }
+        fileCount++;
+        sampleLocked(file);
+    }
+    
+    // 哈希不超过阈值的文件放进样本（已在样本中的替换），样本过大时阈值减半
+    void sampleLocked(const FileMetadata& file) {
+        if (HyperLogLog::hashOf((uint64_t)file.fileId) > sampleThreshold) return;
+        FileMetadata row(file.fileId, "", file.extension, file.fileSize, file.owner, file.createTime, "",
+                         file.modifyTime, file.mode, file.uid, file.gid);
+        row.tags = file.tags;
+        sample.erase(file.fileId);
+        sample.emplace(file.fileId, move(row));
+        if (sample.size() <= 2 * kSampleTarget) return;
+        sampleThreshold >>= 1;
+        for (auto it = sample.begin(); it != sample.end();) {
+            it = HyperLogLog::hashOf((uint64_t)it->first) > sampleThreshold ? sample.erase(it) : next(it);
+        }
+    }
+    
+    // 等值查询，baseField 给定时并入底段中同一键的倒排。命中已溢出的链时换成写锁装回内存
+    // （换锁期间链可能已被删除或已被装回）。驻留状态只是缓存，装回不改变链的内容，因此这里去掉 const 是安全的
+    template <typename Index>
+    vector<int> lookup(const Index& index, const typename Index::Key& key, QueryProfile* profile, bool& exact,
+                       optional<SegmentField> baseField = nullopt) const {
+        exact = exact && Index::kExactEquality;
+        {
+            auto lock = acquireProfiled<shared_lock<shared_mutex>>(indexMutex, profile, QueryStage::IndexLockWait);
+            auto start = profile ? steady_clock::now() : steady_clock::time_point();
+            const auto* posting = index.find(key);
+            bool resident = true;
+            if constexpr (Index::kSpillable) {
+                resident = !posting || !spill || posting->isResident();
+                if (posting && spill && resident) spill->touch(*posting);
+            }
+            if (resident) {
+                vector<int> result;
+                if (posting) posting->copyTo(result);
+                bool stored = mergeBaseLocked<Index>(baseField, key, result);
+                if (posting || stored) recordFetch(profile, start, result.size(), false);
+                return result;
+            }
+        }
+        if constexpr (Index::kSpillable) {
+            auto lock = acquireProfiled<unique_lock<shared_mutex>>(indexMutex, profile, QueryStage::IndexLockWait);
+            auto start = profile ? steady_clock::now() : steady_clock::time_point();
+            const auto* posting = index.find(key);
+            vector<int> result;
+            bool faulted = false;
+            if (posting && spill) {
+                auto& list = const_cast<CompressedInvertedList&>(*posting);
+                faulted = !list.isResident();
+                if (faulted) {
+                    spill->fault(list);
+                } else {
+                    spill->touch(list);
+                }
+                list.copyTo(result);
+                const_cast<InvertedIndex*>(this)->enforceBudgetLocked();
+            } else if (posting) {
+                posting->copyTo(result);
+            }
+            bool stored = mergeBaseLocked<Index>(baseField, key, result);
+            if (posting || stored) recordFetch(profile, start, result.size(), faulted);
+            return result;
+        }
+        return {};
+    }
+    
+    // 底段中 key 的倒排去掉墓碑后按序并入 out（out 已排序）；返回底段中是否有这个键
+    template <typename Index>
+    bool mergeBaseLocked(optional<SegmentField> field, const typename Index::Key& key, vector<int>& out) const {
+        if (!base || !field) return false;
+        auto list = baseListLocked<Index>(*field, key);
+        if (list.empty()) return false;
+        size_t middle = out.size();
+        appendBaseLocked(list, out);
+        inplace_merge(out.begin(), out.begin() + middle, out.end());
+        return true;
+    }
+    
+    template <typename Index>
+    PostingListView baseListLocked(SegmentField field, const typename Index::Key& key) const {
+        if constexpr (is_same<typename Index::Key, string>::value) {
+            return base->find(field, key);
+        } else {
+            return base->find(field, (long long)Index::slotOf(key));
+        }
+    }
+    
+    // 底段倒排中没有墓碑的 fileId 追加到 out
+    void appendBaseLocked(const PostingListView& list, vector<int>& out) const {
+        size_t start = out.size();
+        MappedSegment::decodeInto(list, out);
+        if (tombstones.empty()) return;
+        out.erase(remove_if(out.begin() + start, out.end(), [&](int id) { return tombstones.contains(id); }),
+                  out.end());
+    }
+    
+    template <typename Key>
+    static void addSegmentTerm(SegmentWriter& writer, SegmentField field, const Key& key,
+                               const vector<int>& fileIds) {
+        if constexpr (is_same<Key, string>::value) {
+            writer.addStringTerm(field, key, fileIds);
+        } else {
+            writer.addNumericTerm(field, (long long)key, fileIds);
+        }
+    }
+    
+    // 区间查询：合并区间内的所有倒排（baseField 给定时含底段的）。已溢出的链直接从磁盘解码，不装回内存
+    template <typename Index>
+    vector<int> lookupRange(const Index& index, const typename Index::Key& low, const typename Index::Key& high,
+                            QueryProfile* profile, bool& exact, optional<SegmentField> baseField = nullopt) const {
+        auto lock = acquireProfiled<shared_lock<shared_mutex>>(indexMutex, profile, QueryStage::IndexLockWait);
+        auto start = profile ? steady_clock::now() : steady_clock::time_point();
+        vector<int> result;
+        size_t lists = 0, spilled = 0;
+        bool rangeExact = index.forEachInRange(low, high, [&](const typename Index::Posting& posting) {
+            lists++;
+            if constexpr (Index::kSpillable) {
+                if (spill && !posting.isResident()) {
+                    spilled++;
+                    auto fileIds = spill->read(posting);
+                    result.insert(result.end(), fileIds.begin(), fileIds.end());
+                    return;
+                }
+                if (spill) spill->touch(posting);
+            }
+            posting.copyTo(result);
+        });
+        if (base && baseField) {
+            for (const auto& list : base->findRange(*baseField, Index::slotOf(low), Index::slotOf(high))) {
+                lists++;
+                appendBaseLocked(list, result);
+            }
+        }
+        exact = exact && rangeExact;
+        if (profile) {
+            profile->addTime(QueryStage::PostingFetch, start);
+            (*profile)[QueryStage::PostingFetch].idsIn += result.size();
+            (*profile)[QueryStage::PostingFetch].idsOut += result.size();
+            profile->postingLists += lists;
+            profile->spilledLists += spilled;
+            start = steady_clock::now();
+            (*profile)[QueryStage::SetOperations].idsIn += result.size();
+        }
+        
+        if (lists > 1) {
+            sort(result.begin(), result.end());
+            result.erase(unique(result.begin(), result.end()), result.end());
+        }
+        if (profile) {
+            profile->addTime(QueryStage::SetOperations, start);
+            (*profile)[QueryStage::SetOperations].idsOut += result.size();
+        }
+        return result;
+    }
+    
+    // 单个条件在索引上的行数：等值条件取倒排长度，区间条件累加区间内各倒排的长度，
+    // second 表示是否精确（分桶索引的区间不精确；底段的倒排长度含有墓碑的文件，有墓碑时也不精确）。
+    // 没有可用的倒排或可读位图时返回空
+    optional<pair<size_t, bool>> conditionRowsLocked(const FileQuery& condition) const {
+        optional<pair<size_t, bool>> result;
+        bool baseExact = tombstones.empty();
+        forEachAttribute([&](const auto& slot) {
+            using Attribute = typename decay_t<decltype(slot)>::Type;
+            using Index = typename Attribute::Index;
+            using Key = typename Index::Key;
+            const auto& value = Attribute::condition(condition);
+            if (!value) return;
+            if constexpr (is_same<decay_t<decltype(*value)>, pair<Key, Key>>::value) {
+                size_t rows = 0;
+                bool exact = slot.index.forEachInRange(value->first, value->second,
+                                                       [&](const typename Index::Posting& posting) {
+                                                           rows += posting.size();
+                                                       });
+                if (base) {
+                    for (const auto& list : base->findRange(Attribute::kSegmentField, Index::slotOf(value->first),
+                                                            Index::slotOf(value->second))) {
+                        rows += list.count;
+                    }
+                }
+                result = make_pair(rows, exact && baseExact);
+            } else {
+                const auto* posting = slot.index.find(*value);
+                size_t rows = (posting ? posting->size() : 0) +
+                              (base ? baseListLocked<Index>(Attribute::kSegmentField, *value).count : 0);
+                result = make_pair(rows, Index::kExactEquality && baseExact);
+            }
+        });
+        if (!condition.tags.empty()) {
+            if (const auto* index = tagIndexLocked(condition.tags[0].key)) {
+                const auto* posting = index->find(condition.tags[0].value);
+                result = make_pair(posting ? posting->size() : 0, true);
+            }
+        }
+        if (condition.caller) {
+            auto it = readableSets.find(*condition.caller);
+            if (it != readableSets.end()) result = make_pair(it->second->files.size(), true);
+        }
+        return result;
+    }
+    
+    // 假设条件相互独立时的选择率。有倒排的条件取倒排长度的比例，其余（未建索引的标签等）取样本中的比例
+    double selectivityLocked(const PredicateExpr& expr) const {
+        double selectivity = 1;
+        switch (expr.kind) {
+            case PredicateExpr::Kind::Leaf:
+                for (const auto& condition : expr.leaf.conditions()) {
+                    if (auto rows = conditionRowsLocked(condition)) {
+                        selectivity *= min(1.0, (double)rows->first / (double)fileCount);
+                        continue;
+                    }
+                    size_t hits = 0;
+                    for (const auto& row : sample) hits += condition.matches(row.second);
+                    selectivity *= (hits + 0.5) / (sample.size() + 1.0);
+                }
+                return selectivity;
+            case PredicateExpr::Kind::And:
+                for (const auto& child : expr.children) selectivity *= selectivityLocked(child);
+                return selectivity;
+            case PredicateExpr::Kind::Or:
+                for (const auto& child : expr.children) selectivity *= 1 - selectivityLocked(child);
+                return 1 - selectivity;
+        }
+        return selectivity;
+    }
+    
+    // 结果行数的上界：AND 取最短的分支，OR 取各分支之和
+    double upperBoundLocked(const PredicateExpr& expr) const {
+        double bound = (double)fileCount;
+        switch (expr.kind) {
+            case PredicateExpr::Kind::Leaf:
+                for (const auto& condition : expr.leaf.conditions()) {
+                    if (auto rows = conditionRowsLocked(condition)) bound = min(bound, (double)rows->first);
+                }
+                return bound;
+            case PredicateExpr::Kind::And:
+                for (const auto& child : expr.children) bound = min(bound, upperBoundLocked(child));
+                return bound;
+            case PredicateExpr::Kind::Or: {
+                double sum = 0;
+                for (const auto& child : expr.children) sum += upperBoundLocked(child);
+                return min(bound, sum);
+            }
+        }
+        return bound;
+    }
+    
+    // 按键序逐条取倒排：每一步在增量索引和底段上各找紧接 walk.after 的键，取较前的一个，
+    // 两边都有这个键时两条倒排一起取
+    template <typename Index>
+    bool nextOrderedIn(const Index& index, SegmentField field, OrderedWalk& walk, size_t minIds, vector<int>& out,
+                       QueryProfile* profile) const {
+        using Posting = typename Index::Posting;
+        auto lock = acquireProfiled<shared_lock<shared_mutex>>(indexMutex, profile, QueryStage::IndexLockWait);
+        auto start = profile ? steady_clock::now() : steady_clock::time_point();
+        size_t taken = 0, lists = 0, spilled = 0;
+        bool more = false;
+        while (true) {
+            optional<long long> key;
+            const Posting* posting = nullptr;
+            index.walkOrdered(walk.low, walk.high, walk.descending, walk.after, [&](long long k, const Posting& p) {
+                key = k;
+                posting = &p;
+                return false;
+            });
+            optional<pair<long long, PostingListView>> stored;
+            if (base) {
+                stored = base->nextTerm(field, Index::slotOf(walk.low), Index::slotOf(walk.high), walk.descending,
+                                        walk.after);
+            }
+            if (stored && (!key || (walk.descending ? stored->first > *key : stored->first < *key))) {
+                key = stored->first;
+                posting = nullptr;
+            }
+            if (stored && stored->first != *key) stored.reset();
+            more = key.has_value();
+            if (!more || taken >= minIds) break;
+            
+            size_t before = out.size();
+            if (posting) {
+                lists++;
+                if constexpr (Index::kSpillable) {
+                    if (spill && !posting->isResident()) {
+                        spilled++;
+                        auto fileIds = spill->read(*posting);
+                        out.insert(out.end(), fileIds.begin(), fileIds.end());
+                    } else {
+                        if (spill) spill->touch(*posting);
+                        posting->copyTo(out);
+                    }
+                } else {
+                    posting->copyTo(out);
+                }
+            }
+            if (stored) {
+                lists++;
+                appendBaseLocked(stored->second, out);
+            }
+            taken += out.size() - before;
+            walk.after = *key;
+        }
+        if (profile) {
+            profile->addTime(QueryStage::PostingFetch, start);
+            (*profile)[QueryStage::PostingFetch].idsIn += taken;
+            (*profile)[QueryStage::PostingFetch].idsOut += taken;
+            profile->postingLists += lists;
+            profile->spilledLists += spilled;
+        }
+        return more;
+    }
+    
+    static void recordFetch(QueryProfile* profile, steady_clock::time_point start, size_t ids, bool spilled) {
+        if (!profile) return;
+        profile->addTime(QueryStage::PostingFetch, start);
+        (*profile)[QueryStage::PostingFetch].idsIn += ids;
+        (*profile)[QueryStage::PostingFetch].idsOut += ids;
+        profile->postingLists++;
+        if (spilled) profile->spilledLists++;
+    }
+    
+    // 按可读位图过滤：每个 fileId 一次位测试，不再逐个判断权限位
+    static void filterReadable(const PostingBitmap& readable, vector<int>& fileIds, QueryProfile* profile) {
+        auto start = profile ? steady_clock::now() : steady_clock::time_point();
+        size_t idsIn = fileIds.size();
+        fileIds.erase(remove_if(fileIds.begin(), fileIds.end(), [&](int id) { return !readable.contains(id); }),
+                      fileIds.end());
+        if (profile) {
+            profile->addTime(QueryStage::AccessFilter, start);
+            (*profile)[QueryStage::AccessFilter].idsIn += idsIn;
+            (*profile)[QueryStage::AccessFilter].idsOut += fileIds.size();
+        }
+    }
+    
+    // 已排序的 fileId 列表求交：从最短的开始，长度相差很大时对长列表做二分跳跃
+    static vector<int> intersectSorted(vector<vector<int>> lists, QueryProfile* profile) {
+        auto start = profile ? steady_clock::now() : steady_clock::time_point();
+        sort(lists.begin(), lists.end(), [](const vector<int>& a, const vector<int>& b) {
+            return a.size() < b.size();
+        });
+        size_t idsIn = 0;
+        for (const auto& list : lists) idsIn += list.size();
+        vector<int> result = move(lists[0]);
+        vector<int> next;
+        for (size_t i = 1; i < lists.size() && !result.empty(); ++i) {
+            const auto& other = lists[i];
+            next.clear();
+            if (other.size() / 32 > result.size()) {
+                auto from = other.begin();
+                for (int id : result) {
+                    from = lower_bound(from, other.end(), id);
+                    if (from == other.end()) break;
+                    if (*from == id) next.push_back(id);
+                }
+            } else {
+                set_intersection(result.begin(), result.end(), other.begin(), other.end(), back_inserter(next));
+            }
+            result.swap(next);
+        }
+        if (profile) {
+            profile->addTime(QueryStage::SetOperations, start);
+            (*profile)[QueryStage::SetOperations].idsIn += idsIn;
+            (*profile)[QueryStage::SetOperations].idsOut += result.size();
+        }
+        return result;
+    }
+    
+    // 读出倒排的内容到 scratch（已溢出的从磁盘解码）
+    template <typename Posting>
+    const vector<int>& fileIdsForRead(const Posting& posting, vector<int>& scratch) const {
+        scratch.clear();
+        if constexpr (is_same<Posting, CompressedInvertedList>::value) {
+            if (!posting.isResident()) {
+                scratch = spill->read(posting, false);
+                return scratch;
+            }
+        }
+        posting.copyTo(scratch);
+        return scratch;
+    }
+    
+    template <typename Fn>
+    void forEachListLocked(Fn&& fn) {
+        forEachAttribute([&](auto& slot) { slot.index.forEachSpillable(fn); });
+        for (auto& entry : tagIndexes) entry.second->forEachSpillable(fn);
+    }
+    
+    // 预算中不能换出的部分：external、各索引的键表、位图倒排、标签键表、可读位图、样本和底段位图
+    size_t fixedBytesLocked(const vector<const MemoryAccount*>& external) const {
+        size_t fixed = 0;
+        for (const auto* account : external) fixed += account->getBytes();
+        forEachAttribute([&](const auto& slot) {
+            auto memory = slot.index.memory();
+            fixed += decay_t<decltype(slot.index)>::kSpillable ? memory.dictionary : memory.total();
+        });
+        for (const auto& entry : tagIndexes) fixed += entry.second->memory().dictionary;
+        return fixed + readableAccounts.read().total() + sampleAccounts.read().total() + baseAccounts.read().total();
+    }
+    
+    // 倒排链的额度随不可换出部分的增减调整（不低于保底），超出时换出冷链；溢出文件中垃圾过多时整体压缩
+    void enforceBudgetLocked() {
+        if (!spill) return;
+        size_t fixed = fixedBytesLocked(externalAccounts);
+        spill->setBudget(max(memoryBudget > fixed ? memoryBudget - fixed : 0, kMinPostingBytes));
+        spill->enforce();
+        if (spill->needsCompaction()) {
+            vector<CompressedInvertedList*> lists;
+            forEachListLocked([&](CompressedInvertedList& list) { lists.push_back(&list); });
+            spill->compact(lists);
+        }
+    }
+};
+
+// 二进制序列化：定长整数按本机字节序（小端）写入，字符串带 32 位长度前缀
+class BinaryWriter {
+public:
+    void putU8(uint8_t value) { buffer.push_back((char)value); }
+    void putU32(uint32_t value) { append(&value, sizeof(value)); }
+    void putU64(uint64_t value) { append(&value, sizeof(value)); }
+    void putI64(int64_t value) { append(&value, sizeof(value)); }
+    void putString(const string& value) {
+        putU32((uint32_t)value.size());
+        buffer.append(value);
+    }
+    
+    const string& data() const { return buffer; }
+    size_t size() const { return buffer.size(); }
+    void clear() { buffer.clear(); }
+    
+private:
+    string buffer;
+    
+    void append(const void* data, size_t length) {
+        buffer.append(static_cast<const char*>(data), length);
+    }
+};
+
+class BinaryReader {
+public:
+    BinaryReader(const char* begin, const char* end) : cursor(begin), limit(end) {}
+    
+    bool getU8(uint8_t& value) { return read(&value, sizeof(value)); }
+    bool getU32(uint32_t& value) { return read(&value, sizeof(value)); }
+    bool getU64(uint64_t& value) { return read(&value, sizeof(value)); }
+    bool getI64(int64_t& value) { return read(&value, sizeof(value)); }
+    bool getString(string& value) {
+        uint32_t length;
+        if (!getU32(length) || (size_t)(limit - cursor) < length) return false;
+        value.assign(cursor, length);
+        cursor += length;
+        return true;
+    }
+    
+    const char* position() const { return cursor; }
+    bool atEnd() const { return cursor == limit; }
+    size_t remaining() const { return limit - cursor; }
+    
+private:
+    const char* cursor;
+    const char* limit;
+    
+    bool read(void* out, size_t length) {
+        if ((size_t)(limit - cursor) < length) return false;
+        memcpy(out, cursor, length);
+        cursor += length;
+        return true;
+    }
+};
+
+// 整个文件读入内存（日志段、轨迹）
+inline bool readWholeFile(const string& path, string& content) {
+    int in = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+    char buf[1 << 16];
+    ssize_t n;
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        content.append(buf, n);
+    }
+    close(in);
+    return n == 0;
+}
+
+// FNV-1a 校验和，用于发现日志尾部的残缺记录和损坏的快照
+inline uint32_t checksum32(const char* data, size_t length, uint32_t seed = 2166136261u) {
+    uint32_t hash = seed;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+enum class WalOp : uint8_t {
+    Add = 1,             // addFile / addFiles / bulkLoad
+    Upsert = 2,          // applyMutations 中的增改
+    Update = 3,          // updateFile
+    Remove = 4,
+    RemoveDirectory = 5,
+    DirectoryState = 6,
+    Tags = 7,            // tagFile：修改后的全部标签
+};
+
+struct WalRecord {
+    WalOp op = WalOp::Add;
+    FileRecord file;              // Add / Upsert / Update
+    string path;                  // Remove / RemoveDirectory / Tags
+    DirectoryRecord directory;    // DirectoryState
+    vector<FileTag> tags;         // Tags
+};
+
+// 预写日志。变更在树的写锁内追加到内存缓冲，每次公开写操作结束时 commit，
+// 一次 write 写入当前日志段；fsync 只在 sync() 和检查点时进行。
+// 日志按段（generation）存放：检查点开始时切换到新段，快照写完后删除旧段。
+// 每条记录为 [u32 长度][u32 校验和][内容]，重放时遇到残缺记录即停止。
+class WriteAheadLog {
+public:
+    // 打开目录并新建一个日志段（不续写旧段，旧段由恢复流程重放）
+    explicit WriteAheadLog(const string& dir) : directory(dir) {
+        auto generations = listGenerations(directory);
+        generation = generations.empty() ? 1 : generations.back() + 1;
+        openSegment();
+    }
+    
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+    
+    ~WriteAheadLog() {
+        lock_guard<mutex> lock(walMutex);
+        flushLocked();
+        if (fd >= 0) close(fd);
+    }
+    
+    void append(const WalRecord& record) {
+        lock_guard<mutex> lock(walMutex);
+        BinaryWriter body;
+        body.putU8((uint8_t)record.op);
+        switch (record.op) {
+            case WalOp::Add:
+            case WalOp::Upsert:
+            case WalOp::Update:
+                body.putString(record.file.path);
+                body.putString(record.file.fileName);
+                body.putString(record.file.extension);
+                body.putI64(record.file.fileSize);
+                body.putString(record.file.owner);
+                body.putString(record.file.createTime);
+                body.putI64(record.file.modifyTime);
+                body.putU32(record.file.mode);
+                body.putU32(record.file.uid);
+                body.putU32(record.file.gid);
+                break;
+            case WalOp::Remove:
+            case WalOp::RemoveDirectory:
+                body.putString(record.path);
+                break;
+            case WalOp::DirectoryState:
+                body.putString(record.directory.path);
+                body.putI64(record.directory.modifyTimeNs);
+                body.putU64(record.directory.childCount);
+                break;
+            case WalOp::Tags:
+                body.putString(record.path);
+                body.putU32((uint32_t)record.tags.size());
+                for (const auto& tag : record.tags) {
+                    body.putString(tag.key);
+                    body.putString(tag.value);
+                }
+                break;
+        }
+        BinaryWriter header;
+        header.putU32((uint32_t)body.size());
+        header.putU32(checksum32(body.data().data(), body.size()));
+        pendingData.append(header.data());
+        pendingData.append(body.data());
+    }
+    
+    void appendFile(WalOp op, const FileRecord& file) {
+        WalRecord record;
+        record.op = op;
+        record.file = file;
+        append(record);
+    }
+    
+    void appendPath(WalOp op, const string& path) {
+        WalRecord record;
+        record.op = op;
+        record.path = path;
+        append(record);
+    }
+    
+    void appendDirectoryState(const DirectoryRecord& directory) {
+        WalRecord record;
+        record.op = WalOp::DirectoryState;
+        record.directory = directory;
+        append(record);
+    }
+    
+    void appendTags(const string& path, const vector<FileTag>& tags) {
+        WalRecord record;
+        record.op = WalOp::Tags;
+        record.path = path;
+        record.tags = tags;
+        append(record);
+    }
+    
+    // 把缓冲的记录写入当前段（不 fsync）
+    void commit() {
+        lock_guard<mutex> lock(walMutex);
+        flushLocked();
+    }
+    
+    void sync() {
+        lock_guard<mutex> lock(walMutex);
+        flushLocked();
+        if (fsync(fd) != 0) throw runtime_error(string("日志 fsync 失败: ") + strerror(errno));
+    }
+    
+    // 切换到新日志段，返回新段号。旧段不在这里 fsync：调用方持有树锁，
+    // 而旧段的内容随后会被 fsync 过的快照覆盖
+    uint64_t rotate() {
+        lock_guard<mutex> lock(walMutex);
+        flushLocked();
+        close(fd);
+        generation++;
+        openSegment();
+        return generation;
+    }
+    
+    // 删除段号小于 keepFrom 的所有日志段
+    static void truncateBefore(const string& dir, uint64_t keepFrom) {
+        for (uint64_t g : listGenerations(dir)) {
+            if (g < keepFrom) unlink(segmentPath(dir, g).c_str());
+        }
+    }
+    
+    uint64_t currentGeneration() const {
+        lock_guard<mutex> lock(walMutex);
+        return generation;
+    }
+    
+    static vector<uint64_t> listGenerations(const string& dir) {
+        vector<uint64_t> generations;
+        DIR* dp = opendir(dir.c_str());
+        if (!dp) return generations;
+        while (struct dirent* entry = readdir(dp)) {
+            if (strncmp(entry->d_name, "wal.", 4) == 0) {
+                generations.push_back(strtoull(entry->d_name + 4, nullptr, 10));
+            }
+        }
+        closedir(dp);
+        sort(generations.begin(), generations.end());
+        return generations;
+    }
+    
+    // 依次重放段号 >= fromGeneration 的所有日志，返回重放的记录数
+    static size_t replay(const string& dir, uint64_t fromGeneration,
+                         const function<void(const WalRecord&)>& apply) {
+        size_t replayed = 0;
+        for (uint64_t g : listGenerations(dir)) {
+            if (g < fromGeneration) continue;
+            string content;
+            if (!readWholeFile(segmentPath(dir, g), content)) continue;
+            
+            BinaryReader reader(content.data(), content.data() + content.size());
+            while (!reader.atEnd()) {
+                uint32_t length, checksum;
+                if (!reader.getU32(length) || !reader.getU32(checksum)) break;
+                const char* body = reader.position();
+                if ((size_t)(content.data() + content.size() - body) < length ||
+                    checksum32(body, length) != checksum) {
+                    break;
+                }
+                BinaryReader recordReader(body, body + length);
+                WalRecord record;
+                if (!decode(recordReader, record)) break;
+                apply(record);
+                replayed++;
+                reader = BinaryReader(body + length, content.data() + content.size());
+            }
+        }
+        return replayed;
+    }
+    
+private:
+    string directory;
+    int fd = -1;
+    uint64_t generation = 1;
+    string pendingData;
+    mutable mutex walMutex;
+    
+    static string segmentPath(const string& dir, uint64_t g) {
+        char name[32];
+        snprintf(name, sizeof(name), "wal.%012llu", (unsigned long long)g);
+        return dir + "/" + name;
+    }
+    
+    void openSegment() {
+        string path = segmentPath(directory, generation);
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw runtime_error("无法打开日志段: " + path + ": " + strerror(errno));
+        }
+    }
+    
+    void flushLocked() {
+        const char* data = pendingData.data();
+        size_t remaining = pendingData.size();
+        while (remaining > 0) {
+            ssize_t written = write(fd, data, remaining);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                throw runtime_error(string("写日志失败: ") + strerror(errno));
+            }
+            data += written;
+            remaining -= written;
+        }
+        pendingData.clear();
+    }
+    
+    static bool decode(BinaryReader& reader, WalRecord& record) {
+        uint8_t op;
+        if (!reader.getU8(op)) return false;
+        record.op = (WalOp)op;
+        int64_t size, modifyTime;
+        uint64_t childCount;
+        switch (record.op) {
+            case WalOp::Add:
+            case WalOp::Upsert:
+            case WalOp::Update:
+                if (!reader.getString(record.file.path) || !reader.getString(record.file.fileName) ||
+                    !reader.getString(record.file.extension) || !reader.getI64(size) ||
+                    !reader.getString(record.file.owner) || !reader.getString(record.file.createTime) ||
+                    !reader.getI64(modifyTime)) {
+                    return false;
+                }
+                record.file.fileSize = size;
+                record.file.modifyTime = modifyTime;
+                return reader.getU32(record.file.mode) && reader.getU32(record.file.uid) &&
+                       reader.getU32(record.file.gid);
+            case WalOp::Remove:
+            case WalOp::RemoveDirectory:
+                return reader.getString(record.path);
+            case WalOp::DirectoryState:
+                if (!reader.getString(record.directory.path) || !reader.getI64(modifyTime) ||
+                    !reader.getU64(childCount)) {
+                    return false;
+                }
+                record.directory.modifyTimeNs = modifyTime;
+                record.directory.childCount = childCount;
+                return true;
+            case WalOp::Tags: {
+                uint32_t count;
+                if (!reader.getString(record.path) || !reader.getU32(count) || count > reader.remaining()) {
+                    return false;
+                }
+                record.tags.resize(count);
+                for (auto& tag : record.tags) {
+                    if (!reader.getString(tag.key) || !reader.getString(tag.value)) return false;
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// 检查点快照：捕获时只复制元数据指针（FileMetadata 不可变，更新走写时复制），
+// 序列化在后台完成，捕获期间只短暂阻塞写操作
+struct CheckpointSnapshot {
+    vector<shared_ptr<FileMetadata>> files;
+    vector<DirectoryRecord> directories;
+    int nextFileId = 1;
+    uint64_t walGeneration = 0;   // 快照包含此段之前的全部日志
+};
+
+// 对数线性桶的延迟直方图（HDR 风格，单位纳秒）：128 ns 以内每纳秒一个桶，之后每个 2 的幂区间
+// 64 个桶，相对误差不超过 1/64；2^40 ns（约 18 分钟）以上计入最后一个桶
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 6;
+    static constexpr int kMaxExponent = 40;
+    static constexpr size_t kLinearBuckets = size_t(2) << kSubBucketBits;
+    static constexpr size_t kBucketCount =
+        kLinearBuckets + (size_t(kMaxExponent - kSubBucketBits - 1) << kSubBucketBits);
+    
+    LatencyHistogram() : counts(kBucketCount, 0) {}
+    
+    static size_t bucketIndex(uint64_t ns) {
+        if (ns < kLinearBuckets) return (size_t)ns;
+        int exponent = 63 - __builtin_clzll(ns);
+        if (exponent >= kMaxExponent) return kBucketCount - 1;
+        size_t subBucket = (size_t)(ns >> (exponent - kSubBucketBits)) - (size_t(1) << kSubBucketBits);
+        return kLinearBuckets + ((size_t)(exponent - kSubBucketBits - 1) << kSubBucketBits) + subBucket;
+    }
+    
+    // 桶内的最大值（与 HDR 的 highestEquivalentValue 相同）
+    static uint64_t bucketUpperBound(size_t index) {
+        if (index < kLinearBuckets) return index;
+        size_t offset = index - kLinearBuckets;
+        int shift = (int)(offset >> kSubBucketBits) + 1;
+        uint64_t subBucket = (offset & ((size_t(1) << kSubBucketBits) - 1)) + (uint64_t(1) << kSubBucketBits);
+        return ((subBucket + 1) << shift) - 1;
+    }
+    
+    void record(uint64_t ns) {
+        counts[bucketIndex(ns)]++;
+        total++;
+        sum += ns;
+        maximum = max(maximum, ns);
+    }
+    
+    void addBucket(size_t index, uint64_t count) {
+        counts[index] += count;
+        total += count;
+    }
+    
+    void addTotals(uint64_t sumNs, uint64_t maxNs) {
+        sum += sumNs;
+        maximum = max(maximum, maxNs);
+    }
+    
+    // q 取 [0, 1]；结果不超过记录到的最大值
+    uint64_t percentile(double q) const {
+        if (total == 0) return 0;
+        uint64_t rank = max<uint64_t>(1, (uint64_t)ceil(q * total));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            seen += counts[i];
+            if (seen >= rank) return min(bucketUpperBound(i), maximum);
+        }
+        return maximum;
+    }
+    
+    uint64_t getCount() const {
+        return total;
+    }
+    
+    uint64_t getSum() const {
+        return sum;
+    }
+    
+    uint64_t getMax() const {
+        return maximum;
+    }
+    
+    double getMean() const {
+        return total ? (double)sum / total : 0;
+    }
+    
+private:
+    vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t maximum = 0;
+};
+
+// FileSystemSimulator 的入口操作，用于延迟统计
+enum class SimulatorOp {
+    AddFile, AddFiles, BulkLoad, RemoveFile, UpdateFile, ApplyMutations, ListDirectories,
+    DirectoryListing, ListFiles, QueryExtensionTraditional, QueryExtension, QuerySizeRange, QueryOwner, Query,
+    QueryScan, TagFile, EstimateRows, EstimateDistinct, IndexTag
+};
+constexpr size_t kSimulatorOpCount = 19;
+const char* const kSimulatorOpNames[kSimulatorOpCount] = {
+    "add_file", "add_files", "bulk_load", "remove_file", "update_file", "apply_mutations", "list_directories",
+    "directory_listing", "list_files", "query_extension_traditional", "query_extension", "query_size_range",
+    "query_owner", "query", "query_scan", "tag_file", "estimate_rows", "estimate_distinct", "index_tag"};
+
+struct OperationLatency {
+    SimulatorOp op;
+    LatencyHistogram histogram;
+};
+
+// 按操作、按线程记录延迟：每个线程写自己的槽（单写者，无 RMW 和锁竞争），
+// 读取时把所有槽合并成普通直方图。槽内的桶数组在该线程第一次执行某操作时才分配
+class OperationLatencyRecorder {
+public:
+    OperationLatencyRecorder() : id(nextId.fetch_add(1, memory_order_relaxed)) {}
+    OperationLatencyRecorder(const OperationLatencyRecorder&) = delete;
+    OperationLatencyRecorder& operator=(const OperationLatencyRecorder&) = delete;
+    
+    void record(SimulatorOp op, uint64_t ns) {
+        auto& histogram = localSlot().histograms[(size_t)op];
+        auto* counts = histogram.counts.load(memory_order_acquire);
+        if (!counts) {
+            counts = new atomic<uint64_t>[LatencyHistogram::kBucketCount]();
+            histogram.counts.store(counts, memory_order_release);
+        }
+        bump(counts[LatencyHistogram::bucketIndex(ns)], 1);
+        bump(histogram.sum, ns);
+        if (ns > histogram.maximum.load(memory_order_relaxed)) histogram.maximum.store(ns, memory_order_relaxed);
+    }
+    
+    // 合并各线程的槽，返回有记录的操作
+    vector<OperationLatency> snapshot() const {
+        vector<OperationLatency> result;
+        lock_guard<mutex> lock(slotsMutex);
+        for (size_t op = 0; op < kSimulatorOpCount; ++op) {
+            OperationLatency merged{(SimulatorOp)op, LatencyHistogram()};
+            for (const auto& slot : slots) {
+                const auto& histogram = slot->histograms[op];
+                const auto* counts = histogram.counts.load(memory_order_acquire);
+                if (!counts) continue;
+                for (size_t i = 0; i < LatencyHistogram::kBucketCount; ++i) {
+                    uint64_t count = counts[i].load(memory_order_relaxed);
+                    if (count) merged.histogram.addBucket(i, count);
+                }
+                merged.histogram.addTotals(histogram.sum.load(memory_order_relaxed),
+                                           histogram.maximum.load(memory_order_relaxed));
+            }
+            if (merged.histogram.getCount()) result.push_back(move(merged));
+        }
+        return result;
+    }
+    
+private:
+    struct ThreadHistogram {
+        atomic<atomic<uint64_t>*> counts{nullptr};
+        atomic<uint64_t> sum{0};
+        atomic<uint64_t> maximum{0};
+        
+        ~ThreadHistogram() {
+            delete[] counts.load();
+        }
+    };
+    
+    struct ThreadSlot {
+        array<ThreadHistogram, kSimulatorOpCount> histograms;
+    };
+    
+    static inline atomic<uint64_t> nextId{1};
+    uint64_t id;                          // 进程内唯一，线程缓存据此识别记录器，地址复用也不会认错
+    mutable mutex slotsMutex;
+    vector<unique_ptr<ThreadSlot>> slots;
+    unordered_map<thread::id, ThreadSlot*> slotsByThread;   // 每个线程至多一个槽；线程号复用时沿用旧槽
+    
+    static void bump(atomic<uint64_t>& value, uint64_t delta) {
+        value.store(value.load(memory_order_relaxed) + delta, memory_order_relaxed);
+    }
+    
+    // 线程缓存最近使用的几个记录器的槽；被挤出后再次使用时按线程号找回原来的槽，不会新建
+    ThreadSlot& localSlot() {
+        thread_local vector<pair<uint64_t, ThreadSlot*>> cache;
+        for (const auto& entry : cache) {
+            if (entry.first == id) return *entry.second;
+        }
+        ThreadSlot* slot;
+        {
+            lock_guard<mutex> lock(slotsMutex);
+            auto& owned = slotsByThread[this_thread::get_id()];
+            if (!owned) {
+                slots.push_back(make_unique<ThreadSlot>());
+                owned = slots.back().get();
+            }
+            slot = owned;
+        }
+        if (cache.size() >= 8) cache.erase(cache.begin());
+        cache.emplace_back(id, slot);
+        return *slot;
+    }
+};
+
+// 作用域计时：析构时把耗时记到记录器（含等锁时间）
+class OperationTimer {
+public:
+    OperationTimer(OperationLatencyRecorder& recorder, SimulatorOp op)
+        : recorder(recorder), op(op), start(steady_clock::now()) {}
+    
+    ~OperationTimer() {
+        recorder.record(op, (uint64_t)duration_cast<nanoseconds>(steady_clock::now() - start).count());
+    }
+    
+private:
+    OperationLatencyRecorder& recorder;
+    SimulatorOp op;
+    steady_clock::time_point start;
+};
+
+// 操作轨迹的编码。变长整数（LEB128）和带变长长度前缀的字符串，比 WAL 的定长格式紧凑
+struct TraceCodec {
+    static void putVarint(BinaryWriter& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.putU8((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        out.putU8((uint8_t)value);
+    }
+    
+    // zigzag 编码，小的负数也只占一两个字节
+    static void putSigned(BinaryWriter& out, int64_t value) {
+        putVarint(out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+    }
+    
+    static void putString(BinaryWriter& out, const string& value) {
+        putVarint(out, value.size());
+        for (char c : value) out.putU8((uint8_t)c);
+    }
+    
+    static void put(BinaryWriter& out, const FileRecord& record) {
+        putString(out, record.path);
+        putString(out, record.fileName);
+        putString(out, record.extension);
+        putSigned(out, record.fileSize);
+        putString(out, record.owner);
+        putString(out, record.createTime);
+        putSigned(out, record.modifyTime);
+        putVarint(out, record.mode);
+        putVarint(out, record.uid);
+        putVarint(out, record.gid);
+    }
+    
+    static void put(BinaryWriter& out, const vector<FileRecord>& records) {
+        putVarint(out, records.size());
+        for (const auto& record : records) put(out, record);
+    }
+    
+    static void put(BinaryWriter& out, const MutationBatch& batch) {
+        put(out, batch.upserts);
+        putVarint(out, batch.removals.size());
+        for (const auto& path : batch.removals) putString(out, path);
+        putVarint(out, batch.directoryRemovals.size());
+        for (const auto& path : batch.directoryRemovals) putString(out, path);
+        putVarint(out, batch.directoryStates.size());
+        for (const auto& state : batch.directoryStates) {
+            putString(out, state.path);
+            putSigned(out, state.modifyTimeNs);
+            putVarint(out, state.childCount);
+        }
+    }
+    
+    static void put(BinaryWriter& out, const FileQuery& query) {
+        putVarint(out, (query.extension ? 1 : 0) | (query.owner ? 2 : 0) | (query.createTime ? 4 : 0) |
+                           (query.sizeRange ? 8 : 0) | (query.tags.empty() ? 0 : 16) | (query.gid ? 32 : 0) |
+                           (query.caller ? 64 : 0) | (query.modifyTimeRange ? 128 : 0) | (query.orderBy ? 256 : 0) |
+                           (query.limit ? 512 : 0));
+        if (query.extension) putString(out, *query.extension);
+        if (query.owner) putString(out, *query.owner);
+        if (query.createTime) putString(out, *query.createTime);
+        if (query.sizeRange) {
+            putSigned(out, query.sizeRange->first);
+            putSigned(out, query.sizeRange->second);
+        }
+        if (!query.tags.empty()) {
+            putVarint(out, query.tags.size());
+            for (const auto& tag : query.tags) {
+                putString(out, tag.key);
+                putString(out, tag.value);
+            }
+        }
+        if (query.gid) putVarint(out, *query.gid);
+        if (query.caller) {
+            putVarint(out, query.caller->uid);
+            putVarint(out, query.caller->gids.size());
+            for (uint32_t gid : query.caller->gids) putVarint(out, gid);
+        }
+        if (query.modifyTimeRange) {
+            putSigned(out, query.modifyTimeRange->first);
+            putSigned(out, query.modifyTimeRange->second);
+        }
+        if (query.orderBy) out.putU8((uint8_t)((uint8_t)query.orderBy->key << 1 | (query.orderBy->descending ? 1 : 0)));
+        if (query.limit) putVarint(out, query.limit);
+    }
+    
+    static void put(BinaryWriter& out, const PredicateExpr& expr) {
+        out.putU8((uint8_t)expr.kind);
+        if (expr.kind == PredicateExpr::Kind::Leaf) {
+            put(out, expr.leaf);
+            return;
+        }
+        putVarint(out, expr.children.size());
+        for (const auto& child : expr.children) put(out, child);
+    }
+    
+    static bool getVarint(BinaryReader& in, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte;
+            if (!in.getU8(byte)) return false;
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+    
+    static bool getUnsigned(BinaryReader& in, uint32_t& value) {
+        uint64_t raw;
+        if (!getVarint(in, raw) || raw > UINT32_MAX) return false;
+        value = (uint32_t)raw;
+        return true;
+    }
+    
+    static bool getSigned(BinaryReader& in, int64_t& value) {
+        uint64_t raw;
+        if (!getVarint(in, raw)) return false;
+        value = (int64_t)(raw >> 1) ^ -(int64_t)(raw & 1);
+        return true;
+    }
+    
+    template <typename Int>
+    static bool getSigned(BinaryReader& in, Int& value) {
+        int64_t raw;
+        if (!getSigned(in, raw)) return false;
+        value = (Int)raw;
+        return true;
+    }
+    
+    static bool getString(BinaryReader& in, string& value) {
+        uint64_t length;
+        if (!getVarint(in, length) || length > in.remaining()) return false;
+        value.resize(length);
+        for (auto& c : value) {
+            uint8_t byte;
+            if (!in.getU8(byte)) return false;
+            c = (char)byte;
+        }
+        return true;
+    }
+    
+    static bool get(BinaryReader& in, FileRecord& record) {
+        return getString(in, record.path) && getString(in, record.fileName) && getString(in, record.extension) &&
+               getSigned(in, record.fileSize) && getString(in, record.owner) && getString(in, record.createTime) &&
+               getSigned(in, record.modifyTime) && getUnsigned(in, record.mode) && getUnsigned(in, record.uid) &&
+               getUnsigned(in, record.gid);
+    }
+    
+    // 元素个数先和剩余字节数比较（每个元素至少一个字节），截断或损坏的轨迹不会引发巨大的分配
+    static bool get(BinaryReader& in, vector<FileRecord>& records) {
+        uint64_t count;
+        if (!getVarint(in, count) || count > in.remaining()) return false;
+        records.resize(count);
+        for (auto& record : records) {
+            if (!get(in, record)) return false;
+        }
+        return true;
+    }
+    
+    static bool get(BinaryReader& in, MutationBatch& batch) {
+        uint64_t count;
+        if (!get(in, batch.upserts) || !getVarint(in, count) || count > in.remaining()) return false;
+        batch.removals.resize(count);
+        for (auto& path : batch.removals) {
+            if (!getString(in, path)) return false;
+        }
+        if (!getVarint(in, count) || count > in.remaining()) return false;
+        batch.directoryRemovals.resize(count);
+        for (auto& path : batch.directoryRemovals) {
+            if (!getString(in, path)) return false;
+        }
+        if (!getVarint(in, count) || count > in.remaining()) return false;
+        batch.directoryStates.resize(count);
+        for (auto& state : batch.directoryStates) {
+            uint64_t childCount;
+            if (!getString(in, state.path) || !getSigned(in, state.modifyTimeNs) || !getVarint(in, childCount)) {
+                return false;
+            }
+            state.childCount = childCount;
+        }
+        return true;
+    }
+    
+    static bool get(BinaryReader& in, FileQuery& query) {
+        uint64_t flags;
+        if (!getVarint(in, flags)) return false;
+        string text;
+        if (flags & 1) {
+            if (!getString(in, text)) return false;
+            query.extension = text;
+        }
+        if (flags & 2) {
+            if (!getString(in, text)) return false;
+            query.owner = text;
+        }
+        if (flags & 4) {
+            if (!getString(in, text)) return false;
+            query.createTime = text;
+        }
+        if (flags & 8) {
+            long long low, high;
+            if (!getSigned(in, low) || !getSigned(in, high)) return false;
+            query.sizeRange = make_pair(low, high);
+        }
+        if (flags & 16) {
+            uint64_t count;
+            if (!getVarint(in, count) || count > in.remaining()) return false;
+            query.tags.resize(count);
+            for (auto& tag : query.tags) {
+                if (!getString(in, tag.key) || !getString(in, tag.value)) return false;
+            }
+        }
+        if (flags & 32) {
+            uint32_t gid;
+            if (!getUnsigned(in, gid)) return false;
+            query.gid = gid;
+        }
+        if (flags & 64) {
+            uint32_t uid;
+            uint64_t count;
+            if (!getUnsigned(in, uid) || !getVarint(in, count) || count > in.remaining()) return false;
+            vector<uint32_t> gids(count);
+            for (auto& gid : gids) {
+                if (!getUnsigned(in, gid)) return false;
+            }
+            query.caller = Principal(uid, move(gids));
+        }
+        if (flags & 128) {
+            long long low, high;
+            if (!getSigned(in, low) || !getSigned(in, high)) return false;
+            query.modifyTimeRange = make_pair(low, high);
+        }
+        if (flags & 256) {
+            uint8_t order;
+            if (!in.getU8(order) || (order >> 1) > (uint8_t)OrderKey::CreateTime) return false;
+            query.orderBy = QueryOrder{(OrderKey)(order >> 1), (order & 1) != 0};
+        }
+        if (flags & 512) {
+            uint64_t limit;
+            if (!getVarint(in, limit) || limit == 0) return false;
+            query.limit = (size_t)limit;
+        }
+        return true;
+    }
+    
+    // 嵌套深度有上限，损坏的轨迹不会递归到栈溢出
+    static bool get(BinaryReader& in, PredicateExpr& expr, int depth = 0) {
+        uint8_t kind;
+        if (depth > 64 || !in.getU8(kind) || kind > (uint8_t)PredicateExpr::Kind::Or) return false;
+        expr.kind = (PredicateExpr::Kind)kind;
+        if (expr.kind == PredicateExpr::Kind::Leaf) return get(in, expr.leaf);
+        uint64_t count;
+        if (!getVarint(in, count) || count > in.remaining()) return false;
+        expr.children.resize(count);
+        for (auto& child : expr.children) {
+            if (!get(in, child, depth + 1)) return false;
+        }
+        return true;
+    }
+};
+
+// 操作轨迹记录器：FileSystemSimulator 的每次公开调用记一条
+// [时间差 zigzag][操作 u8][线程号 varint][参数]，时间为相对上一条的纳秒数（起点在文件头）。
+// 写操作在树的写锁内记录，轨迹中的顺序就是实际执行顺序；查询在入口处记录。
+// 记录先攒在内存，满 1MB 写一次文件；文件尾部不完整的记录在读取时丢弃
+class TraceRecorder {
+public:
+    static constexpr char kMagic[8] = {'M', 'A', 'I', 'T', 'R', 'C', '0', '2'};
+    static constexpr size_t kFlushBytes = 1 << 20;
+    
+    explicit TraceRecorder(const string& path) : origin(steady_clock::now()) {
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) throw runtime_error("无法写入轨迹: " + path + ": " + strerror(errno));
+        BinaryWriter header;
+        for (char c : kMagic) header.putU8((uint8_t)c);
+        header.putI64(duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count());
+        writeAll(header.data());
+    }
+    
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+    
+    ~TraceRecorder() {
+        try {
+            flush();
+        } catch (const exception& e) {
+            cerr << "轨迹写入失败: " << e.what() << endl;
+        }
+        close(fd);
+    }
+    
+    // encode(BinaryWriter&) 写入该操作的参数（编码见 TraceCodec）
+    template <typename Encode>
+    void record(SimulatorOp op, Encode&& encode) {
+        unique_lock<mutex> lock(bufferMutex);
+        int64_t now = duration_cast<nanoseconds>(steady_clock::now() - origin).count();
+        TraceCodec::putSigned(buffer, now - lastNs);
+        lastNs = now;
+        buffer.putU8((uint8_t)op);
+        TraceCodec::putVarint(buffer, threadTag());
+        encode(buffer);
+        records++;
+        if (buffer.size() < kFlushBytes) return;
+        
+        // 先拿到文件锁再放开缓冲锁，各块按取出的顺序写入
+        string chunk = buffer.data();
+        buffer.clear();
+        lock_guard<mutex> fileLock(fileMutex);
+        lock.unlock();
+        writeAll(chunk);
+    }
+    
+    void flush() {
+        unique_lock<mutex> lock(bufferMutex);
+        string chunk = buffer.data();
+        buffer.clear();
+        lock_guard<mutex> fileLock(fileMutex);
+        lock.unlock();
+        writeAll(chunk);
+    }
+    
+    uint64_t getRecords() const {
+        lock_guard<mutex> lock(bufferMutex);
+        return records;
+    }
+    
+private:
+    int fd;
+    steady_clock::time_point origin;
+    mutable mutex bufferMutex;
+    mutex fileMutex;
+    BinaryWriter buffer;
+    int64_t lastNs = 0;
+    uint64_t records = 0;
+    
+    // 进程内线程的小编号，按第一次记录的先后分配
+    static uint32_t threadTag() {
+        static atomic<uint32_t> nextTag{0};
+        thread_local uint32_t tag = nextTag.fetch_add(1, memory_order_relaxed);
+        return tag;
+    }
+    
+    void writeAll(const string& data) {
+        const char* cursor = data.data();
+        size_t remaining = data.size();
+        while (remaining > 0) {
+            ssize_t written = write(fd, cursor, remaining);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                throw runtime_error(string("写轨迹失败: ") + strerror(errno));
+            }
+            cursor += written;
+            remaining -= written;
+        }
+    }
+};
+
+// 文件系统模拟器
+class FileSystemSimulator {
+private:
+    using MetadataMap = TrackedHashMap<int, shared_ptr<FileMetadata>>;
+    
+    // 记账分配器的账户先于容器构造；记录可能比模拟器活得久，账户永不释放
+    MemoryAccount* treeAccount = MemoryAccount::create();
+    MemoryAccount* metadataAccount = MemoryAccount::create();
+    shared_ptr<DirectoryNode> root;
+    MetadataMap fileMetadataMap{MetadataMap::allocator_type(metadataAccount)};
+    InvertedIndex invertedIndex;
+    mutable shared_mutex treeMetadataMutex;
+    int nextFileId;
+    shared_ptr<WriteAheadLog> wal;   // 为空时不记日志
+    mutable OperationLatencyRecorder latencies;
+    
+    struct SlowQueryLog {
+        nanoseconds threshold;
+        function<void(const QueryProfile&)> sink;
+    };
+    shared_ptr<const SlowQueryLog> slowQueryLog;   // 用 atomic_load/atomic_store 访问
+    atomic<bool> tracing{false};                   // 未录制时省掉 atomic_load
+    // 摘要松弛后未收紧的删除和修改次数；松弛的摘要只是偏宽，扫描照样可以据此剪枝
+    static constexpr size_t kMinLooseChanges = 1024;
+    static constexpr size_t kLooseFilesPerTighten = 64;
+    size_t looseChanges = 0;
+    shared_ptr<TraceRecorder> trace;               // 用 atomic_load/atomic_store 访问
+    
+public:
+ 
+    FileSystemSimulator() : nextFileId(1) {
+        root = makeNode("/", true);
+    }
+    
+    // 添加文件并同时更新目录树和倒排索引（同名文件视为替换）
+    bool addFile(const string& path, const string& fileName, const string& extension,
+                long long fileSize, const string& owner, const string& createTime) {
+        OperationTimer timer(latencies, SimulatorOp::AddFile);
+        unique_lock<shared_mutex> lock(treeMetadataMutex);
+        
+        FileRecord record{path, fileName, extension, fileSize, owner, createTime, 0};
+        traceOp(SimulatorOp::AddFile, [&](BinaryWriter& out) { TraceCodec::put(out, record); });
+        if (!addRecordLocked(record)) return false;
+        tightenLooseSummariesLocked();
+        
+        if (wal) {
+            wal->appendFile(WalOp::Add, record);
+            wal->commit();
+        }
+        return true;
+    }
+    
+    // 批量添加文件：整批只加一次锁，连续同目录的记录复用目录节点
+    size_t addFiles(const vector<FileRecord>& records) {
+        OperationTimer timer(latencies, SimulatorOp::AddFiles);
+        unique_lock<shared_mutex> lock(treeMetadataMutex);
+        traceOp(SimulatorOp::AddFiles, [&](BinaryWriter& out) { TraceCodec::put(out, records); });
+        auto added = insertRecordsLocked(records);
+        invertedIndex.addFiles(added);
+        tightenLooseSummariesLocked();
+        logRecordsLocked(WalOp::Add, records);
+        return added.size();
+    }
+    
+    // 批量装载（元数据导出等离线来源）：目录树和元数据表整批构建，
+    // 倒排索引走排序式批量构建，不经过逐文件的 addFile
+    size_t bulkLoad(const vector<FileRecord>& records) {
+        OperationTimer timer(latencies, SimulatorOp::BulkLoad);
+        unique_lock<shared_mutex> lock(treeMetadataMutex);
+        traceOp(SimulatorOp::BulkLoad, [&](BinaryWriter& out) { TraceCodec::put(out, records); });
+        fileMetadataMap.reserve(fileMetadataMap.size() + records.size());
+        auto added = insertRecordsLocked(records);
+        invertedIndex.bulkAdd(added);
+        tightenLooseSummariesLocked();
+        logRecordsLocked(WalOp::Add, records);
+        return added.size();
+    }
+    
+    // 删除文件并更新索引
+    bool removeFile(const string& fullPath) {
+        OperationTimer timer(latencies, SimulatorOp::RemoveFile);
+        unique_lock<shared_mutex> lock(treeMetadataMutex);
+        traceOp(SimulatorOp::RemoveFile, [&](BinaryWriter& out) { TraceCodec::putString(out, fullPath); });
+        if (!removeFileLocked(fullPath)) return false;
+        tightenLooseSummariesLocked();
+        
+        if (wal) {
+            wal->appendPath(WalOp::Remove, fullPath);
+            wal->commit();
+        }
+        return true;
+    }
+    
+    // 更新已有文件的元数据：写时复制出新的 FileMetadata 替换旧对象，
+    // 已经交给调用方的旧指针保持不变，fileId 不变
+    bool updateFile(const FileRecord& record) {
+        OperationTimer timer(latencies, SimulatorOp::UpdateFile);
+        unique_lock<shared_mutex> lock(treeMetadataMutex);
+        traceOp(SimulatorOp::UpdateFile, [&](BinaryWriter& out) { TraceCodec::put(out, record); });
+        if (!updateFileLocked(record)) return false;
+        tightenLooseSummariesLocked();
+        
+        if (wal) {
+            wal->appendFile(WalOp::Update, record);
+            wal->commit();
+        }
+        return true;
+    }
+    
+    // 设置、追加或删除文件的一个扩展属性/标签（见 TagMode）。文件不存在或标签没有变化时返回 false。
+    // 写时复制出新的 FileMetadata，倒排只改建了索引的标签键；标签随文件保留到文件被删除或同名替换，
+    // updateFile 和 applyMutations 的更新不影响标签
+    bool tagFile(const string& fullPath, const string& key, const string& value, TagMode mode = TagMode::Add) {
+        if (key.empty()) throw runtime_error("标签键不能为空");
+        OperationTimer timer(latencies, SimulatorOp::TagFile);
+        unique_lock<shared_mutex> lock(treeMetadataMutex);
+        traceOp(SimulatorOp::TagFile, [&](BinaryWriter& out) {
+            TraceCodec::putString(out, fullPath);
+            TraceCodec::putString(out, key);
+            TraceCodec::putString(out, value);
+            out.putU8((uint8_t)mode);
+        });
+        auto fileNode = findFileNode(fullPath);
+        if (!fileNode || fileNode->isDirectory || !fileNode->fileData) return false;
+        auto tags = fileNode->fileData->tags;
+        if (!editTags(tags, key, value, mode)) return false;
+        replaceTagsLocked(fileNode, move(tags));
+        
+        if (wal) {
+            wal->appendTags(fullPath, fileNode->fileData->tags);
+            wal->commit();
+        }
+        return true;
+    }
+    
+    // 为标签键建索引（从现有元数据批量构建），之后该键的等值条件和内置属性一样走倒排；
+    // 已建过时返回 false。索引定义不写日志和快照，恢复后须重新调用
+    bool indexTag(const string& key) {
+        OperationTimer timer(latencies, SimulatorOp::IndexTag);
+        shared_lock<shared_mutex> lock(treeMetadataMutex);
+        traceOp(SimulatorOp::IndexTag, [&](BinaryWriter& out) { TraceCodec::putString(out, key); });
+        return invertedIndex.indexTag(key, sortedColumnsLocked());
+    }
+    
+    vector<string> getIndexedTagKeys() const {
+        return invertedIndex.indexedTagKeys();
+    }
+    
+    // 应用一批变更（先删子树、再删文件、最后增改），整批只加一次锁
+    MutationResult applyMutations(const MutationBatch& batch) {
+        OperationTimer timer(latencies, SimulatorOp::ApplyMutations);
+        unique_lock<shared_mutex> lock(treeMetadataMutex);
+        traceOp(SimulatorOp::ApplyMutations, [&](BinaryWriter& out) { TraceCodec::put(out, batch); });
+        auto result = applyMutationsLocked(batch);
+        tightenLooseSummariesLocked();
+        
+        // 按应用顺序逐条记日志，重放时逐条应用得到相同结果
+        if (wal) {
+            for (const auto& dirPath : batch.directoryRemovals) wal->appendPath(WalOp::RemoveDirectory, dirPath);
+            for (const auto& fullPath : batch.removals) wal->appendPath(WalOp::Remove, fullPath);
+            for (const auto& record : batch.upserts) wal->appendFile(WalOp::Upsert, record);
+            for (const auto& state : batch.directoryStates) wal->appendDirectoryState(state);
+            wal->commit();
+        }
+        return result;
+    }
+    
+    // 列出某目录子树下的全部目录及其记录的状态（含该目录自身）
+    vector<DirectoryRecord> listDirectoriesUnder(const string& dirPath) const {
+        OperationTimer timer(latencies, SimulatorOp::ListDirectories);
+        traceOp(SimulatorOp::ListDirectories, [&](BinaryWriter& out) { TraceCodec::putString(out, dirPath); });
+        shared_lock<shared_mutex> lock(treeMetadataMutex);
+        vector<DirectoryRecord> result;
+        auto node = findFileNode(dirPath);
+        if (node && node->isDirectory) {
+            collectDirectoriesLocked(node, dirPath, result);
+        }
+        return result;
+    }
+    
+    // 读取单个目录的直接子项名称
+    bool getDirectoryListing(const string& dirPath, vector<string>& subdirectories,
+                             vector<string>& files) const {
+        OperationTimer timer(latencies, SimulatorOp::DirectoryListing);
+        traceOp(SimulatorOp::DirectoryListing, [&](BinaryWriter& out) { TraceCodec::putString(out, dirPath); });
+        shared_lock<shared_mutex> lock(treeMetadataMutex);
+        auto node = findFileNode(dirPath);
+        if (!node || !node->isDirectory) return false;
+        for (const auto& child : node->children) {
+            (child.second->isDirectory ? subdirectories : files).push_back(child.first);
+        }
+        return true;
+    }
+    
+    // 列出某目录子树下的全部文件（目录不存在时返回空）
+    vector<shared_ptr<FileMetadata>> listFilesUnder(const string& dirPath) const {
+        OperationTimer timer(latencies, SimulatorOp::ListFiles);
+        traceOp(SimulatorOp::ListFiles, [&](BinaryWriter& out) { TraceCodec::putString(out, dirPath); });
+        shared_lock<shared_mutex> lock(treeMetadataMutex);
+        vector<shared_ptr<FileMetadata>> result;
+        auto node = findFileNode(dirPath);
+        if (node && node->isDirectory) {
+            traverseAndFilter(node, [&](const shared_ptr<FileMetadata>& file) {
+                result.push_back(file);
+            });
+        }
+        return result;
+    }
+    
+    // 传统方式查询（遍历目录树）
+    vector<shared_ptr<FileMetadata>> queryByExtensionTraditional(const string& ext) const {
+        OperationTimer timer(latencies, SimulatorOp::QueryExtensionTraditional);
+        traceOp(SimulatorOp::QueryExtensionTraditional, [&](BinaryWriter& out) { TraceCodec::putString(out, ext); });
+        shared_lock<shared_mutex> lock(treeMetadataMutex);
+        vector<shared_ptr<FileMetadata>> result;
+        traverseAndFilter(root, [&](const shared_ptr<FileMetadata>& file) {
+            if (file->extension == ext) {
+                result.push_back(file);
+            }
+        });
+        return result;
+    }
+    
+    // 使用倒排索引查询；给定 profile 时填入执行剖析（见 QueryProfile）
+    vector<shared_ptr<FileMetadata>> queryByExtensionIndexed(const string& ext,
+                                                             QueryProfile* profile = nullptr) const {
+        OperationTimer timer(latencies, SimulatorOp::QueryExtension);
+        traceOp(SimulatorOp::QueryExtension, [&](BinaryWriter& out) { TraceCodec::putString(out, ext); });
+        FileQuery query;
+        query.extension = ext;
+        return runIndexedQuery(query, profile);
+    }
+    
+    vector<shared_ptr<FileMetadata>> queryBySizeRangeIndexed(long long minSize, long long maxSize,
+                                                             QueryProfile* profile = nullptr) const {
+        OperationTimer timer(latencies, SimulatorOp::QuerySizeRange);
+        traceOp(SimulatorOp::QuerySizeRange, [&](BinaryWriter& out) {
+            TraceCodec::putSigned(out, minSize);
+            TraceCodec::putSigned(out, maxSize);
+        });
+        FileQuery query;
+        query.sizeRange = make_pair(minSize, maxSize);
+        return runIndexedQuery(query, profile);
+    }
+    
+    vector<shared_ptr<FileMetadata>> queryByOwnerIndexed(const string& owner,
+                                                         QueryProfile* profile = nullptr) const {
+        OperationTimer timer(latencies, SimulatorOp::QueryOwner);
+        traceOp(SimulatorOp::QueryOwner, [&](BinaryWriter& out) { TraceCodec::putString(out, owner); });
+        FileQuery query;
+        query.owner = owner;
+        return runIndexedQuery(query, profile);
+    }
+    
+    // 多条件查询（见 FileQuery），没有条件时返回全部文件
+    vector<shared_ptr<FileMetadata>> queryIndexed(const FileQuery& query, QueryProfile* profile = nullptr) const {
+        OperationTimer timer(latencies, SimulatorOp::Query);
+        traceOp(SimulatorOp::Query, [&](BinaryWriter& out) { TraceCodec::put(out, query); });
+        return runIndexedQuery(query, profile);
+    }
+    
+    // 不走索引的即席扫描：遍历 dirPath 子树逐个比较条件，借助目录的子树摘要跳过不可能匹配的子树，
+    // 最后按 ORDER BY / LIMIT 排序截取。只加读锁，尚未收紧的松弛摘要照样用来剪枝
+    vector<shared_ptr<FileMetadata>> queryByScan(const FileQuery& query, const string& dirPath = "/",
+                                                 PruneStats* stats = nullptr) const {
+        OperationTimer timer(latencies, SimulatorOp::QueryScan);
+        traceOp(SimulatorOp::QueryScan, [&](BinaryWriter& out) {
+            TraceCodec::putString(out, dirPath);
+            TraceCodec::put(out, query);
+        });
+        shared_lock<shared_mutex> lock(treeMetadataMutex);
+        vector<shared_ptr<FileMetadata>> result;
+        PruneStats local;
+        PruneStats& counts = stats ? *stats : local;
+        auto node = findFileNode(dirPath);
+        if (node && node->isDirectory) {
+            auto probe = makeProbe(query);
+            if (probe.mayMatch(*node->summary)) {
+                scanLocked(node, probe, query, result, counts);
+            } else {
+                counts.directoriesPruned++;
+            }
+        }
+        lock.unlock();
+        if (query.orderBy || query.limit) orderResults(result, query, nullptr);
+        return result;
+    }
+    
+    // 谓词表达式结果行数的估计（见 InvertedIndex::estimateRows），供查询规划和监控使用，不执行查询
+    CardinalityEstimate estimateRows(const PredicateExpr& expr) const {
+        OperationTimer timer(latencies, SimulatorOp::EstimateRows);
+        traceOp(SimulatorOp::EstimateRows, [&](BinaryWriter& out) { TraceCodec::put(out, expr); });
+        return invertedIndex.estimateRows(expr);
+    }
+    
+    // dirPath 子树内某属性的不同取值个数（子树摘要中 HyperLogLog 草图的估计，误差约 1.6%），
+    // 根目录即全部文件。还没有草图的小子树现场遍历建一个临时草图，取值少时线性计数近乎精确。
+    // 最近一批删除或修改留下的松弛草图可能还没收紧（见 tightenLooseSummariesLocked），估计偏高。目录不存在时返回 0
+    double estimateDistinct(DistinctAttribute attribute, const string& dirPath = "/") const {
+        OperationTimer timer(latencies, SimulatorOp::EstimateDistinct);
+        traceOp(SimulatorOp::EstimateDistinct, [&](BinaryWriter& out) {
+            TraceCodec::putString(out, dirPath);
+            out.putU8((uint8_t)attribute);
+        });
+        shared_lock<shared_mutex> lock(treeMetadataMutex);
+        auto node = findFileNode(dirPath);
+        if (!node || !node->isDirectory) return 0;
+        if (node->summary->hasSketches()) return node->summary->sketch(attribute).estimate();
+        SubtreeSummary summary;
+        summary.allocateSketches();
+        collectSketchesLocked(*node, summary);
+        return summary.sketch(attribute).estimate();
+    }
+    
+    // 慢查询日志：设置后每次索引查询都收集剖析，总耗时达到 threshold 的交给 sink。
+    // sink 在查询线程中调用，多线程查询时需自行同步；sink 为空时关闭
+    void setSlowQueryLog(nanoseconds threshold, function<void(const QueryProfile&)> sink) {
+        shared_ptr<const SlowQueryLog> log;
+        if (sink) log = make_shared<SlowQueryLog>(SlowQueryLog{threshold, move(sink)});
+        atomic_store(&slowQueryLog, log);
+    }
+    
+    // 开始把公开 API 的调用录制到 recorder（见 TraceRecorder），传空指针停止。
+    // 切换时持写锁，写操作不会一半记在旧轨迹、一半记在新轨迹
+    void setTrace(shared_ptr<TraceRecorder> recorder) {
+        unique_lock<shared_mutex> lock(treeMetadataMutex);
+        tracing.store(recorder != nullptr, memory_order_relaxed);
+        atomic_store(&trace, move(recorder));
+    }
+    
+    // 生成测试数据；给定 seed 时结果可复现（基准测试用）
+    void generateTestData(int numFiles, unsigned seed = random_device{}()) {
+        vector<string> extensions = {".jpg", ".png", ".pdf", ".txt", ".doc", ".mp4", ".mp3"};
+        vector<string> owners = {"user1", "user2", "user3", "admin", "guest"};
+        vector<string> paths = {"/home/user1", "/home/user2", "/documents", "/pictures", "/videos"};
+        
+        mt19937 gen(seed);
+        uniform_int_distribution<> extDist(0, extensions.size() - 1);
+        uniform_int_distribution<> ownerDist(0, owners.size() - 1);
+        uniform_int_distribution<> pathDist(0, paths.size() - 1);
+        uniform_int_distribution<long long> sizeDist(1024, 10 * 1024 * 1024); // 1KB to 10MB
+        
+        for (int i = 0; i < numFiles; ++i) {
+            string fileName = "file" + to_string(i);
+            string extension = extensions[extDist(gen)];
+            string owner = owners[ownerDist(gen)];
+            string path = paths[pathDist(gen)];
+            long long fileSize = sizeDist(gen);
+            string createTime = "2024-" + to_string((i % 12) + 1) + "-" + to_string((i % 28) + 1);
+            
+            addFile(path, fileName, extension, fileSize, owner, createTime);
+        }
+    }
+    
+    // 从元数据表全量重建倒排索引（持有树的读锁，重建期间写操作等待）
+    void rebuildIndex() {
+        shared_lock<shared_mutex> lock(treeMetadataMutex);
+        invertedIndex.rebuild(sortedColumnsLocked());
+    }
+    
+    // 挂上预写日志，此后的每个写操作都会记录；恢复完成后再挂，避免重放时重复记录
+    void attachWal(shared_ptr<WriteAheadLog> log) {
+        unique_lock<shared_mutex> lock(treeMetadataMutex);
+        wal = move(log);
+    }
+    
+    // 捕获检查点：在读锁下复制元数据指针和目录状态并切换日志段。
+    // 写操作只在这一步被阻塞，序列化由调用方在锁外进行
+    CheckpointSnapshot captureCheckpoint() const {
+        shared_lock<shared_mutex> lock(treeMetadataMutex);
+        CheckpointSnapshot snapshot;
+        snapshot.files.reserve(fileMetadataMap.size());
+        for (const auto& entry : fileMetadataMap) {
+            snapshot.files.push_back(entry.second);
+        }
+        collectDirectoriesLocked(root, "/", snapshot.directories);
+        snapshot.nextFileId = nextFileId;
+        // 写者都持有写锁，读锁下切换日志段不会把任何变更切到错误的一侧
+        snapshot.walGeneration = wal ? wal->rotate() : 0;
+        return snapshot;
+    }
+    
+    // 用快照替换当前全部内容（保留原 fileId）。segment 是同一检查点写出的段时映射为倒排索引的底段，
+    // 否则倒排索引整体重建
+    void restoreCheckpoint(const CheckpointSnapshot& snapshot, shared_ptr<const MappedSegment> segment = nullptr) {
+        unique_lock<shared_mutex> lock(treeMetadataMutex);
+        root = makeNode("/", true);
+        fileMetadataMap.clear();
+        fileMetadataMap.reserve(snapshot.files.size());
+        
+        for (const auto& state : snapshot.directories) {
+            if (auto dirNode = getOrCreatePath(state.path)) {
+                dirNode->modifyTimeNs = state.modifyTimeNs;
+                dirNode->childCount = state.childCount;
+            }
+        }
+        
+        string lastPath;
+        shared_ptr<DirectoryNode> pathNode;
+        for (const auto& snapshotData : snapshot.files) {
+            // 快照记录可能来自磁盘加载器，复制一份以便记账
+            auto fileData = makeMetadata(*snapshotData);
+            size_t nameStart = fileData->fullPath.size() - fileData->fileName.size();
+            string path = nameStart > 1 ? fileData->fullPath.substr(0, nameStart - 1) : "/";
+            if (!pathNode || path != lastPath) {
+                pathNode = getOrCreatePath(path);
+                lastPath = path;
+            }
+            if (!pathNode) continue;
+            
+            auto fileNode = makeNode(fileData->fileName, false);
+            fileNode->fileData = fileData;
+            fileNode->parent = pathNode;
+            pathNode->children[fileData->fileName] = fileNode;
+            fileMetadataMap[fileData->fileId] = fileData;
+            summarizeAddedLocked(pathNode, *fileData);
+        }
+        nextFileId = snapshot.nextFileId;
+        
+        auto columns = MetadataColumns::fromFiles(snapshot.files);
+        if (!segment || !invertedIndex.attachBase(move(segment), columns)) invertedIndex.rebuild(columns);
+    }
+    
+    // 恢复时重放一条日志记录（不会再次写日志）
+    void applyWalRecord(const WalRecord& record) {
+        unique_lock<shared_mutex> lock(treeMetadataMutex);
+        applyWalRecordLocked(record);
+        tightenLooseSummariesLocked();
+    }
+    
+    size_t getIndexMemoryUsage() const {
+        return invertedIndex.getMemoryUsage();
+    }
+    
+    // 内存预算，覆盖 getMemoryBreakdown 的全部堆内存（见 InvertedIndex::setMemoryBudget）。
+    // 元数据记录由目录树、检查点快照和调用方共同持有（shared_ptr，写时复制），和目录树、键表一样不能换出，
+    // 预算扣除这些之后留给倒排链；容不下不可换出的部分和倒排链保底时抛出异常
+    void setMemoryBudget(size_t budgetBytes, const string& spillPath) {
+        invertedIndex.setMemoryBudget(budgetBytes, spillPath, {treeAccount, metadataAccount});
+    }
+    
+    SpillStats getIndexSpillStats() const {
+        return invertedIndex.getSpillStats();
+    }
+    
+    // 按组件统计内存占用：读记账分配器的账户，O(1)，不加锁
+    MemoryBreakdown getMemoryBreakdown() const {
+        MemoryBreakdown breakdown;
+        breakdown.tree = treeAccount->getBytes();
+        breakdown.metadata = metadataAccount->getBytes();
+        invertedIndex.addMemoryBreakdown(breakdown);
+        return breakdown;
+    }
+    
+    size_t getTotalFiles() const {
+        shared_lock<shared_mutex> lock(treeMetadataMutex);
+        return fileMetadataMap.size();
+    }
+    
+    // 各入口操作自创建以来的延迟分布（只含执行过的操作），各线程的记录在此时合并
+    vector<OperationLatency> getOperationLatencies() const {
+        return latencies.snapshot();
+    }
+    
+private:
+    static SummaryProbe makeProbe(const FileQuery& query) {
+        SummaryProbe probe;
+        if (query.extension) probe.extension = SubtreeSummary::bloomBits(*query.extension);
+        if (query.owner) probe.owner = SubtreeSummary::bloomBits(*query.owner);
+        probe.sizeRange = query.sizeRange;
+        if (query.createTime) {
+            int32_t date = SubtreeSummary::dateKey(*query.createTime);
+            if (date >= 0) probe.date = date;
+        }
+        return probe;
+    }
+    
+    void scanLocked(const shared_ptr<DirectoryNode>& node, const SummaryProbe& probe, const FileQuery& query,
+                    vector<shared_ptr<FileMetadata>>& result, PruneStats& stats) const {
+        stats.directoriesVisited++;
+        for (const auto& child : node->children) {
+            const auto& childNode = child.second;
+            if (childNode->isDirectory) {
+                if (probe.mayMatch(*childNode->summary)) {
+                    scanLocked(childNode, probe, query, result, stats);
+                } else {
+                    stats.directoriesPruned++;
+                }
+            } else if (childNode->fileData) {
+                stats.filesExamined++;
+                if (query.matches(*childNode->fileData)) result.push_back(childNode->fileData);
+            }
+        }
+    }
+    
+    // 新文件并入所在目录及各祖先的摘要。某一层没有变宽、草图也没有变时更上层也已覆盖该文件；
+    // 草图不变之后上层只合并其余部分，还没有草图的一层无从判断，照常向上。
+    // 文件须已挂到树上：子树文件数到达阈值的目录从子树现场建草图，这个文件也在其中
+    void summarizeAddedLocked(const shared_ptr<DirectoryNode>& dirNode, const FileMetadata& file) {
+        SubtreeSummary::FileKey key(file);
+        bool sketchesChanged = true;
+        for (auto node = dirNode; node; node = node->parent.lock()) {
+            auto& summary = *node->summary;
+            bool widened = summary.add(key);
+            if (summary.hasSketches()) {
+                if (sketchesChanged) sketchesChanged = summary.addToSketches(key.hashes);
+            } else if (summary.files >= SubtreeSummary::kSketchMinFiles) {
+                summary.allocateSketches();
+                collectSketchesLocked(*node, summary);
+            }
+            if (!widened && !sketchesChanged) break;
+        }
+    }
+    
+    // 把 dir 子树内的文件并入 into 的草图：已有草图的子目录整体合并，没有的继续往下遍历
+    void collectSketchesLocked(const DirectoryNode& dir, SubtreeSummary& into) const {
+        for (const auto& child : dir.children) {
+            const auto& childNode = child.second;
+            if (!childNode->isDirectory) {
+                if (childNode->fileData) into.addToSketches(SubtreeSummary::distinctHashes(*childNode->fileData));
+            } else if (childNode->summary->hasSketches()) {
+                into.mergeSketches(*childNode->summary);
+            } else {
+                collectSketchesLocked(*childNode, into);
+            }
+        }
+    }
+    
+    // 写操作放锁前调用：松弛累计到文件数的 1/kLooseFilesPerTighten（至少 kMinLooseChanges 次）时收紧，
+    // 只重算松弛的目录。收紧时没有草图的小子树要整个重新遍历，一批删除散布全树时接近遍历全部文件，
+    // 按文件数的比例攒批，分摊到每次删除的开销就与树的大小无关。读路径不收紧，只加读锁
+    void tightenLooseSummariesLocked() {
+        if (looseChanges < max(kMinLooseChanges, fileMetadataMap.size() / kLooseFilesPerTighten)) return;
+        if (root->summaryLoose) tightenSummariesLocked(root);
+        looseChanges = 0;
+    }
+    
+    // 删除或修改后把所在目录及各祖先标为松弛，由写操作放锁前的 tightenLooseSummariesLocked 收紧
+    void loosenSummariesLocked(const shared_ptr<DirectoryNode>& dirNode) {
+        for (auto node = dirNode; node && !node->summaryLoose; node = node->parent.lock()) {
+            node->summaryLoose = true;
+        }
+        looseChanges++;
+    }
+    
+    // 从直接子项重算松弛目录的摘要，只进入松弛的子目录。已有的草图保留（重建），不因删除而回收
+    void tightenSummariesLocked(const shared_ptr<DirectoryNode>& node) {
+        SubtreeSummary summary(node->summary->account());
+        for (const auto& child : node->children) {
+            const auto& childNode = child.second;
+            if (!childNode->isDirectory) {
+                if (childNode->fileData) summary.add(*childNode->fileData);
+                continue;
+            }
+            if (childNode->summaryLoose) tightenSummariesLocked(childNode);
+            summary.merge(*childNode->summary);
+        }
+        if (node->summary->hasSketches() || summary.files >= SubtreeSummary::kSketchMinFiles) {
+            summary.allocateSketches();
+            collectSketchesLocked(*node, summary);
+        }
+        *node->summary = move(summary);
+        node->summaryLoose = false;
+    }
+    
+    template <typename Encode>
+    void traceOp(SimulatorOp op, Encode&& encode) const {
+        if (!tracing.load(memory_order_relaxed)) return;
+        if (auto recorder = atomic_load(&trace)) recorder->record(op, encode);
+    }
+    
+    // 某个访问者第一次查询时在树的读锁下遍历全部元数据，算出其可读位图交给索引维护；
+    // 耗时记在剖析的 access_filter 阶段
+    void prepareReadableSet(const Principal& caller, QueryProfile* profile) const {
+        if (invertedIndex.hasReadableSet(caller)) return;
+        auto lock = acquireProfiled<shared_lock<shared_mutex>>(treeMetadataMutex, profile, QueryStage::TreeLockWait);
+        if (invertedIndex.hasReadableSet(caller)) return;
+        auto start = profile ? steady_clock::now() : steady_clock::time_point();
+        size_t files = invertedIndex.installReadableSet(caller, [&](auto&& fn) {
+            for (const auto& entry : fileMetadataMap) fn(*entry.second);
+        });
+        if (profile) {
+            profile->addTime(QueryStage::AccessFilter, start);
+            (*profile)[QueryStage::AccessFilter].idsIn += files;
+        }
+    }
+    
+    // 索引查询的公共路径：索引取 fileId、持树读锁查元数据表、构造结果，两步分开以便分别计时。
+    // 带 ORDER BY 和 LIMIT 且排序键有有序索引时改为沿该索引取前 K 个（见 walkOrderedIndex），
+    // 其余情况取出全部结果后排序截取（见 orderResults）
+    vector<shared_ptr<FileMetadata>> runIndexedQuery(const FileQuery& query, QueryProfile* profile) const {
+        auto log = atomic_load(&slowQueryLog);
+        QueryProfile logged;
+        if (!profile && log) profile = &logged;
+        auto start = profile ? steady_clock::now() : steady_clock::time_point();
+        if (profile) profile->query = query.describe();
+        
+        if (query.caller) prepareReadableSet(*query.caller, profile);
+        // 排序键上的区间条件交给有序遍历限定范围，不再合并整个区间的倒排
+        FileQuery filter = query;
+        optional<InvertedIndex::OrderedWalk> walk;
+        if (query.orderBy && query.limit && InvertedIndex::hasOrderedIndex(query.orderBy->key)) {
+            walk.emplace();
+            walk->key = query.orderBy->key;
+            walk->descending = query.orderBy->descending;
+            auto& range = walk->key == OrderKey::Size ? filter.sizeRange : filter.modifyTimeRange;
+            if (range) {
+                walk->low = range->first;
+                walk->high = range->second;
+                range.reset();
+            }
+        }
+        optional<vector<int>> fileIds;
+        bool exact = true;   // 分桶索引只给出候选，未建索引的标签条件被跳过，都按元数据复核
+        if (!filter.empty()) fileIds = invertedIndex.query(filter, profile, &exact);
+        bool indexed = fileIds.has_value();   // 没有能走索引的条件时逐个比较全部元数据
+        if (!indexed) exact = filter.empty();
+        
+        vector<shared_ptr<FileMetadata>> result;
+        // 沿索引遍历约读 limit * 文件数 / |其他条件的结果| 个 fileId，后者很小时直接取出排序更省
+        if (walk && (!indexed || (double)fileIds->size() * fileIds->size() >= (double)query.limit * getTotalFiles())) {
+            result = walkOrderedIndex(query, *walk, indexed ? &*fileIds : nullptr,
+                                      exact && InvertedIndex::exactWalk(*walk), profile);
+        } else {
+            if (walk && (walk->low != numeric_limits<long long>::min() ||
+                         walk->high != numeric_limits<long long>::max())) {
+                exact = false;   // 移出的区间条件按元数据复核
+            }
+            result = gatherMetadata(query, indexed ? &*fileIds : nullptr, exact, profile);
+        }
+        if (query.orderBy || query.limit) orderResults(result, query, profile);
+        if (!profile) return result;
+        
+        profile->rows = result.size();
+        profile->totalNs = (uint64_t)duration_cast<nanoseconds>(steady_clock::now() - start).count();
+        if (log && nanoseconds(profile->totalNs) >= log->threshold) log->sink(*profile);
+        return result;
+    }
+    
+    // 持树读锁按 fileIds 查元数据（为空指针时逐个比较全部元数据），不精确时按 query 复核
+    vector<shared_ptr<FileMetadata>> gatherMetadata(const FileQuery& query, const vector<int>* fileIds, bool exact,
+                                                    QueryProfile* profile) const {
+        vector<const shared_ptr<FileMetadata>*> found;
+        auto lock = acquireProfiled<shared_lock<shared_mutex>>(treeMetadataMutex, profile, QueryStage::TreeLockWait);
+        auto stageStart = profile ? steady_clock::now() : steady_clock::time_point();
+        if (!fileIds) {
+            found.reserve(query.empty() ? fileMetadataMap.size() : 0);
+            for (const auto& entry : fileMetadataMap) {
+                if (query.empty() || query.matches(*entry.second)) found.push_back(&entry.second);
+            }
+        } else {
+            found.reserve(fileIds->size());
+            for (int fileId : *fileIds) {
+                auto it = fileMetadataMap.find(fileId);
+                if (it != fileMetadataMap.end() && (exact || query.matches(*it->second))) {
+                    found.push_back(&it->second);
+                }
+            }
+        }
+        if (profile) {
+            profile->addTime(QueryStage::MetadataGather, stageStart);
+            (*profile)[QueryStage::MetadataGather].idsIn += fileIds ? fileIds->size() : fileMetadataMap.size();
+            (*profile)[QueryStage::MetadataGather].idsOut += found.size();
+            stageStart = steady_clock::now();
+        }
+        
+        // 复制 shared_ptr（引用计数的原子自增）仍须在读锁内，元数据表的项随时可能被替换
+        vector<shared_ptr<FileMetadata>> result;
+        result.reserve(found.size());
+        for (const auto* file : found) result.push_back(*file);
+        if (profile) {
+            profile->addTime(QueryStage::ResultBuild, stageStart);
+            (*profile)[QueryStage::ResultBuild].idsIn += found.size();
+            (*profile)[QueryStage::ResultBuild].idsOut += result.size();
+        }
+        return result;
+    }
+    
+    // ORDER BY + LIMIT 沿有序索引取前 K 个：按键序分批取整条倒排，只留下 filter（其他条件的结果，
+    // 空指针表示不限）中的 fileId，持树读锁查元数据复核，凑够 limit 个后在倒排边界停止——之后的倒排
+    // 的键都排在已取到的之后。每批的量逐次加倍，其他条件选择性低时批次数仍是对数级。
+    // 批次之间不持锁，结果不是同一时刻的快照；其间改了排序键的文件可能出现两次，按 fileId 去重
+    vector<shared_ptr<FileMetadata>> walkOrderedIndex(const FileQuery& query, InvertedIndex::OrderedWalk walk,
+                                                      const vector<int>* filter, bool exact,
+                                                      QueryProfile* profile) const {
+        PostingBitmap members;   // 其他条件的结果较大时转成位图，每个 fileId 一次位测试
+        bool useBitmap = filter && filter->size() > 4096;
+        if (useBitmap) {
+            for (int fileId : *filter) members.addFileId(fileId);
+        }
+        
+        vector<shared_ptr<FileMetadata>> result;
+        unordered_set<int> seen;
+        vector<int> batch;
+        size_t batchSize = max<size_t>(query.limit, 256);
+        for (bool more = true; more && result.size() < query.limit; batchSize *= 2) {
+            batch.clear();
+            more = invertedIndex.nextOrdered(walk, batchSize, batch, profile);
+            if (filter) {
+                auto stageStart = profile ? steady_clock::now() : steady_clock::time_point();
+                size_t idsIn = batch.size();
+                batch.erase(remove_if(batch.begin(), batch.end(), [&](int id) {
+                    return useBitmap ? !members.contains(id) : !binary_search(filter->begin(), filter->end(), id);
+                }), batch.end());
+                if (profile) {
+                    profile->addTime(QueryStage::SetOperations, stageStart);
+                    (*profile)[QueryStage::SetOperations].idsIn += idsIn;
+                    (*profile)[QueryStage::SetOperations].idsOut += batch.size();
+                }
+            }
+            
+            auto lock = acquireProfiled<shared_lock<shared_mutex>>(treeMetadataMutex, profile,
+                                                                   QueryStage::TreeLockWait);
+            auto stageStart = profile ? steady_clock::now() : steady_clock::time_point();
+            size_t before = result.size();
+            for (int fileId : batch) {
+                auto it = fileMetadataMap.find(fileId);
+                if (it == fileMetadataMap.end() || !(exact || query.matches(*it->second))) continue;
+                if (seen.insert(fileId).second) result.push_back(it->second);
+            }
+            if (profile) {
+                profile->addTime(QueryStage::MetadataGather, stageStart);
+                (*profile)[QueryStage::MetadataGather].idsIn += batch.size();
+                (*profile)[QueryStage::MetadataGather].idsOut += result.size() - before;
+            }
+        }
+        return result;
+    }
+    
+    // 按 ORDER BY 排序并截取前 LIMIT 个：先取出各行的键，只要前 limit 个时用 partial_sort（堆选择，
+    // O(n log k)），否则全排序；键相同时按 fileId 升序，结果是确定的。没有 ORDER BY 时只截取
+    static void orderResults(vector<shared_ptr<FileMetadata>>& files, const FileQuery& query, QueryProfile* profile) {
+        auto start = profile ? steady_clock::now() : steady_clock::time_point();
+        size_t idsIn = files.size();
+        size_t keep = query.limit ? min(query.limit, files.size()) : files.size();
+        if (query.orderBy) {
+            struct Row {
+                long long key;
+                int fileId;
+                uint32_t index;
+            };
+            vector<Row> rows(files.size());
+            for (size_t i = 0; i < files.size(); ++i) {
+                rows[i] = {orderValue(*files[i], query.orderBy->key), files[i]->fileId, (uint32_t)i};
+            }
+            bool descending = query.orderBy->descending;
+            auto before = [descending](const Row& a, const Row& b) {
+                if (a.key != b.key) return descending ? a.key > b.key : a.key < b.key;
+                return a.fileId < b.fileId;
+            };
+            if (keep < rows.size()) {
+                partial_sort(rows.begin(), rows.begin() + keep, rows.end(), before);
+            } else {
+                sort(rows.begin(), rows.end(), before);
+            }
+            vector<shared_ptr<FileMetadata>> ordered;
+            ordered.reserve(keep);
+            for (size_t i = 0; i < keep; ++i) ordered.push_back(move(files[rows[i].index]));
+            files = move(ordered);
+        } else {
+            files.resize(keep);
+        }
+        if (profile) {
+            profile->addTime(QueryStage::Sort, start);
+            (*profile)[QueryStage::Sort].idsIn += idsIn;
+            (*profile)[QueryStage::Sort].idsOut += files.size();
+        }
+    }
+    
+    MutationResult applyMutationsLocked(const MutationBatch& batch) {
+        MutationResult result;
+        
+        for (const auto& dirPath : batch.directoryRemovals) {
+            result.removed += removeDirectoryLocked(dirPath);
+        }
+        for (const auto& fullPath : batch.removals) {
+            if (removeFileLocked(fullPath)) result.removed++;
+        }
+        
+        vector<shared_ptr<FileMetadata>> added;   // 本批新增的文件，最后一次加进索引
+        int firstAddedId = nextFileId;
+        string lastPath;
+        shared_ptr<DirectoryNode> pathNode;
+        for (const auto& record : batch.upserts) {
+            if (!pathNode || record.path != lastPath) {
+                pathNode = getOrCreatePath(record.path);
+                lastPath = record.path;
+            }
+            if (!pathNode) continue;
+            
+            auto existing = pathNode->children.find(record.fileName);
+            if (existing != pathNode->children.end()) {
+                if (existing->second->isDirectory) continue;
+                const auto& old = existing->second->fileData;
+                if (old && old->fileSize == record.fileSize && old->owner == record.owner &&
+                    old->createTime == record.createTime && old->modifyTime == record.modifyTime &&
+                    old->extension == record.extension && old->mode == record.mode && old->uid == record.uid &&
+                    old->gid == record.gid) {
+                    continue;
+                }
+                // 本批先新增、后又更新的文件还没进索引，先把新增的加进去，替换时才能换掉旧的倒排项
+                if (old && old->fileId >= firstAddedId && !added.empty()) {
+                    invertedIndex.addFiles(added);
+                    result.added += added.size();
+                    added.clear();
+                }
+                replaceMetadataLocked(existing->second, record);
+                result.updated++;
+                continue;
+            }
+            
+            int fileId = nextFileId++;
+            string fullPath = record.path + (record.path.back() == '/' ? "" : "/") + record.fileName;
+            auto fileData = makeMetadata(FileMetadata(fileId, record.fileName, record.extension,
+                                                      record.fileSize, record.owner, record.createTime,
+                                                      fullPath, record.modifyTime, record.mode, record.uid,
+                                                      record.gid));
+            auto fileNode = makeNode(record.fileName, false);
+            fileNode->fileData = fileData;
+            fileNode->parent = pathNode;
+            pathNode->children[record.fileName] = fileNode;
+            fileMetadataMap[fileId] = fileData;
+            summarizeAddedLocked(pathNode, *fileData);
+            added.push_back(fileData);
+        }
+        invertedIndex.addFiles(added);
+        result.added += added.size();
+        
+        for (const auto& state : batch.directoryStates) {
+            if (auto dirNode = getOrCreatePath(state.path)) {
+                dirNode->modifyTimeNs = state.modifyTimeNs;
+                dirNode->childCount = state.childCount;
+            }
+        }
+        
+        return result;
+    }
+    
+    void applyWalRecordLocked(const WalRecord& record) {
+        MutationBatch batch;
+        switch (record.op) {
+            case WalOp::Add:
+                addRecordLocked(record.file);
+                return;
+            case WalOp::Update:
+                updateFileLocked(record.file);
+                return;
+            case WalOp::Remove:
+                removeFileLocked(record.path);
+                return;
+            case WalOp::Upsert:
+                batch.upserts.push_back(record.file);
+                break;
+            case WalOp::RemoveDirectory:
+                batch.directoryRemovals.push_back(record.path);
+                break;
+            case WalOp::DirectoryState:
+                batch.directoryStates.push_back(record.directory);
+                break;
+            case WalOp::Tags:
+                if (auto fileNode = findFileNode(record.path)) {
+                    if (!fileNode->isDirectory && fileNode->fileData) replaceTagsLocked(fileNode, record.tags);
+                }
+                return;
+        }
+        applyMutationsLocked(batch);
+    }
+    
+    bool addRecordLocked(const FileRecord& record) {
+        auto added = insertRecordsLocked({record});
+        if (added.empty()) return false;
+        invertedIndex.addFile(*added.front());
+        return true;
+    }
+    
+    bool updateFileLocked(const FileRecord& record) {
+        auto pathNode = findFileNode(record.path);
+        if (!pathNode || !pathNode->isDirectory) return false;
+        auto it = pathNode->children.find(record.fileName);
+        if (it == pathNode->children.end() || it->second->isDirectory) return false;
+        replaceMetadataLocked(it->second, record);
+        return true;
+    }
+    
+    void logRecordsLocked(WalOp op, const vector<FileRecord>& records) {
+        if (!wal) return;
+        for (const auto& record : records) {
+            wal->appendFile(op, record);
+        }
+        wal->commit();
+    }
+    
+    void collectDirectoriesLocked(const shared_ptr<DirectoryNode>& node, const string& dirPath,
+                                  vector<DirectoryRecord>& result) const {
+        vector<pair<shared_ptr<DirectoryNode>, string>> stack = {{node, dirPath}};
+        while (!stack.empty()) {
+            auto current = move(stack.back());
+            stack.pop_back();
+            result.push_back({current.second, current.first->modifyTimeNs, current.first->childCount});
+            if (current.first->subdirectoryCount == 0) continue;
+            for (const auto& child : current.first->children) {
+                if (child.second->isDirectory) {
+                    string childPath = current.second == "/" ? "/" + child.first
+                                                             : current.second + "/" + child.first;
+                    stack.emplace_back(child.second, move(childPath));
+                }
+            }
+        }
+    }
+    
+    // 把记录插入目录树和元数据表，返回新建的元数据（尚未写入倒排索引）
+    vector<shared_ptr<FileMetadata>> insertRecordsLocked(const vector<FileRecord>& records) {
+        vector<shared_ptr<FileMetadata>> added;
+        added.reserve(records.size());
+        string lastPath;
+        shared_ptr<DirectoryNode> pathNode;
+        
+        for (const auto& record : records) {
+            if (!pathNode || record.path != lastPath) {
+                pathNode = getOrCreatePath(record.path);
+                lastPath = record.path;
+            }
+            if (!pathNode) continue;
+            
+            // 同名文件视为替换，旧元数据先移出索引；同名目录则跳过
+            auto existing = pathNode->children.find(record.fileName);
+            if (existing != pathNode->children.end()) {
+                if (existing->second->isDirectory) continue;
+                if (auto old = existing->second->fileData) {
+                    invertedIndex.removeFile(*old);
+                    fileMetadataMap.erase(old->fileId);
+                    loosenSummariesLocked(pathNode);
+                }
+            }
+            
+            int fileId = nextFileId++;
+            string fullPath = record.path + (record.path.back() == '/' ? "" : "/") + record.fileName;
+            auto fileData = makeMetadata(FileMetadata(fileId, record.fileName, record.extension,
+                                                      record.fileSize, record.owner, record.createTime,
+                                                      fullPath, record.modifyTime, record.mode, record.uid,
+                                                      record.gid));
+            
+            auto fileNode = makeNode(record.fileName, false);
+            fileNode->fileData = fileData;
+            fileNode->parent = pathNode;
+            
+            pathNode->children[record.fileName] = fileNode;
+            fileMetadataMap[fileId] = fileData;
+            summarizeAddedLocked(pathNode, *fileData);
+            added.push_back(fileData);
+        }
+        return added;
+    }
+    
+    bool removeFileLocked(const string& fullPath) {
+        auto fileNode = findFileNode(fullPath);
+        if (!fileNode || fileNode->isDirectory) return false;
+        
+        auto fileData = fileNode->fileData;
+        if (fileData) {
+            invertedIndex.removeFile(*fileData);
+            fileMetadataMap.erase(fileData->fileId);
+        }
+        
+        // 从父节点删除
+        if (auto parent = fileNode->parent.lock()) {
+            parent->children.erase(fileNode->name);
+            loosenSummariesLocked(parent);
+        }
+        
+        return true;
+    }
+    
+    // 删除目录子树，返回删除的文件数
+    size_t removeDirectoryLocked(const string& dirPath) {
+        auto dirNode = findFileNode(dirPath);
+        if (!dirNode || !dirNode->isDirectory || dirNode == root) return 0;
+        
+        size_t removed = 0;
+        traverseAndFilter(dirNode, [&](const shared_ptr<FileMetadata>& file) {
+            invertedIndex.removeFile(*file);
+            fileMetadataMap.erase(file->fileId);
+            removed++;
+        });
+        if (auto parent = dirNode->parent.lock()) {
+            parent->children.erase(dirNode->name);
+            parent->subdirectoryCount--;
+            loosenSummariesLocked(parent);
+        }
+        return removed;
+    }
+    
+    void replaceMetadataLocked(const shared_ptr<DirectoryNode>& fileNode, const FileRecord& record) {
+        const auto& old = fileNode->fileData;
+        FileMetadata updated(old->fileId, record.fileName, record.extension, record.fileSize, record.owner,
+                             record.createTime, old->fullPath, record.modifyTime, record.mode, record.uid,
+                             record.gid);
+        updated.tags = old->tags;
+        auto fileData = makeMetadata(move(updated));
+        invertedIndex.removeFile(*old);
+        invertedIndex.addFile(*fileData);
+        fileMetadataMap[fileData->fileId] = fileData;
+        fileNode->fileData = fileData;
+        if (auto parent = fileNode->parent.lock()) {
+            loosenSummariesLocked(parent);
+            summarizeAddedLocked(parent, *fileData);
+        }
+    }
+    
+    // 只换标签的写时复制：其余字段不变，目录摘要不含标签，也不用调整
+    void replaceTagsLocked(const shared_ptr<DirectoryNode>& fileNode, vector<FileTag> tags) {
+        const auto& old = fileNode->fileData;
+        FileMetadata updated = *old;
+        updated.tags = move(tags);
+        auto fileData = makeMetadata(move(updated));
+        invertedIndex.updateTags(*old, *fileData);
+        fileMetadataMap[fileData->fileId] = fileData;
+        fileNode->fileData = fileData;
+    }
+    
+    // 全部元数据按 fileId 升序的列式视图（指向元数据表中的记录，须在树锁内使用）
+    MetadataColumns sortedColumnsLocked() const {
+        vector<const FileMetadata*> files;
+        files.reserve(fileMetadataMap.size());
+        for (const auto& entry : fileMetadataMap) {
+            files.push_back(entry.second.get());
+        }
+        sort(files.begin(), files.end(), [](const FileMetadata* a, const FileMetadata* b) {
+            return a->fileId < b->fileId;
+        });
+        
+        MetadataColumns columns;
+        columns.reserve(files.size());
+        for (const auto* file : files) {
+            columns.append(*file);
+        }
+        return columns;
+    }
+    
+    shared_ptr<DirectoryNode> makeNode(const string& name, bool isDirectory) {
+        return allocate_shared<DirectoryNode>(TrackingAllocator<DirectoryNode>(treeAccount),
+                                              name, isDirectory, treeAccount);
+    }
+    
+    shared_ptr<FileMetadata> makeMetadata(FileMetadata&& file) {
+        return allocate_shared<FileMetadata>(TrackingAllocator<FileMetadata>(metadataAccount), move(file));
+    }
+    
+    shared_ptr<FileMetadata> makeMetadata(const FileMetadata& file) {
+        return allocate_shared<FileMetadata>(TrackingAllocator<FileMetadata>(metadataAccount), file);
+    }
+    
+    shared_ptr<DirectoryNode> getOrCreatePath(const string& path) {
+        if (path.empty() || path[0] != '/') return nullptr;
+        
+        auto current = root;
+        if (path == "/") return current;
+        
+        stringstream ss(path.substr(1));
+        string part;
+        
+        while (getline(ss, part, '/')) {
+            if (part.empty()) continue;
+            
+            if (current->children.find(part) == current->children.end()) {
+                auto newNode = makeNode(part, true);
+                newNode->parent = current;
+                current->children[part] = newNode;
+                current->subdirectoryCount++;
+            }
+            current = current->children[part];
+        }
+        
+        return current;
+    }
+    
+    shared_ptr<DirectoryNode> findFileNode(const string& fullPath) const {
         if (fullPath.empty() || fullPath[0] != '/') return nullptr;
         
-        auto current = root;
-        if (fullPath == "/") return current;
+        auto current = root;
+        if (fullPath == "/") return current;
+        
+        stringstream ss(fullPath.substr(1));
+        string part;
+        
+        while (getline(ss, part, '/')) {
+            if (part.empty()) continue;
+            
+            auto it = current->children.find(part);
+            if (it == current->children.end()) {
+                return nullptr;
+            }
+            current = it->second;
+        }
+        
+        return current;
+    }
+    
+    void traverseAndFilter(const shared_ptr<DirectoryNode>& node, 
+                          function<void(const shared_ptr<FileMetadata>&)> filter) const {
+        if (!node->isDirectory && node->fileData) {
+            filter(node->fileData);
+        }
+        
+        for (const auto& child : node->children) {
+            traverseAndFilter(child.second, filter);
+        }
+    }
+};
+
+// 以 Prometheus 文本格式输出运行时指标：各入口操作的延迟（summary，秒）和最大值、文件数、
+// 各组件内存。分位数按直方图桶计算，相对误差不超过 1/64
+void writePrometheusMetrics(ostream& out, const FileSystemSimulator& fs) {
+    auto latencies = fs.getOperationLatencies();
+    out << setprecision(9);
+    out << "# HELP mai_operation_duration_seconds FileSystemSimulator operation latency since start.\n"
+        << "# TYPE mai_operation_duration_seconds summary\n";
+    for (const auto& entry : latencies) {
+        string label = string("op=\"") + kSimulatorOpNames[(size_t)entry.op] + "\"";
+        for (double q : {0.5, 0.9, 0.99, 0.999}) {
+            out << "mai_operation_duration_seconds{" << label << ",quantile=\"" << q << "\"} "
+                << entry.histogram.percentile(q) / 1e9 << '\n';
+        }
+        out << "mai_operation_duration_seconds_sum{" << label << "} " << entry.histogram.getSum() / 1e9 << '\n'
+            << "mai_operation_duration_seconds_count{" << label << "} " << entry.histogram.getCount() << '\n';
+    }
+    out << "# HELP mai_operation_duration_max_seconds Slowest call of each operation since start.\n"
+        << "# TYPE mai_operation_duration_max_seconds gauge\n";
+    for (const auto& entry : latencies) {
+        out << "mai_operation_duration_max_seconds{op=\"" << kSimulatorOpNames[(size_t)entry.op] << "\"} "
+            << entry.histogram.getMax() / 1e9 << '\n';
+    }
+    
+    auto memory = fs.getMemoryBreakdown();
+    out << "# HELP mai_files Files currently indexed.\n"
+        << "# TYPE mai_files gauge\n"
+        << "mai_files " << fs.getTotalFiles() << '\n'
+        << "# HELP mai_memory_bytes Heap bytes held by each component.\n"
+        << "# TYPE mai_memory_bytes gauge\n"
+        << "mai_memory_bytes{component=\"tree\"} " << memory.tree << '\n'
+        << "mai_memory_bytes{component=\"metadata\"} " << memory.metadata << '\n';
+    const pair<const char*, const IndexMemory*> indexes[] = {
+        {"extension", &memory.extension}, {"size", &memory.size}, {"owner", &memory.owner}, {"time", &memory.time},
+        {"group", &memory.group}, {"modify_time", &memory.modifyTime}, {"tags", &memory.tags},
+        {"readable", &memory.readable}, {"sample", &memory.sample}, {"base", &memory.base}};
+    for (const auto& index : indexes) {
+        out << "mai_memory_bytes{component=\"" << index.first << "_dictionary\"} " << index.second->dictionary << '\n'
+            << "mai_memory_bytes{component=\"" << index.first << "_postings\"} " << index.second->postings << '\n';
+    }
+    out << "# HELP mai_distinct_values Estimated distinct values of each attribute across all files (HyperLogLog).\n"
+        << "# TYPE mai_distinct_values gauge\n";
+    for (size_t i = 0; i < kDistinctAttributeCount; ++i) {
+        out << "mai_distinct_values{attribute=\"" << kDistinctAttributeNames[i] << "\"} "
+            << llround(fs.estimateDistinct((DistinctAttribute)i)) << '\n';
+    }
+}
+
+// 定期把指标写到文件（node_exporter 文本文件采集器的用法）：先写临时文件再改名，
+// 采集方不会读到写了一半的内容。停止时再写一次，文件里是最终结果
+class MetricsFileExporter {
+public:
+    MetricsFileExporter(const FileSystemSimulator& simulator, string path, milliseconds interval)
+        : fs(simulator), path(move(path)), interval(interval) {}
+    
+    // 析构时的最后一次写入失败只记日志，不让异常逃出析构函数
+    ~MetricsFileExporter() {
+        try {
+            stop();
+        } catch (const exception& e) {
+            cerr << "指标导出失败: " << e.what() << endl;
+        }
+    }
+    
+    void start() {
+        lock_guard<mutex> lock(stateMutex);
+        if (running) return;
+        running = true;
+        worker = thread([this]() { run(); });
+    }
+    
+    void stop() {
+        {
+            lock_guard<mutex> lock(stateMutex);
+            if (!running) return;
+            running = false;
+        }
+        wakeup.notify_all();
+        worker.join();
+        writeNow();
+    }
+    
+    void writeNow() const {
+        string tempPath = path + ".tmp";
+        {
+            ofstream out(tempPath);
+            writePrometheusMetrics(out, fs);
+            if (!out) throw runtime_error("写入失败: " + tempPath);
+        }
+        if (rename(tempPath.c_str(), path.c_str()) != 0) {
+            throw runtime_error("改名失败: " + path + ": " + strerror(errno));
+        }
+    }
+    
+private:
+    const FileSystemSimulator& fs;
+    string path;
+    milliseconds interval;
+    mutex stateMutex;
+    condition_variable wakeup;
+    bool running = false;
+    thread worker;
+    
+    void run() {
+        unique_lock<mutex> lock(stateMutex);
+        while (!wakeup.wait_for(lock, interval, [this]() { return !running; })) {
+            lock.unlock();
+            try {
+                writeNow();
+            } catch (const exception& e) {
+                cerr << "指标导出失败: " << e.what() << endl;
+            }
+            lock.lock();
+        }
+    }
+};
+
+// 轨迹中的一条调用；按操作只有相应的参数字段有效
+struct TraceEntry {
+    int64_t timeNs = 0;       // 相对录制开始
+    SimulatorOp op = SimulatorOp::Query;
+    uint32_t thread = 0;      // 录制时的线程编号
+    FileRecord file;          // add_file / update_file
+    vector<FileRecord> files; // add_files / bulk_load
+    string text;              // 路径、扩展名、所有者或标签键
+    long long low = 0, high = 0;
+    MutationBatch batch;
+    FileQuery query;
+    FileTag tag;              // tag_file（文件路径在 text）
+    TagMode tagMode = TagMode::Add;
+    PredicateExpr expr;       // estimate_rows
+    DistinctAttribute attribute = DistinctAttribute::Extension;   // estimate_distinct（目录在 text）
+    
+    // 单键操作返回其键（文件完整路径）；多键操作和只读操作返回空
+    string key() const {
+        switch (op) {
+            case SimulatorOp::AddFile:
+            case SimulatorOp::UpdateFile:
+                return file.path + (!file.path.empty() && file.path.back() == '/' ? "" : "/") + file.fileName;
+            case SimulatorOp::RemoveFile:
+            case SimulatorOp::TagFile:
+                return text;
+            default:
+                return "";
+        }
+    }
+    
+    bool isBarrier() const {
+        return op == SimulatorOp::AddFiles || op == SimulatorOp::BulkLoad || op == SimulatorOp::ApplyMutations ||
+               op == SimulatorOp::IndexTag;
+    }
+};
+
+struct Trace {
+    int64_t wallStartNs = 0;   // 录制开始的墙钟时间
+    vector<TraceEntry> entries;
+    bool truncated = false;    // 尾部有不完整的记录（录制进程未正常结束）
+};
+
+// 读取 TraceRecorder 写出的文件
+inline Trace readTrace(const string& path) {
+    string content;
+    if (!readWholeFile(path, content)) throw runtime_error("无法读取轨迹: " + path);
+    if (content.size() < sizeof(TraceRecorder::kMagic) + sizeof(int64_t) ||
+        memcmp(content.data(), TraceRecorder::kMagic, sizeof(TraceRecorder::kMagic)) != 0) {
+        throw runtime_error("不是轨迹文件: " + path);
+    }
+    
+    Trace trace;
+    BinaryReader reader(content.data() + sizeof(TraceRecorder::kMagic), content.data() + content.size());
+    reader.getI64(trace.wallStartNs);
+    int64_t timeNs = 0;
+    while (!reader.atEnd()) {
+        TraceEntry entry;
+        int64_t delta;
+        uint8_t op;
+        uint64_t thread;
+        bool ok = TraceCodec::getSigned(reader, delta) && reader.getU8(op) && op < kSimulatorOpCount &&
+                  TraceCodec::getVarint(reader, thread);
+        if (ok) {
+            entry.op = (SimulatorOp)op;
+            switch (entry.op) {
+                case SimulatorOp::AddFile:
+                case SimulatorOp::UpdateFile:
+                    ok = TraceCodec::get(reader, entry.file);
+                    break;
+                case SimulatorOp::AddFiles:
+                case SimulatorOp::BulkLoad:
+                    ok = TraceCodec::get(reader, entry.files);
+                    break;
+                case SimulatorOp::ApplyMutations:
+                    ok = TraceCodec::get(reader, entry.batch);
+                    break;
+                case SimulatorOp::QuerySizeRange:
+                    ok = TraceCodec::getSigned(reader, entry.low) && TraceCodec::getSigned(reader, entry.high);
+                    break;
+                case SimulatorOp::Query:
+                    ok = TraceCodec::get(reader, entry.query);
+                    break;
+                case SimulatorOp::QueryScan:
+                    ok = TraceCodec::getString(reader, entry.text) && TraceCodec::get(reader, entry.query);
+                    break;
+                case SimulatorOp::TagFile: {
+                    uint8_t mode = 0;
+                    ok = TraceCodec::getString(reader, entry.text) && TraceCodec::getString(reader, entry.tag.key) &&
+                         TraceCodec::getString(reader, entry.tag.value) && reader.getU8(mode) &&
+                         mode <= (uint8_t)TagMode::Remove;
+                    entry.tagMode = (TagMode)mode;
+                    break;
+                }
+                case SimulatorOp::EstimateRows:
+                    ok = TraceCodec::get(reader, entry.expr);
+                    break;
+                case SimulatorOp::EstimateDistinct: {
+                    uint8_t attribute = 0;
+                    ok = TraceCodec::getString(reader, entry.text) && reader.getU8(attribute) &&
+                         attribute < kDistinctAttributeCount;
+                    entry.attribute = (DistinctAttribute)attribute;
+                    break;
+                }
+                default:
+                    ok = TraceCodec::getString(reader, entry.text);
+                    break;
+            }
+        }
+        if (!ok) {
+            trace.truncated = true;
+            break;
+        }
+        timeNs += delta;
+        entry.timeNs = timeNs;
+        entry.thread = (uint32_t)thread;
+        trace.entries.push_back(move(entry));
+    }
+    return trace;
+}
+
+enum class ReplayMode {
+    Timed,   // 按录制时的时间间隔（除以 speed）发出
+    Fast,    // 尽快发出
+};
+
+struct ReplayOptions {
+    ReplayMode mode = ReplayMode::Fast;
+    double speed = 1.0;
+    int threads = 1;
+};
+
+struct ReplayStats {
+    size_t operations = 0;
+    size_t barriers = 0;      // 多键操作，执行前等待全部工作线程排空
+    double seconds = 0;
+    double meanLagUs = 0;     // 定时模式下实际开始时间落后计划时间的量
+    double maxLagUs = 0;
+};
+
+// 轨迹重放：单线程时按轨迹顺序逐条执行。多线程时由分发线程把单键操作按键的哈希
+// 交给固定的工作线程，同一文件上的操作保持录制顺序；只读操作轮流分给各工作线程，
+// 与写操作之间不保证顺序；多键操作（add_files、bulk_load、apply_mutations、index_tag）作为屏障，
+// 等所有工作线程排空后在分发线程上执行。定时模式下由分发线程按计划时间放行
+class TraceReplayer {
+public:
+    TraceReplayer(FileSystemSimulator& fs, const ReplayOptions& options) : fs(fs), options(options) {}
+    
+    ReplayStats run(const Trace& trace) {
+        ReplayStats stats;
+        int threads = max(1, options.threads);
+        start = steady_clock::now();
+        firstNs = trace.entries.empty() ? 0 : trace.entries.front().timeNs;
+        
+        if (threads == 1) {
+            Lag lag;
+            for (const auto& entry : trace.entries) {
+                waitUntilDue(entry);
+                lag.record(this, entry);
+                execute(entry);
+                if (entry.isBarrier()) stats.barriers++;
+            }
+            lags.push_back(lag);
+        } else {
+            workers.resize(threads);
+            vector<thread> pool;
+            for (auto& worker : workers) pool.emplace_back([this, &worker] { workerLoop(worker); });
+            
+            hash<string> hasher;
+            size_t nextReader = 0;
+            Lag lag;
+            for (const auto& entry : trace.entries) {
+                waitUntilDue(entry);
+                if (entry.isBarrier()) {
+                    drain();
+                    lag.record(this, entry);
+                    execute(entry);
+                    stats.barriers++;
+                    continue;
+                }
+                string key = entry.key();
+                size_t target = key.empty() ? nextReader++ % threads : hasher(key) % threads;
+                enqueue(workers[target], &entry);
+            }
+            drain();
+            for (auto& worker : workers) enqueue(worker, nullptr);
+            for (auto& t : pool) t.join();
+            lags.push_back(lag);
+            for (const auto& worker : workers) lags.push_back(worker.lag);
+        }
+        
+        stats.seconds = duration<double>(steady_clock::now() - start).count();
+        stats.operations = trace.entries.size();
+        double lagSum = 0;
+        for (const auto& lag : lags) {
+            lagSum += lag.sumNs;
+            stats.maxLagUs = max(stats.maxLagUs, lag.maxNs / 1000.0);
+        }
+        if (options.mode == ReplayMode::Timed && stats.operations > 0) {
+            stats.meanLagUs = lagSum / stats.operations / 1000.0;
+        }
+        return stats;
+    }
+    
+private:
+    struct Lag {
+        double sumNs = 0;
+        double maxNs = 0;
+        
+        void record(const TraceReplayer* replayer, const TraceEntry& entry) {
+            if (replayer->options.mode != ReplayMode::Timed) return;
+            double lag = duration<double, nano>(steady_clock::now() - replayer->dueTime(entry)).count();
+            sumNs += max(0.0, lag);
+            maxNs = max(maxNs, lag);
+        }
+    };
+    
+    struct Worker {
+        mutex queueMutex;
+        condition_variable ready;
+        deque<const TraceEntry*> queue;   // nullptr 表示退出
+        Lag lag;
+    };
+    
+    FileSystemSimulator& fs;
+    ReplayOptions options;
+    steady_clock::time_point start;
+    int64_t firstNs = 0;
+    deque<Worker> workers;
+    vector<Lag> lags;
+    mutex idleMutex;
+    condition_variable idle;
+    size_t inFlight = 0;   // 已分发未执行完的操作数，受 idleMutex 保护
+    
+    steady_clock::time_point dueTime(const TraceEntry& entry) const {
+        return start + duration_cast<steady_clock::duration>(
+                           duration<double, nano>((entry.timeNs - firstNs) / max(1e-9, options.speed)));
+    }
+    
+    void waitUntilDue(const TraceEntry& entry) const {
+        if (options.mode == ReplayMode::Timed) this_thread::sleep_until(dueTime(entry));
+    }
+    
+    void enqueue(Worker& worker, const TraceEntry* entry) {
+        if (entry) {
+            lock_guard<mutex> lock(idleMutex);
+            inFlight++;
+        }
+        {
+            lock_guard<mutex> lock(worker.queueMutex);
+            worker.queue.push_back(entry);
+        }
+        worker.ready.notify_one();
+    }
+    
+    void drain() {
+        unique_lock<mutex> lock(idleMutex);
+        idle.wait(lock, [this] { return inFlight == 0; });
+    }
+    
+    void workerLoop(Worker& worker) {
+        while (true) {
+            const TraceEntry* entry;
+            {
+                unique_lock<mutex> lock(worker.queueMutex);
+                worker.ready.wait(lock, [&] { return !worker.queue.empty(); });
+                entry = worker.queue.front();
+                worker.queue.pop_front();
+            }
+            if (!entry) return;
+            worker.lag.record(this, *entry);
+            execute(*entry);
+            
+            lock_guard<mutex> lock(idleMutex);
+            if (--inFlight == 0) idle.notify_all();
+        }
+    }
+    
+    void execute(const TraceEntry& entry) {
+        vector<string> subdirectories, files;
+        switch (entry.op) {
+            case SimulatorOp::AddFile:
+                fs.addFile(entry.file.path, entry.file.fileName, entry.file.extension, entry.file.fileSize,
+                           entry.file.owner, entry.file.createTime);
+                break;
+            case SimulatorOp::AddFiles:
+                fs.addFiles(entry.files);
+                break;
+            case SimulatorOp::BulkLoad:
+                fs.bulkLoad(entry.files);
+                break;
+            case SimulatorOp::RemoveFile:
+                fs.removeFile(entry.text);
+                break;
+            case SimulatorOp::UpdateFile:
+                fs.updateFile(entry.file);
+                break;
+            case SimulatorOp::ApplyMutations:
+                fs.applyMutations(entry.batch);
+                break;
+            case SimulatorOp::ListDirectories:
+                fs.listDirectoriesUnder(entry.text);
+                break;
+            case SimulatorOp::DirectoryListing:
+                fs.getDirectoryListing(entry.text, subdirectories, files);
+                break;
+            case SimulatorOp::ListFiles:
+                fs.listFilesUnder(entry.text);
+                break;
+            case SimulatorOp::QueryExtensionTraditional:
+                fs.queryByExtensionTraditional(entry.text);
+                break;
+            case SimulatorOp::QueryExtension:
+                fs.queryByExtensionIndexed(entry.text);
+                break;
+            case SimulatorOp::QuerySizeRange:
+                fs.queryBySizeRangeIndexed(entry.low, entry.high);
+                break;
+            case SimulatorOp::QueryOwner:
+                fs.queryByOwnerIndexed(entry.text);
+                break;
+            case SimulatorOp::Query:
+                fs.queryIndexed(entry.query);
+                break;
+            case SimulatorOp::QueryScan:
+                fs.queryByScan(entry.query, entry.text);
+                break;
+            case SimulatorOp::TagFile:
+                fs.tagFile(entry.text, entry.tag.key, entry.tag.value, entry.tagMode);
+                break;
+            case SimulatorOp::EstimateRows:
+                fs.estimateRows(entry.expr);
+                break;
+            case SimulatorOp::EstimateDistinct:
+                fs.estimateDistinct(entry.attribute, entry.text);
+                break;
+            case SimulatorOp::IndexTag:
+                fs.indexTag(entry.text);
+                break;
+        }
+    }
+};
+
+// 按 uid 缓存的所有者名称查询，避免每个文件都调用 getpwuid_r
+class OwnerNameCache {
+private:
+    unordered_map<uid_t, string> names;
+    mutable shared_mutex cacheMutex;
+    
+public:
+    string lookup(uid_t uid) {
+        {
+            shared_lock<shared_mutex> lock(cacheMutex);
+            auto it = names.find(uid);
+            if (it != names.end()) return it->second;
+        }
+        
+        string name = resolve(uid);
+        unique_lock<shared_mutex> lock(cacheMutex);
+        names.emplace(uid, name);
+        return name;
+    }
+    
+private:
+    static string resolve(uid_t uid) {
+        long bufSize = sysconf(_SC_GETPW_R_SIZE_MAX);
+        vector<char> buf(bufSize > 0 ? bufSize : 16384);
+        struct passwd pwd;
+        struct passwd* result = nullptr;
+        if (getpwuid_r(uid, &pwd, buf.data(), buf.size(), &result) == 0 && result) {
+            return result->pw_name;
+        }
+        return to_string(uid);
+    }
+};
+
+// 时间戳到 YYYY-MM-DD 的格式化缓存：同一天内的文件直接复用上次结果，
+// 避免每个文件都进入 localtime_r 的全局时区锁
+class DateFormatCache {
+private:
+    time_t dayStart = 1;
+    time_t dayEnd = 0;
+    string cached;
+    
+public:
+    const string& format(time_t t) {
+        if (t < dayStart || t >= dayEnd) {
+            struct tm tmv;
+            localtime_r(&t, &tmv);
+            char buf[16];
+            strftime(buf, sizeof(buf), "%Y-%m-%d", &tmv);
+            cached = buf;
+            dayStart = t - (tmv.tm_hour * 3600 + tmv.tm_min * 60 + tmv.tm_sec);
+            dayEnd = dayStart + 86400;
+        }
+        return cached;
+    }
+};
+
+#ifdef FS_HAVE_IO_URING
+// 批量 statx 提交环：直接使用 io_uring 系统调用（不依赖 liburing）。
+// 每个扫描线程独占一个环，在途请求数不超过 SQ 深度，因此 CQ 不会溢出。
+class StatxRing {
+public:
+    struct Slot {
+        string name;
+        struct statx result;
+        shared_ptr<void> owner;   // 保证目录 fd 在请求完成前有效
+    };
+    
+    StatxRing() = default;
+    StatxRing(const StatxRing&) = delete;
+    StatxRing& operator=(const StatxRing&) = delete;
+    
+    ~StatxRing() {
+        if (sqes) munmap(sqes, sqesSize);
+        if (cqRing) munmap(cqRing, cqRingSize);
+        if (sqRing) munmap(sqRing, sqRingSize);
+        if (ringFd >= 0) close(ringFd);
+    }
+    
+    // 内核不支持 io_uring 或 IORING_OP_STATX 时返回 false，调用方回退到同步 fstatat
+    bool init(unsigned entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ringFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (ringFd < 0) return false;
+        
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        
+        sqRing = mapRing(sqRingSize, IORING_OFF_SQ_RING);
+        cqRing = mapRing(cqRingSize, IORING_OFF_CQ_RING);
+        sqes = static_cast<io_uring_sqe*>(mapRing(sqesSize, IORING_OFF_SQES));
+        if (!sqRing || !cqRing || !sqes) return false;
+        
+        char* sq = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        localTail = *sqTail;
+        
+        slots.resize(params.sq_entries);
+        for (unsigned i = params.sq_entries; i > 0; --i) {
+            freeSlots.push_back(i - 1);
+        }
+        
+        // 探测 STATX 操作码：5.6 之前的内核对未知操作码返回 -EINVAL
+        int probeResult = -EINVAL;
+        queue(AT_FDCWD, "/", nullptr);
+        submit(1);
+        reap([&](Slot&, int res) { probeResult = res; });
+        return probeResult == 0;
+    }
+    
+    bool hasFreeSlot() const { return !freeSlots.empty(); }
+    unsigned inFlight() const { return (unsigned)(slots.size() - freeSlots.size()); }
+    unsigned unsubmitted() const { return toSubmit; }
+    
+    void queue(int dirFd, const char* name, shared_ptr<void> owner) {
+        unsigned slotIndex = freeSlots.back();
+        freeSlots.pop_back();
+        Slot& slot = slots[slotIndex];
+        slot.name = name;
+        slot.owner = move(owner);
+        
+        unsigned index = localTail & sqMask;
+        io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = dirFd;
+        sqe->addr = reinterpret_cast<unsigned long long>(slot.name.c_str());
+        sqe->len = STATX_BASIC_STATS | STATX_BTIME;   // 与 FileStat::kStatxMask 相同
+        sqe->off = reinterpret_cast<unsigned long long>(&slot.result);
+        sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+        sqe->user_data = slotIndex;
+        sqArray[index] = index;
+        localTail++;
+        toSubmit++;
+    }
+    
+    // 提交所有已填好的请求，并至少等待 waitNr 个完成。io_uring_enter 出错（EINTR、EAGAIN、EBUSY 以外）时
+    // 返回 false，errno 为其错误码；内核没有取走的请求仍在环里，由 takeUnsubmitted 取回
+    bool submit(unsigned waitNr) {
+        if (waitNr > inFlight()) waitNr = inFlight();
+        if (toSubmit == 0 && waitNr == 0) return true;
+        __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+        
+        unsigned flags = waitNr > 0 ? IORING_ENTER_GETEVENTS : 0;
+        while (true) {
+            long ret = syscall(__NR_io_uring_enter, ringFd, toSubmit, waitNr, flags, nullptr, 0);
+            if (ret >= 0) {
+                toSubmit -= min<unsigned>(toSubmit, (unsigned)ret);
+                return true;
+            }
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) return false;
+            this_thread::yield();
+        }
+    }
+    
+    // 取回还没提交给内核的请求（提交失败后改走同步 statx）：回退 SQ 尾指针，回调返回后槽位即被回收
+    template <typename Callback>
+    void takeUnsubmitted(Callback&& onTaken) {
+        for (; toSubmit > 0; --toSubmit) {
+            localTail--;
+            unsigned slotIndex = (unsigned)sqes[localTail & sqMask].user_data;
+            onTaken(slots[slotIndex]);
+            slots[slotIndex].owner.reset();
+            freeSlots.push_back(slotIndex);
+        }
+        __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+    }
+    
+    // 处理所有已完成的请求，回调返回后槽位即被回收
+    template <typename Callback>
+    void reap(Callback&& onComplete) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            const io_uring_cqe& cqe = cqes[head & cqMask];
+            unsigned slotIndex = (unsigned)cqe.user_data;
+            onComplete(slots[slotIndex], cqe.res);
+            slots[slotIndex].owner.reset();
+            freeSlots.push_back(slotIndex);
+            head++;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+    
+private:
+    int ringFd = -1;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    size_t sqesSize = 0;
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned cqMask = 0;
+    unsigned localTail = 0;
+    unsigned toSubmit = 0;
+    vector<Slot> slots;
+    vector<unsigned> freeSlots;
+    
+    void* mapRing(size_t size, off_t offset) {
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, offset);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+};
+#endif
+
+// 由 stat 结果构造批量写入记录
+inline FileRecord makeFileRecord(const string& dir, const string& name, long long size, uid_t uid, gid_t gid,
+                                 mode_t mode, time_t createTime, time_t modifyTime,
+                                 OwnerNameCache& owners, DateFormatCache& dates) {
+    FileRecord record;
+    record.path = dir;
+    record.fileName = name;
+    record.extension = extractExtension(name);
+    record.fileSize = size;
+    record.owner = owners.lookup(uid);
+    record.createTime = dates.format(createTime);
+    record.modifyTime = modifyTime;
+    record.mode = mode & 07777;
+    record.uid = uid;
+    record.gid = gid;
+    return record;
+}
+
+// 取 stat 结果中的 mtime（纳秒）
+inline long long statModifyTimeNs(const struct stat& st) {
+#ifdef __APPLE__
+    return st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+    return st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+}
+
+// 扫描得到的单个文件的元数据。创建时间取 btime（Linux 用 statx，macOS 用 st_birthtime），
+// 文件系统不提供时一律退回 mtime。全量扫描的两种后端、增量重扫和 inotify 跟踪都经过这里，
+// 同一个文件不论由哪条路径采集，元数据都相同
+struct FileStat {
+    long long size = 0;
+    uid_t uid = 0;
+    gid_t gid = 0;
+    mode_t mode = 0;
+    time_t createTime = 0;
+    time_t modifyTime = 0;
+    
+#ifdef FS_HAVE_STATX
+    static constexpr unsigned kStatxMask = STATX_BASIC_STATS | STATX_BTIME;
+    
+    static FileStat fromStatx(const struct statx& stx) {
+        FileStat result;
+        result.size = (long long)stx.stx_size;
+        result.uid = stx.stx_uid;
+        result.gid = stx.stx_gid;
+        result.mode = stx.stx_mode;
+        result.modifyTime = stx.stx_mtime.tv_sec;
+        result.createTime = (stx.stx_mask & STATX_BTIME) ? stx.stx_btime.tv_sec : result.modifyTime;
+        return result;
+    }
+#endif
+    
+    static FileStat fromStat(const struct stat& st) {
+        FileStat result;
+        result.size = st.st_size;
+        result.uid = st.st_uid;
+        result.gid = st.st_gid;
+        result.mode = st.st_mode;
+        result.modifyTime = st.st_mtime;
+#ifdef __APPLE__
+        result.createTime = st.st_birthtimespec.tv_sec;
+#else
+        result.createTime = st.st_mtime;
+#endif
+        return result;
+    }
+};
+
+// 不跟随符号链接取 dirFd 下 name 的元数据（dirFd 可为 AT_FDCWD，name 为完整路径），失败返回 false
+inline bool statFileAt(int dirFd, const char* name, FileStat& out) {
+#ifdef FS_HAVE_STATX
+    struct statx stx;
+    if (statx(dirFd, name, AT_SYMLINK_NOFOLLOW, FileStat::kStatxMask, &stx) != 0) return false;
+    out = FileStat::fromStatx(stx);
+#else
+    struct stat st;
+    if (fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) return false;
+    out = FileStat::fromStat(st);
+#endif
+    return true;
+}
+
+inline FileRecord makeFileRecord(const string& dir, const string& name, const FileStat& st,
+                                 OwnerNameCache& owners, DateFormatCache& dates) {
+    return makeFileRecord(dir, name, st.size, st.uid, st.gid, st.mode, st.createTime, st.modifyTime, owners, dates);
+}
+
+// 逐个回调目录项（跳过 . 和 ..），读取出错时返回 false；Linux 上直接用 getdents64 批量读取
+template <typename Callback>
+bool forEachDirectoryEntry(int dirFd, vector<char>& direntBuffer, Callback&& callback) {
+#ifdef __linux__
+    struct LinuxDirent64 {
+        ino64_t d_ino;
+        off64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    };
+    
+    while (true) {
+        long n = syscall(SYS_getdents64, dirFd, direntBuffer.data(), direntBuffer.size());
+        if (n < 0) return false;
+        if (n == 0) return true;
+        for (long offset = 0; offset < n;) {
+            auto* entry = reinterpret_cast<LinuxDirent64*>(direntBuffer.data() + offset);
+            offset += entry->d_reclen;
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+            callback(name, entry->d_type);
+        }
+    }
+#else
+    (void)direntBuffer;
+    int dupFd = dup(dirFd);
+    DIR* dp = dupFd >= 0 ? fdopendir(dupFd) : nullptr;
+    if (!dp) {
+        if (dupFd >= 0) close(dupFd);
+        return false;
+    }
+    while (struct dirent* entry = readdir(dp)) {
+        const char* name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+        callback(name, entry->d_type);
+    }
+    closedir(dp);
+    return true;
+#endif
+}
+
+// 元数据获取后端：线程池同步 fstatat，或 io_uring 批量 statx（不可用时自动回退）
+enum class ScanBackend {
+    ThreadPool,
+    IoUring,
+};
+
+struct ScanOptions {
+    int numThreads = (int)max(1u, thread::hardware_concurrency());
+    size_t batchSize = 4096;
+    ScanBackend backend = ScanBackend::ThreadPool;
+    unsigned ringEntries = 256;     // 每个线程 io_uring 的 SQ 深度
+    unsigned submitBatch = 64;      // 攒够这么多 statx 再提交一次
+};
+
+struct ScanStats {
+    size_t files = 0;
+    size_t directories = 0;
+    size_t skipped = 0;     // 符号链接、设备等非普通文件
+    size_t errors = 0;
+    double seconds = 0;
+    string backend;         // 实际使用的后端
+};
+
+// 真实目录树的并行扫描器
+// 每个工作线程持有一个目录队列，本地按 LIFO 取（深度优先，局部性好），
+// 空闲时从其他线程队列头部窃取（取走的是较浅、子树较大的目录）。
+// 扫描结果按批交给 sink，sink 会被多个工作线程并发调用。
+class DirectoryScanner {
+public:
+    using Options = ScanOptions;
+    using Stats = ScanStats;
+    using BatchSink = function<void(vector<FileRecord>&)>;
+    using DirectorySink = function<void(vector<DirectoryRecord>&)>;
+    
+    explicit DirectoryScanner(Options opts = Options()) : options(opts) {
+        if (options.numThreads < 1) options.numThreads = 1;
+        if (options.batchSize < 1) options.batchSize = 1;
+    }
+    
+    // directorySink 可选，用于接收每个目录的 mtime 和子项数
+    Stats scan(const string& rootPath, const BatchSink& sink, const DirectorySink& directorySink = nullptr) {
+        string root = normalizeRoot(rootPath);
+        
+        queues.clear();
+        for (int i = 0; i < options.numThreads; ++i) {
+            queues.push_back(make_unique<WorkQueue>());
+        }
+        pendingDirs = 0;
+        ioUringFallbacks = 0;
+        pushDirectory(0, root);
+        
+        vector<Stats> perThread(options.numThreads);
+        auto start = steady_clock::now();
+        
+        vector<thread> workers;
+        for (int i = 0; i < options.numThreads; ++i) {
+            workers.emplace_back([this, i, &sink, &directorySink, &perThread]() {
+                workerLoop(i, sink, directorySink, perThread[i]);
+            });
+        }
+        for (auto& t : workers) {
+            t.join();
+        }
+        
+        Stats total;
+        for (const auto& s : perThread) {
+            total.files += s.files;
+            total.directories += s.directories;
+            total.skipped += s.skipped;
+            total.errors += s.errors;
+        }
+        total.seconds = duration<double>(steady_clock::now() - start).count();
+        total.backend = options.backend == ScanBackend::IoUring && ioUringFallbacks.load() == 0
+                            && ioUringSupported() ? "io_uring" : "thread-pool";
+        return total;
+    }
+    
+    // 扫描并直接写入模拟器（同时记录目录状态，供增量重扫使用）
+    Stats scanInto(const string& rootPath, FileSystemSimulator& fs) {
+        return scan(rootPath, [&fs](vector<FileRecord>& batch) {
+            fs.addFiles(batch);
+        }, [&fs](vector<DirectoryRecord>& directories) {
+            MutationBatch batch;
+            batch.directoryStates.swap(directories);
+            fs.applyMutations(batch);
+        });
+    }
+    
+private:
+    struct WorkQueue {
+        mutex queueMutex;
+        deque<string> dirs;
+    };
+    
+    Options options;
+    OwnerNameCache ownerCache;
+    vector<unique_ptr<WorkQueue>> queues;
+    atomic<size_t> pendingDirs{0};   // 已入队或正在处理的目录数，归零即扫描结束
+    atomic<int> ioUringFallbacks{0}; // 未能建立 io_uring 而回退的线程数
+    
+    static bool ioUringSupported() {
+#ifdef FS_HAVE_IO_URING
+        return true;
+#else
+        return false;
+#endif
+    }
+    
+    static string normalizeRoot(const string& rootPath) {
+        char resolved[PATH_MAX];
+        if (!realpath(rootPath.c_str(), resolved)) {
+            throw runtime_error("无法访问目录: " + rootPath);
+        }
+        struct stat st;
+        if (stat(resolved, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            throw runtime_error("不是目录: " + rootPath);
+        }
+        return resolved;
+    }
+    
+    static string joinPath(const string& dir, const char* name) {
+        return dir == "/" ? "/" + string(name) : dir + "/" + name;
+    }
+    
+    void pushDirectory(int worker, string dir) {
+        pendingDirs.fetch_add(1);
+        lock_guard<mutex> lock(queues[worker]->queueMutex);
+        queues[worker]->dirs.push_back(move(dir));
+    }
+    
+    bool popLocal(int worker, string& dir) {
+        lock_guard<mutex> lock(queues[worker]->queueMutex);
+        if (queues[worker]->dirs.empty()) return false;
+        dir = move(queues[worker]->dirs.back());
+        queues[worker]->dirs.pop_back();
+        return true;
+    }
+    
+    bool steal(int worker, string& dir) {
+        for (int k = 1; k < options.numThreads; ++k) {
+            auto& victim = *queues[(worker + k) % options.numThreads];
+            lock_guard<mutex> lock(victim.queueMutex);
+            if (!victim.dirs.empty()) {
+                dir = move(victim.dirs.front());
+                victim.dirs.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    // 单个工作线程的扫描状态
+    struct WorkerContext {
+        const BatchSink* sink = nullptr;
+        const DirectorySink* directorySink = nullptr;
+        Stats stats;
+        vector<FileRecord> batch;
+        vector<DirectoryRecord> directoryBatch;
+        vector<char> direntBuffer;
+        DateFormatCache dates;
+#ifdef FS_HAVE_IO_URING
+        unique_ptr<StatxRing> statxRing;
+#endif
+    };
+    
+    void workerLoop(int worker, const BatchSink& sink, const DirectorySink& directorySink, Stats& stats) {
+        WorkerContext ctx;
+        ctx.sink = &sink;
+        ctx.directorySink = directorySink ? &directorySink : nullptr;
+        ctx.batch.reserve(options.batchSize);
+        ctx.direntBuffer.resize(1 << 16);
+#ifdef FS_HAVE_IO_URING
+        if (options.backend == ScanBackend::IoUring) {
+            auto ring = make_unique<StatxRing>();
+            if (ring->init(options.ringEntries)) {
+                ctx.statxRing = move(ring);
+            } else {
+                ioUringFallbacks.fetch_add(1);
+            }
+        }
+#endif
+        string dir;
+        
+        while (true) {
+            if (popLocal(worker, dir) || steal(worker, dir)) {
+                listDirectory(worker, dir, ctx);
+                pendingDirs.fetch_sub(1);
+                continue;
+            }
+#ifdef FS_HAVE_IO_URING
+            // 空闲时先收完自己在途的 statx，避免结果滞留在环里
+            if (ctx.statxRing && ctx.statxRing->inFlight() > 0) {
+                drainStatx(ctx);
+                continue;
+            }
+#endif
+            if (pendingDirs.load() == 0) break;
+            this_thread::yield();
+        }
+        
+        if (!ctx.batch.empty()) {
+            sink(ctx.batch);
+        }
+        if (ctx.directorySink && !ctx.directoryBatch.empty()) {
+            directorySink(ctx.directoryBatch);
+        }
+        stats = ctx.stats;
+    }
+    
+    void listDirectory(int worker, const string& dir, WorkerContext& ctx) {
+        int dirFd = openat(AT_FDCWD, dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd < 0) {
+            ctx.stats.errors++;
+            return;
+        }
+        ctx.stats.directories++;
+        
+#ifdef FS_HAVE_IO_URING
+        // 目录 fd 和路径由在途的 statx 共享，最后一个引用释放时关闭
+        shared_ptr<OpenDirectory> openDir;
+        if (ctx.statxRing) {
+            openDir = make_shared<OpenDirectory>(dirFd, dir);
+        }
+#endif
+        
+        // 目录 mtime 必须在列目录之前取，列目录期间发生的变化才会在下次重扫时被发现
+        long long dirModifyTimeNs = -1;
+        struct stat dirStat;
+        if (ctx.directorySink && fstat(dirFd, &dirStat) == 0) {
+            dirModifyTimeNs = statModifyTimeNs(dirStat);
+        }
+        
+        size_t childCount = 0;
+        bool listed = forEachDirectoryEntry(dirFd, ctx.direntBuffer, [&](const char* name, unsigned char type) {
+            childCount++;
+            if (type == DT_DIR) {
+                pushDirectory(worker, joinPath(dir, name));
+                return;
+            }
+            if (type != DT_REG && type != DT_UNKNOWN) {
+                ctx.stats.skipped++;
+                return;
+            }
+#ifdef FS_HAVE_IO_URING
+            // 已知是普通文件的条目交给 io_uring 异步 statx，与后续目录读取重叠（环中途失效后改走 fstatat）
+            if (openDir && ctx.statxRing && type == DT_REG) {
+                queueStatx(ctx, openDir, name);
+                return;
+            }
+#endif
+            
+            FileStat st;
+            if (!statFileAt(dirFd, name, st)) {
+                ctx.stats.errors++;
+                return;
+            }
+            if (S_ISDIR(st.mode)) {
+                pushDirectory(worker, joinPath(dir, name));
+                return;
+            }
+            if (!S_ISREG(st.mode)) {
+                ctx.stats.skipped++;
+                return;
+            }
+            appendRecord(ctx, dir, name, st);
+        });
+        if (!listed) ctx.stats.errors++;
+        
+        if (dirModifyTimeNs >= 0) {
+            ctx.directoryBatch.push_back({dir, dirModifyTimeNs, childCount});
+            if (ctx.directoryBatch.size() >= options.batchSize) {
+                (*ctx.directorySink)(ctx.directoryBatch);
+                ctx.directoryBatch.clear();
+            }
+        }
+        
+#ifdef FS_HAVE_IO_URING
+        if (openDir) {
+            if (ctx.statxRing && submitStatx(ctx, 0)) reapStatx(ctx);
+            return;
+        }
+#endif
+        close(dirFd);
+    }
+    
+    void appendRecord(WorkerContext& ctx, const string& dir, const char* name, const FileStat& st) {
+        ctx.batch.push_back(makeFileRecord(dir, name, st, ownerCache, ctx.dates));
+        ctx.stats.files++;
+        
+        if (ctx.batch.size() >= options.batchSize) {
+            (*ctx.sink)(ctx.batch);
+            ctx.batch.clear();
+        }
+    }
+    
+#ifdef FS_HAVE_IO_URING
+    struct OpenDirectory {
+        int fd;
+        string path;
+        OpenDirectory(int f, const string& p) : fd(f), path(p) {}
+        ~OpenDirectory() { close(fd); }
+    };
+    
+    void queueStatx(WorkerContext& ctx, const shared_ptr<OpenDirectory>& dir, const char* name) {
+        auto& ring = *ctx.statxRing;
+        // 环满时先提交并至少等一个完成，腾出槽位
+        while (!ring.hasFreeSlot()) {
+            if (!submitStatx(ctx, 1)) {
+                StatxRing::Slot slot{name, {}, dir};
+                completeStatx(ctx, slot, syncStatx(*dir, name, slot.result));
+                return;
+            }
+            reapStatx(ctx);
+        }
+        ring.queue(dir->fd, name, dir);
+        if (ring.unsubmitted() >= options.submitBatch && submitStatx(ctx, 0)) reapStatx(ctx);
+    }
+    
+    // 提交失败时放弃本线程的环（见 abandonStatxRing），返回 false，ctx.statxRing 此后为空
+    bool submitStatx(WorkerContext& ctx, unsigned waitNr) {
+        if (ctx.statxRing->submit(waitNr)) return true;
+        abandonStatxRing(ctx);
+        return false;
+    }
+    
+    // io_uring_enter 出错：未提交的请求改用同步 statx 完成，本线程之后的文件走 fstatat。
+    // 已在内核里的请求不再调 io_uring_enter，轮询完成队列等它们完成（最多 1 秒）；
+    // 仍未完成的记为错误，环也不再释放，因为内核之后仍可能写入它的槽位
+    void abandonStatxRing(WorkerContext& ctx) {
+        ioUringFallbacks.fetch_add(1);
+        auto ring = move(ctx.statxRing);
+        ring->takeUnsubmitted([&](StatxRing::Slot& slot) {
+            completeStatx(ctx, slot, syncStatx(*static_pointer_cast<OpenDirectory>(slot.owner), slot.name.c_str(),
+                                               slot.result));
+        });
+        auto deadline = steady_clock::now() + seconds(1);
+        while (ring->inFlight() > 0 && steady_clock::now() < deadline) {
+            ring->reap([&](StatxRing::Slot& slot, int res) { completeStatx(ctx, slot, res); });
+            if (ring->inFlight() > 0) this_thread::sleep_for(milliseconds(1));
+        }
+        if (ring->inFlight() > 0) {
+            ctx.stats.errors += ring->inFlight();
+            ring.release();
+        }
+    }
+    
+    static int syncStatx(const OpenDirectory& dir, const char* name, struct statx& result) {
+        return statx(dir.fd, name, AT_SYMLINK_NOFOLLOW, FileStat::kStatxMask, &result) == 0 ? 0 : -errno;
+    }
+    
+    void completeStatx(WorkerContext& ctx, const StatxRing::Slot& slot, int res) {
+        auto dir = static_pointer_cast<OpenDirectory>(slot.owner);
+        if (res < 0) {
+            ctx.stats.errors++;
+        } else if (!S_ISREG(slot.result.stx_mode)) {
+            ctx.stats.skipped++;
+        } else {
+            appendRecord(ctx, dir->path, slot.name.c_str(), FileStat::fromStatx(slot.result));
+        }
+    }
+    
+    void reapStatx(WorkerContext& ctx) {
+        ctx.statxRing->reap([&](StatxRing::Slot& slot, int res) { completeStatx(ctx, slot, res); });
+    }
+    
+    void drainStatx(WorkerContext& ctx) {
+        while (ctx.statxRing && ctx.statxRing->inFlight() > 0) {
+            if (!submitStatx(ctx, 1)) return;
+            reapStatx(ctx);
+        }
+    }
+#endif
+};
+
+struct RescanStats {
+    size_t directoriesChecked = 0;    // stat 过的已知目录
+    size_t directoriesListed = 0;     // mtime 变化、重新列出的目录
+    size_t newSubtrees = 0;           // 新出现并全量扫描的子树
+    size_t added = 0;
+    size_t updated = 0;
+    size_t removed = 0;
+    size_t errors = 0;
+    double seconds = 0;
+};
+
+// 增量重扫：用于没有实时事件的场景（如网络挂载）。
+// 对内存树中的每个已知目录只做一次 stat，mtime 未变的目录不再列出；
+// mtime 变化的目录重新列出，与内存中的子项比对后只产生必要的变更。
+// 注意：文件内容原地修改不会改变目录 mtime，这类变化只在其所在目录被重新列出时才会更新。
+class IncrementalRescanner {
+public:
+    IncrementalRescanner(FileSystemSimulator& simulator, const ScanOptions& opts)
+        : fs(simulator), options(opts) {
+        if (options.numThreads < 1) options.numThreads = 1;
+    }
+    
+    explicit IncrementalRescanner(FileSystemSimulator& simulator)
+        : IncrementalRescanner(simulator, ScanOptions()) {}
+    
+    RescanStats rescan(const string& rootPath) {
+        char resolved[PATH_MAX];
+        if (!realpath(rootPath.c_str(), resolved)) {
+            throw runtime_error("无法访问目录: " + rootPath);
+        }
+        auto start = steady_clock::now();
+        
+        auto known = fs.listDirectoriesUnder(resolved);
+        if (known.empty()) {
+            // 从未扫描过：退化为全量扫描
+            DirectoryScanner scanner(options);
+            auto scanStats = scanner.scanInto(resolved, fs);
+            RescanStats stats;
+            stats.newSubtrees = 1;
+            stats.added = scanStats.files;
+            stats.errors = scanStats.errors;
+            stats.seconds = duration<double>(steady_clock::now() - start).count();
+            return stats;
+        }
+        
+        atomic<size_t> nextIndex(0);
+        vector<RescanStats> perThread(options.numThreads);
+        vector<thread> workers;
+        for (int i = 0; i < options.numThreads; ++i) {
+            workers.emplace_back([&, i]() {
+                workerLoop(known, nextIndex, perThread[i]);
+            });
+        }
+        for (auto& t : workers) {
+            t.join();
+        }
+        
+        RescanStats total;
+        for (const auto& s : perThread) {
+            total.directoriesChecked += s.directoriesChecked;
+            total.directoriesListed += s.directoriesListed;
+            total.newSubtrees += s.newSubtrees;
+            total.added += s.added;
+            total.updated += s.updated;
+            total.removed += s.removed;
+            total.errors += s.errors;
+        }
+        total.seconds = duration<double>(steady_clock::now() - start).count();
+        return total;
+    }
+    
+private:
+    FileSystemSimulator& fs;
+    ScanOptions options;
+    OwnerNameCache ownerCache;
+    
+    struct WorkerContext {
+        RescanStats stats;
+        MutationBatch batch;
+        vector<char> direntBuffer;
+        DateFormatCache dates;
+    };
+    
+    void workerLoop(const vector<DirectoryRecord>& known, atomic<size_t>& nextIndex, RescanStats& stats) {
+        const size_t chunk = 64;
+        WorkerContext ctx;
+        ctx.direntBuffer.resize(1 << 16);
+        
+        while (true) {
+            size_t begin = nextIndex.fetch_add(chunk);
+            if (begin >= known.size()) break;
+            size_t end = min(begin + chunk, known.size());
+            for (size_t i = begin; i < end; ++i) {
+                checkDirectory(known[i], ctx);
+            }
+        }
+        flush(ctx);
+        stats = ctx.stats;
+    }
+    
+    void checkDirectory(const DirectoryRecord& known, WorkerContext& ctx) {
+        ctx.stats.directoriesChecked++;
+        
+        int dirFd = openat(AT_FDCWD, known.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd < 0) {
+            // 目录已消失（其父目录 mtime 也会变化，重复删除是无害的）
+            if (errno == ENOENT || errno == ENOTDIR) {
+                ctx.batch.directoryRemovals.push_back(known.path);
+                maybeFlush(ctx);
+            } else {
+                ctx.stats.errors++;
+            }
+            return;
+        }
+        
+        struct stat dirStat;
+        if (fstat(dirFd, &dirStat) != 0) {
+            ctx.stats.errors++;
+            close(dirFd);
+            return;
+        }
+        long long modifyTimeNs = statModifyTimeNs(dirStat);
+        if (modifyTimeNs == known.modifyTimeNs) {
+            close(dirFd);
+            return;
+        }
+        
+        ctx.stats.directoriesListed++;
+        listAndDiff(known.path, dirFd, modifyTimeNs, ctx);
+        close(dirFd);
+        maybeFlush(ctx);
+    }
+    
+    void listAndDiff(const string& dir, int dirFd, long long modifyTimeNs, WorkerContext& ctx) {
+        vector<string> memorySubdirs, memoryFiles;
+        fs.getDirectoryListing(dir, memorySubdirs, memoryFiles);
+        unordered_set<string> diskSubdirs, diskFiles;
+        size_t childCount = 0;
+        
+        bool listed = forEachDirectoryEntry(dirFd, ctx.direntBuffer, [&](const char* name, unsigned char type) {
+            childCount++;
+            if (type == DT_DIR) {
+                diskSubdirs.insert(name);
+                return;
+            }
+            if (type != DT_REG && type != DT_UNKNOWN) return;
+            
+            FileStat st;
+            if (!statFileAt(dirFd, name, st)) {
+                ctx.stats.errors++;
+                return;
+            }
+            if (S_ISDIR(st.mode)) {
+                diskSubdirs.insert(name);
+            } else if (S_ISREG(st.mode)) {
+                diskFiles.insert(name);
+                // 内容未变的文件会在 applyMutations 中被跳过
+                ctx.batch.upserts.push_back(makeFileRecord(dir, name, st, ownerCache, ctx.dates));
+            }
+        });
+        if (!listed) {
+            // 列目录失败时保留旧状态，下次重扫再试
+            ctx.stats.errors++;
+            return;
+        }
+        
+        for (const auto& name : memoryFiles) {
+            if (!diskFiles.count(name)) ctx.batch.removals.push_back(childPath(dir, name));
+        }
+        for (const auto& name : memorySubdirs) {
+            if (!diskSubdirs.count(name)) ctx.batch.directoryRemovals.push_back(childPath(dir, name));
+        }
+        unordered_set<string> knownSubdirs(memorySubdirs.begin(), memorySubdirs.end());
+        for (const auto& name : diskSubdirs) {
+            if (!knownSubdirs.count(name)) scanNewSubtree(childPath(dir, name), ctx);
+        }
+        ctx.batch.directoryStates.push_back({dir, modifyTimeNs, childCount});
+    }
+    
+    // 新出现的子目录没有旧状态可比，直接全量扫描（在当前工作线程内单线程完成）
+    void scanNewSubtree(const string& dir, WorkerContext& ctx) {
+        ScanOptions subtreeOptions = options;
+        subtreeOptions.numThreads = 1;
+        DirectoryScanner scanner(subtreeOptions);
+        try {
+            auto scanStats = scanner.scan(dir, [&](vector<FileRecord>& records) {
+                move(records.begin(), records.end(), back_inserter(ctx.batch.upserts));
+                maybeFlush(ctx);
+            }, [&](vector<DirectoryRecord>& directories) {
+                move(directories.begin(), directories.end(), back_inserter(ctx.batch.directoryStates));
+            });
+            ctx.stats.newSubtrees++;
+            ctx.stats.errors += scanStats.errors;
+        } catch (const exception&) {
+            ctx.stats.errors++;
+        }
+    }
+    
+    static string childPath(const string& dir, const string& name) {
+        return dir == "/" ? "/" + name : dir + "/" + name;
+    }
+    
+    void maybeFlush(WorkerContext& ctx) {
+        if (ctx.batch.upserts.size() + ctx.batch.removals.size() >= options.batchSize) {
+            flush(ctx);
+        }
+    }
+    
+    void flush(WorkerContext& ctx) {
+        if (ctx.batch.empty()) return;
+        auto result = fs.applyMutations(ctx.batch);
+        ctx.stats.added += result.added;
+        ctx.stats.updated += result.updated;
+        ctx.stats.removed += result.removed;
+        ctx.batch = MutationBatch();
+    }
+};
+
+enum class DumpFormat {
+    Auto,
+    FindPrintf,   // find -printf '%p\t%s\t%u\t%T@\n'
+    Csv,          // path,size,owner,mtime
+};
+
+struct BulkLoadOptions {
+    int numThreads = (int)max(1u, thread::hardware_concurrency());
+    DumpFormat format = DumpFormat::Auto;
+};
+
+struct BulkLoadStats {
+    size_t lines = 0;
+    size_t loaded = 0;
+    size_t malformed = 0;     // 含 CSV 表头
+    double parseSeconds = 0;
+    double buildSeconds = 0;
+    string format;
+};
+
+// 元数据导出文件的批量装载器。
+// 文件整体 mmap 后按行边界切成若干块并行解析，分隔符和换行的查找都交给 memchr
+// （glibc 中为向量化实现），字段从行尾往前取最后三个分隔符，因此路径中含分隔符也能正确解析。
+// 解析结果通过 FileSystemSimulator::bulkLoad 整批建树和建索引。
+class MetadataDumpLoader {
+public:
+    explicit MetadataDumpLoader(const BulkLoadOptions& opts) : options(opts) {
+        if (options.numThreads < 1) options.numThreads = 1;
+    }
+    
+    MetadataDumpLoader() : MetadataDumpLoader(BulkLoadOptions()) {}
+    
+    BulkLoadStats load(const string& path, FileSystemSimulator& fs) {
+        BulkLoadStats stats;
+        MappedFile file(path);
+        const char* data = file.data();
+        size_t size = file.size();
+        
+        DumpFormat format = options.format;
+        if (format == DumpFormat::Auto) {
+            const char* firstLineEnd = size ? static_cast<const char*>(memchr(data, '\n', size)) : nullptr;
+            size_t firstLineLength = firstLineEnd ? (size_t)(firstLineEnd - data) : size;
+            format = size && memchr(data, '\t', firstLineLength) ? DumpFormat::FindPrintf : DumpFormat::Csv;
+        }
+        char delimiter = format == DumpFormat::FindPrintf ? '\t' : ',';
+        stats.format = format == DumpFormat::FindPrintf ? "find-printf" : "csv";
+        
+        auto parseStart = steady_clock::now();
+        int numChunks = size > (1 << 20) ? options.numThreads : 1;
+        vector<vector<FileRecord>> chunks(numChunks);
+        vector<BulkLoadStats> chunkStats(numChunks);
+        vector<thread> workers;
+        for (int i = 0; i < numChunks; ++i) {
+            workers.emplace_back([&, i]() {
+                const char* begin = alignToLine(data, size, size * i / numChunks);
+                const char* end = alignToLine(data, size, size * (i + 1) / numChunks);
+                parseChunk(begin, end, delimiter, format == DumpFormat::Csv, chunks[i], chunkStats[i]);
+            });
+        }
+        for (auto& t : workers) {
+            t.join();
+        }
+        
+        vector<FileRecord> records;
+        size_t total = 0;
+        for (const auto& chunk : chunks) total += chunk.size();
+        records.reserve(total);
+        for (int i = 0; i < numChunks; ++i) {
+            move(chunks[i].begin(), chunks[i].end(), back_inserter(records));
+            vector<FileRecord>().swap(chunks[i]);
+            stats.lines += chunkStats[i].lines;
+            stats.malformed += chunkStats[i].malformed;
+        }
+        stats.parseSeconds = duration<double>(steady_clock::now() - parseStart).count();
+        
+        auto buildStart = steady_clock::now();
+        stats.loaded = fs.bulkLoad(records);
+        stats.buildSeconds = duration<double>(steady_clock::now() - buildStart).count();
+        return stats;
+    }
+    
+private:
+    BulkLoadOptions options;
+    
+    // 把偏移推进到下一行行首（偏移 0 和文件末尾保持不变）
+    static const char* alignToLine(const char* data, size_t size, size_t offset) {
+        if (offset == 0 || offset >= size) return data + min(offset, size);
+        if (data[offset - 1] == '\n') return data + offset;
+        const char* newline = static_cast<const char*>(memchr(data + offset, '\n', size - offset));
+        return newline ? newline + 1 : data + size;
+    }
+    
+    static void parseChunk(const char* begin, const char* end, char delimiter, bool csv,
+                           vector<FileRecord>& out, BulkLoadStats& stats) {
+        out.reserve((end - begin) / 64);
+        DateFormatCache dates;
+        const char* line = begin;
+        while (line < end) {
+            const char* newline = static_cast<const char*>(memchr(line, '\n', end - line));
+            const char* lineEnd = newline ? newline : end;
+            if (lineEnd > line) {
+                stats.lines++;
+                FileRecord record;
+                if (parseLine(line, lineEnd, delimiter, csv, dates, record)) {
+                    out.push_back(move(record));
+                } else {
+                    stats.malformed++;
+                }
+            }
+            line = lineEnd + 1;
+        }
+    }
+    
+    static bool parseLine(const char* begin, const char* end, char delimiter, bool csv,
+                          DateFormatCache& dates, FileRecord& record) {
+        if (end > begin && end[-1] == '\r') --end;
+        
+        string path;
+        const char* fieldsBegin = begin;
+        if (csv && begin < end && *begin == '"') {
+            // 带引号的路径，"" 表示一个引号
+            const char* p = begin + 1;
+            while (true) {
+                const char* quote = static_cast<const char*>(memchr(p, '"', end - p));
+                if (!quote) return false;
+                path.append(p, quote);
+                if (quote + 1 < end && quote[1] == '"') {
+                    path.push_back('"');
+                    p = quote + 2;
+                    continue;
+                }
+                fieldsBegin = quote + 1;
+                break;
+            }
+            if (fieldsBegin >= end || *fieldsBegin != delimiter) return false;
+        }
+        
+        // 记录最后三个分隔符的位置
+        const char* delimiters[3] = {nullptr, nullptr, nullptr};
+        size_t found = 0;
+        for (const char* p = fieldsBegin; p < end;) {
+            const char* hit = static_cast<const char*>(memchr(p, delimiter, end - p));
+            if (!hit) break;
+            delimiters[found % 3] = hit;
+            found++;
+            p = hit + 1;
+        }
+        if (found < 3 || (!path.empty() && found != 3)) return false;
+        const char* d1 = delimiters[found % 3];
+        const char* d2 = delimiters[(found + 1) % 3];
+        const char* d3 = delimiters[(found + 2) % 3];
+        
+        long long size = 0;
+        long long modifyTime = 0;
+        if (!parseInteger(d1 + 1, d2, size) || !parseInteger(d3 + 1, end, modifyTime)) return false;
+        if (path.empty()) path.assign(begin, d1);
+        
+        // 相对路径（如 find . 的输出 ./a/b）统一挂到根目录下
+        if (path.compare(0, 2, "./") == 0) path.erase(0, 1);
+        if (path.empty() || path[0] != '/') path.insert(path.begin(), '/');
+        auto slash = path.rfind('/');
+        if (slash + 1 == path.size()) return false;
+        
+        record.fileName = path.substr(slash + 1);
+        path.resize(slash == 0 ? 1 : slash);
+        record.path = move(path);
+        record.extension = extractExtension(record.fileName);
+        record.fileSize = size;
+        record.owner.assign(d2 + 1, d3);
+        record.modifyTime = modifyTime;
+        record.createTime = dates.format((time_t)modifyTime);
+        return true;
+    }
+    
+    // 解析整数部分，允许带小数（%T@ 输出形如 1700000000.1234567890）
+    static bool parseInteger(const char* begin, const char* end, long long& value) {
+        value = 0;
+        const char* p = begin;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+            value = value * 10 + (*p - '0');
+        }
+        return p > begin && (p == end || *p == '.');
+    }
+};
+
+struct CheckpointStats {
+    size_t files = 0;
+    size_t directories = 0;
+    size_t bytes = 0;
+    size_t segmentBytes = 0;     // 同时写出的倒排段
+    uint64_t generation = 0;
+    double captureMillis = 0;    // 写操作被阻塞的时间
+    double writeSeconds = 0;     // 后台序列化并落盘的时间
+    string error;                // 后台写快照失败时的原因
+};
+
+// 检查点管理：恢复（快照 + 底段 + 日志重放）和后台检查点。
+// 检查点只在捕获阶段持有树的读锁，之后由后台线程先把快照中文件的内置属性倒排写成段 index.<段号>.seg，
+// 再把快照写到 checkpoint.tmp，fsync 后原子改名为 checkpoint.snap，最后删除快照已经覆盖的日志段和旧的段。
+// 恢复时映射与快照段号相同的段作为倒排索引的底段，没有或打不开时从快照重建索引
+class CheckpointManager {
+public:
+    CheckpointManager(FileSystemSimulator& fs, const string& directory)
+        : fs(fs), directory(directory) {}
+    
+    CheckpointManager(const CheckpointManager&) = delete;
+    CheckpointManager& operator=(const CheckpointManager&) = delete;
+    
+    ~CheckpointManager() {
+        if (worker.joinable()) worker.join();
+    }
+    
+    // 恢复到最近一次的状态并挂上新的日志段，返回重放的日志记录数。须在任何写入之前调用
+    size_t open() {
+        mkdir(directory.c_str(), 0755);
+        
+        CheckpointSnapshot snapshot;
+        if (readSnapshot(snapshotPath(), snapshot)) {
+            fs.restoreCheckpoint(snapshot, openSegment(snapshot.walGeneration));
+        }
+        size_t replayed = WriteAheadLog::replay(directory, snapshot.walGeneration, [&](const WalRecord& record) {
+            fs.applyWalRecord(record);
+        });
+        fs.attachWal(make_shared<WriteAheadLog>(directory));
+        return replayed;
+    }
+    
+    // 开始一次后台检查点；已有检查点在进行时返回 false
+    bool startCheckpoint() {
+        lock_guard<mutex> lock(checkpointMutex);
+        if (running) return false;
+        if (worker.joinable()) worker.join();
+        
+        auto start = steady_clock::now();
+        auto snapshot = make_shared<CheckpointSnapshot>(fs.captureCheckpoint());
+        lastStats = CheckpointStats();
+        lastStats.captureMillis = duration<double, milli>(steady_clock::now() - start).count();
+        running = true;
+        
+        worker = thread([this, snapshot] {
+            auto writeStart = steady_clock::now();
+            CheckpointStats stats;
+            stats.files = snapshot->files.size();
+            stats.directories = snapshot->directories.size();
+            stats.generation = snapshot->walGeneration;
+            try {
+                sort(snapshot->files.begin(), snapshot->files.end(),
+                     [](const shared_ptr<FileMetadata>& a, const shared_ptr<FileMetadata>& b) {
+                         return a->fileId < b->fileId;
+                     });
+                // 段改名后由 writeSnapshot 的目录 fsync 一并持久；快照没有落盘时 writeSnapshot 抛出，日志段保留
+                stats.segmentBytes = writeSegment(*snapshot);
+                stats.bytes = writeSnapshot(*snapshot);
+                WriteAheadLog::truncateBefore(directory, snapshot->walGeneration);
+                removeSegmentsExcept(snapshot->walGeneration);
+            } catch (const exception& e) {
+                stats.error = e.what();
+            }
+            stats.writeSeconds = duration<double>(steady_clock::now() - writeStart).count();
+            
+            lock_guard<mutex> lock(checkpointMutex);
+            stats.captureMillis = lastStats.captureMillis;
+            lastStats = stats;
+            running = false;
+        });
+        return true;
+    }
+    
+    bool isRunning() const {
+        lock_guard<mutex> lock(checkpointMutex);
+        return running;
+    }
+    
+    // 等待进行中的检查点完成，返回最近一次检查点的统计
+    CheckpointStats waitForCheckpoint() {
+        thread finished;
+        {
+            lock_guard<mutex> lock(checkpointMutex);
+            finished = move(worker);
+        }
+        if (finished.joinable()) finished.join();
+        lock_guard<mutex> lock(checkpointMutex);
+        return lastStats;
+    }
+    
+    CheckpointStats checkpoint() {
+        startCheckpoint();
+        return waitForCheckpoint();
+    }
+    
+private:
+    // 最后两位是格式版本，只读取当前版本的快照
+    static constexpr char kMagic[8] = {'F', 'S', 'S', 'N', 'A', 'P', '0', '3'};
+    
+    FileSystemSimulator& fs;
+    string directory;
+    thread worker;
+    mutable mutex checkpointMutex;
+    bool running = false;
+    CheckpointStats lastStats;
+    
+    string snapshotPath() const { return directory + "/checkpoint.snap"; }
+    
+    string segmentPath(uint64_t generation) const {
+        return directory + "/index." + to_string(generation) + ".seg";
+    }
+    
+    // 后台写段：单线程构建，不和前台的写操作争抢 CPU。先写 index.tmp，finish 中 fsync 后再改名
+    size_t writeSegment(const CheckpointSnapshot& snapshot) const {
+        string tmpPath = directory + "/index.tmp";
+        uint64_t bytes = InvertedIndex::writeSegment(MetadataColumns::fromFiles(snapshot.files), tmpPath, 1);
+        if (rename(tmpPath.c_str(), segmentPath(snapshot.walGeneration).c_str()) != 0) {
+            throw runtime_error(string("段文件改名失败: ") + strerror(errno));
+        }
+        return bytes;
+    }
+    
+    // 映射段号为 generation 的段；不存在或格式不对时返回空，由调用方重建索引
+    shared_ptr<const MappedSegment> openSegment(uint64_t generation) const {
+        string path = segmentPath(generation);
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) return nullptr;
+        try {
+            return make_shared<const MappedSegment>(path);
+        } catch (const runtime_error&) {
+            return nullptr;
+        }
+    }
+    
+    // 新快照落盘后，其他检查点的段都不会再被恢复用到（已映射的段删除后仍可访问）
+    void removeSegmentsExcept(uint64_t generation) const {
+        DIR* dp = opendir(directory.c_str());
+        if (!dp) return;
+        vector<string> stale;
+        while (struct dirent* entry = readdir(dp)) {
+            string path = directory + "/" + entry->d_name;
+            if (strncmp(entry->d_name, "index.", 6) == 0 && path.size() > 4 &&
+                path.compare(path.size() - 4, 4, ".seg") == 0 && path != segmentPath(generation)) {
+                stale.push_back(path);
+            }
+        }
+        closedir(dp);
+        for (const auto& path : stale) unlink(path.c_str());
+    }
+    
+    // 快照格式：magic | generation | nextFileId | 文件数 | 文件… | 目录数 | 目录… | 校验和，
+    // 每个文件的定长字段之后依次是标签（个数 | (键, 值)…）和 mode | uid | gid
+    size_t writeSnapshot(const CheckpointSnapshot& snapshot) const {
+        string tmpPath = directory + "/checkpoint.tmp";
+        int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw runtime_error("无法写入快照: " + tmpPath + ": " + strerror(errno));
+        }
+        
+        BinaryWriter out;
+        uint32_t checksum = 2166136261u;
+        size_t written = 0;
+        auto flush = [&](bool force) {
+            if (out.size() < (1 << 20) && !force) return;
+            checksum = checksum32(out.data().data(), out.size(), checksum);
+            const char* data = out.data().data();
+            size_t remaining = out.size();
+            while (remaining > 0) {
+                ssize_t n = write(fd, data, remaining);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    close(fd);
+                    throw runtime_error(string("写快照失败: ") + strerror(errno));
+                }
+                data += n;
+                remaining -= n;
+            }
+            written += out.size();
+            out.clear();
+        };
+        
+        for (char c : kMagic) out.putU8((uint8_t)c);
+        out.putU64(snapshot.walGeneration);
+        out.putU32((uint32_t)snapshot.nextFileId);
+        out.putU64(snapshot.files.size());
+        for (const auto& file : snapshot.files) {
+            out.putU32((uint32_t)file->fileId);
+            out.putString(file->fullPath);
+            out.putString(file->fileName);
+            out.putString(file->extension);
+            out.putI64(file->fileSize);
+            out.putString(file->owner);
+            out.putString(file->createTime);
+            out.putI64(file->modifyTime);
+            out.putU32((uint32_t)file->tags.size());
+            for (const auto& tag : file->tags) {
+                out.putString(tag.key);
+                out.putString(tag.value);
+            }
+            out.putU32(file->mode);
+            out.putU32(file->uid);
+            out.putU32(file->gid);
+            flush(false);
+        }
+        out.putU64(snapshot.directories.size());
+        for (const auto& dir : snapshot.directories) {
+            out.putString(dir.path);
+            out.putI64(dir.modifyTimeNs);
+            out.putU64(dir.childCount);
+            flush(false);
+        }
+        flush(true);
+        out.putU32(checksum);
+        flush(true);
+        
+        // 快照落盘之前不能改名：改名后工作线程会删掉快照覆盖的日志段，那时快照是这些变更唯一的副本
+        if (fsync(fd) != 0) {
+            int error = errno;
+            close(fd);
+            throw runtime_error("快照 fsync 失败: " + tmpPath + ": " + strerror(error));
+        }
+        if (close(fd) != 0) {
+            throw runtime_error("关闭快照失败: " + tmpPath + ": " + strerror(errno));
+        }
+        if (rename(tmpPath.c_str(), snapshotPath().c_str()) != 0) {
+            throw runtime_error(string("快照改名失败: ") + strerror(errno));
+        }
+        // 改名本身要等目录 fsync 后才持久；失败时抛出，调用方不截断日志
+        int dirFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd < 0) {
+            throw runtime_error("无法打开检查点目录: " + directory + ": " + strerror(errno));
+        }
+        if (fsync(dirFd) != 0) {
+            int error = errno;
+            close(dirFd);
+            throw runtime_error("检查点目录 fsync 失败: " + directory + ": " + strerror(error));
+        }
+        close(dirFd);
+        return written;
+    }
+    
+    // 读取快照；文件不存在或校验失败时返回 false（此时从空状态重放全部日志）
+    static bool readSnapshot(const string& path, CheckpointSnapshot& snapshot) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) return false;
+        MappedFile file(path);
+        if (file.size() < sizeof(kMagic) + sizeof(uint32_t) ||
+            memcmp(file.data(), kMagic, sizeof(kMagic)) != 0) {
+            return false;
+        }
+        
+        const char* end = file.data() + file.size() - sizeof(uint32_t);
+        uint32_t expected;
+        memcpy(&expected, end, sizeof(expected));
+        if (checksum32(file.data(), end - file.data()) != expected) return false;
+        
+        BinaryReader reader(file.data() + sizeof(kMagic), end);
+        uint32_t nextFileId;
+        uint64_t fileCount, dirCount;
+        if (!reader.getU64(snapshot.walGeneration) || !reader.getU32(nextFileId) ||
+            !reader.getU64(fileCount)) {
+            return false;
+        }
+        snapshot.nextFileId = (int)nextFileId;
+        snapshot.files.reserve(fileCount);
+        for (uint64_t i = 0; i < fileCount; ++i) {
+            auto meta = make_shared<FileMetadata>();
+            uint32_t fileId;
+            int64_t size, modifyTime;
+            if (!reader.getU32(fileId) || !reader.getString(meta->fullPath) ||
+                !reader.getString(meta->fileName) || !reader.getString(meta->extension) ||
+                !reader.getI64(size) || !reader.getString(meta->owner) ||
+                !reader.getString(meta->createTime) || !reader.getI64(modifyTime)) {
+                return false;
+            }
+            meta->fileId = (int)fileId;
+            meta->fileSize = size;
+            meta->modifyTime = modifyTime;
+            uint32_t tagCount;
+            if (!reader.getU32(tagCount) || tagCount > reader.remaining()) return false;
+            meta->tags.resize(tagCount);
+            for (auto& tag : meta->tags) {
+                if (!reader.getString(tag.key) || !reader.getString(tag.value)) return false;
+            }
+            if (!reader.getU32(meta->mode) || !reader.getU32(meta->uid) || !reader.getU32(meta->gid)) return false;
+            snapshot.files.push_back(move(meta));
+        }
+        if (!reader.getU64(dirCount)) return false;
+        snapshot.directories.resize(dirCount);
+        for (auto& dir : snapshot.directories) {
+            int64_t modifyTimeNs;
+            uint64_t childCount;
+            if (!reader.getString(dir.path) || !reader.getI64(modifyTimeNs) || !reader.getU64(childCount)) {
+                return false;
+            }
+            dir.modifyTimeNs = modifyTimeNs;
+            dir.childCount = childCount;
+        }
+        return true;
+    }
+};
+
+#ifdef __linux__
+struct WatchOptions {
+    int coalesceMillis = 100;        // 事件合并窗口：窗口内同一路径的多次事件只处理一次
+    size_t maxBatch = 4096;          // 待处理路径达到上限时立即刷新
+    int overflowWindowSeconds = 5;   // 队列溢出时，重扫这段时间内有过事件的目录
+    ScanOptions scanOptions;         // 子树重扫使用的扫描参数
+};
+
+struct WatchStats {
+    size_t events = 0;
+    size_t batches = 0;
+    size_t added = 0;
+    size_t updated = 0;
+    size_t removed = 0;
+    size_t overflows = 0;
+    size_t subtreeRescans = 0;
+    size_t watchedDirectories = 0;
+};
+
+// 目录树实时同步：inotify 订阅创建、删除、移动和属性变化，
+// 合并突发事件后通过 applyMutations 批量写入模拟器。
+// 事件队列溢出时，对近期有活动的目录做子树对账重扫，而不是全量重扫。
+// fanotify 需要 CAP_SYS_ADMIN，这里只使用 inotify。
+class FileSystemWatcher {
+public:
+    FileSystemWatcher(FileSystemSimulator& simulator, const WatchOptions& opts)
+        : fs(simulator), options(opts) {
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd < 0) {
+            throw runtime_error(string("inotify_init1 失败: ") + strerror(errno));
+        }
+    }
+    
+    explicit FileSystemWatcher(FileSystemSimulator& simulator)
+        : FileSystemWatcher(simulator, WatchOptions()) {}
+    
+    ~FileSystemWatcher() {
+        stop();
+        close(inotifyFd);
+    }
+    
+    // 订阅整棵子树（需在 start 之前调用）；初始数据由调用方先行扫描
+    void watch(const string& rootPath) {
+        char resolved[PATH_MAX];
+        if (!realpath(rootPath.c_str(), resolved)) {
+            throw runtime_error("无法访问目录: " + rootPath);
+        }
+        roots.push_back(resolved);
+        addWatchRecursive(resolved);
+    }
+    
+    void start() {
+        if (running.exchange(true)) return;
+        worker = thread([this]() { run(); });
+    }
+    
+    void stop() {
+        if (!running.exchange(false)) return;
+        if (worker.joinable()) worker.join();
+    }
+    
+    WatchStats getStats() const {
+        lock_guard<mutex> lock(statsMutex);
+        WatchStats snapshot = stats;
+        snapshot.watchedDirectories = watchedDirectoryCount.load();
+        return snapshot;
+    }
+    
+private:
+    static constexpr uint32_t kWatchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                           IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_ONLYDIR;
+    
+    FileSystemSimulator& fs;
+    WatchOptions options;
+    int inotifyFd;
+    thread worker;
+    atomic<bool> running{false};
+    
+    vector<string> roots;
+    unordered_map<int, string> wdToPath;
+    unordered_map<string, int> pathToWd;
+    atomic<size_t> watchedDirectoryCount{0};
+    
+    // 合并窗口内的待处理变更：文件只记路径，刷新时再 stat 决定是增改还是删除
+    unordered_set<string> pendingFiles;
+    unordered_set<string> pendingNewDirectories;
+    unordered_set<string> pendingRemovedDirectories;
+    steady_clock::time_point firstPending;
+    unordered_map<string, steady_clock::time_point> recentActivity;
+    
+    OwnerNameCache ownerCache;
+    DateFormatCache dates;
+    
+    mutable mutex statsMutex;
+    WatchStats stats;
+    
+    void run() {
+        vector<char> buffer(1 << 16);
+        pollfd pfd{inotifyFd, POLLIN, 0};
+        
+        while (running.load()) {
+            int timeout = pendingCount() > 0 ? options.coalesceMillis : 200;
+            int ready = poll(&pfd, 1, timeout);
+            if (ready > 0) {
+                while (true) {
+                    ssize_t n = read(inotifyFd, buffer.data(), buffer.size());
+                    if (n <= 0) break;
+                    for (ssize_t offset = 0; offset < n;) {
+                        auto* event = reinterpret_cast<inotify_event*>(buffer.data() + offset);
+                        offset += sizeof(inotify_event) + event->len;
+                        handleEvent(*event);
+                    }
+                }
+            }
+            
+            if (pendingCount() > 0 &&
+                (pendingCount() >= options.maxBatch ||
+                 steady_clock::now() - firstPending >= milliseconds(options.coalesceMillis))) {
+                flush();
+            }
+        }
+        flush();
+    }
+    
+    size_t pendingCount() const {
+        return pendingFiles.size() + pendingNewDirectories.size() + pendingRemovedDirectories.size();
+    }
+    
+    void markPending(const string& dir) {
+        if (pendingCount() == 0) firstPending = steady_clock::now();
+        recentActivity[dir] = steady_clock::now();
+    }
+    
+    void handleEvent(const inotify_event& event) {
+        {
+            lock_guard<mutex> lock(statsMutex);
+            stats.events++;
+        }
+        
+        if (event.mask & IN_Q_OVERFLOW) {
+            handleOverflow();
+            return;
+        }
+        
+        auto it = wdToPath.find(event.wd);
+        if (it == wdToPath.end()) return;
+        string dir = it->second;
+        
+        if (event.mask & (IN_IGNORED | IN_DELETE_SELF)) {
+            if (event.mask & IN_IGNORED) {
+                pathToWd.erase(dir);
+                wdToPath.erase(event.wd);
+                watchedDirectoryCount--;
+            }
+            return;
+        }
+        if (event.len == 0) return;
+        
+        string path = dir == "/" ? "/" + string(event.name) : dir + "/" + event.name;
+        markPending(dir);
+        
+        if (event.mask & IN_ISDIR) {
+            if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+                // 移出的目录其 watch 仍然有效但路径已失效，一并撤销
+                removeWatchesUnder(path);
+                pendingNewDirectories.erase(path);
+                pendingRemovedDirectories.insert(path);
+            } else if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+                pendingRemovedDirectories.erase(path);
+                pendingNewDirectories.insert(path);
+            }
+            return;
+        }
+        pendingFiles.insert(path);
+    }
+    
+    void handleOverflow() {
+        {
+            lock_guard<mutex> lock(statsMutex);
+            stats.overflows++;
+        }
+        
+        // 丢失的是最新的事件，它们大概率来自近期活跃的目录；没有活跃记录时退化为重扫全部根目录
+        auto cutoff = steady_clock::now() - seconds(options.overflowWindowSeconds);
+        vector<string> targets;
+        for (const auto& entry : recentActivity) {
+            if (entry.second >= cutoff) targets.push_back(entry.first);
+        }
+        if (targets.empty()) targets = roots;
+        if (pendingCount() == 0) firstPending = steady_clock::now();
+        for (const auto& dir : collapseToTopmost(targets)) {
+            pendingNewDirectories.insert(dir);
+        }
+    }
+    
+    // 去掉被其他目录包含的目录，避免重复重扫
+    static vector<string> collapseToTopmost(vector<string> dirs) {
+        sort(dirs.begin(), dirs.end());
+        vector<string> result;
+        for (const auto& dir : dirs) {
+            if (!result.empty() && isUnder(dir, result.back())) continue;
+            result.push_back(dir);
+        }
+        return result;
+    }
+    
+    static bool isUnder(const string& path, const string& dir) {
+        if (dir == "/") return true;
+        return path.size() >= dir.size() && path.compare(0, dir.size(), dir) == 0 &&
+               (path.size() == dir.size() || path[dir.size()] == '/');
+    }
+    
+    void flush() {
+        if (pendingCount() == 0) return;
+        
+        MutationBatch batch;
+        batch.directoryRemovals.assign(pendingRemovedDirectories.begin(), pendingRemovedDirectories.end());
+        
+        for (const auto& path : pendingFiles) {
+            auto slash = path.rfind('/');
+            string dir = slash == 0 ? "/" : path.substr(0, slash);
+            string name = path.substr(slash + 1);
+            
+            FileStat st;
+            if (statFileAt(AT_FDCWD, path.c_str(), st) && S_ISREG(st.mode)) {
+                batch.upserts.push_back(makeFileRecord(dir, name, st, ownerCache, dates));
+            } else {
+                batch.removals.push_back(path);
+            }
+        }
+        
+        auto result = fs.applyMutations(batch);
+        {
+            lock_guard<mutex> lock(statsMutex);
+            stats.batches++;
+            stats.added += result.added;
+            stats.updated += result.updated;
+            stats.removed += result.removed;
+        }
+        
+        // 新目录在建立 watch 之前可能已有内容，逐个做子树对账
+        vector<string> newDirectories(pendingNewDirectories.begin(), pendingNewDirectories.end());
+        pendingFiles.clear();
+        pendingNewDirectories.clear();
+        pendingRemovedDirectories.clear();
+        for (const auto& dir : collapseToTopmost(newDirectories)) {
+            rescanSubtree(dir);
+        }
+        
+        auto cutoff = steady_clock::now() - seconds(options.overflowWindowSeconds);
+        for (auto it = recentActivity.begin(); it != recentActivity.end();) {
+            it = it->second < cutoff ? recentActivity.erase(it) : next(it);
+        }
+    }
+    
+    // 子树对账：以磁盘为准，补齐新增/变化的文件，删除已不存在的文件
+    void rescanSubtree(const string& dir) {
+        vector<FileRecord> onDisk;
+        mutex diskMutex;
+        MutationBatch batch;
+        
+        try {
+            DirectoryScanner scanner(options.scanOptions);
+            scanner.scan(dir, [&](vector<FileRecord>& records) {
+                lock_guard<mutex> lock(diskMutex);
+                move(records.begin(), records.end(), back_inserter(onDisk));
+            });
+            addWatchRecursive(dir);
+        } catch (const exception&) {
+            // 目录在重扫前已被删除
+            batch.directoryRemovals.push_back(dir);
+        }
+        
+        unordered_set<string> diskPaths;
+        for (const auto& record : onDisk) {
+            diskPaths.insert(record.path + (record.path == "/" ? "" : "/") + record.fileName);
+        }
+        for (const auto& file : fs.listFilesUnder(dir)) {
+            if (!diskPaths.count(file->fullPath)) batch.removals.push_back(file->fullPath);
+        }
+        batch.upserts = move(onDisk);
+        
+        auto result = fs.applyMutations(batch);
+        lock_guard<mutex> lock(statsMutex);
+        stats.subtreeRescans++;
+        stats.added += result.added;
+        stats.updated += result.updated;
+        stats.removed += result.removed;
+    }
+    
+    void addWatchRecursive(const string& rootDir) {
+        vector<string> stack = {rootDir};
+        while (!stack.empty()) {
+            string dir = move(stack.back());
+            stack.pop_back();
+            
+            int wd = inotify_add_watch(inotifyFd, dir.c_str(), kWatchMask);
+            if (wd < 0) continue;
+            auto existing = wdToPath.find(wd);
+            if (existing == wdToPath.end()) {
+                watchedDirectoryCount++;
+            } else {
+                pathToWd.erase(existing->second);
+            }
+            wdToPath[wd] = dir;
+            pathToWd[dir] = wd;
+            
+            DIR* dp = opendir(dir.c_str());
+            if (!dp) continue;
+            while (struct dirent* entry = readdir(dp)) {
+                const char* name = entry->d_name;
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+                string child = dir == "/" ? "/" + string(name) : dir + "/" + name;
+                bool isDir = entry->d_type == DT_DIR;
+                if (entry->d_type == DT_UNKNOWN) {
+                    struct stat st;
+                    isDir = lstat(child.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+                }
+                if (isDir) stack.push_back(child);
+            }
+            closedir(dp);
+        }
+    }
+    
+    void removeWatchesUnder(const string& dir) {
+        for (auto it = pathToWd.begin(); it != pathToWd.end();) {
+            if (isUnder(it->first, dir)) {
+                inotify_rm_watch(inotifyFd, it->second);
+                wdToPath.erase(it->second);
+                watchedDirectoryCount--;
+                it = pathToWd.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+#endif
+
+// 64 位随机数的高 53 位映射到 [0, 1)。生成器只从原始输出自行变换，不用 std 的分布：
+// 分布的算法由各标准库自定，同一种子在 libstdc++ 和 libc++ 上会得到不同序列
+inline double unitInterval(uint64_t bits) {
+    return (double)(bits >> 11) * 0x1.0p-53;
+}
+
+// YCSB 风格的 Zipfian 分布（Gray 等人的算法），返回 [0, items)，0 最热。
+// theta 取 [0, 1)：算法里的 alpha = 1 / (1 - theta) 在 theta = 1 时除以零
+class ZipfianGenerator {
+public:
+    explicit ZipfianGenerator(uint64_t items, double theta = 0.99)
+        : items(max<uint64_t>(1, items)), theta(theta) {
+        if (!validTheta(theta)) throw runtime_error("Zipfian 偏斜度须在 [0, 1) 内: " + to_string(theta));
+        zetan = zeta(this->items, theta);
+        double zeta2 = zeta(2, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - pow(2.0 / this->items, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+        halfPowTheta = 1.0 + pow(0.5, theta);
+    }
+    
+    template <typename Rng>
+    uint64_t next(Rng& rng) const {
+        static_assert(Rng::min() == 0 && Rng::max() == UINT64_MAX, "需要 64 位随机数发生器");
+        double u = unitInterval(rng());
+        double uz = u * zetan;
+        if (uz < 1.0) return 0;
+        if (uz < halfPowTheta) return 1;
+        return min(items - 1, (uint64_t)(items * pow(eta * u - eta + 1.0, alpha)));
+    }
+    
+    static bool validTheta(double theta) { return theta >= 0 && theta < 1; }
+    
+private:
+    uint64_t items;
+    double theta;
+    double zetan;
+    double alpha;
+    double eta;
+    double halfPowTheta;
+    
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; ++i) sum += 1.0 / pow((double)i, theta);
+        return sum;
+    }
+};
+
+// splitmix64：由键确定性地派生属性，并把 Zipfian 的热点打散到整个键空间
+inline uint64_t mixKey(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// 贴近真实文件系统的合成命名空间参数（默认值参考大型共享文件系统的统计）：
+// 扩展名和属主按 Zipfian 流行度偏斜，文件大小呈对数正态，每目录文件数长尾，
+// 目录树按随机扩展的分支过程生成，同一子树、同一目录的文件集中在一段时间内创建
+struct NamespaceOptions {
+    long long files = 100000;
+    unsigned seed = 42;                   // 相同参数和种子生成完全相同的命名空间
+    int extensions = 500;                 // 扩展名种类，排名越前越常见
+    double extensionTheta = 0.99;         // Zipfian 偏斜度，取值 [0, 1)
+    double extensionLocality = 0.5;       // 文件沿用目录主扩展名的概率
+    int owners = 2000;
+    double ownerTheta = 0.99;
+    double ownerLocality = 0.9;           // 文件沿用目录属主的概率
+    double sizeMedian = 16384;            // 文件大小中位数（字节）
+    double sizeSigma = 2.5;               // 文件大小对数的标准差，越大尾部越重
+    double meanFilesPerDirectory = 20;
+    double directorySigma = 1.5;          // 每目录文件数对数的标准差，越大超大目录越多
+    double meanFanOut = 4;                // 每个目录的平均子目录数
+    double fanOutSigma = 1.0;
+    int maxDepth = 16;                    // 根目录 /data 为第 1 层
+    time_t startTime = 1420070400;        // 2015-01-01 UTC
+    double spanDays = 3650;               // 创建时间的总跨度
+    double subtreeLagDays = 30;           // 子目录晚于父目录创建的平均天数
+    double burstHours = 48;               // 同一目录内文件创建时间的平均跨度
+};
+
+// 按 NamespaceOptions 确定性地生成文件记录：构造时先生成整棵目录树和每个目录的属性，
+// 之后逐目录流式产出文件，可分批交给 bulkLoad，不需要一次持有全部记录
+class NamespaceGenerator {
+public:
+    explicit NamespaceGenerator(const NamespaceOptions& options)
+        : options(options), rng(options.seed), extensionRank(options.extensions, options.extensionTheta),
+          ownerRank(options.owners, options.ownerTheta) {
+        if (options.files < 0 || options.extensions < 1 || options.owners < 1 || options.maxDepth < 2 ||
+            options.meanFilesPerDirectory <= 0 || options.meanFanOut <= 0) {
+            throw runtime_error("命名空间参数无效");
+        }
+        buildDirectories();
+        assignFileCounts();
+    }
+    
+    // 清空 out 并填入至多 maxRecords 条记录，返回条数；0 表示已生成完毕
+    size_t nextBatch(vector<FileRecord>& out, size_t maxRecords) {
+        out.clear();
+        while (out.size() < maxRecords && directoryIndex < directories.size()) {
+            const auto& dir = directories[directoryIndex];
+            if (fileIndex >= dir.files) {
+                directoryIndex++;
+                fileIndex = 0;
+                continue;
+            }
+            out.push_back(makeFile(dir, fileIndex++));
+        }
+        return out.size();
+    }
+    
+    size_t getDirectoryCount() const {
+        return directories.size();
+    }
+    
+    // 排名从 0 起，0 最常见（.jpg / user1）
+    static string extensionName(uint64_t rank) {
+        static const vector<string> common = {
+            ".jpg", ".txt", ".h", ".c", ".py", ".png", ".log", ".pdf", ".js", ".html",
+            ".gz", ".o", ".json", ".xml", ".csv", ".doc", ".mp3", ".mp4", ".so", ".java"};
+        return rank < common.size() ? common[rank] : ".x" + to_string(rank);
+    }
+    
+    static string ownerName(uint64_t rank) {
+        return "user" + to_string(rank + 1);
+    }
+    
+private:
+    struct Directory {
+        string path;
+        int depth;
+        uint32_t owner;
+        uint32_t extension;
+        time_t baseTime;
+        long long files = 0;
+    };
+    
+    NamespaceOptions options;
+    mt19937_64 rng;
+    ZipfianGenerator extensionRank;
+    ZipfianGenerator ownerRank;
+    vector<Directory> directories;
+    size_t directoryIndex = 0;
+    long long fileIndex = 0;
+    
+    // 以下变换都只用 rng 的原始输出，同一种子在任何标准库上生成相同的命名空间
+    // （只剩 log/exp/cos 在不同 libm 上可能差最后一位）
+    
+    // [0, n) 内均匀的整数：拒绝低端不足一整轮的取值，避免取模偏差
+    uint64_t uniformBelow(uint64_t n) {
+        uint64_t threshold = (0 - n) % n;
+        uint64_t r = rng();
+        while (r < threshold) r = rng();
+        return r % n;
+    }
+    
+    bool bernoulli(double p) {
+        return unitInterval(rng()) < p;
+    }
+    
+    // Box-Muller 变换，每次消耗两个随机数、只用一个结果，保持调用次数与状态无关
+    double normal(double mu, double sigma) {
+        double u1 = 1.0 - unitInterval(rng());  // (0, 1]，避免 log(0)
+        double u2 = unitInterval(rng());
+        return mu + sigma * sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+    }
+    
+    // 均值为 mean 的对数正态随机数
+    double logNormalWithMean(double mean, double sigma) {
+        return exp(normal(log(mean) - sigma * sigma / 2, sigma));
+    }
+    
+    // 反函数法
+    double exponential(double mean) {
+        return -mean * log(1.0 - unitInterval(rng()));
+    }
+    
+    time_t clampTime(double t) const {
+        return (time_t)min(t, (double)options.startTime + options.spanDays * 86400);
+    }
+    
+    // 分支过程：每次从尚未展开的目录中随机取一个，按对数正态的分支数添加子目录，
+    // 随机的展开顺序让各子树深浅不一；全部目录都到达深度上限或没有子目录时从根目录继续
+    void buildDirectories() {
+        static const char* const words[] = {"src", "data", "logs", "build", "img", "docs",
+                                            "tmp", "cache", "lib", "test", "home", "proj"};
+        size_t target = (size_t)max<long long>(1, llround(options.files / options.meanFilesPerDirectory));
+        directories.reserve(target);
+        // 根目录取最常见的属主和扩展名，继承后它们也是整体最常见的（基准查询 user1、.jpg 命中热点）
+        directories.push_back({"/data", 1, 0, 0, options.startTime});
+        vector<size_t> frontier = {0};
+        while (directories.size() < target) {
+            if (frontier.empty()) frontier.push_back(0);
+            size_t pick = (size_t)uniformBelow(frontier.size());
+            size_t parent = frontier[pick];
+            frontier[pick] = frontier.back();
+            frontier.pop_back();
+            if (directories[parent].depth >= options.maxDepth) continue;
+            
+            long long children = llround(logNormalWithMean(options.meanFanOut, options.fanOutSigma));
+            for (long long i = 0; i < children && directories.size() < target; ++i) {
+                const Directory& up = directories[parent];
+                Directory dir;
+                dir.path = up.path + "/" + words[uniformBelow(size(words))] + to_string(directories.size());
+                dir.depth = up.depth + 1;
+                dir.owner = bernoulli(options.ownerLocality) ? up.owner : (uint32_t)ownerRank.next(rng);
+                dir.extension = (uint32_t)extensionRank.next(rng);
+                dir.baseTime = clampTime(up.baseTime + exponential(options.subtreeLagDays * 86400));
+                frontier.push_back(directories.size());
+                directories.push_back(move(dir));
+            }
+        }
+    }
+    
+    // 按对数正态权重分配文件数，累计取整保证总数恰好为 files
+    void assignFileCounts() {
+        vector<double> weights(directories.size());
+        double total = 0;
+        for (auto& weight : weights) {
+            weight = logNormalWithMean(1.0, options.directorySigma);
+            total += weight;
+        }
+        double cumulative = 0;
+        long long assigned = 0;
+        for (size_t i = 0; i < directories.size(); ++i) {
+            cumulative += weights[i];
+            long long upTo = i + 1 == directories.size() ? options.files
+                                                         : llround(options.files * (cumulative / total));
+            directories[i].files = max(0LL, upTo - assigned);
+            assigned += directories[i].files;
+        }
+    }
+    
+    FileRecord makeFile(const Directory& dir, long long index) {
+        FileRecord record;
+        record.path = dir.path;
+        uint64_t extension = bernoulli(options.extensionLocality) ? dir.extension : extensionRank.next(rng);
+        record.extension = extensionName(extension);
+        record.fileName = "f" + to_string(index) + record.extension;
+        record.fileSize = (long long)min(1e12, exp(normal(log(options.sizeMedian), options.sizeSigma)));
+        uint64_t owner = bernoulli(options.ownerLocality) ? dir.owner : ownerRank.next(rng);
+        record.owner = ownerName(owner);
+        time_t created = clampTime(dir.baseTime + exponential(options.burstHours * 3600));
+        record.createTime = formatUtcDate(created);
+        record.modifyTime = clampTime(created + exponential(30 * 86400.0));
+        return record;
+    }
+    
+    // 按 UTC 格式化，结果不受本机时区影响
+    static string formatUtcDate(time_t t) {
+        struct tm tmv;
+        gmtime_r(&t, &tmv);
+        char buf[16];
+        strftime(buf, sizeof(buf), "%Y-%m-%d", &tmv);
+        return buf;
+    }
+};
+
+// 硬件性能计数器（Linux perf_event_open）：只计本线程及其之后创建的线程的用户态事件
+// （exclude_kernel，perf_event_paranoid 为 2 时普通用户也能打开）。每个事件单独打开，
+// 计数器不够时由内核轮换并按 time_enabled/time_running 折算；某个事件打不开时只缺这一项，
+// 内核不支持、权限不足或虚拟机没有 PMU 时全部不可用，读数为 -1
+enum class PerfEvent { Instructions, Cycles, LlcMisses, BranchMisses, DtlbMisses };
+constexpr size_t kPerfEventCount = 5;
+const char* const kPerfEventNames[kPerfEventCount] = {
+    "instructions", "cycles", "llc_misses", "branch_misses", "dtlb_misses"};
+using PerfReading = array<double, kPerfEventCount>;
+
+class PerfCounters {
+public:
+    PerfCounters() {
+        fds.fill(-1);
+#ifdef FS_HAVE_PERF_EVENTS
+        auto cache = [](uint64_t cacheId) {
+            return cacheId | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        };
+        const pair<uint32_t, uint64_t> configs[kPerfEventCount] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_LL)},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_DTLB)}};
+        for (size_t i = 0; i < kPerfEventCount; ++i) {
+            fds[i] = open(configs[i].first, configs[i].second);
+            // 有的 PMU 没有末级缓存的读未命中事件，退回到通用的缓存未命中
+            if (fds[i] < 0 && i == (size_t)PerfEvent::LlcMisses) {
+                fds[i] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+            }
+            if (fds[i] < 0 && error.empty()) error = string(kPerfEventNames[i]) + ": " + strerror(errno);
+        }
+#else
+        error = "perf_event_open 不可用（非 Linux 或缺少内核头文件）";
+#endif
+    }
+    
+    ~PerfCounters() {
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+    }
+    
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+    
+    bool available() const {
+        return any_of(fds.begin(), fds.end(), [](int fd) { return fd >= 0; });
+    }
+    
+    // 第一个打不开的事件及原因
+    const string& getError() const {
+        return error;
+    }
+    
+    void start() {
+#ifdef FS_HAVE_PERF_EVENTS
+        for (int fd : fds) {
+            if (fd < 0) continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+    
+    // 停止计数并返回 start 以来的读数，不可用的事件为 -1
+    PerfReading stop() {
+        PerfReading reading;
+        reading.fill(-1);
+#ifdef FS_HAVE_PERF_EVENTS
+        for (size_t i = 0; i < kPerfEventCount; ++i) {
+            if (fds[i] < 0) continue;
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t values[3];   // 计数、time_enabled、time_running
+            if (read(fds[i], values, sizeof(values)) != (ssize_t)sizeof(values) || values[2] == 0) continue;
+            reading[i] = (double)values[0] * ((double)values[1] / values[2]);
+        }
+#endif
+        return reading;
+    }
+    
+private:
+    array<int, kPerfEventCount> fds;
+    string error;
+    
+#ifdef FS_HAVE_PERF_EVENTS
+    static int open(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;                 // 并发用例的工作线程在打开之后创建，也计入
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    }
+#endif
+};
+
+struct BenchmarkOptions {
+    vector<int> scales = {1000, 10000, 100000};
+    int warmup = 20;              // 每个用例正式计时前的预热次数
+    int repetitions = 1000;       // 每个用例的计时次数上限
+    double maxSeconds = 2.0;      // 每个用例的计时时长上限（至少完成 minRepetitions 次）
+    int minRepetitions = 10;
+    int concurrentThreads = 4;
+    unsigned seed = 42;           // 测试数据的随机种子，固定后各次运行的数据相同
+    bool realistic = false;       // 用 NamespaceGenerator 生成数据，否则用 generateTestData 的均匀分布
+    bool counters = true;         // 计时阶段同时读硬件性能计数器（不可用时自动跳过）
+    string filter;                // 只运行名称包含该子串的用例
+    string jsonPath;
+    string csvPath;
+};
+
+// 单个用例的延迟统计，单位纳秒/次
+struct BenchmarkResult {
+    string name;                  // 类别/操作，如 query/extension_indexed
+    int scale = 0;
+    size_t samples = 0;
+    double totalSeconds = 0;      // 计时阶段的墙钟时间
+    double opsPerSecond = 0;
+    double mean = 0;
+    double stddev = 0;
+    double min = 0;
+    double median = 0;
+    double p99 = 0;               // 样本不够时（p99 需 100 个，p999 需 1000 个）最近秩就是最大值，记为 NaN
+    double p999 = 0;
+    double max = 0;
+    // 计时阶段平均每次操作的硬件计数器读数（顺序见 PerfEvent），不可用为 -1。
+    // 含两次取时间的开销（vDSO，约几十条指令）
+    PerfReading counters = {-1, -1, -1, -1, -1};
+    
+    bool hasCounters() const {
+        return any_of(counters.begin(), counters.end(), [](double v) { return v >= 0; });
+    }
+};
+
+// 结果文件中的一项运行参数：数值写成 JSON 数字，其余写成字符串
+struct BenchmarkSetting {
+    string name;
+    string value;
+    bool numeric = false;
+    
+    BenchmarkSetting(string name, string value) : name(move(name)), value(move(value)) {}
+    BenchmarkSetting(string name, const char* value) : name(move(name)), value(value) {}
+    
+    template <typename T, typename = enable_if_t<is_arithmetic<T>::value>>
+    BenchmarkSetting(string name, T number) : name(move(name)), value(to_string(number)), numeric(true) {}
+};
+
+// 基准测试套件：每种查询、每种写操作在每个数据规模下各为一个用例。
+// 每个用例先预热，再逐次计时（每次调用单独取时间，得到完整的延迟分布），
+// 汇总为均值、中位数、p99、p999，可输出 JSON/CSV 供不同构建之间对比。
+// 测试数据用固定种子生成，保证各次运行可比
+class BenchmarkSuite {
+public:
+    explicit BenchmarkSuite(BenchmarkOptions options) : options(move(options)) {
+        if (this->options.counters) perf = make_unique<PerfCounters>();
+    }
+    
+    // 计数器不可用时返回原因，可用或未启用时为空
+    string countersUnavailableReason() const {
+        if (!perf || perf->available()) return "";
+        return perf->getError();
+    }
+    
+    vector<BenchmarkResult> run() {
+        results.clear();
+        for (int scale : options.scales) {
+            runScale(scale);
+        }
+        return results;
+    }
+    
+    static void printTable(ostream& out, const vector<BenchmarkResult>& results) {
+        out << left << setw(44) << "用例" << right << setw(10) << "规模" << setw(9) << "次数"
+            << setw(12) << "mean(us)" << setw(12) << "p50(us)" << setw(12) << "p99(us)"
+            << setw(12) << "p999(us)" << setw(14) << "ops/s" << endl;
+        out << fixed;
+        for (const auto& r : results) {
+            out << left << setw(44) << r.name << right << setw(10) << r.scale << setw(9) << r.samples
+                << setprecision(2) << setw(12) << r.mean / 1000 << setw(12) << r.median / 1000;
+            for (double tail : {r.p99, r.p999}) {
+                if (isnan(tail)) {
+                    out << setw(12) << "-";
+                } else {
+                    out << setw(12) << tail / 1000;
+                }
+            }
+            out << setprecision(0) << setw(14) << r.opsPerSecond << endl;
+        }
+        
+        if (none_of(results.begin(), results.end(), [](const BenchmarkResult& r) { return r.hasCounters(); })) {
+            return;
+        }
+        // 硬件计数器：每次操作的平均值，IPC = 指令数 / 周期数；不可用的项显示 -
+        out << endl << left << setw(44) << "用例" << right << setw(10) << "规模" << setw(14) << "instr/op"
+            << setw(14) << "cycles/op" << setw(8) << "IPC" << setw(12) << "LLC/op" << setw(12) << "br-miss/op"
+            << setw(12) << "dTLB/op" << endl;
+        auto cell = [&](double value, int width, int precision) {
+            if (value < 0) {
+                out << setw(width) << "-";
+            } else {
+                out << setw(width) << setprecision(precision) << value;
+            }
+        };
+        for (const auto& r : results) {
+            if (!r.hasCounters()) continue;
+            const auto& c = r.counters;
+            double instructions = c[(size_t)PerfEvent::Instructions];
+            double cycles = c[(size_t)PerfEvent::Cycles];
+            out << left << setw(44) << r.name << right << setw(10) << r.scale;
+            cell(instructions, 14, 0);
+            cell(cycles, 14, 0);
+            cell(instructions >= 0 && cycles > 0 ? instructions / cycles : -1, 8, 2);
+            cell(c[(size_t)PerfEvent::LlcMisses], 12, 1);
+            cell(c[(size_t)PerfEvent::BranchMisses], 12, 1);
+            cell(c[(size_t)PerfEvent::DtlbMisses], 12, 1);
+            out << endl;
+        }
+    }
+    
+    // 数值写成 JSON 数字，NaN（样本不足的分位数）写成 null
+    static void jsonNumber(ostream& out, double value) {
+        if (isnan(value)) {
+            out << "null";
+        } else {
+            out << value;
+        }
+    }
+    
+    // settings 为运行参数（种子、预热次数等），原样记录在结果文件中
+    static void writeJson(ostream& out, const vector<BenchmarkResult>& results,
+                          const vector<BenchmarkSetting>& settings) {
+        out << "{\n  \"unit\": \"ns\",\n";
+#ifdef __VERSION__
+        out << "  \"compiler\": \"" << jsonEscape(__VERSION__) << "\",\n";
+#endif
+        out << "  \"hardware_threads\": " << thread::hardware_concurrency() << ",\n";
+        for (const auto& setting : settings) {
+            out << "  \"" << jsonEscape(setting.name) << "\": ";
+            if (setting.numeric) {
+                out << setting.value;
+            } else {
+                out << "\"" << jsonEscape(setting.value) << "\"";
+            }
+            out << ",\n";
+        }
+        out << "  \"results\": [";
+        out << setprecision(1) << fixed;
+        for (size_t i = 0; i < results.size(); ++i) {
+            const auto& r = results[i];
+            out << (i ? ",\n" : "\n") << "    {\"name\": \"" << jsonEscape(r.name) << "\", \"scale\": " << r.scale
+                << ", \"samples\": " << r.samples << ", \"ops_per_second\": " << r.opsPerSecond
+                << ", \"mean\": " << r.mean << ", \"stddev\": " << r.stddev << ", \"min\": " << r.min
+                << ", \"median\": " << r.median << ", \"p99\": ";
+            jsonNumber(out, r.p99);
+            out << ", \"p999\": ";
+            jsonNumber(out, r.p999);
+            out << ", \"max\": " << r.max;
+            if (r.hasCounters()) {
+                out << ", \"counters_per_op\": {";
+                bool first = true;
+                for (size_t e = 0; e < kPerfEventCount; ++e) {
+                    if (r.counters[e] < 0) continue;
+                    out << (first ? "" : ", ") << "\"" << kPerfEventNames[e] << "\": " << r.counters[e];
+                    first = false;
+                }
+                out << "}";
+            }
+            out << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+    
+    static void writeCsv(ostream& out, const vector<BenchmarkResult>& results) {
+        out << "name,scale,samples,ops_per_second,mean_ns,stddev_ns,min_ns,median_ns,p99_ns,p999_ns,max_ns";
+        for (const char* event : kPerfEventNames) out << ',' << event << "_per_op";
+        out << '\n' << setprecision(1) << fixed;
+        for (const auto& r : results) {
+            out << r.name << ',' << r.scale << ',' << r.samples << ',' << r.opsPerSecond << ',' << r.mean << ','
+                << r.stddev << ',' << r.min << ',' << r.median;
+            // 样本不足的分位数和不可用的计数器留空
+            for (double tail : {r.p99, r.p999}) {
+                out << ',';
+                if (!isnan(tail)) out << tail;
+            }
+            out << ',' << r.max;
+            for (double value : r.counters) {
+                out << ',';
+                if (value >= 0) out << value;
+            }
+            out << '\n';
+        }
+    }
+    
+    // 把一组延迟样本（纳秒）汇总为统计结果；百分位取最近秩
+    static BenchmarkResult summarize(const string& name, int scale, vector<double>& samples, double totalSeconds) {
+        BenchmarkResult r;
+        r.name = name;
+        r.scale = scale;
+        r.samples = samples.size();
+        r.totalSeconds = totalSeconds;
+        if (samples.empty()) return r;
         
-        stringstream ss(fullPath.substr(1));
-        string part;
+        sort(samples.begin(), samples.end());
+        double sum = 0;
+        for (double v : samples) sum += v;
+        r.mean = sum / samples.size();
+        double squares = 0;
+        for (double v : samples) squares += (v - r.mean) * (v - r.mean);
+        r.stddev = sqrt(squares / samples.size());
+        r.min = samples.front();
+        r.max = samples.back();
+        r.median = percentile(samples, 0.5);
+        r.p99 = tailPercentile(samples, 0.99);
+        r.p999 = tailPercentile(samples, 0.999);
+        r.opsPerSecond = totalSeconds > 0 ? samples.size() / totalSeconds : 0;
+        return r;
+    }
+    
+    static double percentile(const vector<double>& sorted, double q) {
+        size_t rank = (size_t)ceil(q * sorted.size());
+        return sorted[min(sorted.size(), max<size_t>(rank, 1)) - 1];
+    }
+    
+    // 尾部分位数至少要有 1 / (1 - q) 个样本，否则最近秩只是最大值，返回 NaN
+    static double tailPercentile(const vector<double>& sorted, double q) {
+        if ((double)sorted.size() < llround(1 / (1 - q))) return numeric_limits<double>::quiet_NaN();
+        return percentile(sorted, q);
+    }
+    
+private:
+    BenchmarkOptions options;
+    vector<BenchmarkResult> results;
+    size_t checksum = 0;          // 累加各次操作的返回值，防止调用被优化掉
+    unique_ptr<PerfCounters> perf;
+    
+    void startCounters() {
+        if (perf) perf->start();
+    }
+    
+    // 停止计数并返回读数（未启用时各项为 -1）。紧跟计时循环调用，汇总统计等工作不计入
+    PerfReading stopCounters() {
+        if (!perf) return {-1, -1, -1, -1, -1};
+        return perf->stop();
+    }
+    
+    // 把读数按操作次数平均后写入 result
+    static void applyCounters(BenchmarkResult& result, const PerfReading& reading) {
+        if (result.samples == 0) return;
+        for (size_t i = 0; i < kPerfEventCount; ++i) {
+            if (reading[i] >= 0) result.counters[i] = reading[i] / result.samples;
+        }
+    }
+    
+    void runScale(int scale) {
+        FileSystemSimulator fs;
+        if (options.realistic) {
+            NamespaceOptions data;
+            data.files = scale;
+            data.seed = options.seed;
+            NamespaceGenerator generator(data);
+            vector<FileRecord> records;
+            while (generator.nextBatch(records, 100000)) fs.bulkLoad(records);
+        } else {
+            fs.generateTestData(scale, options.seed);
+        }
+        auto files = fs.listFilesUnder("/");
+        
+        runCase("query/extension_traditional", scale, [&](int) {
+            return fs.queryByExtensionTraditional(".jpg").size();
+        });
+        runCase("query/extension_indexed", scale, [&](int) {
+            return fs.queryByExtensionIndexed(".jpg").size();
+        });
+        // 不走索引的扫描，靠目录摘要剪枝：属主和创建日期在目录内有局部性时才剪得掉
+        FileQuery ownerQuery, dateQuery;
+        ownerQuery.owner = "user1";
+        dateQuery.createTime = files.empty() ? "2024-1-1" : files[files.size() / 2]->createTime;
+        runCase("query/owner_scan", scale, [&](int) {
+            return fs.queryByScan(ownerQuery).size();
+        });
+        runCase("query/create_time_scan", scale, [&](int) {
+            return fs.queryByScan(dateQuery).size();
+        });
+        runCase("query/size_range_indexed", scale, [&](int) {
+            return fs.queryBySizeRangeIndexed(100000, 1000000).size();   // 100KB 到 1MB
+        });
+        runCase("query/owner_indexed", scale, [&](int) {
+            return fs.queryByOwnerIndexed("user1").size();
+        });
+        runConcurrentCase("query/extension_indexed_concurrent", scale, [&](int) {
+            return fs.queryByExtensionIndexed(".jpg").size();
+        });
+        
+        // 写操作用例依次执行：先新增（名称不重复），再逐个删除刚新增的文件，规模保持不变
+        vector<string> addedPaths;
+        runCase("mutation/add_file", scale, [&](int i) {
+            string name = "bench_add_" + to_string(i);
+            fs.addFile("/bench", name, ".dat", 4096 + i, "bench", "2024-1-1");
+            addedPaths.push_back("/bench/" + name);
+            return (size_t)1;
+        });
+        // 预热和计时都会新增文件，删除用例按同样的次数消耗它们
+        runCase("mutation/remove_file", scale, [&](int i) {
+            return (size_t)(i < (int)addedPaths.size() && fs.removeFile(addedPaths[i]));
+        }, (int)addedPaths.size());
+        
+        runCase("mutation/update_file", scale, [&](int i) {
+            const auto& file = files[i % files.size()];
+            FileRecord record{parentPath(file->fullPath, file->fileName), file->fileName, file->extension,
+                              file->fileSize + (i % 2 ? -1 : 1), file->owner, file->createTime, 0};
+            return (size_t)fs.updateFile(record);
+        });
+        
+        const int batchSize = 100;
+        int batches = 0;
+        runCase("mutation/add_files_x100", scale, [&](int i) {
+            vector<FileRecord> records;
+            records.reserve(batchSize);
+            for (int j = 0; j < batchSize; ++j) {
+                string name = "batch_" + to_string(i) + "_" + to_string(j);
+                records.push_back({"/bench_batch", name, ".dat", 4096, "bench", "2024-1-1", 0});
+            }
+            batches++;
+            return fs.addFiles(records);
+        });
+        runCase("mutation/apply_removals_x100", scale, [&](int i) {
+            MutationBatch batch;
+            for (int j = 0; j < batchSize; ++j) {
+                batch.removals.push_back("/bench_batch/batch_" + to_string(i) + "_" + to_string(j));
+            }
+            return fs.applyMutations(batch).removed;
+        }, batches);
+        
+        // 同一批里先新增、再更新同一路径（如 inotify 合并窗口内先创建后写入）。
+        // 之后检查索引：新增时的扩展名不应再有倒排项，否则查询会返回旧版本
+        int upsertBatches = 0;
+        runCase("mutation/apply_add_update_x100", scale, [&](int i) {
+            MutationBatch batch;
+            for (int j = 0; j < batchSize; ++j) {
+                string name = "upsert_" + to_string(i) + "_" + to_string(j);
+                batch.upserts.push_back({"/bench_upsert", name, ".created", 4096, "bench", "2024-1-1", 0});
+                batch.upserts.push_back({"/bench_upsert", name, ".written", 8192, "bench", "2024-1-1", 0});
+            }
+            upsertBatches++;
+            auto result = fs.applyMutations(batch);
+            return result.added + result.updated;
+        });
+        if (upsertBatches > 0) {
+            FileQuery created, written;
+            created.extension = ".created";
+            written.extension = ".written";
+            if (!fs.queryIndexed(created).empty() ||
+                fs.queryIndexed(written).size() != (size_t)upsertBatches * batchSize) {
+                throw runtime_error("同一批先新增后更新的文件在索引中仍有旧版本");
+            }
+        }
+    }
+    
+    static string parentPath(const string& fullPath, const string& fileName) {
+        size_t nameStart = fullPath.size() - fileName.size();
+        return nameStart > 1 ? fullPath.substr(0, nameStart - 1) : "/";
+    }
+    
+    bool selected(const string& name) const {
+        return options.filter.empty() || name.find(options.filter) != string::npos;
+    }
+    
+    // op(i) 执行第 i 次操作，返回值累加到校验和，防止结果被优化掉；
+    // limit 限制总次数（含预热），用于消耗前一个用例产生的数据
+    template <typename Op>
+    void runCase(const string& name, int scale, Op&& op, int limit = INT_MAX) {
+        if (!selected(name)) return;
+        int warmup = min(options.warmup, limit);
+        int repetitions = min(options.repetitions, limit - warmup);
+        size_t sink = 0;
+        for (int i = 0; i < warmup; ++i) {
+            sink += op(i);
+        }
+        
+        vector<double> samples;
+        samples.reserve(repetitions);
+        auto caseStart = steady_clock::now();
+        auto deadline = caseStart + duration_cast<steady_clock::duration>(duration<double>(options.maxSeconds));
+        startCounters();
+        for (int i = 0; i < repetitions; ++i) {
+            auto start = steady_clock::now();
+            sink += op(warmup + i);
+            auto end = steady_clock::now();
+            samples.push_back((double)duration_cast<nanoseconds>(end - start).count());
+            if ((int)samples.size() >= options.minRepetitions && end >= deadline) break;
+        }
+        auto reading = stopCounters();
+        double total = duration<double>(steady_clock::now() - caseStart).count();
+        auto result = summarize(name, scale, samples, total);
+        applyCounters(result, reading);
+        results.push_back(move(result));
+        checksum += sink;
+    }
+    
+    // 多线程同时执行同一操作，各线程的延迟样本合并统计，吞吐按总墙钟时间计算
+    template <typename Op>
+    void runConcurrentCase(const string& name, int scale, Op&& op) {
+        int numThreads = max(1, options.concurrentThreads);
+        string caseName = name + "_" + to_string(numThreads) + "t";
+        if (!selected(caseName)) return;
+        int perThread = max(1, options.repetitions / numThreads);
+        for (int i = 0; i < options.warmup; ++i) checksum += op(i);
+        
+        vector<vector<double>> perThreadSamples(numThreads);
+        vector<size_t> sinks(numThreads, 0);
+        auto caseStart = steady_clock::now();
+        auto deadline = caseStart + duration_cast<steady_clock::duration>(duration<double>(options.maxSeconds));
+        vector<thread> workers;
+        startCounters();
+        for (int t = 0; t < numThreads; ++t) {
+            workers.emplace_back([&, t]() {
+                auto& samples = perThreadSamples[t];
+                samples.reserve(perThread);
+                for (int i = 0; i < perThread; ++i) {
+                    auto start = steady_clock::now();
+                    sinks[t] += op(i);
+                    auto end = steady_clock::now();
+                    samples.push_back((double)duration_cast<nanoseconds>(end - start).count());
+                    if ((int)samples.size() >= options.minRepetitions && end >= deadline) break;
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        // 工作线程已退出，继承的计数已合并到父事件
+        auto reading = stopCounters();
+        double total = duration<double>(steady_clock::now() - caseStart).count();
+        
+        vector<double> samples;
+        for (int t = 0; t < numThreads; ++t) {
+            samples.insert(samples.end(), perThreadSamples[t].begin(), perThreadSamples[t].end());
+            checksum += sinks[t];
+        }
+        auto result = summarize(caseName, scale, samples, total);
+        applyCounters(result, reading);
+        results.push_back(move(result));
+    }
+    
+    static string jsonEscape(const string& text) {
+        string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\') escaped += '\\';
+            if ((unsigned char)c < 0x20) continue;
+            escaped += c;
+        }
+        return escaped;
+    }
+};
+
+// mai bench [--scales 1000,10000] [--reps N] [--warmup N] [--max-seconds S] [--threads N]
+//           [--seed N] [--filter 子串] [--json 文件] [--csv 文件] [--realistic] [--no-counters]
+// 不带命令运行时以默认参数执行；--realistic 改用 NamespaceGenerator 生成的偏斜数据；
+// 硬件计数器可用时另外输出每次操作的指令、周期、缓存/分支/dTLB 未命中，--no-counters 关闭
+int runBenchmarkCommand(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--realistic") {
+            options.realistic = true;
+            continue;
+        }
+        if (arg == "--no-counters") {
+            options.counters = false;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            cerr << "参数缺少取值: " << arg << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        if (arg == "--scales") {
+            options.scales.clear();
+            stringstream ss(value);
+            string item;
+            while (getline(ss, item, ',')) options.scales.push_back(stoi(item));
+        } else if (arg == "--reps") {
+            options.repetitions = stoi(value);
+        } else if (arg == "--warmup") {
+            options.warmup = stoi(value);
+        } else if (arg == "--max-seconds") {
+            options.maxSeconds = stod(value);
+        } else if (arg == "--threads") {
+            options.concurrentThreads = stoi(value);
+        } else if (arg == "--seed") {
+            options.seed = (unsigned)stoul(value);
+        } else if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--json") {
+            options.jsonPath = value;
+        } else if (arg == "--csv") {
+            options.csvPath = value;
+        } else {
+            cerr << "未知参数: " << arg << endl;
+            return 1;
+        }
+    }
+    
+    cout << "=== 文件元数据查找优化系统基准测试 ===" << endl;
+    BenchmarkSuite suite(options);
+    string counterError = suite.countersUnavailableReason();
+    if (!counterError.empty()) cout << "硬件计数器不可用，只报告时间 (" << counterError << ")" << endl;
+    auto results = suite.run();
+    BenchmarkSuite::printTable(cout, results);
+    
+    if (!options.jsonPath.empty()) {
+        ofstream out(options.jsonPath);
+        BenchmarkSuite::writeJson(out, results, {{"seed", options.seed},
+                                                 {"warmup", options.warmup},
+                                                 {"dataset", options.realistic ? "realistic" : "uniform"}});
+        if (!out) throw runtime_error("写入失败: " + options.jsonPath);
+    }
+    if (!options.csvPath.empty()) {
+        ofstream out(options.csvPath);
+        BenchmarkSuite::writeCsv(out, results);
+        if (!out) throw runtime_error("写入失败: " + options.csvPath);
+    }
+    return 0;
+}
+
+// 由键确定性合成的测试文件：每 1000 个键一个目录，属性由键的哈希派生，version 改变大小
+const vector<string>& syntheticExtensions() {
+    static const vector<string> values = {".jpg", ".png", ".pdf", ".txt", ".doc", ".mp4", ".mp3"};
+    return values;
+}
+
+const vector<string>& syntheticOwners() {
+    static const vector<string> values = {"user1", "user2", "user3", "admin", "guest"};
+    return values;
+}
+
+inline string syntheticDirectory(long long key) {
+    return "/data/d" + to_string(key / 1000);
+}
+
+inline string syntheticFileName(long long key) {
+    return "f" + to_string(key) + syntheticExtensions()[mixKey(key) % syntheticExtensions().size()];
+}
+
+inline long long syntheticSize(long long key, uint64_t version = 0) {
+    return 1024 + (long long)(mixKey(key ^ (version << 40)) % (10 * 1024 * 1024));
+}
+
+inline FileRecord syntheticRecord(long long key, uint64_t version = 0) {
+    uint64_t hash = mixKey(key);
+    return {syntheticDirectory(key), syntheticFileName(key), syntheticExtensions()[hash % syntheticExtensions().size()],
+            syntheticSize(key, version), syntheticOwners()[(hash >> 8) % syntheticOwners().size()],
+            "2024-" + to_string((key % 12) + 1) + "-" + to_string((key % 28) + 1),
+            1704067200 + (long long)((hash >> 16) % (366 * 86400))};
+}
+
+enum class WorkloadOp { QueryExtension, QueryOwner, QuerySizeRange, Insert, Update, Remove };
+constexpr size_t kWorkloadOpCount = 6;
+const char* const kWorkloadOpNames[kWorkloadOpCount] = {
+    "query_extension", "query_owner", "query_size_range", "insert", "update", "remove"};
+
+enum class KeyDistribution { Uniform, Zipfian, Latest };
+
+struct WorkloadOptions {
+    int initialFiles = 100000;
+    // 各操作的权重，顺序同 WorkloadOp；默认约 90% 查询、10% 增删改。不能为负，总和须大于 0
+    double mix[kWorkloadOpCount] = {30, 30, 30, 4, 3, 3};
+    int threads = 4;
+    double seconds = 10;
+    long long maxOps = 0;                 // 总操作数上限，0 表示只按时长
+    KeyDistribution distribution = KeyDistribution::Zipfian;
+    double zipfTheta = 0.99;
+    double targetRate = 0;                // 开环模式的总到达率（次/秒，泊松到达），0 为闭环
+    unsigned seed = 42;
+};
+
+// 混合读写负载：每个键对应一个确定的文件（见 syntheticRecord），
+// 查询取所选键的属性值作为条件，因此键分布决定了属性值的冷热。
+// 开环模式按泊松过程预先排定每个请求的发出时间，延迟从排定时间算起，
+// 系统跟不上时排队时间计入延迟（避免协调遗漏）
+class WorkloadDriver {
+public:
+    explicit WorkloadDriver(WorkloadOptions options)
+        : options(move(options)), zipf((uint64_t)max(1, this->options.initialFiles), this->options.zipfTheta) {
+        double total = 0;
+        for (double weight : this->options.mix) {
+            if (!(weight >= 0) || isinf(weight)) throw runtime_error("操作比例必须是非负的有限数");
+            total += weight;
+        }
+        if (!(total > 0)) throw runtime_error("操作比例不能全为 0");
+    }
+    
+    // 装入初始数据（键 0 到 initialFiles-1）
+    void load(FileSystemSimulator& fs) {
+        vector<FileRecord> records;
+        records.reserve(options.initialFiles);
+        for (int key = 0; key < options.initialFiles; ++key) {
+            records.push_back(syntheticRecord(key));
+        }
+        fs.bulkLoad(records);
+        nextKey = options.initialFiles;
+    }
+    
+    // 运行负载，返回每种操作的统计（未出现的操作不返回）
+    vector<BenchmarkResult> run(FileSystemSimulator& fs) {
+        int numThreads = max(1, options.threads);
+        vector<array<vector<double>, kWorkloadOpCount>> samples(numThreads);
+        discrete_distribution<int> opDist(begin(options.mix), end(options.mix));
+        atomic<long long> issued{0};
+        
+        auto startTime = steady_clock::now();
+        auto deadline = startTime + duration_cast<steady_clock::duration>(duration<double>(options.seconds));
+        vector<thread> workers;
+        for (int t = 0; t < numThreads; ++t) {
+            workers.emplace_back([&, t]() {
+                mt19937_64 rng(options.seed + t * 7919);
+                auto localOps = opDist;
+                exponential_distribution<double> arrival(options.targetRate > 0 ? options.targetRate / numThreads : 1.0);
+                auto intended = steady_clock::now();
+                while (true) {
+                    if (options.targetRate > 0) {
+                        intended += duration_cast<steady_clock::duration>(duration<double>(arrival(rng)));
+                        if (intended >= deadline) break;
+                        this_thread::sleep_until(intended);
+                    } else {
+                        intended = steady_clock::now();
+                        if (intended >= deadline) break;
+                    }
+                    if (options.maxOps > 0 && issued.fetch_add(1, memory_order_relaxed) >= options.maxOps) break;
+                    
+                    int op = localOps(rng);
+                    if (!execute(fs, (WorkloadOp)op, rng)) {
+                        misses[op].fetch_add(1, memory_order_relaxed);
+                    }
+                    samples[t][op].push_back((double)duration_cast<nanoseconds>(steady_clock::now() - intended).count());
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        elapsedSeconds = duration<double>(steady_clock::now() - startTime).count();
+        
+        vector<BenchmarkResult> results;
+        for (size_t op = 0; op < kWorkloadOpCount; ++op) {
+            vector<double> merged;
+            for (auto& threadSamples : samples) {
+                merged.insert(merged.end(), threadSamples[op].begin(), threadSamples[op].end());
+            }
+            if (merged.empty()) continue;
+            results.push_back(BenchmarkSuite::summarize(string("workload/") + kWorkloadOpNames[op],
+                                                        options.initialFiles, merged, elapsedSeconds));
+        }
+        return results;
+    }
+    
+    double getElapsedSeconds() const { return elapsedSeconds; }
+    
+    // 更新或删除时目标文件已不存在的次数
+    uint64_t getMisses(WorkloadOp op) const { return misses[(size_t)op].load(); }
+    
+private:
+    WorkloadOptions options;
+    ZipfianGenerator zipf;
+    atomic<long long> nextKey{0};
+    atomic<uint64_t> misses[kWorkloadOpCount] = {};
+    atomic<uint64_t> version{1};
+    double elapsedSeconds = 0;
+    
+    template <typename Rng>
+    long long chooseKey(Rng& rng) {
+        long long limit = max(1LL, nextKey.load(memory_order_relaxed));
+        switch (options.distribution) {
+            case KeyDistribution::Uniform:
+                return uniform_int_distribution<long long>(0, limit - 1)(rng);
+            case KeyDistribution::Zipfian:
+                return (long long)(mixKey(zipf.next(rng)) % (uint64_t)limit);
+            case KeyDistribution::Latest:
+                return max(0LL, limit - 1 - (long long)zipf.next(rng));
+        }
+        return 0;
+    }
+    
+    // 执行一次操作；更新/删除的目标已不存在时返回 false
+    template <typename Rng>
+    bool execute(FileSystemSimulator& fs, WorkloadOp op, Rng& rng) {
+        switch (op) {
+            case WorkloadOp::QueryExtension:
+                fs.queryByExtensionIndexed(syntheticRecord(chooseKey(rng)).extension);
+                return true;
+            case WorkloadOp::QueryOwner:
+                fs.queryByOwnerIndexed(syntheticRecord(chooseKey(rng)).owner);
+                return true;
+            case WorkloadOp::QuerySizeRange: {
+                long long low = syntheticSize(chooseKey(rng));
+                fs.queryBySizeRangeIndexed(low, low + 64 * 1024);
+                return true;
+            }
+            case WorkloadOp::Insert: {
+                auto record = syntheticRecord(nextKey.fetch_add(1, memory_order_relaxed));
+                return fs.addFile(record.path, record.fileName, record.extension, record.fileSize, record.owner,
+                                  record.createTime);
+            }
+            case WorkloadOp::Update:
+                return fs.updateFile(syntheticRecord(chooseKey(rng), version.fetch_add(1, memory_order_relaxed)));
+            case WorkloadOp::Remove: {
+                long long key = chooseKey(rng);
+                return fs.removeFile(syntheticDirectory(key) + "/" + syntheticFileName(key));
+            }
+        }
+        return true;
+    }
+};
+
+// 打印模拟器内部记录的各入口操作延迟（不含客户端排队）
+void printOperationLatencies(ostream& out, const FileSystemSimulator& fs) {
+    out << "--- 模拟器内部延迟 (us) ---" << endl;
+    out << left << setw(30) << "op" << right << setw(10) << "count" << setw(10) << "p50" << setw(10) << "p99"
+        << setw(10) << "p999" << setw(12) << "max" << endl;
+    out << fixed << setprecision(2);
+    for (const auto& entry : fs.getOperationLatencies()) {
+        const auto& h = entry.histogram;
+        out << left << setw(30) << kSimulatorOpNames[(size_t)entry.op] << right << setw(10) << h.getCount()
+            << setw(10) << h.percentile(0.5) / 1000.0 << setw(10) << h.percentile(0.99) / 1000.0
+            << setw(10) << h.percentile(0.999) / 1000.0 << setw(12) << h.getMax() / 1000.0 << endl;
+    }
+}
+
+// mai workload [--files N] [--threads N] [--seconds S] [--ops N] [--rate 次/秒]
+//              [--dist uniform|zipfian|latest] [--theta T] [--seed N]
+//              [--mix query_extension=30,query_owner=30,...] [--json 文件] [--csv 文件]
+//              [--metrics-file 文件] [--metrics-interval 秒] [--slow-query-ms 毫秒] [--trace 文件]
+// 结束后另外打印模拟器内部记录的各入口操作延迟（不含客户端排队）；慢查询的剖析逐行写到标准错误。
+// --trace 把初始装载和整个负载的调用录制成轨迹，可用 mai replay 重放
+int runWorkloadCommand(int argc, char* argv[]) {
+    WorkloadOptions options;
+    string jsonPath, csvPath, metricsPath, tracePath, distributionName = "zipfian";
+    double metricsInterval = 10;
+    double slowQueryMs = -1;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            cerr << "参数缺少取值: " << arg << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        if (arg == "--files") {
+            options.initialFiles = stoi(value);
+        } else if (arg == "--threads") {
+            options.threads = stoi(value);
+        } else if (arg == "--seconds") {
+            options.seconds = stod(value);
+        } else if (arg == "--ops") {
+            options.maxOps = stoll(value);
+        } else if (arg == "--rate") {
+            options.targetRate = stod(value);
+        } else if (arg == "--theta") {
+            options.zipfTheta = stod(value);
+            if (!ZipfianGenerator::validTheta(options.zipfTheta)) {
+                cerr << "--theta 须在 [0, 1) 内: " << value << endl;
+                return 1;
+            }
+        } else if (arg == "--seed") {
+            options.seed = (unsigned)stoul(value);
+        } else if (arg == "--dist") {
+            distributionName = value;
+            if (value == "uniform") {
+                options.distribution = KeyDistribution::Uniform;
+            } else if (value == "zipfian") {
+                options.distribution = KeyDistribution::Zipfian;
+            } else if (value == "latest") {
+                options.distribution = KeyDistribution::Latest;
+            } else {
+                cerr << "未知的键分布: " << value << endl;
+                return 1;
+            }
+        } else if (arg == "--mix") {
+            // 未列出的操作权重为 0
+            fill(begin(options.mix), end(options.mix), 0.0);
+            stringstream ss(value);
+            string item;
+            while (getline(ss, item, ',')) {
+                auto eq = item.find('=');
+                auto name = item.substr(0, eq);
+                auto it = find_if(begin(kWorkloadOpNames), end(kWorkloadOpNames),
+                                  [&](const char* opName) { return name == opName; });
+                if (eq == string::npos || it == end(kWorkloadOpNames)) {
+                    cerr << "无法解析的操作比例: " << item << endl;
+                    return 1;
+                }
+                options.mix[it - begin(kWorkloadOpNames)] = stod(item.substr(eq + 1));
+            }
+        } else if (arg == "--json") {
+            jsonPath = value;
+        } else if (arg == "--csv") {
+            csvPath = value;
+        } else if (arg == "--metrics-file") {
+            metricsPath = value;
+        } else if (arg == "--metrics-interval") {
+            metricsInterval = stod(value);
+        } else if (arg == "--slow-query-ms") {
+            slowQueryMs = stod(value);
+        } else if (arg == "--trace") {
+            tracePath = value;
+        } else {
+            cerr << "未知参数: " << arg << endl;
+            return 1;
+        }
+    }
+    
+    FileSystemSimulator fs;
+    WorkloadDriver driver(options);
+    shared_ptr<TraceRecorder> recorder;
+    if (!tracePath.empty()) {
+        recorder = make_shared<TraceRecorder>(tracePath);
+        fs.setTrace(recorder);
+    }
+    driver.load(fs);
+    unique_ptr<MetricsFileExporter> exporter;
+    if (!metricsPath.empty()) {
+        exporter = make_unique<MetricsFileExporter>(
+            fs, metricsPath, duration_cast<milliseconds>(duration<double>(metricsInterval)));
+        exporter->start();
+    }
+    mutex slowLogMutex;
+    size_t slowQueries = 0;
+    if (slowQueryMs >= 0) {
+        fs.setSlowQueryLog(duration_cast<nanoseconds>(duration<double, milli>(slowQueryMs)),
+                           [&](const QueryProfile& profile) {
+                               lock_guard<mutex> lock(slowLogMutex);
+                               slowQueries++;
+                               cerr << "slow_query " << profile.formatLogLine() << '\n';
+                           });
+    }
+    cout << "=== 混合负载 (" << options.initialFiles << " 文件, " << options.threads << " 线程, "
+         << distributionName << ", "
+         << (options.targetRate > 0 ? "开环 " + to_string((long long)options.targetRate) + " 次/秒" : string("闭环"))
+         << ") ===" << endl;
+    auto results = driver.run(fs);
+    fs.setSlowQueryLog(nanoseconds(0), nullptr);
+    if (recorder) {
+        fs.setTrace(nullptr);
+        recorder->flush();
+    }
+    if (exporter) exporter->stop();
+    BenchmarkSuite::printTable(cout, results);
+    
+    printOperationLatencies(cout, fs);
+    
+    size_t total = 0;
+    for (const auto& r : results) total += r.samples;
+    cout << "总吞吐: " << fixed << setprecision(0) << total / max(1e-9, driver.getElapsedSeconds()) << " ops/s ("
+         << total << " 次, " << setprecision(2) << driver.getElapsedSeconds() << " s), 更新未命中 "
+         << driver.getMisses(WorkloadOp::Update) << ", 删除未命中 " << driver.getMisses(WorkloadOp::Remove)
+         << ", 最终文件数 " << fs.getTotalFiles() << endl;
+    if (slowQueryMs >= 0) cout << "慢查询: " << slowQueries << " 次" << endl;
+    if (recorder) cout << "轨迹: " << recorder->getRecords() << " 条调用, 已写入 " << tracePath << endl;
+    
+    vector<BenchmarkSetting> settings = {
+        {"distribution", distributionName}, {"threads", options.threads},
+        {"target_rate", options.targetRate}, {"seed", options.seed}};
+    if (!jsonPath.empty()) {
+        ofstream out(jsonPath);
+        BenchmarkSuite::writeJson(out, results, settings);
+        if (!out) throw runtime_error("写入失败: " + jsonPath);
+    }
+    if (!csvPath.empty()) {
+        ofstream out(csvPath);
+        BenchmarkSuite::writeCsv(out, results);
+        if (!out) throw runtime_error("写入失败: " + csvPath);
+    }
+    return 0;
+}
+
+// 当前进程的常驻内存（字节）。先把 malloc 空闲内存还给系统，使前后两次测量之差接近真实增量
+size_t currentResidentBytes() {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+#ifdef __linux__
+    ifstream statm("/proc/self/statm");
+    size_t totalPages = 0, residentPages = 0;
+    if (statm >> totalPages >> residentPages) {
+        return residentPages * (size_t)sysconf(_SC_PAGESIZE);
+    }
+#endif
+    // 无 /proc 时退化为峰值常驻内存（Linux 单位为 KB，macOS 为字节）
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+struct ScalePoint {
+    long long files = 0;
+    double buildSeconds = 0;
+    size_t rssBytes = 0;          // 构建前后常驻内存之差
+    MemoryBreakdown memory;
+    vector<BenchmarkResult> queries;
+};
+
+// mai bench-scale [最大文件数] [最小文件数] [--json 文件] [--csv 文件] [--realistic]：
+// 从最小规模起每次乘 10，每个规模新建模拟器，用 syntheticRecord（--realistic 时用 NamespaceGenerator）
+// 分批（每批 100 万）批量装载，
+// 记录构建耗时、常驻内存增量、各组件每文件字节数和查询延迟；结果序列可写成 JSON/CSV 供对比
+int runScaleBenchmarkCommand(int argc, char* argv[]) {
+    vector<string> positional;
+    string jsonPath, csvPath;
+    bool realistic = false;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if ((arg == "--json" || arg == "--csv") && i + 1 < argc) {
+            (arg == "--json" ? jsonPath : csvPath) = argv[++i];
+        } else if (arg == "--realistic") {
+            realistic = true;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    long long maxFiles = positional.size() >= 1 ? stoll(positional[0]) : 1000000;
+    long long minFiles = positional.size() >= 2 ? stoll(positional[1]) : 1000;
+    if (minFiles < 1 || minFiles > maxFiles) {
+        cerr << "起始文件数必须在 1 到最大文件数之间" << endl;
+        return 1;
+    }
+    const long long chunk = 1000000;
+    
+    vector<ScalePoint> series;
+    cout << "=== 规模扩展 (" << minFiles << " 到 " << maxFiles << " 文件) ===" << endl;
+    // 列依次为：文件数、构建秒数、RSS 每文件字节、记账每文件字节及其按组件（树、元数据、四个索引）的拆分、
+    // 扩展名查询和窄大小区间查询的中位延迟；CSV/JSON 中每个索引再拆成键表和倒排链两部分
+    cout << setw(11) << "files" << setw(10) << "build_s" << setw(10) << "rss_B/f" << setw(10) << "acct_B/f"
+         << setw(8) << "tree" << setw(8) << "meta" << setw(8) << "ext" << setw(8) << "size"
+         << setw(8) << "owner" << setw(8) << "time" << setw(12) << "ext_p50_us" << setw(12) << "narrow_us"
+         << endl;
+    for (long long scale = minFiles; scale <= maxFiles; scale *= 10) {
+        ScalePoint point;
+        point.files = scale;
+        size_t rssBefore = currentResidentBytes();
+        {
+            FileSystemSimulator fs;
+            vector<FileRecord> records;
+            NamespaceOptions data;
+            data.files = scale;
+            unique_ptr<NamespaceGenerator> generator;
+            if (realistic) generator = make_unique<NamespaceGenerator>(data);
+            for (long long begin = 0; begin < scale; begin += chunk) {
+                long long end = min(scale, begin + chunk);
+                if (generator) {
+                    generator->nextBatch(records, end - begin);
+                } else {
+                    records.clear();
+                    records.reserve(end - begin);
+                    for (long long key = begin; key < end; ++key) {
+                        records.push_back(syntheticRecord(key));
+                    }
+                }
+                auto start = steady_clock::now();
+                fs.bulkLoad(records);
+                point.buildSeconds += duration<double>(steady_clock::now() - start).count();
+            }
+            vector<FileRecord>().swap(records);
+            size_t rssAfter = currentResidentBytes();
+            point.rssBytes = rssAfter > rssBefore ? rssAfter - rssBefore : 0;
+            point.memory = fs.getMemoryBreakdown();
+            
+            // 查询延迟：每种查询最多 200 次或 1 秒
+            auto timeQuery = [&](const string& name, function<size_t()> query) {
+                vector<double> samples;
+                auto caseStart = steady_clock::now();
+                size_t sink = 0;
+                for (int i = 0; i < 200; ++i) {
+                    auto start = steady_clock::now();
+                    sink += query();
+                    auto end = steady_clock::now();
+                    samples.push_back((double)duration_cast<nanoseconds>(end - start).count());
+                    if (samples.size() >= 5 && end - caseStart > seconds(1)) break;
+                }
+                double total = duration<double>(steady_clock::now() - caseStart).count();
+                point.queries.push_back(BenchmarkSuite::summarize(name, (int)min<long long>(scale, INT_MAX), samples, total));
+                return sink;
+            };
+            timeQuery("query/extension_indexed", [&]() { return fs.queryByExtensionIndexed(".jpg").size(); });
+            timeQuery("query/owner_indexed", [&]() { return fs.queryByOwnerIndexed("user1").size(); });
+            timeQuery("query/size_narrow_indexed", [&]() {
+                return fs.queryBySizeRangeIndexed(1000000, 1000000 + 4096).size();
+            });
+        }
+        series.push_back(point);
+        
+        double perFile = 1.0 / scale;
+        const auto& m = point.memory;
+        cout << setw(11) << scale << fixed << setprecision(3) << setw(10) << point.buildSeconds << setprecision(1)
+             << setw(10) << point.rssBytes * perFile << setw(10) << m.total() * perFile
+             << setw(8) << m.tree * perFile << setw(8) << m.metadata * perFile
+             << setw(8) << m.extension.total() * perFile << setw(8) << m.size.total() * perFile
+             << setw(8) << m.owner.total() * perFile << setw(8) << m.time.total() * perFile << setprecision(2)
+             << setw(12) << point.queries[0].median / 1000 << setw(12) << point.queries[2].median / 1000 << endl;
+    }
+    
+    if (!csvPath.empty()) {
+        ofstream out(csvPath);
+        out << "files,build_seconds,rss_bytes,tree_bytes,metadata_bytes";
+        for (const char* name : {"extension", "size", "owner", "time"}) {
+            out << ',' << name << "_dictionary_bytes," << name << "_postings_bytes";
+        }
+        for (const auto& q : series.front().queries) out << ',' << q.name << "_p50_ns," << q.name << "_p99_ns";
+        out << '\n' << fixed << setprecision(6);
+        for (const auto& point : series) {
+            const auto& m = point.memory;
+            out << point.files << ',' << point.buildSeconds << ',' << point.rssBytes << ',' << m.tree << ','
+                << m.metadata;
+            for (const auto* index : {&m.extension, &m.size, &m.owner, &m.time}) {
+                out << ',' << index->dictionary << ',' << index->postings;
+            }
+            for (const auto& q : point.queries) {
+                out << ',' << q.median << ',';
+                if (!isnan(q.p99)) out << q.p99;
+            }
+            out << '\n';
+        }
+        if (!out) throw runtime_error("写入失败: " + csvPath);
+    }
+    if (!jsonPath.empty()) {
+        ofstream out(jsonPath);
+        out << "{\n  \"unit\": \"bytes, ns\",\n  \"series\": [";
+        out << fixed << setprecision(6);
+        for (size_t i = 0; i < series.size(); ++i) {
+            const auto& point = series[i];
+            const auto& m = point.memory;
+            out << (i ? ",\n" : "\n") << "    {\"files\": " << point.files << ", \"build_seconds\": "
+                << point.buildSeconds << ", \"rss_bytes\": " << point.rssBytes << ", \"tree_bytes\": " << m.tree
+                << ", \"metadata_bytes\": " << m.metadata;
+            const pair<const char*, const IndexMemory*> indexes[] = {
+                {"extension", &m.extension}, {"size", &m.size}, {"owner", &m.owner}, {"time", &m.time}};
+            for (const auto& index : indexes) {
+                out << ", \"" << index.first << "_index\": {\"dictionary_bytes\": " << index.second->dictionary
+                    << ", \"postings_bytes\": " << index.second->postings << "}";
+            }
+            out << ", \"queries\": {";
+            for (size_t q = 0; q < point.queries.size(); ++q) {
+                out << (q ? ", " : "") << "\"" << point.queries[q].name << "\": {\"median_ns\": "
+                    << point.queries[q].median << ", \"p99_ns\": ";
+                BenchmarkSuite::jsonNumber(out, point.queries[q].p99);
+                out << "}";
+            }
+            out << "}}";
+        }
+        out << "\n  ]\n}\n";
+        if (!out) throw runtime_error("写入失败: " + jsonPath);
+    }
+    return 0;
+}
+
+// mai gen-namespace [文件数] [--seed N] [--depth N] [--fanout X] [--dir-files X] [--dump 文件]：
+// 用 NamespaceGenerator 生成命名空间并打印分布统计；--dump 写成 gen-dump 同样的 find 导出格式，
+// 可交给 mai load 装载
+int runGenerateNamespaceCommand(int argc, char* argv[]) {
+    NamespaceOptions options;
+    string dumpPath;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg[0] != '-') {
+            options.files = stoll(arg);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            cerr << "参数缺少取值: " << arg << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        if (arg == "--seed") {
+            options.seed = (unsigned)stoul(value);
+        } else if (arg == "--depth") {
+            options.maxDepth = stoi(value);
+        } else if (arg == "--fanout") {
+            options.meanFanOut = stod(value);
+        } else if (arg == "--dir-files") {
+            options.meanFilesPerDirectory = stod(value);
+        } else if (arg == "--dump") {
+            dumpPath = value;
+        } else {
+            cerr << "未知参数: " << arg << endl;
+            return 1;
+        }
+    }
+    
+    auto start = steady_clock::now();
+    NamespaceGenerator generator(options);
+    FILE* out = nullptr;
+    vector<char> buffer(1 << 20);
+    if (!dumpPath.empty()) {
+        out = fopen(dumpPath.c_str(), "w");
+        if (!out) throw runtime_error("无法写入文件: " + dumpPath);
+        setvbuf(out, buffer.data(), _IOFBF, buffer.size());
+    }
+    
+    unordered_map<string, long long> extensionCounts, ownerCounts, dayCounts, directoryCounts;
+    vector<long long> sizes;
+    sizes.reserve(options.files);
+    size_t maxDepth = 0;
+    vector<FileRecord> records;
+    while (generator.nextBatch(records, 100000)) {
+        for (const auto& record : records) {
+            extensionCounts[record.extension]++;
+            ownerCounts[record.owner]++;
+            dayCounts[record.createTime]++;
+            if (directoryCounts[record.path]++ == 0) {
+                maxDepth = max<size_t>(maxDepth, count(record.path.begin(), record.path.end(), '/'));
+            }
+            sizes.push_back(record.fileSize);
+            if (out) {
+                fprintf(out, "%s/%s\t%lld\t%s\t%lld.000000000\n", record.path.c_str(), record.fileName.c_str(),
+                        record.fileSize, record.owner.c_str(), record.modifyTime);
+            }
+        }
+    }
+    if (out && fclose(out) != 0) throw runtime_error("写入失败: " + dumpPath);
+    double seconds = duration<double>(steady_clock::now() - start).count();
+    
+    // 前 k 名所占的文件比例
+    auto topShare = [&](const unordered_map<string, long long>& counts, size_t k) {
+        vector<long long> values;
+        for (const auto& entry : counts) values.push_back(entry.second);
+        sort(values.rbegin(), values.rend());
+        long long top = 0;
+        for (size_t i = 0; i < min(k, values.size()); ++i) top += values[i];
+        return options.files ? 100.0 * top / options.files : 0.0;
+    };
+    sort(sizes.begin(), sizes.end());
+    auto sizeAt = [&](double q) {
+        return sizes.empty() ? 0 : sizes[min(sizes.size() - 1, (size_t)(q * sizes.size()))];
+    };
+    long long largestDirectory = 0;
+    for (const auto& entry : directoryCounts) largestDirectory = max(largestDirectory, entry.second);
+    
+    cout << "=== 合成命名空间 (" << options.files << " 文件, 种子 " << options.seed << ") ===" << endl;
+    cout << "目录: " << generator.getDirectoryCount() << " 个 (含文件 " << directoryCounts.size()
+         << " 个), 最大深度 " << maxDepth << ", 最大目录 " << largestDirectory << " 文件" << endl;
+    cout << fixed << setprecision(1);
+    cout << "扩展名: " << extensionCounts.size() << " 种, 前 1/10 名占 " << topShare(extensionCounts, 1) << "% / "
+         << topShare(extensionCounts, 10) << "%" << endl;
+    cout << "属主: " << ownerCounts.size() << " 个, 前 1/10 名占 " << topShare(ownerCounts, 1) << "% / "
+         << topShare(ownerCounts, 10) << "%" << endl;
+    cout << "创建日期: " << dayCounts.size() << " 天, 最忙 10 天占 " << topShare(dayCounts, 10) << "%" << endl;
+    cout << "文件大小: p50 " << sizeAt(0.5) << " / p90 " << sizeAt(0.9) << " / p99 " << sizeAt(0.99)
+         << " / 最大 " << (sizes.empty() ? 0 : sizes.back()) << " bytes" << endl;
+    cout << "耗时 " << setprecision(3) << seconds << " s" << (out ? ", 已写入 " + dumpPath : "") << endl;
+    return 0;
+}
+
+// mai explain [--files N] [--realistic] [--seed N] [--runs N] [--ext 扩展名] [--owner 属主] [--time 日期]
+//             [--size 最小:最大] [--mtime 起:止] [--gid 组] [--as uid:组,组…] [--order 键[:asc|:desc]]
+//             [--limit N] [--scan]：装入测试数据后执行一个多条件查询，
+// 打印每次执行的剖析（第一次通常是冷的，之后是热的）。--as 只返回该身份可读的文件，
+// 第一次执行包含建可读位图的时间。--order 的键为 size、modify_time 或 create_time，默认降序；
+// 只有 --realistic 的数据带修改时间。--scan 改为不走索引的摘要剪枝扫描，打印剪掉的子树数。
+// 最后打印结果行数的估计（见 InvertedIndex::estimateRows）
+int runExplainCommand(int argc, char* argv[]) {
+    int numFiles = 100000;
+    int runs = 2;
+    bool realistic = false;
+    bool scan = false;
+    unsigned seed = 42;
+    FileQuery query;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--realistic") {
+            realistic = true;
+            continue;
+        }
+        if (arg == "--scan") {
+            scan = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            cerr << "参数缺少取值: " << arg << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        if (arg == "--files") {
+            numFiles = stoi(value);
+        } else if (arg == "--runs") {
+            runs = stoi(value);
+        } else if (arg == "--seed") {
+            seed = (unsigned)stoul(value);
+        } else if (arg == "--ext") {
+            query.extension = value;
+        } else if (arg == "--owner") {
+            query.owner = value;
+        } else if (arg == "--time") {
+            query.createTime = value;
+        } else if (arg == "--size") {
+            auto colon = value.find(':');
+            if (colon == string::npos) {
+                cerr << "大小区间格式应为 最小:最大" << endl;
+                return 1;
+            }
+            query.sizeRange = make_pair(stoll(value.substr(0, colon)), stoll(value.substr(colon + 1)));
+        } else if (arg == "--mtime") {
+            auto colon = value.find(':');
+            if (colon == string::npos) {
+                cerr << "修改时间区间格式应为 起:止（Unix 秒）" << endl;
+                return 1;
+            }
+            query.modifyTimeRange = make_pair(stoll(value.substr(0, colon)), stoll(value.substr(colon + 1)));
+        } else if (arg == "--order") {
+            auto colon = value.find(':');
+            string key = value.substr(0, colon), direction = colon == string::npos ? "desc" : value.substr(colon + 1);
+            auto name = find_if(begin(kOrderKeyNames), end(kOrderKeyNames), [&](const char* n) { return key == n; });
+            if (name == end(kOrderKeyNames) || (direction != "asc" && direction != "desc")) {
+                cerr << "排序格式应为 size|modify_time|create_time[:asc|:desc]" << endl;
+                return 1;
+            }
+            query.orderBy = QueryOrder{(OrderKey)(name - begin(kOrderKeyNames)), direction == "desc"};
+        } else if (arg == "--limit") {
+            query.limit = stoul(value);
+        } else if (arg == "--gid") {
+            query.gid = (uint32_t)stoul(value);
+        } else if (arg == "--as") {
+            auto colon = value.find(':');
+            vector<uint32_t> groups;
+            if (colon != string::npos) {
+                stringstream list(value.substr(colon + 1));
+                string group;
+                while (getline(list, group, ',')) {
+                    if (!group.empty()) groups.push_back((uint32_t)stoul(group));
+                }
+            }
+            query.caller = Principal((uint32_t)stoul(value.substr(0, colon)), move(groups));
+        } else {
+            cerr << "未知参数: " << arg << endl;
+            return 1;
+        }
+    }
+    
+    FileSystemSimulator fs;
+    if (realistic) {
+        NamespaceOptions data;
+        data.files = numFiles;
+        data.seed = seed;
+        NamespaceGenerator generator(data);
+        vector<FileRecord> records;
+        while (generator.nextBatch(records, 100000)) fs.bulkLoad(records);
+    } else {
+        fs.generateTestData(numFiles, seed);
+    }
+    for (int run = 0; run < runs && scan; ++run) {
+        PruneStats stats;
+        auto start = steady_clock::now();
+        auto rows = fs.queryByScan(query, "/", &stats).size();
+        double ms = duration<double, milli>(steady_clock::now() - start).count();
+        cout << "--- 第 " << run + 1 << " 次 (扫描) ---" << endl;
+        cout << "Scan: " << query.describe() << endl;
+        cout << "  rows=" << rows << " time=" << fixed << setprecision(3) << ms << " ms" << endl;
+        cout << "  directories: visited=" << stats.directoriesVisited << " pruned=" << stats.directoriesPruned
+             << ", files examined=" << stats.filesExamined << " / " << fs.getTotalFiles() << endl;
+    }
+    for (int run = 0; run < runs && !scan; ++run) {
+        QueryProfile profile;
+        fs.queryIndexed(query, &profile);
+        cout << "--- 第 " << run + 1 << " 次 ---" << endl << profile.format();
+    }
+    auto estimate = fs.estimateRows(PredicateExpr::of(query));
+    cout << "Estimate: rows=" << llround(estimate.rows) << (estimate.exact ? " (exact)" : "")
+         << " sample=" << estimate.sampleHits << "/" << estimate.sampleRows << endl;
+    return 0;
+}
+
+// mai scan <目录> [线程数] [--io-uring]：扫描真实目录树并建立索引
+int runScanCommand(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "用法: " << argv[0] << " scan <目录> [线程数] [--io-uring]" << endl;
+        return 1;
+    }
+    
+    DirectoryScanner::Options options;
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--io-uring") {
+            options.backend = ScanBackend::IoUring;
+        } else {
+            options.numThreads = stoi(arg);
+        }
+    }
+    
+    FileSystemSimulator fs;
+    DirectoryScanner scanner(options);
+    auto stats = scanner.scanInto(argv[2], fs);
+    
+    cout << "=== 目录扫描 ===" << endl;
+    cout << "线程数: " << options.numThreads << ", 后端: " << stats.backend << endl;
+    cout << "文件数: " << stats.files << ", 目录数: " << stats.directories
+         << ", 跳过: " << stats.skipped << ", 错误: " << stats.errors << endl;
+    cout << "耗时: " << fixed << setprecision(3) << stats.seconds << " s" << endl;
+    if (stats.seconds > 0) {
+        cout << "吞吐: " << fixed << setprecision(0)
+             << (stats.files + stats.directories) * 60.0 / stats.seconds << " 条目/分钟" << endl;
+    }
+    cout << "已索引文件: " << fs.getTotalFiles() << endl;
+    cout << "倒排索引内存: " << fs.getIndexMemoryUsage() << " bytes" << endl;
+    return 0;
+}
+
+// mai gen-tree <目录> <文件数>：在本地生成用于扫描基准的目录树
+// 两级目录、每个叶子目录 1000 个文件，文件大小用 ftruncate 设置（稀疏文件，不占实际空间）
+int runGenerateTreeCommand(int argc, char* argv[]) {
+    if (argc < 4) {
+        cerr << "用法: " << argv[0] << " gen-tree <目录> <文件数>" << endl;
+        return 1;
+    }
+    string root = argv[2];
+    long long numFiles = stoll(argv[3]);
+    const int filesPerDir = 1000;
+    const int dirsPerLevel = 100;
+    const vector<string> extensions = {".jpg", ".png", ".pdf", ".txt", ".doc", ".mp4", ".mp3"};
+    
+    auto start = steady_clock::now();
+    mkdir(root.c_str(), 0755);
+    string leaf;
+    for (long long i = 0; i < numFiles; ++i) {
+        if (i % filesPerDir == 0) {
+            long long leafIndex = i / filesPerDir;
+            string mid = root + "/d" + to_string(leafIndex / dirsPerLevel);
+            leaf = mid + "/s" + to_string(leafIndex % dirsPerLevel);
+            mkdir(mid.c_str(), 0755);
+            mkdir(leaf.c_str(), 0755);
+        }
+        string path = leaf + "/file" + to_string(i) + extensions[i % extensions.size()];
+        int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            throw runtime_error("无法创建文件: " + path + ": " + strerror(errno));
+        }
+        if (ftruncate(fd, (i * 7919) % (10 * 1024 * 1024)) != 0) {
+            close(fd);
+            throw runtime_error("无法设置文件大小: " + path);
+        }
+        close(fd);
+    }
+    
+    cout << "已生成 " << numFiles << " 个文件于 " << root << ", 耗时 "
+         << duration_cast<milliseconds>(steady_clock::now() - start).count() << " ms" << endl;
+    return 0;
+}
+
+// 按 NamespaceGenerator 的参数在 root 下建出真实目录树：文件用 ftruncate 设大小（稀疏文件，不占实际空间），
+// mtime 设为记录的修改时间；root 用户再把属主 userN 改成 uid kSyntheticUidBase+N。返回是否改了属主
+constexpr uid_t kSyntheticUidBase = 100000;
+
+bool materializeNamespace(const string& root, const NamespaceOptions& options) {
+    NamespaceGenerator generator(options);
+    bool chownFiles = geteuid() == 0;
+    vector<FileRecord> records;
+    string createdDirectory;
+    while (generator.nextBatch(records, 10000)) {
+        for (const auto& record : records) {
+            string dirPath = root + record.path;
+            if (dirPath != createdDirectory) {
+                // 生成器先产出父目录的文件，但没有文件的父目录不会出现，逐级创建
+                for (size_t slash = root.size() + 1; slash != string::npos; slash = dirPath.find('/', slash + 1)) {
+                    mkdir(dirPath.substr(0, slash).c_str(), 0755);
+                }
+                if (mkdir(dirPath.c_str(), 0755) != 0 && errno != EEXIST) {
+                    throw runtime_error("无法创建目录: " + dirPath + ": " + strerror(errno));
+                }
+                createdDirectory = dirPath;
+            }
+            string path = dirPath + "/" + record.fileName;
+            int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+            if (fd < 0) throw runtime_error("无法创建文件: " + path + ": " + strerror(errno));
+            struct timespec times[2] = {{record.modifyTime, 0}, {record.modifyTime, 0}};
+            bool ok = ftruncate(fd, record.fileSize) == 0 && futimens(fd, times) == 0;
+            if (ok && chownFiles) {
+                ok = fchown(fd, kSyntheticUidBase + stoul(record.owner.substr(4)), (gid_t)-1) == 0;
+            }
+            close(fd);
+            if (!ok) throw runtime_error("无法设置文件属性: " + path + ": " + strerror(errno));
+        }
+    }
+    return chownFiles;
+}
+
+// 丢弃页缓存、dentry 和 inode 缓存（需要 root），失败返回 false
+bool dropFileSystemCaches() {
+    sync();
+    int fd = open("/proc/sys/vm/drop_caches", O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = write(fd, "3", 1) == 1;
+    close(fd);
+    return ok;
+}
+
+// 基准测试用的临时目录：在 parent 下用 mkdtemp 新建，析构时（包括异常退出）删除其中的全部内容，
+// keep 时保留。只删自己建的目录，不会碰 parent 里原有的文件
+class ScratchDirectory {
+public:
+    ScratchDirectory(const string& parent, bool keep) : keep(keep) {
+        string pattern = parent + "/mai-find-XXXXXX";
+        if (!mkdtemp(&pattern[0])) throw runtime_error("无法创建临时目录: " + pattern + ": " + strerror(errno));
+        path = pattern;
+    }
+    
+    ScratchDirectory(const ScratchDirectory&) = delete;
+    ScratchDirectory& operator=(const ScratchDirectory&) = delete;
+    
+    ~ScratchDirectory() {
+        if (keep) return;
+        nftw(path.c_str(), [](const char* entry, const struct stat*, int, struct FTW*) { return remove(entry); },
+             64, FTW_DEPTH | FTW_PHYS);
+    }
+    
+    const string& get() const { return path; }
+    
+private:
+    string path;
+    bool keep;
+};
+
+// mai bench-find [文件数] [--dir 目录] [--threads N] [--runs N] [--keep]：
+// 在 --dir（默认 /tmp）下新建临时目录，把合成命名空间建成真实目录树，同一组谓词分别用 find(1)、进程内遍历（DirectoryScanner 逐个 stat 后过滤）
+// 和索引查询求值，比较冷缓存（每次前丢弃内核缓存，需 root）和热缓存（取 runs 次中位数）下的耗时，
+// 并给出建索引的扫描耗时，以及扫描成本被多少次查询摊平
+int runFindBenchmarkCommand(int argc, char* argv[]) {
+    NamespaceOptions data;
+    data.files = 100000;
+    string parent = "/tmp";
+    int threads = 1;
+    int runs = 3;
+    bool keep = false;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--keep") {
+            keep = true;
+        } else if (arg == "--dir" && i + 1 < argc) {
+            parent = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = stoi(argv[++i]);
+        } else if (arg == "--runs" && i + 1 < argc) {
+            runs = max(1, stoi(argv[++i]));
+        } else {
+            data.files = stoll(arg);
+        }
+    }
+    if (mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw runtime_error("无法创建目录: " + parent + ": " + strerror(errno));
+    }
+    ScratchDirectory scratch(parent, keep);
+    const string& root = scratch.get();
+    
+    auto start = steady_clock::now();
+    bool ownersSet = materializeNamespace(root, data);
+    cout << "=== find 对比 (" << data.files << " 文件于 " << root << ", 建树 " << fixed << setprecision(1)
+         << duration<double>(steady_clock::now() - start).count() << " s) ===" << endl;
+    
+    ScanOptions scanOptions;
+    scanOptions.numThreads = threads;
+    FileSystemSimulator fs;
+    bool canDropCaches = dropFileSystemCaches();
+    start = steady_clock::now();
+    DirectoryScanner(scanOptions).scanInto(root, fs);
+    double scanMs = duration<double, milli>(steady_clock::now() - start).count();
+    
+    struct Predicate {
+        string name;
+        string findArgs;
+        FileQuery query;
+        function<bool(const FileRecord&)> matches;
+    };
+    vector<Predicate> predicates;
+    {
+        Predicate p{"ext=.jpg", "-name '*.jpg'", {}, [](const FileRecord& r) { return r.extension == ".jpg"; }};
+        p.query.extension = ".jpg";
+        predicates.push_back(p);
+    }
+    {
+        Predicate p{"size=[1M,10M]", "-size +1048575c -size -10485761c", {}, [](const FileRecord& r) {
+            return r.fileSize >= 1048576 && r.fileSize <= 10485760;
+        }};
+        p.query.sizeRange = make_pair(1048576LL, 10485760LL);
+        predicates.push_back(p);
+    }
+    if (ownersSet) {
+        string uid = to_string(kSyntheticUidBase + 1);
+        Predicate p{"ext=.jpg&owner=user1", "-name '*.jpg' -uid " + uid, {}, [uid](const FileRecord& r) {
+            return r.extension == ".jpg" && r.owner == uid;
+        }};
+        p.query.extension = ".jpg";
+        p.query.owner = uid;
+        predicates.push_back(p);
+    }
+    
+    // 一次计时，返回 (毫秒, 匹配数)
+    auto runFind = [&](const Predicate& p) {
+        string command = "find '" + root + "' -type f " + p.findArgs;
+        auto begin = steady_clock::now();
+        FILE* pipe = popen(command.c_str(), "r");
+        if (!pipe) throw runtime_error("无法运行 find");
+        char buffer[65536];
+        size_t lines = 0, n;
+        while ((n = fread(buffer, 1, sizeof(buffer), pipe)) > 0) lines += count(buffer, buffer + n, '\n');
+        if (pclose(pipe) != 0) throw runtime_error("find 执行失败: " + command);
+        return make_pair(duration<double, milli>(steady_clock::now() - begin).count(), lines);
+    };
+    auto runWalk = [&](const Predicate& p) {
+        atomic<size_t> matched{0};
+        auto begin = steady_clock::now();
+        DirectoryScanner(scanOptions).scan(root, [&](vector<FileRecord>& batch) {
+            size_t local = 0;
+            for (const auto& record : batch) local += p.matches(record);
+            matched += local;
+        });
+        return make_pair(duration<double, milli>(steady_clock::now() - begin).count(), matched.load());
+    };
+    auto runIndex = [&](const Predicate& p) {
+        auto begin = steady_clock::now();
+        size_t matched = fs.queryIndexed(p.query).size();
+        return make_pair(duration<double, milli>(steady_clock::now() - begin).count(), matched);
+    };
+    auto warm = [&](auto&& run, const Predicate& p) {
+        vector<double> times;
+        size_t matched = 0;
+        for (int r = 0; r < runs; ++r) {
+            auto result = run(p);
+            times.push_back(result.first);
+            matched = result.second;
+        }
+        sort(times.begin(), times.end());
+        return make_pair(times[times.size() / 2], matched);
+    };
+    
+    if (!canDropCaches) cout << "无法丢弃内核缓存（需要 root），只测热缓存" << endl;
+    cout << "建索引扫描: " << setprecision(1) << scanMs << " ms (" << threads << " 线程"
+         << (canDropCaches ? ", 冷缓存" : "") << ")" << endl;
+    // 列依次为：谓词、匹配数、find 冷/热、进程内遍历冷/热、索引查询（毫秒），索引相对 find 和遍历的加速比，
+    // 以及扫描成本相对每次热 find 节省的时间需要多少次查询摊平
+    cout << left << setw(22) << "predicate" << right << setw(9) << "matches" << setw(11) << "find_cold"
+         << setw(11) << "find_warm" << setw(11) << "walk_cold" << setw(11) << "walk_warm" << setw(10) << "index"
+         << setw(11) << "x_find" << setw(11) << "x_walk" << setw(11) << "x_cold" << setw(10) << "breakeven"
+         << endl;
+    bool consistent = true;
+    for (const auto& p : predicates) {
+        auto index = warm(runIndex, p);
+        auto findWarm = warm(runFind, p);
+        auto walkWarm = warm(runWalk, p);
+        double findCold = -1, walkCold = -1;
+        if (canDropCaches) {
+            dropFileSystemCaches();
+            findCold = runFind(p).first;
+            dropFileSystemCaches();
+            walkCold = runWalk(p).first;
+        }
+        consistent = consistent && findWarm.second == index.second && walkWarm.second == index.second;
         
-        while (getline(ss, part, '/')) {
-            if (part.empty()) continue;
-            
-            auto it = current->children.find(part);
-            if (it == current->children.end()) {
-                return nullptr;
+        double indexMs = max(index.first, 1e-6);
+        auto cell = [&](double value, int width) {
+            if (value < 0) {
+                cout << setw(width) << "-";
+            } else {
+                cout << setw(width) << value;
             }
-            current = it->second;
+        };
+        cout << left << setw(22) << p.name << right << setw(9) << index.second << setprecision(2);
+        cell(findCold, 11);
+        cell(findWarm.first, 11);
+        cell(walkCold, 11);
+        cell(walkWarm.first, 11);
+        cout << setprecision(3) << setw(10) << index.first << setprecision(0) << setw(10) << findWarm.first / indexMs
+             << "x" << setw(10) << walkWarm.first / indexMs << "x";
+        if (findCold < 0) {
+            cout << setw(11) << "-";
+        } else {
+            cout << setw(10) << findCold / indexMs << "x";
         }
-        
-        return current;
+        cell(findWarm.first > index.first ? ceil(scanMs / (findWarm.first - index.first)) : -1, 10);
+        cout << endl;
+        if (findWarm.second != index.second || walkWarm.second != index.second) {
+            cout << "  匹配数不一致: find " << findWarm.second << ", 遍历 " << walkWarm.second << ", 索引 "
+                 << index.second << endl;
+        }
+    }
+    return consistent ? 0 : 1;
+}
+
+// mai bench-scan <目录> [线程数] [轮数]：对比同步 fstatat 与 io_uring statx 两种后端的元数据采集速度
+// 结果只计数、不写入模拟器，以便单独衡量扫描本身
+int runScanBenchmarkCommand(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "用法: " << argv[0] << " bench-scan <目录> [线程数] [轮数]" << endl;
+        return 1;
     }
+    int numThreads = argc >= 4 ? stoi(argv[3]) : (int)max(1u, thread::hardware_concurrency());
+    int rounds = argc >= 5 ? stoi(argv[4]) : 3;
     
-    void traverseAndFilter(const shared_ptr<DirectoryNode>& node, 
-                          function<void(const shared_ptr<FileMetadata>&)> filter) const {
-        if (!node->isDirectory && node->fileData) {
-            filter(node->fileData);
+    cout << "=== 扫描后端对比 (" << numThreads << " 线程, " << rounds << " 轮取中位数) ===" << endl;
+    double baseline = 0;
+    for (auto backend : {ScanBackend::ThreadPool, ScanBackend::IoUring}) {
+        DirectoryScanner::Options options;
+        options.numThreads = numThreads;
+        options.backend = backend;
+        
+        vector<double> times;
+        ScanStats stats;
+        for (int r = 0; r < rounds; ++r) {
+            atomic<size_t> received(0);
+            DirectoryScanner scanner(options);
+            stats = scanner.scan(argv[2], [&received](vector<FileRecord>& batch) {
+                received += batch.size();
+            });
+            times.push_back(stats.seconds);
         }
+        sort(times.begin(), times.end());
+        double median = times[times.size() / 2];
+        if (backend == ScanBackend::ThreadPool) baseline = median;
         
-        for (const auto& child : node->children) {
-            traverseAndFilter(child.second, filter);
+        cout << stats.backend << ": 文件 " << stats.files << ", 目录 " << stats.directories
+             << ", 中位耗时 " << fixed << setprecision(3) << median << " s, "
+             << setprecision(0) << (median > 0 ? stats.files / median : 0) << " 文件/秒";
+        if (backend == ScanBackend::IoUring && median > 0) {
+            cout << ", 相对同步后端 " << setprecision(2) << baseline / median << "x";
+        }
+        cout << endl;
+    }
+    return 0;
+}
+
+// mai rescan <目录> [等待秒数] [线程数]：全量扫描后等待一段时间（期间可修改目录），再做一次增量重扫
+int runRescanCommand(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "用法: " << argv[0] << " rescan <目录> [等待秒数] [线程数]" << endl;
+        return 1;
+    }
+    int waitSeconds = argc >= 4 ? stoi(argv[3]) : 10;
+    ScanOptions options;
+    if (argc >= 5) options.numThreads = stoi(argv[4]);
+    
+    FileSystemSimulator fs;
+    DirectoryScanner scanner(options);
+    auto scanStats = scanner.scanInto(argv[2], fs);
+    cout << "全量扫描: " << scanStats.files << " 个文件, " << scanStats.directories << " 个目录, 耗时 "
+         << fixed << setprecision(3) << scanStats.seconds << " s" << endl;
+    
+    cout << "等待 " << waitSeconds << " 秒后增量重扫..." << endl;
+    this_thread::sleep_for(seconds(waitSeconds));
+    
+    IncrementalRescanner rescanner(fs, options);
+    auto stats = rescanner.rescan(argv[2]);
+    cout << "增量重扫: 检查目录 " << stats.directoriesChecked << ", 重新列出 " << stats.directoriesListed
+         << ", 新子树 " << stats.newSubtrees << ", 新增/更新/删除 " << stats.added << "/"
+         << stats.updated << "/" << stats.removed << ", 错误 " << stats.errors
+         << ", 耗时 " << fixed << setprecision(3) << stats.seconds << " s" << endl;
+    cout << "当前文件数: " << fs.getTotalFiles() << endl;
+    return 0;
+}
+
+// mai load <导出文件> [线程数]：批量装载 find -printf 或 CSV 格式的元数据导出
+int runLoadCommand(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "用法: " << argv[0] << " load <导出文件> [线程数]" << endl;
+        return 1;
+    }
+    BulkLoadOptions options;
+    if (argc >= 4) options.numThreads = stoi(argv[3]);
+    
+    FileSystemSimulator fs;
+    MetadataDumpLoader loader(options);
+    auto stats = loader.load(argv[2], fs);
+    
+    double totalSeconds = stats.parseSeconds + stats.buildSeconds;
+    cout << "=== 批量装载 (" << stats.format << ", " << options.numThreads << " 线程) ===" << endl;
+    cout << "行数: " << stats.lines << ", 装载: " << stats.loaded << ", 无效行: " << stats.malformed << endl;
+    cout << "解析: " << fixed << setprecision(3) << stats.parseSeconds << " s, 建树和索引: "
+         << stats.buildSeconds << " s" << endl;
+    if (totalSeconds > 0) {
+        cout << "吞吐: " << setprecision(0) << stats.lines / totalSeconds << " 行/秒" << endl;
+    }
+    cout << "倒排索引内存: " << fs.getIndexMemoryUsage() << " bytes" << endl;
+    return 0;
+}
+
+// mai gen-dump <输出文件> <行数>：生成 find -printf '%p\t%s\t%u\t%T@\n' 格式的测试导出
+int runGenerateDumpCommand(int argc, char* argv[]) {
+    if (argc < 4) {
+        cerr << "用法: " << argv[0] << " gen-dump <输出文件> <行数>" << endl;
+        return 1;
+    }
+    long long numLines = stoll(argv[3]);
+    const vector<string> extensions = {".jpg", ".png", ".pdf", ".txt", ".doc", ".mp4", ".mp3"};
+    const vector<string> owners = {"user1", "user2", "user3", "admin", "guest"};
+    
+    FILE* out = fopen(argv[2], "w");
+    if (!out) {
+        throw runtime_error(string("无法写入文件: ") + argv[2]);
+    }
+    vector<char> buffer(1 << 20);
+    setvbuf(out, buffer.data(), _IOFBF, buffer.size());
+    mt19937_64 gen(42);
+    for (long long i = 0; i < numLines; ++i) {
+        long long leaf = i / 1000;
+        fprintf(out, "/data/d%lld/s%lld/file%lld%s\t%llu\t%s\t%llu.%09llu\n",
+                leaf / 100, leaf % 100, i, extensions[i % extensions.size()].c_str(),
+                (unsigned long long)(gen() % (10 * 1024 * 1024)), owners[gen() % owners.size()].c_str(),
+                1600000000ULL + gen() % 100000000ULL, (unsigned long long)(gen() % 1000000000ULL));
+    }
+    fclose(out);
+    cout << "已生成 " << numLines << " 行于 " << argv[2] << endl;
+    return 0;
+}
+
+// 与 generateTestData 同分布的测试词表；生成的列式数据只保存指向这里的指针
+struct TestVocabulary {
+    vector<string> extensions = {".jpg", ".png", ".pdf", ".txt", ".doc", ".mp4", ".mp3"};
+    vector<string> owners = {"user1", "user2", "user3", "admin", "guest"};
+    vector<string> dates;
+    
+    TestVocabulary() {
+        for (int i = 0; i < 12 * 28; ++i) {
+            dates.push_back("2024-" + to_string((i % 12) + 1) + "-" + to_string((i % 28) + 1));
         }
     }
 };
 
-// 性能测试类
-class PerformanceTest {
-public:
-    static void runTests() {
-        cout << "=== 文件元数据查找优化系统性能测试 ===" << endl;
-        
-        //FileSystemSimulator fs;
-        
-        // 测试不同数据规模
-        vector<int> testSizes = {1000, 5000, 10000, 50000};
+MetadataColumns generateTestColumns(long long count, const TestVocabulary& vocabulary) {
+    mt19937 gen(42);
+    uniform_int_distribution<long long> sizeDist(1024, 10 * 1024 * 1024);
+    MetadataColumns columns;
+    columns.reserve(count);
+    for (long long i = 0; i < count; ++i) {
+        columns.fileIds.push_back((int)i + 1);
+        columns.extensions.push_back(&vocabulary.extensions[gen() % vocabulary.extensions.size()]);
+        columns.sizes.push_back(sizeDist(gen));
+        columns.owners.push_back(&vocabulary.owners[gen() % vocabulary.owners.size()]);
+        columns.createTimes.push_back(&vocabulary.dates[i % vocabulary.dates.size()]);
+        columns.modifyTimes.push_back(1704067200 + (long long)(mixKey(i) % (366 * 86400)));
+        columns.modes.push_back(0644);
+        columns.uids.push_back(0);
+        columns.gids.push_back(100 + (uint32_t)(mixKey(i) % 16));
+    }
+    return columns;
+}
+
+// mai bench-build [最大文件数] [线程数]：对比逐文件 addFile 与排序式批量构建的建索引耗时
+// 数据分布与 generateTestData 一致，规模从 100 万起每次乘 10，直到最大文件数
+int runBuildBenchmarkCommand(int argc, char* argv[]) {
+    long long maxFiles = argc >= 3 ? stoll(argv[2]) : 10000000;
+    int numThreads = argc >= 4 ? stoi(argv[3]) : (int)max(1u, thread::hardware_concurrency());
+    
+    TestVocabulary vocabulary;
+    cout << "=== 索引构建对比 (" << numThreads << " 线程) ===" << endl;
+    for (long long scale = 1000000; scale <= maxFiles; scale *= 10) {
+        auto columns = generateTestColumns(scale, vocabulary);
         
-        for (int size : testSizes) {
-            cout << "\n--- 测试数据规模: " << size << " 文件 ---" << endl;
-            FileSystemSimulator fs;
-            //fs = FileSystemSimulator();
-            // 生成测试数据
-            auto start = high_resolution_clock::now();
-            fs.generateTestData(size);
-            auto end = high_resolution_clock::now();
-            
-            cout << "数据生成时间: " 
-                 << duration_cast<milliseconds>(end - start).count() << " ms" << endl;
-            
-            // 测试查询性能
-            testQueryPerformance(fs, size);
-            
-            // 测试内存使用
-            testMemoryUsage(fs, size);
+        double incrementalSeconds;
+        size_t incrementalMemory;
+        size_t incrementalPostings;
+        vector<int> expected;
+        {
+            InvertedIndex index;
+            FileMetadata file;
+            auto start = steady_clock::now();
+            for (long long i = 0; i < scale; ++i) {
+                file.fileId = columns.fileIds[i];
+                file.extension = *columns.extensions[i];
+                file.fileSize = columns.sizes[i];
+                file.owner = *columns.owners[i];
+                file.createTime = *columns.createTimes[i];
+                file.modifyTime = columns.modifyTimes[i];
+                file.gid = columns.gids[i];
+                index.addFile(file);
+            }
+            incrementalSeconds = duration<double>(steady_clock::now() - start).count();
+            incrementalMemory = index.getMemoryUsage();
+            incrementalPostings = index.getPostingCount();
+            expected = index.queryBySizeRange(100000, 1000000);
         }
         
-        // 测试并发性能
-        cout << "\n=== 并发性能测试 ===" << endl;
-        testConcurrentPerformance();
+        InvertedIndex index;
+        index.setBuildThreads(numThreads);
+        auto start = steady_clock::now();
+        index.rebuild(columns);
+        double bulkSeconds = duration<double>(steady_clock::now() - start).count();
+        // 两种构建的数组增长方式不同，内存只打印不比较
+        bool consistent = index.getPostingCount() == incrementalPostings &&
+                          index.queryBySizeRange(100000, 1000000) == expected;
+        
+        cout << scale << " 文件: 逐文件插入 " << fixed << setprecision(3) << incrementalSeconds
+             << " s, 批量构建 " << bulkSeconds << " s, 加速比 " << setprecision(2)
+             << (bulkSeconds > 0 ? incrementalSeconds / bulkSeconds : 0) << "x, 内存 "
+             << incrementalMemory << " / " << index.getMemoryUsage() << " bytes, 结果"
+             << (consistent ? "一致" : "不一致!") << endl;
+        if (!consistent) return 1;
     }
+    return 0;
+}
+
+// mai bench-checkpoint <目录> [文件数]：从目录恢复（快照 + 底段 + 日志），为空时先装入测试数据，
+// 然后对比后台检查点期间与平时的 addFile 延迟；再次运行同一目录即可验证恢复结果，
+// 恢复后的索引查询（底段 + 增量）与逐个比较元数据的结果须一致
+int runCheckpointBenchmarkCommand(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "用法: " << argv[0] << " bench-checkpoint <目录> [文件数]" << endl;
+        return 1;
+    }
+    long long numFiles = argc >= 4 ? stoll(argv[3]) : 1000000;
     
-private:
-    static void testQueryPerformance(FileSystemSimulator& fs, int dataSize) {
-        const int queryCount = 100;
+    FileSystemSimulator fs;
+    CheckpointManager checkpoints(fs, argv[2]);
+    auto start = steady_clock::now();
+    size_t replayed = checkpoints.open();
+    cout << "恢复: " << fs.getTotalFiles() << " 个文件, 重放日志 " << replayed << " 条, 耗时 "
+         << fixed << setprecision(3) << duration<double>(steady_clock::now() - start).count() << " s" << endl;
+    if (fs.getTotalFiles() > 0) {
+        auto memory = fs.getMemoryBreakdown();
+        cout << "索引内存 " << memory.index() << " bytes, 映射的底段 " << memory.mappedSegment << " bytes" << endl;
         
-        // 测试扩展名查询
-        auto start = high_resolution_clock::now();
-        for (int i = 0; i < queryCount; ++i) {
-            fs.queryByExtensionTraditional(".jpg");
+        vector<FileQuery> queries(4);
+        queries[0].extension = ".txt";
+        queries[1].owner = "user2";
+        queries[1].sizeRange = make_pair(1LL << 20, 4LL << 20);
+        queries[2].sizeRange = make_pair(0LL, 1LL << 20);
+        queries[2].orderBy = QueryOrder{OrderKey::Size, true};
+        queries[2].limit = 100;
+        queries[3].createTime = "2024-6-1";
+        for (const auto& query : queries) {
+            vector<int> indexed, scanned;
+            for (const auto& file : fs.queryIndexed(query)) indexed.push_back(file->fileId);
+            for (const auto& file : fs.queryByScan(query)) scanned.push_back(file->fileId);
+            if (!query.orderBy) {
+                sort(indexed.begin(), indexed.end());
+                sort(scanned.begin(), scanned.end());
+            }
+            if (indexed != scanned) throw runtime_error("恢复后的索引查询与扫描不一致: " + query.describe());
         }
-        auto end = high_resolution_clock::now();
-        auto traditionalTime = duration_cast<microseconds>(end - start).count();
-        
-        start = high_resolution_clock::now();
-        for (int i = 0; i < queryCount; ++i) {
-            fs.queryByExtensionIndexed(".jpg");
+        cout << "恢复后索引查询与扫描结果一致" << endl;
+    }
+    
+    if (fs.getTotalFiles() == 0) {
+        const vector<string> extensions = {".jpg", ".png", ".pdf", ".txt", ".doc", ".mp4", ".mp3"};
+        const vector<string> owners = {"user1", "user2", "user3", "admin", "guest"};
+        mt19937 gen(42);
+        vector<FileRecord> records;
+        records.reserve(numFiles);
+        for (long long i = 0; i < numFiles; ++i) {
+            records.push_back({"/data/d" + to_string(i / 1000), "file" + to_string(i),
+                               extensions[i % extensions.size()], (long long)(gen() % (10 * 1024 * 1024)),
+                               owners[gen() % owners.size()],
+                               "2024-" + to_string((i % 12) + 1) + "-" + to_string((i % 28) + 1), 0});
         }
-        end = high_resolution_clock::now();
-        auto indexedTime = duration_cast<microseconds>(end - start).count();
-        
-        cout << "扩展名查询 (" << queryCount << " 次):" << endl;
-        cout << "  传统方式: " << traditionalTime << " μs" << endl;
-        cout << "  索引方式: " << indexedTime << " μs" << endl;
-        cout << "  加速比: " << fixed << setprecision(2) 
-             << (double)traditionalTime / indexedTime << "x" << endl;
-        
-        // 测试其他类型查询
-        start = high_resolution_clock::now();
-        for (int i = 0; i < queryCount; ++i) {
-            fs.queryBySizeRangeIndexed(100000, 1000000); // 100KB to 1MB
+        fs.bulkLoad(records);
+        cout << "装入 " << numFiles << " 个测试文件" << endl;
+    }
+    
+    // 单个写线程持续 addFile，记录每次调用的延迟（微秒）
+    long long written = (long long)fs.getTotalFiles();
+    auto measureWrites = [&](const function<bool()>& keepGoing) {
+        vector<double> latencies;
+        while (keepGoing()) {
+            auto opStart = steady_clock::now();
+            fs.addFile("/incoming", "new" + to_string(written++) + ".txt", ".txt", 4096, "user1", "2024-6-1");
+            latencies.push_back(duration<double, micro>(steady_clock::now() - opStart).count());
         }
-        end = high_resolution_clock::now();
-        auto sizeQueryTime = duration_cast<microseconds>(end - start).count();
-        
-        start = high_resolution_clock::now();
-        for (int i = 0; i < queryCount; ++i) {
-            fs.queryByOwnerIndexed("user1");
+        sort(latencies.begin(), latencies.end());
+        return latencies;
+    };
+    auto report = [](const string& label, const vector<double>& latencies) {
+        if (latencies.empty()) return;
+        auto at = [&](double q) { return latencies[min(latencies.size() - 1, (size_t)(q * latencies.size()))]; };
+        cout << label << ": " << latencies.size() << " 次写入, p50 " << fixed << setprecision(1) << at(0.5)
+             << " us, p99 " << at(0.99) << " us, p99.9 " << at(0.999) << " us, 最大 " << latencies.back()
+             << " us" << endl;
+    };
+    
+    auto baselineEnd = steady_clock::now() + seconds(1);
+    report("平时", measureWrites([&] { return steady_clock::now() < baselineEnd; }));
+    
+    checkpoints.startCheckpoint();
+    auto duringCheckpoint = measureWrites([&] { return checkpoints.isRunning(); });
+    auto stats = checkpoints.waitForCheckpoint();
+    report("检查点期间", duringCheckpoint);
+    if (!stats.error.empty()) {
+        throw runtime_error("检查点失败: " + stats.error);
+    }
+    cout << "检查点: " << stats.files << " 个文件, " << stats.directories << " 个目录, 快照 " << stats.bytes
+         << " bytes, 倒排段 " << stats.segmentBytes << " bytes, 日志段 " << stats.generation << ", 捕获 "
+         << setprecision(2) << stats.captureMillis << " ms, 后台写入 " << setprecision(3) << stats.writeSeconds
+         << " s" << endl;
+    cout << "当前文件数: " << fs.getTotalFiles() << endl;
+    return 0;
+}
+
+// mai bench-segment <段文件> [文件数] [轮数]：把测试索引写成段文件，丢弃其页缓存后 mmap 打开，
+// 校验段上查询与内存索引结果一致，并对比两者的单值查询和多条件求交耗时
+int runSegmentBenchmarkCommand(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "用法: " << argv[0] << " bench-segment <段文件> [文件数] [轮数]" << endl;
+        return 1;
+    }
+    string path = argv[2];
+    long long numFiles = argc >= 4 ? stoll(argv[3]) : 1000000;
+    int rounds = argc >= 5 ? stoi(argv[4]) : 20;
+    
+    TestVocabulary vocabulary;
+    InvertedIndex index;
+    index.rebuild(generateTestColumns(numFiles, vocabulary));
+    
+    auto start = steady_clock::now();
+    uint64_t segmentBytes = index.writeSegment(path);
+    double writeSeconds = duration<double>(steady_clock::now() - start).count();
+    
+    // 刚写完的页已 fsync，是干净页，可以让内核丢弃，模拟冷启动
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+#ifdef POSIX_FADV_DONTNEED
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+        close(fd);
+    }
+    
+    MappedSegment segment(path);
+    cout << "=== 倒排段 (" << numFiles << " 文件) ===" << endl;
+    cout << "段文件: " << segmentBytes << " bytes (" << fixed << setprecision(2)
+         << (double)segmentBytes / max<uint64_t>(1, segment.totalPostings()) << " bytes/posting), 内存索引: "
+         << index.getMemoryUsage() << " bytes, 写入 " << setprecision(3) << writeSeconds << " s" << endl;
+    cout << "打开后驻留: " << segment.residentBytes() << " bytes" << endl;
+    
+    // 正确性：每个扩展名、所有者、一个大小区间和全部扩展名 x 所有者的两两求交
+    bool consistent = segment.queryBySizeRange(100000, 1000000) == index.queryBySizeRange(100000, 1000000);
+    for (const auto& ext : vocabulary.extensions) {
+        consistent = consistent && segment.queryByExtension(ext) == index.queryByExtension(ext);
+        for (const auto& owner : vocabulary.owners) {
+            auto left = index.queryByExtension(ext);
+            auto right = index.queryByOwner(owner);
+            vector<int> expected;
+            set_intersection(left.begin(), left.end(), right.begin(), right.end(), back_inserter(expected));
+            auto actual = MappedSegment::intersect({segment.find(SegmentField::Extension, ext),
+                                                    segment.find(SegmentField::Owner, owner)});
+            consistent = consistent && actual == expected;
         }
-        end = high_resolution_clock::now();
-        auto ownerQueryTime = duration_cast<microseconds>(end - start).count();
-        
-        cout << "文件大小范围查询 (" << queryCount << " 次): " << sizeQueryTime << " μs" << endl;
-        cout << "所有者查询 (" << queryCount << " 次): " << ownerQueryTime << " μs" << endl;
     }
+    for (const auto& owner : vocabulary.owners) {
+        consistent = consistent && segment.queryByOwner(owner) == index.queryByOwner(owner);
+    }
+    cout << "结果" << (consistent ? "一致" : "不一致!") << ", 查询后驻留: " << segment.residentBytes()
+         << " bytes" << endl;
+    if (!consistent) return 1;
     
-    static void testMemoryUsage(FileSystemSimulator& fs, int dataSize) {
-        size_t indexMemory = fs.getIndexMemoryUsage();
-        size_t totalFiles = fs.getTotalFiles();
-        
-        cout << "内存使用情况:" << endl;
-        cout << "  倒排索引内存: " << indexMemory << " bytes" << endl;
-        cout << "  平均每文件索引开销: " << (double)indexMemory / totalFiles << " bytes" << endl;
-        cout << "  索引压缩效果: 良好 (使用排序数组存储)" << endl;
+    // 三条件求交：扩展名 x 所有者 x 单个日期（最短的日期链驱动，其余链大多整块跳过）
+    const string& ext = vocabulary.extensions[0];
+    const string& owner = vocabulary.owners[0];
+    const string& date = vocabulary.dates[0];
+    size_t sink = 0;
+    
+    start = steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        auto a = index.queryByExtension(ext);
+        auto b = index.queryByOwner(owner);
+        auto c = index.queryByTime(date);
+        vector<int> ab, abc;
+        set_intersection(a.begin(), a.end(), b.begin(), b.end(), back_inserter(ab));
+        set_intersection(ab.begin(), ab.end(), c.begin(), c.end(), back_inserter(abc));
+        sink += abc.size();
     }
+    double heapMillis = duration<double, milli>(steady_clock::now() - start).count() / rounds;
     
-    static void testConcurrentPerformance() {
-        FileSystemSimulator fs;
-        fs.generateTestData(10000);
-        
-        const int numThreads = 4;
-        const int operationsPerThread = 1000;
+    start = steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        sink += MappedSegment::intersect({segment.find(SegmentField::Extension, ext),
+                                          segment.find(SegmentField::Owner, owner),
+                                          segment.find(SegmentField::CreateTime, date)}).size();
+    }
+    double segmentMillis = duration<double, milli>(steady_clock::now() - start).count() / rounds;
+    
+    start = steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        sink += index.queryByExtension(ext).size();
+    }
+    double heapScanMillis = duration<double, milli>(steady_clock::now() - start).count() / rounds;
+    
+    start = steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        sink += segment.queryByExtension(ext).size();
+    }
+    double segmentScanMillis = duration<double, milli>(steady_clock::now() - start).count() / rounds;
+    
+    cout << "单值查询 (" << ext << "): 内存索引 " << setprecision(3) << heapScanMillis << " ms, 段 "
+         << segmentScanMillis << " ms" << endl;
+    cout << "三条件求交: 内存索引 " << heapMillis << " ms, 段 " << segmentMillis << " ms"
+         << " (校验和 " << sink << ")" << endl;
+    return 0;
+}
+
+// mai bench-spill <溢出文件> [文件数] [倒排链额度MB] [操作数]：同一份测试数据分别建无预算和有预算的索引，
+// 预算为无预算索引中不可换出的部分加上倒排链额度；先确认低于不可换出部分的预算被拒绝，
+// 再按偏斜分布（日期按 Zipf）执行查询并穿插删除/重新添加，逐个比对结果，输出命中率和缺页延迟，
+// 最后核对索引的堆内存没有超出预算
+int runSpillBenchmarkCommand(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "用法: " << argv[0] << " bench-spill <溢出文件> [文件数] [倒排链额度MB] [操作数]" << endl;
+        return 1;
+    }
+    string spillPath = argv[2];
+    long long numFiles = argc >= 4 ? stoll(argv[3]) : 1000000;
+    size_t postingBytes = (size_t)((argc >= 5 ? stod(argv[4]) : 8.0) * 1024 * 1024);
+    int operations = argc >= 6 ? stoi(argv[5]) : 20000;
+    
+    TestVocabulary vocabulary;
+    auto columns = generateTestColumns(numFiles, vocabulary);
+    InvertedIndex reference;
+    reference.rebuild(columns);
+    size_t fixedBytes = reference.getFixedMemoryUsage();
+    size_t budgetBytes = fixedBytes + postingBytes;
+    
+    try {
+        reference.setMemoryBudget(fixedBytes / 2, spillPath);
+        cerr << "低于不可换出部分的预算没有被拒绝" << endl;
+        return 1;
+    } catch (const runtime_error& e) {
+        cout << "拒绝预算 " << fixedBytes / 2 << " bytes: " << e.what() << endl;
+    }
+    InvertedIndex budgeted;
+    budgeted.setMemoryBudget(budgetBytes, spillPath);
+    auto start = steady_clock::now();
+    budgeted.rebuild(columns);
+    double buildSeconds = duration<double>(steady_clock::now() - start).count();
+    
+    cout << "=== 内存预算 (" << numFiles << " 文件, 预算 " << budgetBytes << " bytes = 不可换出 " << fixedBytes
+         << " + 倒排链额度 " << postingBytes << ") ===" << endl;
+    cout << "无预算索引: " << reference.getMemoryUsage() << " bytes, 有预算索引驻留: "
+         << budgeted.getMemoryUsage() << " bytes, 构建 " << fixed << setprecision(3) << buildSeconds << " s" << endl;
+    
+    vector<double> dateWeights;
+    for (size_t i = 0; i < vocabulary.dates.size(); ++i) dateWeights.push_back(1.0 / (i + 1));
+    mt19937 gen(7);
+    discrete_distribution<size_t> dateDist(dateWeights.begin(), dateWeights.end());
+    uniform_int_distribution<int> opDist(0, 99);
+    uniform_int_distribution<long long> rowDist(0, numFiles - 1);
+    
+    double referenceSeconds = 0, budgetedSeconds = 0;
+    size_t mutations = 0;
+    for (int op = 0; op < operations; ++op) {
+        int kind = opDist(gen);
+        if (kind < 5) {
+            // 删除后重新添加同一文件：两个索引做相同修改
+            size_t row = (size_t)rowDist(gen);
+            FileMetadata file(columns.fileIds[row], "", *columns.extensions[row], columns.sizes[row],
+                              *columns.owners[row], *columns.createTimes[row], "", columns.modifyTimes[row],
+                              columns.modes[row], columns.uids[row], columns.gids[row]);
+            for (auto* index : {&reference, &budgeted}) {
+                index->removeFile(file);
+                index->addFile(file);
+            }
+            mutations++;
+            continue;
+        }
         
-        vector<thread> threads;
-        atomic<int> successCount(0);
+        function<vector<int>(const InvertedIndex&)> query;
+        if (kind < 85) {
+            const string& date = vocabulary.dates[dateDist(gen)];
+            query = [&](const InvertedIndex& index) { return index.queryByTime(date); };
+        } else if (kind < 95) {
+            const string& owner = vocabulary.owners[gen() % vocabulary.owners.size()];
+            query = [&](const InvertedIndex& index) { return index.queryByOwner(owner); };
+        } else {
+            long long low = columns.sizes[(size_t)rowDist(gen)];
+            query = [=](const InvertedIndex& index) { return index.queryBySizeRange(low, low + 4096); };
+        }
         
-        auto start = high_resolution_clock::now();
+        start = steady_clock::now();
+        auto expected = query(reference);
+        referenceSeconds += duration<double>(steady_clock::now() - start).count();
+        start = steady_clock::now();
+        auto actual = query(budgeted);
+        budgetedSeconds += duration<double>(steady_clock::now() - start).count();
+        if (actual != expected) {
+            cerr << "第 " << op << " 个操作结果不一致" << endl;
+            return 1;
+        }
+    }
+    
+    auto stats = budgeted.getSpillStats();
+    size_t queries = max<size_t>(1, operations - mutations);
+    cout << "操作 " << operations << " 个 (其中修改 " << mutations << " 个), 结果全部一致" << endl;
+    cout << "平均查询: 无预算 " << setprecision(2) << referenceSeconds * 1e6 / queries << " us, 有预算 "
+         << budgetedSeconds * 1e6 / queries << " us" << endl;
+    cout << "命中率 " << stats.hitRate() * 100 << "% (命中 " << stats.hits << ", 缺页 " << stats.faults
+         << ", 范围扫描直读 " << stats.scanReads << ")" << endl;
+    cout << "缺页延迟 平均 " << stats.meanFaultMicros << " us / 最大 " << stats.maxFaultMicros << " us" << endl;
+    cout << "驻留 " << stats.residentBytes << " bytes / " << stats.residentLists << " 条链, 已溢出 "
+         << stats.spilledLists << " 条链, 换出 " << stats.evictions << " 次, 写盘 " << stats.spillWrites
+         << " 次, 溢出文件 " << stats.spillFileBytes << " bytes (有效 " << stats.liveSpillBytes << ")" << endl;
+    size_t used = budgeted.getMemoryUsage();
+    cout << "索引堆内存 " << used << " / 预算 " << stats.budgetBytes << " bytes (不可换出 " << stats.fixedBytes << ")"
+         << endl;
+    if (used > stats.budgetBytes) {
+        cerr << "超出预算" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+// mai bench-tags [文件数] [轮数]：给合成文件打上机器学习数据集常见的标签（split 按 80/10/10 划分，
+// label 20 种、一成文件带第二个 label，annotator 50 种），为 split 和 label 建索引，
+// 对比标签查询、内置属性查询和含未建索引标签的查询，并与扫描结果逐一比对
+int runTagBenchmarkCommand(int argc, char* argv[]) {
+    long long numFiles = argc >= 3 ? stoll(argv[2]) : 1000000;
+    int rounds = argc >= 4 ? stoi(argv[3]) : 20;
+    static const vector<string> splits = {"train", "val", "test"};
+    static const vector<string> labels = {"cat", "dog", "bird", "horse", "sheep", "cow", "bear", "zebra",
+                                          "giraffe", "fish", "frog", "deer", "fox", "lion", "tiger", "wolf",
+                                          "rabbit", "mouse", "owl", "duck"};
+    
+    FileSystemSimulator fs;
+    vector<FileRecord> records;
+    for (long long key = 0; key < numFiles; ++key) {
+        records.push_back(syntheticRecord(key));
+        if (records.size() == 100000 || key + 1 == numFiles) {
+            fs.bulkLoad(records);
+            records.clear();
+        }
+    }
+    
+    auto start = steady_clock::now();
+    size_t tagged = 0;
+    for (long long key = 0; key < numFiles; ++key) {
+        string fullPath = syntheticDirectory(key) + "/" + syntheticFileName(key);
+        uint64_t hash = mixKey(key ^ 0x7461677300000000ULL);
+        int bucket = (int)(hash % 10);
+        tagged += fs.tagFile(fullPath, "split", splits[bucket < 8 ? 0 : bucket - 7], TagMode::Set);
+        tagged += fs.tagFile(fullPath, "label", labels[(hash >> 8) % labels.size()]);
+        if ((hash >> 16) % 10 == 0) tagged += fs.tagFile(fullPath, "label", labels[(hash >> 24) % labels.size()]);
+        tagged += fs.tagFile(fullPath, "annotator", "ann" + to_string((hash >> 32) % 50), TagMode::Set);
+    }
+    double tagSeconds = duration<double>(steady_clock::now() - start).count();
+    
+    start = steady_clock::now();
+    fs.indexTag("split");
+    fs.indexTag("label");
+    double indexSeconds = duration<double>(steady_clock::now() - start).count();
+    auto memory = fs.getMemoryBreakdown();
+    
+    cout << "=== 标签查询 (" << numFiles << " 文件) ===" << endl;
+    cout << "打标签 " << tagged << " 个, " << fixed << setprecision(3) << tagSeconds << " s ("
+         << setprecision(2) << tagSeconds * 1e6 / max<size_t>(1, tagged) << " us/个); 为 split、label 建索引 "
+         << setprecision(3) << indexSeconds << " s" << endl;
+    cout << "标签索引 " << memory.tags.total() << " bytes (" << setprecision(1)
+         << (double)memory.tags.total() / max<long long>(1, numFiles) << " B/文件), 内置属性索引 "
+         << memory.index() - memory.tags.total() << " bytes" << endl;
+    
+    FileQuery tagQuery;
+    tagQuery.tags = {{"split", "train"}, {"label", "cat"}};
+    FileQuery builtinQuery;
+    builtinQuery.extension = syntheticExtensions()[0];
+    builtinQuery.owner = syntheticOwners()[0];
+    FileQuery mixedQuery;
+    mixedQuery.tags = {{"split", "val"}, {"annotator", "ann7"}};
+    FileQuery unindexedQuery;
+    unindexedQuery.tags = {{"annotator", "ann7"}};
+    
+    auto key = [](const shared_ptr<FileMetadata>& file) { return file->fileId; };
+    for (const auto* query : {&tagQuery, &builtinQuery, &mixedQuery, &unindexedQuery}) {
+        size_t rows = 0;
+        start = steady_clock::now();
+        for (int r = 0; r < rounds; ++r) rows = fs.queryIndexed(*query).size();
+        double indexedMillis = duration<double, milli>(steady_clock::now() - start).count() / rounds;
         
-        // 创建读线程
-        for (int i = 0; i < numThreads; ++i) {
-            threads.emplace_back([&fs, &successCount, operationsPerThread]() {
-                for (int j = 0; j < operationsPerThread; ++j) {
-                    auto results = fs.queryByExtensionIndexed(".jpg");
-                    if (!results.empty()) {
-                        successCount++;
-                    }
+        auto indexed = fs.queryIndexed(*query);
+        start = steady_clock::now();
+        auto scanned = fs.queryByScan(*query);
+        double scanMillis = duration<double, milli>(steady_clock::now() - start).count();
+        vector<int> expected, actual;
+        for (const auto& file : scanned) expected.push_back(key(file));
+        for (const auto& file : indexed) actual.push_back(key(file));
+        sort(expected.begin(), expected.end());
+        sort(actual.begin(), actual.end());
+        if (actual != expected) {
+            cerr << "查询结果与扫描不一致: " << query->describe() << endl;
+            return 1;
+        }
+        cout << query->describe() << endl;
+        cout << "  rows=" << rows << " 索引 " << setprecision(3) << indexedMillis << " ms, 扫描 " << scanMillis
+             << " ms" << endl;
+    }
+    return 0;
+}
+
+// mai bench-acl [文件数] [访问者数] [轮数]：合成文件随机分给 200 个用户、40 个组，权限位取常见的
+// 0600/0640/0644/0660/0400；每个访问者属于 1~4 个组。对比同一查询不过滤、按可读位图过滤
+// 和查出结果后逐个判断权限的耗时，并与逐个判断的结果比对
+int runAclBenchmarkCommand(int argc, char* argv[]) {
+    long long numFiles = argc >= 3 ? stoll(argv[2]) : 1000000;
+    int numPrincipals = argc >= 4 ? stoi(argv[3]) : 16;
+    int rounds = argc >= 5 ? stoi(argv[4]) : 10;
+    if (numPrincipals < 1 || rounds < 1) {
+        cerr << "访问者数和轮数必须大于 0" << endl;
+        return 1;
+    }
+    static const uint32_t modes[] = {0600, 0600, 0640, 0640, 0640, 0644, 0644, 0644, 0660, 0400};
+    
+    FileSystemSimulator fs;
+    vector<FileRecord> records;
+    for (long long key = 0; key < numFiles; ++key) {
+        auto record = syntheticRecord(key);
+        uint64_t hash = mixKey(key ^ 0x61636c0000000000ULL);
+        record.uid = 1000 + (uint32_t)(hash % 200);
+        record.gid = 100 + (uint32_t)((hash >> 16) % 40);
+        record.mode = modes[(hash >> 32) % 10];
+        records.push_back(move(record));
+        if (records.size() == 100000 || key + 1 == numFiles) {
+            fs.bulkLoad(records);
+            records.clear();
+        }
+    }
+    
+    mt19937 gen(11);
+    vector<Principal> principals;
+    for (int i = 0; i < numPrincipals; ++i) {
+        vector<uint32_t> groups;
+        for (int g = 0, count = 1 + (int)(gen() % 4); g < count; ++g) groups.push_back(100 + gen() % 40);
+        principals.emplace_back(1000 + gen() % 200, groups);
+    }
+    
+    vector<FileQuery> queries(4);
+    queries[0].extension = ".jpg";
+    queries[1].extension = ".pdf";
+    queries[1].owner = "user2";
+    queries[2].gid = 107;
+    queries[3].sizeRange = make_pair(0LL, 1024LL * 1024);
+    
+    cout << "=== 权限过滤查询 (" << numFiles << " 文件, " << numPrincipals << " 个访问者) ===" << endl;
+    double buildMillis = 0;
+    for (const auto& caller : principals) {
+        FileQuery query;
+        query.caller = caller;
+        auto start = steady_clock::now();
+        fs.queryIndexed(query);
+        buildMillis += duration<double, milli>(steady_clock::now() - start).count();
+    }
+    auto memory = fs.getMemoryBreakdown();
+    cout << "首次查询 (建可读位图) 平均 " << fixed << setprecision(3) << buildMillis / numPrincipals
+         << " ms, 位图共 " << memory.readable.total() << " bytes; 属组索引 " << memory.group.total() << " bytes"
+         << endl;
+    
+    for (const auto& base : queries) {
+        double plainMillis = 0, secureMillis = 0, checkedMillis = 0;
+        size_t plainRows = 0, secureRows = 0;
+        for (int r = 0; r < rounds; ++r) {
+            for (const auto& caller : principals) {
+                auto start = steady_clock::now();
+                auto all = fs.queryIndexed(base);
+                plainMillis += duration<double, milli>(steady_clock::now() - start).count();
+                plainRows += all.size();
+                
+                FileQuery query = base;
+                query.caller = caller;
+                start = steady_clock::now();
+                auto secure = fs.queryIndexed(query);
+                secureMillis += duration<double, milli>(steady_clock::now() - start).count();
+                secureRows += secure.size();
+                
+                start = steady_clock::now();
+                vector<shared_ptr<FileMetadata>> checked;
+                for (auto& file : fs.queryIndexed(base)) {
+                    if (canRead(caller, *file)) checked.push_back(move(file));
                 }
-            });
+                checkedMillis += duration<double, milli>(steady_clock::now() - start).count();
+                
+                if (r > 0) continue;
+                vector<int> expected, actual;
+                for (const auto& file : checked) expected.push_back(file->fileId);
+                for (const auto& file : secure) actual.push_back(file->fileId);
+                sort(expected.begin(), expected.end());
+                sort(actual.begin(), actual.end());
+                if (actual != expected) {
+                    cerr << "结果不一致: " << query.describe() << endl;
+                    return 1;
+                }
+            }
+        }
+        size_t runs = (size_t)rounds * numPrincipals;
+        cout << base.describe() << endl;
+        cout << "  不过滤 " << setprecision(3) << plainMillis / runs << " ms (" << plainRows / runs << " 行), 可读位图 "
+             << secureMillis / runs << " ms (" << secureRows / runs << " 行), 逐个判断 " << checkedMillis / runs << " ms"
+             << endl;
+    }
+    return 0;
+}
+
+// mai bench-topk [文件数] [K] [轮数]：合成文件（修改时间散布在 2024 年内）上的 ORDER BY … LIMIT K 查询，
+// 对比沿有序索引取前 K 个与取出全部结果后在调用方排序的耗时，并与扫描后排序的结果逐行比对。
+// 最后两个查询分别是其他条件很窄（直接取出排序）和按没有有序索引的创建日期排序（堆选择）
+int runTopKBenchmarkCommand(int argc, char* argv[]) {
+    long long numFiles = argc >= 3 ? stoll(argv[2]) : 1000000;
+    size_t limit = argc >= 4 ? stoul(argv[3]) : 100;
+    int rounds = argc >= 5 ? stoi(argv[4]) : 20;
+    
+    FileSystemSimulator fs;
+    vector<FileRecord> records;
+    for (long long key = 0; key < numFiles; ++key) {
+        records.push_back(syntheticRecord(key));
+        if (records.size() == 100000 || key + 1 == numFiles) {
+            fs.bulkLoad(records);
+            records.clear();
         }
+    }
+    
+    vector<FileQuery> queries(6);
+    queries[0].extension = ".mp4";
+    queries[0].orderBy = QueryOrder{OrderKey::Size, true};
+    queries[1].owner = "user2";
+    queries[1].orderBy = QueryOrder{OrderKey::ModifyTime, true};
+    queries[2].orderBy = QueryOrder{OrderKey::Size, false};
+    queries[3].extension = ".pdf";
+    queries[3].sizeRange = make_pair(1024LL * 1024, 4LL * 1024 * 1024);
+    queries[3].orderBy = QueryOrder{OrderKey::ModifyTime, false};
+    queries[4].extension = ".pdf";
+    queries[4].owner = "user2";
+    queries[4].sizeRange = make_pair(0LL, 64LL * 1024);
+    queries[4].orderBy = QueryOrder{OrderKey::ModifyTime, true};
+    queries[5].extension = ".jpg";
+    queries[5].orderBy = QueryOrder{OrderKey::CreateTime, true};
+    
+    cout << "=== 排序取前 K 个 (" << numFiles << " 文件, K = " << limit << ") ===" << endl;
+    for (auto query : queries) {
+        query.limit = limit;
+        FileQuery unordered = query;
+        unordered.orderBy.reset();
+        unordered.limit = 0;
+        auto key = query.orderBy->key;
+        bool descending = query.orderBy->descending;
         
-        // 等待所有线程完成
-        for (auto& t : threads) {
-            t.join();
+        double topMillis = 0, sortMillis = 0;
+        size_t matched = 0;
+        vector<shared_ptr<FileMetadata>> top, sorted;
+        for (int r = 0; r < rounds; ++r) {
+            auto start = steady_clock::now();
+            top = fs.queryIndexed(query);
+            topMillis += duration<double, milli>(steady_clock::now() - start).count();
+            
+            start = steady_clock::now();
+            auto all = fs.queryIndexed(unordered);
+            matched = all.size();
+            vector<pair<long long, shared_ptr<FileMetadata>>> keyed;
+            keyed.reserve(all.size());
+            for (auto& file : all) keyed.emplace_back(orderValue(*file, key), move(file));
+            sort(keyed.begin(), keyed.end(), [&](const auto& a, const auto& b) {
+                if (a.first != b.first) return descending ? a.first > b.first : a.first < b.first;
+                return a.second->fileId < b.second->fileId;
+            });
+            sorted.clear();
+            for (size_t i = 0; i < keyed.size() && i < limit; ++i) sorted.push_back(move(keyed[i].second));
+            sortMillis += duration<double, milli>(steady_clock::now() - start).count();
         }
         
-        auto end = high_resolution_clock::now();
-        auto totalTime = duration_cast<milliseconds>(end - start).count();
+        auto scanned = fs.queryByScan(query);
+        vector<int> expected, actual, callerSorted;
+        for (const auto& file : scanned) expected.push_back(file->fileId);
+        for (const auto& file : top) actual.push_back(file->fileId);
+        for (const auto& file : sorted) callerSorted.push_back(file->fileId);
+        if (actual != expected || callerSorted != expected) {
+            cerr << "结果不一致: " << query.describe() << endl;
+            return 1;
+        }
+        QueryProfile profile;
+        fs.queryIndexed(query, &profile);
+        cout << query.describe() << endl;
+        cout << "  前 K 个 " << fixed << setprecision(3) << topMillis / rounds << " ms (读倒排 "
+             << profile[QueryStage::PostingFetch].idsOut << " 项, 查元数据 " << profile[QueryStage::MetadataGather].idsIn
+             << " 次), 全部取出后排序 " << sortMillis / rounds << " ms (" << matched << " 行)" << endl;
+    }
+    return 0;
+}
+
+// mai bench-estimate [文件数] [表达式数]：真实感命名空间（属组由属主决定，两者强相关）上
+// 1. 根目录和若干子目录的不同扩展名、属主、属组个数：HyperLogLog 估计与逐个统计对比；
+// 2. 随机的 AND/OR 表达式（叶子取自随机文件的属性，1~2 个条件）：行数估计与实际行数的
+//    q-error（max(估计/实际, 实际/估计)，两边各加 1），以及估计与用索引求出实际结果的耗时
+int runEstimateBenchmarkCommand(int argc, char* argv[]) {
+    long long numFiles = argc >= 3 ? stoll(argv[2]) : 1000000;
+    int numExprs = argc >= 4 ? stoi(argv[3]) : 200;
+    if (numFiles < 1 || numExprs < 1) {
+        cerr << "文件数和表达式数必须大于 0" << endl;
+        return 1;
+    }
+    
+    FileSystemSimulator fs;
+    NamespaceOptions data;
+    data.files = numFiles;
+    NamespaceGenerator generator(data);
+    vector<FileRecord> records;
+    while (generator.nextBatch(records, 100000)) {
+        for (auto& record : records) record.gid = 100 + (uint32_t)(HyperLogLog::hashOf(record.owner) % 300);
+        fs.bulkLoad(records);
+    }
+    auto files = fs.queryIndexed(FileQuery());
+    cout << "=== 基数估计 (" << files.size() << " 文件) ===" << endl;
+    
+    // 1. 不同取值个数：根目录加上按路径抽取的子目录
+    mt19937 gen(7);
+    vector<string> directories = {"/"};
+    for (int i = 0; i < 8; ++i) {
+        string path = files[gen() % files.size()]->fullPath;
+        for (int depth = 1 + (int)(gen() % 4); depth > 0 && path.size() > 1; --depth) {
+            path = path.substr(0, max<size_t>(1, path.rfind('/')));
+        }
+        directories.push_back(path);
+    }
+    double worst = 0;
+    for (const auto& directory : directories) {
+        string prefix = directory == "/" ? "/" : directory + "/";
+        unordered_set<string> extensions, owners;
+        unordered_set<uint32_t> groups;
+        for (const auto& file : files) {
+            if (file->fullPath.compare(0, prefix.size(), prefix) != 0) continue;
+            extensions.insert(file->extension);
+            owners.insert(file->owner);
+            groups.insert(file->gid);
+        }
+        size_t exact[kDistinctAttributeCount] = {extensions.size(), owners.size(), groups.size()};
+        cout << directory << endl << " ";
+        for (size_t i = 0; i < kDistinctAttributeCount; ++i) {
+            double estimate = fs.estimateDistinct((DistinctAttribute)i, directory);
+            worst = max(worst, fabs(estimate - (double)exact[i]) / max<size_t>(1, exact[i]));
+            cout << " " << kDistinctAttributeNames[i] << " " << llround(estimate) << "/" << exact[i];
+        }
+        cout << endl;
+    }
+    cout << "不同取值个数的最大相对误差 " << fixed << setprecision(2) << worst * 100 << "%" << endl;
+    
+    // 2. 表达式行数
+    auto randomLeaf = [&]() {
+        const auto& file = *files[gen() % files.size()];
+        FileQuery query;
+        for (int conditions = 1 + (int)(gen() % 2), added = 0; added < conditions;) {
+            switch (gen() % 5) {
+                case 0: if (!query.extension) query.extension = file.extension, added++; break;
+                case 1: if (!query.owner) query.owner = file.owner, added++; break;
+                case 2: if (!query.gid) query.gid = file.gid, added++; break;
+                case 3:
+                    if (!query.sizeRange) query.sizeRange = make_pair(file.fileSize / 4, file.fileSize * 4), added++;
+                    break;
+                default:
+                    if (!query.modifyTimeRange) {
+                        query.modifyTimeRange = make_pair(file.modifyTime - 30 * 86400, file.modifyTime + 30 * 86400);
+                        added++;
+                    }
+            }
+        }
+        return PredicateExpr::of(query);
+    };
+    // 按索引求出表达式的实际结果（fileId 升序），作为对照
+    function<vector<int>(const PredicateExpr&)> evaluate = [&](const PredicateExpr& expr) {
+        vector<int> result;
+        if (expr.kind == PredicateExpr::Kind::Leaf) {
+            for (const auto& file : fs.queryIndexed(expr.leaf)) result.push_back(file->fileId);
+            sort(result.begin(), result.end());
+            return result;
+        }
+        result = evaluate(expr.children[0]);
+        for (size_t i = 1; i < expr.children.size(); ++i) {
+            auto other = evaluate(expr.children[i]);
+            vector<int> merged;
+            if (expr.kind == PredicateExpr::Kind::And) {
+                set_intersection(result.begin(), result.end(), other.begin(), other.end(), back_inserter(merged));
+            } else {
+                set_union(result.begin(), result.end(), other.begin(), other.end(), back_inserter(merged));
+            }
+            result = move(merged);
+        }
+        return result;
+    };
+    
+    vector<double> errors[2];   // 实际行数 >= 1000 / < 1000
+    double estimateMillis = 0, exactMillis = 0;
+    size_t exactEstimates = 0;
+    for (int i = 0; i < numExprs; ++i) {
+        PredicateExpr expr;
+        switch (i % 4) {
+            case 0: expr = randomLeaf(); break;
+            case 1: expr = PredicateExpr::allOf({randomLeaf(), randomLeaf()}); break;
+            case 2: expr = PredicateExpr::anyOf({randomLeaf(), randomLeaf()}); break;
+            default: expr = PredicateExpr::allOf({PredicateExpr::anyOf({randomLeaf(), randomLeaf()}), randomLeaf()});
+        }
+        auto start = steady_clock::now();
+        auto estimate = fs.estimateRows(expr);
+        estimateMillis += duration<double, milli>(steady_clock::now() - start).count();
+        start = steady_clock::now();
+        size_t actual = evaluate(expr).size();
+        exactMillis += duration<double, milli>(steady_clock::now() - start).count();
         
-        cout << "并发查询测试 (" << numThreads << " 线程, 每线程 " << operationsPerThread << " 操作):" << endl;
-        cout << "  总耗时: " << totalTime << " ms" << endl;
-        cout << "  成功操作: " << successCount.load() << endl;
-        cout << "  QPS: " << (successCount.load() * 1000) / totalTime << endl;
+        size_t checked = 0;
+        for (const auto& file : files) checked += expr.matches(*file);
+        if (checked != actual) {
+            cerr << "对照结果不一致: " << expr.describe() << endl;
+            return 1;
+        }
+        exactEstimates += estimate.exact;
+        double error = max((estimate.rows + 1) / (actual + 1.0), (actual + 1.0) / (estimate.rows + 1));
+        errors[actual < 1000].push_back(error);
     }
-};
+    cout << "表达式 " << numExprs << " 个: 估计平均 " << setprecision(3) << estimateMillis / numExprs
+         << " ms, 用索引求实际结果平均 " << exactMillis / numExprs << " ms, 直接得出精确值 " << exactEstimates << " 个"
+         << endl;
+    const char* const labels[2] = {"实际 >= 1000 行", "实际 < 1000 行"};
+    for (int group = 0; group < 2; ++group) {
+        auto& values = errors[group];
+        if (values.empty()) continue;
+        sort(values.begin(), values.end());
+        cout << "  " << labels[group] << " (" << values.size() << " 个): q-error 中位数 " << setprecision(2)
+             << values[values.size() / 2] << ", p90 " << values[values.size() * 9 / 10] << ", 最大 " << values.back()
+             << endl;
+    }
+    auto memory = fs.getMemoryBreakdown();
+    cout << "样本 " << memory.sample.total() << " bytes, 目录树（含摘要与草图） " << memory.tree << " bytes" << endl;
+    return 0;
+}
+
+#ifdef __linux__
+// mai watch <目录> [秒数] [--metrics-file 文件]：先全量扫描，再用 inotify 跟踪变化并定期输出索引状态；
+// 给定指标文件时每秒以 Prometheus 文本格式刷新一次
+int runWatchCommand(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "用法: " << argv[0] << " watch <目录> [秒数] [--metrics-file 文件]" << endl;
+        return 1;
+    }
+    int durationSeconds = 60;
+    string metricsPath;
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--metrics-file") {
+            if (i + 1 >= argc) {
+                cerr << "参数缺少取值: " << arg << endl;
+                return 1;
+            }
+            metricsPath = argv[++i];
+        } else {
+            durationSeconds = stoi(arg);
+        }
+    }
+    
+    FileSystemSimulator fs;
+    FileSystemWatcher watcher(fs);
+    // 先订阅再扫描，扫描期间发生的变化会在之后的事件中补齐
+    watcher.watch(argv[2]);
+    DirectoryScanner scanner;
+    auto scanStats = scanner.scanInto(argv[2], fs);
+    watcher.start();
+    unique_ptr<MetricsFileExporter> exporter;
+    if (!metricsPath.empty()) {
+        exporter = make_unique<MetricsFileExporter>(fs, metricsPath, seconds(1));
+        exporter->start();
+    }
+    cout << "初始扫描: " << scanStats.files << " 个文件, 开始监听 " << durationSeconds << " 秒" << endl;
+    
+    for (int i = 0; i < durationSeconds; ++i) {
+        this_thread::sleep_for(seconds(1));
+        auto stats = watcher.getStats();
+        cout << "[" << i + 1 << "s] 文件: " << fs.getTotalFiles()
+             << ", 事件: " << stats.events << ", 批次: " << stats.batches
+             << ", 新增/更新/删除: " << stats.added << "/" << stats.updated << "/" << stats.removed
+             << ", 溢出: " << stats.overflows << ", 子树重扫: " << stats.subtreeRescans
+             << ", 监听目录: " << stats.watchedDirectories << endl;
+    }
+    watcher.stop();
+    return 0;
+}
+#endif
+
+// mai replay <轨迹> [--mode timed|fast] [--speed 倍数] [--threads N]：在空的模拟器上重放
+// mai workload --trace 录下的调用。timed 按录制时的间隔发出（--speed 2 表示两倍速），fast 尽快发出；
+// 多线程时同一文件上的操作保持录制顺序（见 TraceReplayer）
+int runReplayCommand(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "用法: mai replay <轨迹> [--mode timed|fast] [--speed 倍数] [--threads N]" << endl;
+        return 1;
+    }
+    string tracePath = argv[2];
+    ReplayOptions options;
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            cerr << "参数缺少取值: " << arg << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        if (arg == "--mode") {
+            if (value == "timed") {
+                options.mode = ReplayMode::Timed;
+            } else if (value == "fast") {
+                options.mode = ReplayMode::Fast;
+            } else {
+                cerr << "未知的重放模式: " << value << endl;
+                return 1;
+            }
+        } else if (arg == "--speed") {
+            options.speed = stod(value);
+            if (options.speed <= 0) {
+                cerr << "--speed 必须大于 0" << endl;
+                return 1;
+            }
+        } else if (arg == "--threads") {
+            options.threads = max(1, stoi(value));
+        } else {
+            cerr << "未知参数: " << arg << endl;
+            return 1;
+        }
+    }
+    
+    auto loadStart = steady_clock::now();
+    Trace trace = readTrace(tracePath);
+    double loadSeconds = duration<double>(steady_clock::now() - loadStart).count();
+    double spanSeconds = trace.entries.empty()
+                             ? 0
+                             : (trace.entries.back().timeNs - trace.entries.front().timeNs) / 1e9;
+    time_t wallStart = (time_t)(trace.wallStartNs / 1000000000);
+    struct tm tmv;
+    localtime_r(&wallStart, &tmv);
+    char started[32];
+    strftime(started, sizeof(started), "%Y-%m-%d %H:%M:%S", &tmv);
+    cout << "=== 重放 " << tracePath << " (" << trace.entries.size() << " 条调用, 录制于 " << started
+         << ", 跨度 " << fixed << setprecision(2) << spanSeconds << " s, 读取 " << setprecision(3) << loadSeconds
+         << " s" << (trace.truncated ? ", 尾部记录不完整已丢弃" : "") << ") ===" << endl;
+    
+    FileSystemSimulator fs;
+    TraceReplayer replayer(fs, options);
+    auto stats = replayer.run(trace);
+    
+    cout << "模式: " << (options.mode == ReplayMode::Timed ? "timed" : "fast");
+    if (options.mode == ReplayMode::Timed) cout << " x" << setprecision(2) << options.speed;
+    cout << ", " << options.threads << " 线程" << endl;
+    cout << "执行: " << stats.operations << " 次 (屏障 " << stats.barriers << "), " << setprecision(3)
+         << stats.seconds << " s, " << setprecision(0) << stats.operations / max(1e-9, stats.seconds) << " ops/s"
+         << endl;
+    if (options.mode == ReplayMode::Timed) {
+        cout << "落后计划: 平均 " << setprecision(1) << stats.meanLagUs << " us, 最大 " << stats.maxLagUs << " us"
+             << endl;
+    }
+    printOperationLatencies(cout, fs);
+    cout << "最终文件数: " << fs.getTotalFiles() << endl;
+    return 0;
+}
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
-        PerformanceTest::runTests();
+        string command = argc >= 2 ? argv[1] : "";
+        if (command == "scan") {
+            return runScanCommand(argc, argv);
+        }
+        if (command == "gen-tree") {
+            return runGenerateTreeCommand(argc, argv);
+        }
+        if (command == "bench-find") {
+            return runFindBenchmarkCommand(argc, argv);
+        }
+        if (command == "bench-scan") {
+            return runScanBenchmarkCommand(argc, argv);
+        }
+        if (command == "rescan") {
+            return runRescanCommand(argc, argv);
+        }
+        if (command == "load") {
+            return runLoadCommand(argc, argv);
+        }
+        if (command == "explain") {
+            return runExplainCommand(argc, argv);
+        }
+        if (command == "gen-namespace") {
+            return runGenerateNamespaceCommand(argc, argv);
+        }
+        if (command == "gen-dump") {
+            return runGenerateDumpCommand(argc, argv);
+        }
+        if (command == "bench-build") {
+            return runBuildBenchmarkCommand(argc, argv);
+        }
+        if (command == "bench-checkpoint") {
+            return runCheckpointBenchmarkCommand(argc, argv);
+        }
+        if (command == "bench-segment") {
+            return runSegmentBenchmarkCommand(argc, argv);
+        }
+        if (command == "bench-spill") {
+            return runSpillBenchmarkCommand(argc, argv);
+        }
+        if (command == "bench-tags") {
+            return runTagBenchmarkCommand(argc, argv);
+        }
+        if (command == "bench-acl") {
+            return runAclBenchmarkCommand(argc, argv);
+        }
+        if (command == "bench-topk") {
+            return runTopKBenchmarkCommand(argc, argv);
+        }
+        if (command == "bench-estimate") {
+            return runEstimateBenchmarkCommand(argc, argv);
+        }
+#ifdef __linux__
+        if (command == "watch") {
+            return runWatchCommand(argc, argv);
+        }
+#endif
+        if (command == "bench-scale") {
+            return runScaleBenchmarkCommand(argc, argv);
+        }
+        if (command == "workload") {
+            return runWorkloadCommand(argc, argv);
+        }
+        if (command == "replay") {
+            return runReplayCommand(argc, argv);
+        }
+        if (command == "bench" || command.empty()) {
+            return runBenchmarkCommand(argc, argv);
+        }
+        cerr << "未知命令: " << command << endl;
+        return 1;
     } catch (const exception& e) {
         cerr << "错误: " << e.what() << endl;
         return 1;